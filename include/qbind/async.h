@@ -0,0 +1,313 @@
+#pragma once
+
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+#include <boost/preprocessor/repetition/enum_params.hpp>
+
+#include <kx/kx.h>
+
+#include "function.h"
+#include "thread_pool.h"
+
+namespace qbind
+{
+
+/**
+ * @brief Runs work on the ThreadPool and hands results back to q's main
+ * thread.
+ *
+ * Completion is signalled through an eventfd (a pipe where there is no
+ * eventfd) registered with sd1, so q calls back in to the dispatcher from its
+ * own event loop. The callback given on submission is then invoked on the
+ * main thread with (1b;result) or (0b;"error").
+ *
+ * K objects may not cross threads, even to be read, as any copy touches
+ * their reference counts. Arguments are serialised with b9 on the main thread
+ * and deserialised on the worker, results go the other way. Anything b9 can't
+ * serialise, such as a function, can't be passed.
+ *
+ * The dispatcher must first be used from the main thread. It lives until
+ * the process exits.
+ */
+class AsyncDispatcher
+{
+public:
+
+    AsyncDispatcher(const AsyncDispatcher&) = delete;
+    AsyncDispatcher& operator=(const AsyncDispatcher&) = delete;
+
+    static AsyncDispatcher& instance()
+    {
+        static AsyncDispatcher dispatcher;
+        return dispatcher;
+    }
+
+    /**
+     * @brief Queue work on the pool. Must be called on the main thread.
+     *
+     * @param callback: q function taking the (success;result) pair.
+     * @param args: Arguments for the work, copied to the worker.
+     * @param work: Produces the result from the worker's copy of args.
+     *              Exceptions become errors.
+     * @return ::K Generic null to return to q straight away.
+     */
+    ::K submit(::K callback, const std::vector<::K>& args, std::function<::K(const std::vector<::K>&)> work)
+    {
+        if (!callback || callback->t < 100)
+            throw std::runtime_error("Callback must be a function. Found type: " + std::to_string(callback ? callback->t : 0));
+
+        auto job = std::make_shared<Job>();
+        for (auto arg : args)
+            job->args.push_back(serialise(arg));
+        job->callback = r1(callback);
+
+        ThreadPool::instance().submit([this, job, work = std::move(work)]
+        {
+            std::vector<::K> args;
+            try
+            {
+                for (const auto& bytes : job->args)
+                    args.push_back(deserialise(bytes));
+                ::K res = work(args);
+                try
+                {
+                    job->result = serialise(res);
+                }
+                catch (...)
+                {
+                    r0(res);
+                    throw;
+                }
+                r0(res);
+                job->ok = true;
+            }
+            catch (const std::exception& e)
+            {
+                job->error = e.what();
+                std::cerr << job->error << std::endl;
+            }
+            catch (...)
+            {
+                job->error = "Unknown exception";
+                std::cerr << job->error << std::endl;
+            }
+            for (auto arg : args)
+                r0(arg);
+            complete(job);
+        });
+        return knk(0);
+    }
+
+private:
+
+    struct Job
+    {
+        ::K callback = nullptr;
+        std::vector<std::vector<uint8_t>> args;
+        std::vector<uint8_t> result;
+        std::string error;
+        bool ok = false;
+    };
+
+    AsyncDispatcher()
+    {
+#ifdef __linux__
+        m_read = m_write = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_read == -1)
+            throw std::runtime_error(std::string("eventfd: ") + strerror(errno));
+#else
+        int fds[2];
+        if (pipe(fds) == -1)
+            throw std::runtime_error(std::string("pipe: ") + strerror(errno));
+        m_read = fds[0];
+        m_write = fds[1];
+        for (auto fd : fds)
+        {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+#endif
+        sd1(m_read, &AsyncDispatcher::on_ready);
+    }
+
+    static std::vector<uint8_t> serialise(::K x)
+    {
+        ::K bytes = b9(3, x);
+        if (!bytes || bytes->t == -128)
+        {
+            const std::string error = bytes && bytes->s ? bytes->s : "Failed to serialise";
+            if (bytes)
+                r0(bytes);
+            throw std::runtime_error(error);
+        }
+        std::vector<uint8_t> res(bytes->G0, bytes->G0 + bytes->n);
+        r0(bytes);
+        return res;
+    }
+
+    static ::K deserialise(const std::vector<uint8_t>& data)
+    {
+        ::K bytes = ktn(KG, static_cast<int64_t>(data.size()));
+        memcpy(bytes->G0, data.data(), data.size());
+        ::K res = ee(d9(bytes));
+        r0(bytes);
+        if (!res || res->t == -128)
+        {
+            const std::string error = res && res->s ? res->s : "Failed to deserialise";
+            if (res)
+                r0(res);
+            throw std::runtime_error(error);
+        }
+        return res;
+    }
+
+    // Called on a worker.
+    void complete(std::shared_ptr<Job> job)
+    {
+        {
+            std::lock_guard<std::mutex> lk(m_mutex);
+            m_done.push_back(std::move(job));
+        }
+#ifdef __linux__
+        const uint64_t one = 1;
+        [[maybe_unused]] auto n = write(m_write, &one, sizeof(one));
+#else
+        const char one = 1;
+        [[maybe_unused]] auto n = write(m_write, &one, sizeof(one));
+#endif
+    }
+
+    // Called on the main thread by q when the fd is readable.
+    static ::K on_ready(I fd)
+    {
+        auto& self = instance();
+
+        // Drain the signal. A full pipe only means there is already a signal pending.
+        char buf[64];
+        while (read(fd, buf, sizeof(buf)) > 0)
+        { }
+
+        std::vector<std::shared_ptr<Job>> done;
+        {
+            std::lock_guard<std::mutex> lk(self.m_mutex);
+            done.swap(self.m_done);
+        }
+
+        for (auto& job : done)
+            self.finish(*job);
+        return nullptr;
+    }
+
+    void finish(Job& job)
+    {
+        ::K res = nullptr;
+        if (job.ok)
+        {
+            try
+            {
+                res = deserialise(job.result);
+            }
+            catch (const std::exception& e)
+            {
+                job.ok = false;
+                job.error = e.what();
+            }
+        }
+        if (!job.ok)
+            res = kp(const_cast<char *>(job.error.c_str()));
+
+        ::K arg = knk(1, knk(2, kb(job.ok), res));
+        ::K ret = ee(dot(job.callback, arg));
+        if (ret && ret->t == -128)
+            std::cerr << "Async callback failed: " << (ret->s ? ret->s : "") << std::endl;
+        if (ret)
+            r0(ret);
+        r0(arg);
+
+        r0(job.callback);
+    }
+
+    int m_read = -1;
+    int m_write = -1;
+    std::mutex m_mutex;
+    std::vector<std::shared_ptr<Job>> m_done;
+};
+
+}
+
+/**
+ * @brief Async parameters. The callback comes first, then the function's.
+ */
+#define QBIND_ASYNC_PARAMETER_FOLD(z, n, str) QBIND_ID(QBIND_COMMA)() QBIND_PARAMETER(n)
+#define QBIND_ASYNC_PARAMETERS(n) (K karr_cb BOOST_PP_REPEAT(n, QBIND_ASYNC_PARAMETER_FOLD,))
+
+/**
+ * @brief Pointers to the arguments to copy to the worker.
+ */
+#define QBIND_ASYNC_ARGS(n) std::vector<K>{BOOST_PP_ENUM_PARAMS(n, karr)}
+
+/**
+ * @brief Name the worker's copies of the arguments as the parameters were named.
+ */
+#define QBIND_ASYNC_UNPACK_FOLD(z, n, str) K QBIND_JOIN(karr, n) = args[n];
+#define QBIND_ASYNC_UNPACK(n) BOOST_PP_REPEAT(n, QBIND_ASYNC_UNPACK_FOLD,)
+
+/**
+ * @brief Export a function to Q which runs on the qbind thread pool.
+ *
+ * The exported function takes a callback followed by the function's
+ * arguments, and returns the generic null straight away. When the function
+ * completes the callback is called on the main thread with (1b;result), or
+ * (0b;"error") if it threw. Functions which don't return give (1b;()).
+ * Arguments are copied to the worker with b9, so must be serialisable.
+ *
+ * q must be listening for events (e.g. not blocked in a long query) for the
+ * callback to run.
+ *
+ * @param fn: Function to export
+ * @param name: Name to export function as (must be unique as its extern C)
+ * @param nargs: Number of arguments of function
+ * @param returns: 0 if doesn't return
+ */
+#define QBIND_FN_EXPORT_ASYNC(fn, name, nargs, returns)                      \
+    extern "C"                                                               \
+    {                                                                        \
+        K name QBIND_ASYNC_PARAMETERS(nargs)                                 \
+        {                                                                    \
+            qbind::helpers::NonConstLvalueRefArgChecker<decltype(fn)>();     \
+            try                                                              \
+            {                                                                \
+                return qbind::AsyncDispatcher::instance().submit(            \
+                    karr_cb,                                                 \
+                    QBIND_ASYNC_ARGS(nargs),                                 \
+                    []([[maybe_unused]] const std::vector<K>& args) -> K     \
+                    {                                                        \
+                        QBIND_ASYNC_UNPACK(nargs)                            \
+                        QBIND_CALL_SIGNATURE(returns, fn, nargs)             \
+                        return knk(0);                                       \
+                    });                                                      \
+            }                                                                \
+            catch (const std::exception& e)                                  \
+            {                                                                \
+                thread_local std::string errmsg;                             \
+                errmsg = e.what();                                           \
+                std::cerr << errmsg << std::endl;                            \
+                return krr(errmsg.data());                                   \
+            }                                                                \
+        }                                                                    \
+    }
@@ -4,6 +4,7 @@
 
 #include "k.h"
 #include "type.h"
+#include "utils.h"
 
 namespace qbind
 {
@@ -37,6 +38,11 @@ public:
         m_ptr.is_with_info<Atom<T>>();
     }
 
+    // Initialise from a K object already known to be an atom of type T
+    Atom(K data, internal::unchecked_t) noexcept
+    :m_ptr(std::move(data))
+    { }
+
     // Initialise from value
     Atom(value v)
     {
@@ -98,7 +104,7 @@ public:
 
 private:
 
-    static constexpr typename internal::c_type<T>::to_underlier to_underlier;
+    static constexpr typename internal::c_type<T>::to_underlier to_underlier{};
 
     K m_ptr;
 };
@@ -0,0 +1,350 @@
+#pragma once
+
+#include <chrono>
+#include <limits>
+#include <stdint.h>
+#include <vector>
+
+#include <kx/kx.h>
+
+#include "k.h"
+#include "type.h"
+#include "vector.h"
+
+namespace qbind
+{
+
+/**
+ * Temporal types and std::chrono.
+ *
+ * kdb temporal types are counts from 2000.01.01, std::chrono counts from
+ * 1970.01.01. Nulls and infinities are sentinel values at the extremes of the
+ * underlying integer and are passed through unchanged in both directions, so
+ * a null timestamp becomes a time point with count INT64_MIN and back again.
+ * The exception is Month, see to_year_month.
+ *
+ * The bulk kernels work on raw pointers and are branch free so the compiler
+ * can vectorise them. They can be used in place (in == out).
+ */
+
+namespace internal
+{
+
+// 2000.01.01 - 1970.01.01
+constexpr int64_t epoch_seconds = 946684800;
+constexpr int32_t epoch_days = 10957;
+constexpr int64_t epoch_ns = epoch_seconds * 1000000000LL;
+constexpr int64_t ns_per_day = 86400LL * 1000000000LL;
+
+constexpr int64_t null_j = std::numeric_limits<int64_t>::min();
+constexpr int64_t inf_j = std::numeric_limits<int64_t>::max();
+constexpr int32_t null_i = std::numeric_limits<int32_t>::min();
+constexpr int32_t inf_i = std::numeric_limits<int32_t>::max();
+
+// null, infinity or negative infinity
+constexpr bool is_special(int64_t v) noexcept
+{
+    return (v == null_j) | (v == inf_j) | (v == -inf_j);
+}
+
+constexpr bool is_special(int32_t v) noexcept
+{
+    return (v == null_i) | (v == inf_i) | (v == -inf_i);
+}
+
+// Shift by offset unless special. Wraps rather than overflows on out of range input.
+template<typename T>
+constexpr T shift(T v, T offset) noexcept
+{
+    using U = std::make_unsigned_t<T>;
+    const T shifted = static_cast<T>(static_cast<U>(v) + static_cast<U>(offset));
+    return is_special(v) ? v : shifted;
+}
+
+constexpr int32_t floor_div(int32_t a, int32_t b) noexcept
+{
+    const int32_t q = a / b;
+    return q - ((a % b != 0) & ((a < 0) != (b < 0)));
+}
+
+}
+
+// Scalar conversions
+
+inline std::chrono::sys_time<std::chrono::nanoseconds> to_sys_time(int64_t timestamp) noexcept
+{
+    return std::chrono::sys_time<std::chrono::nanoseconds>{std::chrono::nanoseconds{internal::shift(timestamp, internal::epoch_ns)}};
+}
+
+inline int64_t to_timestamp(std::chrono::sys_time<std::chrono::nanoseconds> tp) noexcept
+{
+    return internal::shift(static_cast<int64_t>(tp.time_since_epoch().count()), -internal::epoch_ns);
+}
+
+inline std::chrono::sys_days to_sys_days(int32_t date) noexcept
+{
+    return std::chrono::sys_days{std::chrono::days{internal::shift(date, internal::epoch_days)}};
+}
+
+inline int32_t to_date(std::chrono::sys_days days) noexcept
+{
+    return internal::shift(static_cast<int32_t>(days.time_since_epoch().count()), -internal::epoch_days);
+}
+
+/**
+ * @brief Months since 2000.01 to a year_month. year_month can't hold the
+ * sentinels so nulls and infinities become a year_month which is not ok().
+ */
+inline std::chrono::year_month to_year_month(int32_t month) noexcept
+{
+    if (internal::is_special(month))
+        return std::chrono::year_month{std::chrono::year{-32768}, std::chrono::month{0}};
+    const int32_t total = month + 2000 * 12;
+    const int32_t y = internal::floor_div(total, 12);
+    return std::chrono::year_month{std::chrono::year{y}, std::chrono::month{static_cast<unsigned>(total - y * 12 + 1)}};
+}
+
+// Not ok() year_months become null.
+inline int32_t to_month(std::chrono::year_month ym) noexcept
+{
+    if (!ym.ok())
+        return internal::null_i;
+    return (static_cast<int32_t>(ym.year()) - 2000) * 12 + static_cast<int32_t>(static_cast<unsigned>(ym.month())) - 1;
+}
+
+/**
+ * @brief Datetime (fractional days since 2000.01.01) to timestamp. Nulls and
+ * values beyond the range of a timestamp become null and infinite
+ * timestamps. Rounds to the nearest nanosecond.
+ */
+inline int64_t datetime_to_timestamp(double datetime) noexcept
+{
+    // ~106751 days either way fits in int64 nanoseconds
+    constexpr double limit = static_cast<double>(internal::inf_j / internal::ns_per_day);
+    const bool in_range = datetime > -limit && datetime < limit;
+    const double ns = (in_range ? datetime : 0.0) * static_cast<double>(internal::ns_per_day);
+    const int64_t rounded = static_cast<int64_t>(ns + (ns < 0 ? -0.5 : 0.5));
+    const int64_t special = datetime != datetime ? internal::null_j : datetime > 0 ? internal::inf_j : -internal::inf_j;
+    return in_range ? rounded : special;
+}
+
+// Bulk kernels
+
+inline void timestamp_to_unix_ns(const int64_t *in, int64_t *out, size_t n) noexcept
+{
+    for (size_t i = 0; i < n; ++i)
+        out[i] = internal::shift(in[i], internal::epoch_ns);
+}
+
+inline void unix_ns_to_timestamp(const int64_t *in, int64_t *out, size_t n) noexcept
+{
+    for (size_t i = 0; i < n; ++i)
+        out[i] = internal::shift(in[i], -internal::epoch_ns);
+}
+
+// Dates to days since 1970.01.01, the count behind std::chrono::sys_days.
+inline void date_to_unix_days(const int32_t *in, int32_t *out, size_t n) noexcept
+{
+    for (size_t i = 0; i < n; ++i)
+        out[i] = internal::shift(in[i], internal::epoch_days);
+}
+
+inline void unix_days_to_date(const int32_t *in, int32_t *out, size_t n) noexcept
+{
+    for (size_t i = 0; i < n; ++i)
+        out[i] = internal::shift(in[i], -internal::epoch_days);
+}
+
+inline void datetime_to_timestamp(const double *in, int64_t *out, size_t n) noexcept
+{
+    for (size_t i = 0; i < n; ++i)
+        out[i] = datetime_to_timestamp(in[i]);
+}
+
+inline void month_to_year_month(const int32_t *in, std::chrono::year_month *out, size_t n) noexcept
+{
+    for (size_t i = 0; i < n; ++i)
+        out[i] = to_year_month(in[i]);
+}
+
+inline void year_month_to_month(const std::chrono::year_month *in, int32_t *out, size_t n) noexcept
+{
+    for (size_t i = 0; i < n; ++i)
+        out[i] = to_month(in[i]);
+}
+
+// Vector level conversions
+
+inline std::vector<int64_t> to_unix_ns(const Vector<Type::Timestamp>& timestamps)
+{
+    std::vector<int64_t> res(timestamps.size());
+    timestamp_to_unix_ns(timestamps.get().data<int64_t>(), res.data(), res.size());
+    return res;
+}
+
+inline Vector<Type::Timestamp> from_unix_ns(const int64_t *ns, size_t n)
+{
+    K res{ktn(KP, static_cast<int64_t>(n))};
+    unix_ns_to_timestamp(ns, res.data<int64_t>(), n);
+    return Vector<Type::Timestamp>(std::move(res));
+}
+
+inline std::vector<int32_t> to_unix_days(const Vector<Type::Date>& dates)
+{
+    std::vector<int32_t> res(dates.size());
+    date_to_unix_days(dates.get().data<int32_t>(), res.data(), res.size());
+    return res;
+}
+
+inline Vector<Type::Date> from_unix_days(const int32_t *days, size_t n)
+{
+    K res{ktn(KD, static_cast<int64_t>(n))};
+    unix_days_to_date(days, res.data<int32_t>(), n);
+    return Vector<Type::Date>(std::move(res));
+}
+
+inline std::vector<std::chrono::year_month> to_year_months(const Vector<Type::Month>& months)
+{
+    std::vector<std::chrono::year_month> res(months.size());
+    month_to_year_month(months.get().data<int32_t>(), res.data(), res.size());
+    return res;
+}
+
+inline Vector<Type::Month> from_year_months(const std::chrono::year_month *yms, size_t n)
+{
+    K res{ktn(KM, static_cast<int64_t>(n))};
+    year_month_to_month(yms, res.data<int32_t>(), n);
+    return Vector<Type::Month>(std::move(res));
+}
+
+inline Vector<Type::Timestamp> datetime_to_timestamp(const Vector<Type::Datetime>& datetimes)
+{
+    K res{ktn(KP, static_cast<int64_t>(datetimes.size()))};
+    datetime_to_timestamp(datetimes.get().data<double>(), res.data<int64_t>(), datetimes.size());
+    return Vector<Type::Timestamp>(std::move(res));
+}
+
+namespace internal
+{
+
+template<Type T> struct chrono_type;
+
+template<> struct chrono_type<Type::Timestamp>
+{
+    using type = std::chrono::sys_time<std::chrono::nanoseconds>;
+    static type convert(int64_t v) noexcept { return to_sys_time(v); }
+};
+
+template<> struct chrono_type<Type::Date>
+{
+    using type = std::chrono::sys_days;
+    static type convert(int32_t v) noexcept { return to_sys_days(v); }
+};
+
+template<> struct chrono_type<Type::Month>
+{
+    using type = std::chrono::year_month;
+    static type convert(int32_t v) noexcept { return to_year_month(v); }
+};
+
+template<> struct chrono_type<Type::Datetime>
+{
+    using type = std::chrono::sys_time<std::chrono::nanoseconds>;
+    static type convert(double v) noexcept { return to_sys_time(datetime_to_timestamp(v)); }
+};
+
+// Durations have no epoch so are a change of type only.
+
+template<> struct chrono_type<Type::Timespan>
+{
+    using type = std::chrono::nanoseconds;
+    static type convert(int64_t v) noexcept { return type{v}; }
+};
+
+template<> struct chrono_type<Type::Minute>
+{
+    using type = std::chrono::minutes;
+    static type convert(int32_t v) noexcept { return type{v}; }
+};
+
+template<> struct chrono_type<Type::Second>
+{
+    using type = std::chrono::seconds;
+    static type convert(int32_t v) noexcept { return type{v}; }
+};
+
+template<> struct chrono_type<Type::Time>
+{
+    using type = std::chrono::milliseconds;
+    static type convert(int32_t v) noexcept { return type{v}; }
+};
+
+}
+
+/**
+ * @brief Zero copy view of a temporal vector as std::chrono values. Elements
+ * are converted on access.
+ *
+ * @tparam T Temporal type.
+ */
+template<Type T>
+class ChronoView
+{
+public:
+
+    static constexpr Type type = T;
+
+    using underlier  = typename internal::c_type<T>::underlier;
+    using value_type = typename internal::chrono_type<T>::type;
+
+    ChronoView(const Vector<T>& data)
+    :m_ptr(data.get())
+    {
+    }
+
+    value_type operator[](size_t pos) const noexcept
+    {
+        return internal::chrono_type<T>::convert(data()[pos]);
+    }
+
+    value_type at(size_t pos) const
+    {
+        if (pos >= size())
+            throw std::out_of_range("Attempted to access index " + std::to_string(pos) + " but length is " + std::to_string(size()));
+        return (*this)[pos];
+    }
+
+    // True for nulls and infinities.
+    bool is_special(size_t pos) const noexcept
+    {
+        if constexpr (std::is_floating_point_v<underlier>)
+            return !(data()[pos] - data()[pos] == 0);
+        else
+            return internal::is_special(data()[pos]);
+    }
+
+    const underlier *data() const noexcept
+    {
+        return m_ptr.data<underlier>();
+    }
+
+    bool empty() const noexcept
+    {
+        return size() == 0;
+    }
+
+    size_t size() const noexcept
+    {
+        return m_ptr.size();
+    }
+
+    K get() const
+    {
+        return m_ptr;
+    }
+
+private:
+    K m_ptr;
+};
+
+}
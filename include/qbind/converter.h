@@ -1,44 +1,209 @@
 #pragma once
 
+#include <span>
+#include <sstream>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
 #include "forward.h"
 #include "k.h"
+#include "type.h"
 #include "utils.h"
 
 namespace qbind
 {
 
+namespace internal
+{
+
+template<typename T>
+struct is_span : std::false_type {};
+
+template<typename T, size_t N>
+struct is_span<std::span<T, N>> : std::true_type {};
+
+template<typename T>
+constexpr bool is_span_v = is_span<T>::value;
+
+template<typename T>
+struct is_std_vector : std::false_type {};
+
+template<typename T, typename A>
+struct is_std_vector<std::vector<T, A>> : std::true_type {};
+
+template<typename T>
+constexpr bool is_std_vector_v = is_std_vector<T>::value;
+
+[[noreturn]] inline void throw_type_mismatch(Type expected, ::K arr)
+{
+    std::ostringstream ss;
+    ss << "Types did not match. Expected " << expected << " vector or atom but found type " << static_cast<int>(arr->t);
+    throw std::runtime_error(ss.str());
+}
+
+[[noreturn]] inline void throw_structure_mismatch(Structure s, Type t, ::K arr)
+{
+    std::ostringstream ss;
+    ss << "Types did not match. Expected " << s << " " << t << " but found type " << static_cast<int>(arr->t);
+    throw std::runtime_error(ss.str());
+}
+
+/**
+ * @brief Pointer to the data of a vector of type t, or of an atom of type -t
+ * as a singleton. Atom values sit where a vector's length does.
+ */
+inline void *vector_or_atom_data(::K arr, signed char t, size_t& n)
+{
+    if (arr->t == t)
+    {
+        n = static_cast<size_t>(arr->n);
+        return arr->G0;
+    }
+    if (arr->t == -t)
+    {
+        n = 1;
+        return &arr->g;
+    }
+    throw_type_mismatch(static_cast<Type>(t), arr);
+}
+
+}
+
 class Converter
 {
 public:
-    // Enforce only qbind types are being accepted in to methods.
+    /**
+     * Enforce only qbind types are being accepted in to methods, plus views
+     * which bind directly on to kdb memory:
+     *  - std::span<const T> for T with a q_type, over a vector or atom.
+     *  - std::string_view over a char vector, char atom or symbol atom.
+     *
+     * EnumVector arguments bind the codes of any enumeration, without their
+     * domain, see EnumVector::set_domain.
+     *
+     * Arguments are borrowed rather than reference counted as kdb holds them
+     * for the duration of the call. Checks are specialised on the target type
+     * at compile time: a type byte compare for atoms and vectors, a length
+     * compare for tuples whose elements are checked when accessed.
+     *
+     * Views are only valid for the duration of the call.
+     */
     template<class T>
-    static T to_cpp(::K arr)
+    static std::remove_cv_t<std::remove_reference_t<T>> to_cpp(::K arr)
     {
-        static_assert(  internal::is_instance_type_v<T, Atom> ||
-                        internal::is_instance_type_v<T, Vector> ||
-                        internal::is_instance_class_v<T, Tuple>,
-                        "T must be a qbind wrapper type: Atom, Vector, Tuple, Map, Table, KeyedTable");
-        // Must be non-owning as kdb decrements arguments ref count on completion anyway.
-        // This avoid a double-free by incrementing the ref-count when making as a non-owning K.
-        return {K::make_non_owning(arr)};
+        using U = std::remove_cv_t<std::remove_reference_t<T>>;
+        if (!arr)
+            throw std::runtime_error("K is empty");
+
+        if constexpr (internal::is_span_v<U>)
+        {
+            using element = typename U::element_type;
+            static_assert(std::is_const_v<element>, "Spans over kdb arguments must be const: std::span<const T>");
+            static_assert(U::extent == std::dynamic_extent, "Spans over kdb arguments must have dynamic extent");
+            static_assert(internal::has_q_type_v<std::remove_cv_t<element>>, "No q type for span element type");
+
+            size_t n = 0;
+            auto *data = internal::vector_or_atom_data(arr, static_cast<signed char>(internal::q_type<std::remove_cv_t<element>>::value), n);
+            return U{static_cast<element *>(data), n};
+        }
+        else if constexpr (std::is_same_v<U, std::string_view>)
+        {
+            if (arr->t == -KS)
+                return {arr->s};
+            size_t n = 0;
+            auto *data = internal::vector_or_atom_data(arr, KC, n);
+            return {static_cast<const char *>(data), n};
+        }
+        else if constexpr (internal::is_instance_type_v<U, Atom>)
+        {
+            if (arr->t != -static_cast<signed char>(U::type))
+                internal::throw_structure_mismatch(U::structure, U::type, arr);
+            return U{K::make_borrowed(arr), internal::unchecked};
+        }
+        else if constexpr (internal::is_instance_type_v<U, Vector>)
+        {
+            if (arr->t != static_cast<signed char>(U::type))
+                internal::throw_structure_mismatch(U::structure, U::type, arr);
+            return U{K::make_borrowed(arr), internal::unchecked};
+        }
+        else if constexpr (std::is_same_v<U, EnumVector>)
+        {
+            if (arr->t < 20 || 76 < arr->t)
+                internal::throw_structure_mismatch(U::structure, Type::Symbol, arr);
+            return U{K::make_borrowed(arr), internal::unchecked};
+        }
+        else if constexpr (internal::is_instance_class_v<U, Tuple>)
+        {
+            constexpr auto n = std::tuple_size<U>::value;
+            if (arr->t != 0 || arr->n != static_cast<decltype(arr->n)>(n))
+            {
+                std::ostringstream ss;
+                ss << "Types did not match. Expected Tuple of length " << n << " but found type " << static_cast<int>(arr->t);
+                if (arr->t == 0)
+                    ss << " of length " << arr->n;
+                throw std::runtime_error(ss.str());
+            }
+            return U{K::make_borrowed(arr), internal::unchecked};
+        }
+        else
+        {
+            static_assert(  internal::is_instance_type_v<U, Atom> ||
+                            internal::is_instance_type_v<U, Vector> ||
+                            std::is_same_v<U, EnumVector> ||
+                            internal::is_instance_class_v<U, Tuple>,
+                            "T must be a qbind wrapper type: Atom, Vector, EnumVector, Tuple, Map, Table, KeyedTable");
+        }
     }
 
-    // Enforce only qbind types are being returned from methods (if anything returned).
+    /**
+     * Enforce only qbind types are being returned from methods (if anything
+     * returned), plus std containers which are copied in to a new vector:
+     *  - std::vector<T> and std::span<const T> for T with a q_type.
+     *  - std::string and std::string_view as a char vector.
+     */
     template<class T>
     static ::K to_q(T value)
     {
-        static_assert(  internal::is_instance_type_v<T, Atom> ||
-                        internal::is_instance_type_v<T, Vector> ||
-                        internal::is_instance_class_v<T, Tuple>,
-                        "T must be a qbind wrapper type: Atom, Vector, Tuple, Map, Table, KeyedTable");
-        
-        // If the k object is one of the arguments passed in it must be r1'ed before return.
-        // However, we r1 all arguments in to_cpp. The non-returned arguments will be r0'ed
-        // by their K destructor. Release means the K will be left with a nullptr meaning when
-        // it is destructed it doesn't call r0, meaning the original r1 of the argument is
-        // preserved.
-        return value.get().release();
+        if constexpr (internal::is_std_vector_v<T> || internal::is_span_v<T>)
+        {
+            using element = std::remove_cv_t<typename T::value_type>;
+            static_assert(internal::has_q_type_v<element>, "No q type for vector element type");
+
+            ::K res = ktn(static_cast<signed char>(internal::q_type<element>::value), static_cast<int64_t>(value.size()));
+            // std::vector<bool> is packed so can't be copied in one go
+            if constexpr (std::is_same_v<T, std::vector<bool>>)
+            {
+                for (size_t i = 0; i < value.size(); ++i)
+                    res->G0[i] = value[i];
+            }
+            else if (!value.empty())
+            {
+                memcpy(res->G0, value.data(), value.size() * sizeof(element));
+            }
+            return res;
+        }
+        else if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>)
+        {
+            return kpn(const_cast<char *>(value.data()), static_cast<int64_t>(value.size()));
+        }
+        else
+        {
+            static_assert(  internal::is_instance_type_v<T, Atom> ||
+                            internal::is_instance_type_v<T, Vector> ||
+                            std::is_same_v<T, EnumVector> ||
+                            internal::is_instance_class_v<T, Tuple>,
+                            "T must be a qbind wrapper type: Atom, Vector, EnumVector, Tuple, Map, Table, KeyedTable");
+
+            // If the k object is one of the arguments passed in it must be r1'ed before return.
+            // Arguments are borrowed in to_cpp, and releasing a borrowed K takes the reference
+            // then. Anything else is owned so release hands over its reference.
+            return value.get().release();
+        }
     }
 };
 
-}
\ No newline at end of file
+}
@@ -46,62 +46,75 @@ public:
  * 
  * TODO: Need == on nested vector
  */
-template <typename U>
+template <typename U, typename TT = T>
 typename std::enable_if_t<
-    is_instance_type_v<T, Vector> || is_instance_type_v<T, NestedVector>, 
+    is_instance_type_v<TT, Vector> || is_instance_type_v<TT, NestedVector>, 
     size_t>
 static find(const T& keys, U value)
 {
     // impl for vector
     if constexpr (is_instance_type_v<T, Vector>)
     {
-        static_assert(std::is_same_v<U, T::value>, "Cannot search flat vector for type it doesn't contain");
-        return std::find(keys.begin(), keys.end(), value) - keys.begin();
+        static_assert(std::is_same_v<U, typename T::value>, "Cannot search flat vector for type it doesn't contain");
+        // Intern the probe once and scan for its pointer.
+        if constexpr (T::type == Type::Symbol)
+            return keys.find(value);
+        else
+            return std::find(keys.begin(), keys.end(), value) - keys.begin();
     }
-    // impl for nested vector
-    for (size_t idx = 0; idx < keys.size(); ++ idx)
+    else
     {
-        auto &idx_v = keys[{idx}];
-        if (std::holds_alternative<U>(idx_v) && idx_v == value)
-            return idx;
+        // impl for nested vector
+        for (size_t idx = 0; idx < keys.size(); ++ idx)
+        {
+            auto &idx_v = keys[{idx}];
+            if (std::holds_alternative<U>(idx_v) && idx_v == value)
+                return idx;
+        }
+        return keys.size();
     }
-    return keys.size();
 }
 
-template <typename U>
+template <typename U, typename TT = T>
 typename std::enable_if_t<
-    is_instance_type_v<T, Vector> || is_instance_type_v<T, NestedVector>, 
+    is_instance_type_v<TT, Vector> || is_instance_type_v<TT, NestedVector>, 
     size_t>
 static count(const T& keys, U value)
 {
     // impl for vector
     if constexpr (is_instance_type_v<T, Vector>)
     {
-        static_assert(std::is_same_v<U, T::value>, "Cannot search flat vector for type it doesn't contain");
-        return std::count(keys.begin(), keys.end(), value);
+        static_assert(std::is_same_v<U, typename T::value>, "Cannot search flat vector for type it doesn't contain");
+        if constexpr (T::type == Type::Symbol)
+            return keys.count(value);
+        else
+            return std::count(keys.begin(), keys.end(), value);
     }
-    size_t count = 0;
-    // impl for nested vector
-    for (size_t idx = 0; idx < keys.size(); ++ idx)
+    else
     {
-        auto &idx_v = keys[{idx}];
-        if (std::holds_alternative<U>(idx_v) && idx_v == value)
-            ++count;
+        size_t count = 0;
+        // impl for nested vector
+        for (size_t idx = 0; idx < keys.size(); ++ idx)
+        {
+            auto &idx_v = keys[{idx}];
+            if (std::holds_alternative<U>(idx_v) && idx_v == value)
+                ++count;
+        }
+        return count;
     }
-    return count;
 }
 
 // Tuple
 
-template<typename U>
-typename std::enable_if_t<is_instance_class_v<T, Tuple>, size_t>
+template<typename U, typename TT = T>
+typename std::enable_if_t<is_instance_class_v<TT, Tuple>, size_t>
 static find(const T& keys, U value)
 {
     return T::template find_impl(keys, value);
 }
 
-template<typename U>
-typename std::enable_if_t<is_instance_class_v<T, Tuple>, size_t>
+template<typename U, typename TT = T>
+typename std::enable_if_t<is_instance_class_v<TT, Tuple>, size_t>
 static count(const T& keys, U value)
 {
     return T::template count_impl(keys, value);
@@ -228,7 +241,7 @@ public:
         if (!m_ptr)
             throw std::runtime_error("K is empty");
         m_ptr.is_with_info<Dictionary<TKey, TValue>>();
-        m_length = static_cast<::K *>(m_ptr.data())[0]->n;
+        m_length = m_ptr.data<::K>()[0]->n;
     }
 
     Dictionary(TKey ks, TValue vs)
@@ -242,12 +255,12 @@ public:
 
     TKey keys() const
     {
-        return {K::make_non_owning(static_cast<::K *>(m_ptr.data())[0])};
+        return TKey(K::make_non_owning(m_ptr.data<::K>()[0]));
     }
 
     TValue values() const
     {
-        return {K::make_non_owning(static_cast<::K *>(m_ptr.data())[1])};
+        return TValue(K::make_non_owning(m_ptr.data<::K>()[1]));
     }
 
     // TODO: Implement for all
@@ -0,0 +1,401 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <optional>
+#include <string.h>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <kx/kx.h>
+
+#include "k.h"
+#include "symbol.h"
+#include "type.h"
+#include "vector.h"
+
+namespace qbind
+{
+
+/**
+ * @brief A vector of symbols enumerated against a domain (types 20 to 76).
+ *
+ * On-disk and many in-memory tables store symbols as indices in to a domain
+ * symbol vector, usually `sym`. Comparison, grouping and joining work on the
+ * indices. Symbols are only resolved when asked for.
+ *
+ * The domain of an enumeration can't be recovered through the C API, so it is
+ * provided by the caller alongside the data. It must be the vector the data
+ * was enumerated against. Arguments from q carry only their codes: within a
+ * process each enumeration type has one domain, so codes of the same type are
+ * compared, grouped and joined directly, and set_domain is only needed to
+ * resolve symbols.
+ *
+ * Since kdb+ 3.0 enumerations use 64 bit indices, so the codes are exposed at
+ * that width.
+ */
+class EnumVector
+{
+public:
+
+    static constexpr Structure structure = Structure::Enum;
+
+#if KXVER>=3
+    using index = int64_t;
+#else
+    using index = int32_t;
+#endif
+
+    // Enumerated null symbols have the null index.
+    static constexpr index null_index = std::numeric_limits<index>::min();
+
+    // Initialise from an enumerated K object, without its domain
+    EnumVector(K data)
+    :m_ptr(std::move(data))
+    {
+        if (!m_ptr)
+            throw std::runtime_error("K is empty");
+        check_type(type_code());
+    }
+
+    // Initialise from a K object already known to be an enumeration
+    EnumVector(K data, internal::unchecked_t) noexcept
+    :m_ptr(std::move(data))
+    { }
+
+    // Initialise from an enumerated K object and its domain
+    EnumVector(K data, Vector<Type::Symbol> domain)
+    :m_ptr(std::move(data))
+    ,m_domain(std::move(domain))
+    {
+        if (!m_ptr)
+            throw std::runtime_error("K is empty");
+        check_type(type_code());
+    }
+
+    /**
+     * @brief Enumerate symbols against a domain. Like q's $ each value must
+     * already be in the domain.
+     *
+     * @param values: Symbols to enumerate.
+     * @param domain: Domain to enumerate against.
+     * @param t: Type code for the enumeration (20 to 76).
+     */
+    EnumVector(const Vector<Type::Symbol>& values, Vector<Type::Symbol> domain, signed char t = 20)
+    :m_domain(std::move(domain))
+    {
+        check_type(t);
+        const auto codes = domain_codes();
+        m_ptr = K{ktn(t, static_cast<int64_t>(values.size()))};
+        char * const *syms = values.get().data<char *>();
+        index *out = m_ptr.data<index>();
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            // the null symbol enumerates to the null index
+            if (syms[i][0] == '\0')
+            {
+                out[i] = null_index;
+                continue;
+            }
+            const auto it = codes.find(syms[i]);
+            if (it == codes.end())
+                throw std::runtime_error(std::string("cast: ") + syms[i] + " is not in the domain");
+            out[i] = it->second;
+        }
+    }
+
+    signed char type_code() const noexcept
+    {
+        return m_ptr.type();
+    }
+
+    bool has_domain() const noexcept
+    {
+        return m_domain.has_value();
+    }
+
+    Vector<Type::Symbol> domain() const
+    {
+        return required_domain();
+    }
+
+    // Bind the domain of codes passed without one.
+    void set_domain(Vector<Type::Symbol> domain)
+    {
+        m_domain = std::move(domain);
+    }
+
+    // Element access. These are the codes, see symbol() to resolve.
+
+    index operator[](size_t pos) const
+    {
+        return data()[pos];
+    }
+
+    index at(size_t pos) const
+    {
+        check_in_range(pos);
+        return data()[pos];
+    }
+
+    const index *data() const noexcept
+    {
+        return m_ptr.data<index>();
+    }
+
+    bool empty() const noexcept
+    {
+        return size() == 0;
+    }
+
+    size_t size() const noexcept
+    {
+        return m_ptr.size();
+    }
+
+    // Resolution
+
+    /**
+     * @brief Resolve a single element to its symbol. The null index resolves
+     * to the empty (null) symbol.
+     */
+    std::string_view symbol(size_t pos) const
+    {
+        check_in_range(pos);
+        const auto code = data()[pos];
+        if (code == null_index)
+            return {};
+        check_code(code);
+        return domain_data()[code];
+    }
+
+    /**
+     * @brief Resolve all elements to a symbol vector. This is the only
+     * operation which touches the symbols, so only do it when needed.
+     */
+    Vector<Type::Symbol> resolve() const
+    {
+        const size_t n = size();
+        K res{ktn(KS, static_cast<int64_t>(n))};
+        char **out = res.data<char *>();
+        char * const *dom = domain_data();
+        const index *codes = data();
+        char *null_sym = internal::intern{}("");
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (codes[i] == null_index)
+            {
+                out[i] = null_sym;
+                continue;
+            }
+            check_code(codes[i]);
+            out[i] = dom[codes[i]];
+        }
+        return {std::move(res)};
+    }
+
+    // Lookup on codes
+
+    /**
+     * @brief Code of value in the domain, null_index if not in the domain.
+     */
+    index code(const std::string_view& value) const
+    {
+        const auto& domain = required_domain();
+        const auto pos = domain.find(value);
+        return pos < domain.size() ? static_cast<index>(pos) : null_index;
+    }
+
+    // Index of first occurrence of value, size() if absent.
+    size_t find(const std::string_view& value) const
+    {
+        const auto c = code(value);
+        if (c == null_index)
+            return size();
+        const index *codes = data();
+        const size_t n = size();
+        for (size_t i = 0; i < n; ++i)
+            if (codes[i] == c)
+                return i;
+        return n;
+    }
+
+    size_t count(const std::string_view& value) const
+    {
+        const auto c = code(value);
+        if (c == null_index)
+            return 0;
+        const index *codes = data();
+        const size_t n = size();
+        size_t count = 0;
+        // Branch free so the compiler can vectorise.
+        for (size_t i = 0; i < n; ++i)
+            count += codes[i] == c;
+        return count;
+    }
+
+    /**
+     * @brief Group rows by code. Entry i holds the rows enumerated to domain
+     * element i, in order. Null rows are not grouped. Without a domain
+     * there is an entry up to the largest code.
+     */
+    std::vector<std::vector<size_t>> group() const
+    {
+        std::vector<std::vector<size_t>> groups(code_space());
+        const index *codes = data();
+        for (size_t i = 0; i < size(); ++i)
+        {
+            if (codes[i] == null_index)
+                continue;
+            check_code(codes[i]);
+            groups[codes[i]].push_back(i);
+        }
+        return groups;
+    }
+
+    /**
+     * @brief For each element the first row in keys with the same symbol,
+     * keys.size() if there is no such row. This is the lookup behind joins.
+     *
+     * When both sides share a domain this is done on the codes alone.
+     * Otherwise codes are translated through the symbols (interned, so
+     * compared on pointer) once per domain element, not once per row.
+     */
+    std::vector<size_t> lookup(const EnumVector& keys) const
+    {
+        const size_t missing = keys.size();
+
+        // first row in keys for each of its codes
+        std::vector<size_t> first_row(keys.code_space(), missing);
+        const index *key_codes = keys.data();
+        for (size_t i = keys.size(); i-- > 0;)
+        {
+            if (key_codes[i] == null_index)
+                continue;
+            keys.check_code(key_codes[i]);
+            first_row[key_codes[i]] = i;
+        }
+
+        // translate our codes in to keys codes
+        std::vector<size_t> translated;
+        const std::vector<size_t> *rows_by_code = &first_row;
+        if (!same_domain(keys))
+        {
+            std::unordered_map<const char *, size_t> key_domain;
+            char * const *kdom = keys.domain_data();
+            for (size_t i = 0; i < keys.m_domain->size(); ++i)
+                key_domain.emplace(kdom[i], first_row[i]);
+            translated.resize(m_domain->size(), missing);
+            char * const *dom = domain_data();
+            for (size_t i = 0; i < m_domain->size(); ++i)
+                if (auto it = key_domain.find(dom[i]); it != key_domain.end())
+                    translated[i] = it->second;
+            rows_by_code = &translated;
+        }
+
+        std::vector<size_t> res(size(), missing);
+        const index *codes = data();
+        for (size_t i = 0; i < size(); ++i)
+        {
+            if (codes[i] == null_index)
+                continue;
+            check_code(codes[i]);
+            // codes past the largest in keys, when neither has a domain
+            if (static_cast<size_t>(codes[i]) < rows_by_code->size())
+                res[i] = (*rows_by_code)[codes[i]];
+        }
+        return res;
+    }
+
+    /**
+     * @brief True if both vectors enumerate against the same domain. Without
+     * both domains, true if they are of the same enumeration type.
+     */
+    bool same_domain(const EnumVector& rhs) const
+    {
+        if (!has_domain() || !rhs.has_domain())
+            return type_code() == rhs.type_code();
+        return domain_data() == rhs.domain_data() || *m_domain == *rhs.m_domain;
+    }
+
+    /**
+     * @brief Equality over codes when the domains match, else over symbols.
+     */
+    bool operator==(const EnumVector& rhs) const
+    {
+        if (size() != rhs.size())
+            return false;
+        if (same_domain(rhs))
+            return memcmp(data(), rhs.data(), size() * sizeof(index)) == 0;
+        return resolve() == rhs.resolve();
+    }
+
+    K get() const
+    {
+        return m_ptr;
+    }
+
+private:
+
+    static void check_type(signed char t)
+    {
+        if (t < 20 || 76 < t)
+            throw std::runtime_error("Enumerations have type in range [20, 76]. Found: " + std::to_string(t));
+    }
+
+    void check_in_range(size_t pos) const
+    {
+        if (pos >= size())
+            throw std::out_of_range("Attempted to access index " + std::to_string(pos) + " but length is " + std::to_string(size()));
+    }
+
+    void check_code(index code) const
+    {
+        if (code < 0)
+            throw std::out_of_range("Enumeration index " + std::to_string(code) + " is negative");
+        if (m_domain && static_cast<size_t>(code) >= m_domain->size())
+            throw std::out_of_range("Enumeration index " + std::to_string(code) + " outside of domain of length " + std::to_string(m_domain->size()));
+    }
+
+    const Vector<Type::Symbol>& required_domain() const
+    {
+        if (!m_domain)
+            throw std::runtime_error("Enumeration has no domain, see set_domain");
+        return *m_domain;
+    }
+
+    char * const *domain_data() const
+    {
+        return required_domain().get().data<char *>();
+    }
+
+    // Codes there may be: the domain's length, else past the largest code.
+    size_t code_space() const
+    {
+        if (m_domain)
+            return m_domain->size();
+        const index *codes = data();
+        index largest = -1;
+        for (size_t i = 0; i < size(); ++i)
+            largest = std::max(largest, codes[i]);
+        return static_cast<size_t>(largest + 1);
+    }
+
+    // Domain symbol (interned pointer) to code.
+    std::unordered_map<const char *, index> domain_codes() const
+    {
+        std::unordered_map<const char *, index> codes;
+        codes.reserve(m_domain->size());
+        char * const *dom = domain_data();
+        for (size_t i = 0; i < m_domain->size(); ++i)
+            codes.emplace(dom[i], static_cast<index>(i));
+        return codes;
+    }
+
+    K m_ptr;
+    // unset for codes passed from q
+    std::optional<Vector<Type::Symbol>> m_domain;
+};
+
+}
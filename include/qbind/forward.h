@@ -20,6 +20,8 @@ class Tuple;
 template <class TKey, class TValue>
 class Dictionary;
 
+class EnumVector;
+
 class Converter;
 
 // Abbreviation: Q style and C style
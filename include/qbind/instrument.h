@@ -0,0 +1,439 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <kx/kx.h>
+
+#include "function.h"
+
+namespace qbind
+{
+
+/**
+ * @brief Log-linear latency histogram, HDR style.
+ *
+ * Values below 2^sub_bits have their own bucket. Above that each power of two
+ * is split in to 2^sub_bits buckets, so the relative error of a bucket is at
+ * most 1/2^sub_bits (about 6%). Counting is a relaxed atomic increment.
+ */
+class LatencyHistogram
+{
+public:
+
+    static constexpr unsigned sub_bits = 4;
+    static constexpr size_t sub_count = size_t{1} << sub_bits;
+    static constexpr size_t bucket_count = (64 - sub_bits + 1) * sub_count;
+
+    static constexpr size_t bucket(uint64_t v) noexcept
+    {
+        if (v < sub_count)
+            return static_cast<size_t>(v);
+        const unsigned e = 63 - static_cast<unsigned>(__builtin_clzll(v));
+        const size_t sub = static_cast<size_t>(v >> (e - sub_bits)) & (sub_count - 1);
+        return (e - sub_bits + 1) * sub_count + sub;
+    }
+
+    // Smallest value counted in bucket b.
+    static constexpr uint64_t lower_bound(size_t b) noexcept
+    {
+        if (b < sub_count)
+            return b;
+        const unsigned e = static_cast<unsigned>(b / sub_count) + sub_bits - 1;
+        return (sub_count + b % sub_count) << (e - sub_bits);
+    }
+
+    void record(uint64_t v) noexcept
+    {
+        m_counts[bucket(v)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t count(size_t b) const noexcept
+    {
+        return m_counts[b].load(std::memory_order_relaxed);
+    }
+
+    void reset() noexcept
+    {
+        for (auto& c : m_counts)
+            c.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, bucket_count> m_counts{};
+};
+
+/**
+ * @brief Call statistics for one exported function.
+ *
+ * Counters are sharded with a shard per thread (modulo shard_count) so
+ * threads calling the same function, e.g. under peach, don't contend on a
+ * cache line. All updates are relaxed atomics, so there are no locks on the
+ * call path. Reads sum the shards and are approximate while calls are in
+ * flight.
+ */
+class CallStats
+{
+public:
+
+    static constexpr size_t shard_count = 8;
+
+    struct Summary
+    {
+        std::string name;
+        uint64_t calls = 0;
+        uint64_t errors = 0;
+        uint64_t total_ns = 0;
+        uint64_t convert_ns = 0;
+        uint64_t bytes = 0;
+        uint64_t max_ns = 0;
+        std::vector<uint64_t> histogram = std::vector<uint64_t>(LatencyHistogram::bucket_count, 0);
+
+        // Value at quantile q in [0, 1], to within a bucket.
+        uint64_t quantile(double q) const noexcept
+        {
+            if (calls == 0)
+                return 0;
+            const auto target = static_cast<uint64_t>(q * static_cast<double>(calls - 1)) + 1;
+            uint64_t seen = 0;
+            for (size_t b = 0; b < histogram.size(); ++b)
+            {
+                seen += histogram[b];
+                if (seen >= target)
+                    return LatencyHistogram::lower_bound(b);
+            }
+            return max_ns;
+        }
+    };
+
+    explicit CallStats(std::string name)
+    : m_name(std::move(name))
+    { }
+
+    void record(uint64_t total_ns, uint64_t convert_ns, uint64_t bytes, bool error) noexcept
+    {
+        auto& s = m_shards[shard()];
+        s.calls.fetch_add(1, std::memory_order_relaxed);
+        s.errors.fetch_add(error, std::memory_order_relaxed);
+        s.total_ns.fetch_add(total_ns, std::memory_order_relaxed);
+        s.convert_ns.fetch_add(convert_ns, std::memory_order_relaxed);
+        s.bytes.fetch_add(bytes, std::memory_order_relaxed);
+        auto max = s.max_ns.load(std::memory_order_relaxed);
+        while (total_ns > max && !s.max_ns.compare_exchange_weak(max, total_ns, std::memory_order_relaxed))
+        { }
+        s.histogram.record(total_ns);
+    }
+
+    Summary summary() const
+    {
+        Summary res;
+        res.name = m_name;
+        for (const auto& s : m_shards)
+        {
+            res.calls += s.calls.load(std::memory_order_relaxed);
+            res.errors += s.errors.load(std::memory_order_relaxed);
+            res.total_ns += s.total_ns.load(std::memory_order_relaxed);
+            res.convert_ns += s.convert_ns.load(std::memory_order_relaxed);
+            res.bytes += s.bytes.load(std::memory_order_relaxed);
+            res.max_ns = std::max(res.max_ns, s.max_ns.load(std::memory_order_relaxed));
+            for (size_t b = 0; b < LatencyHistogram::bucket_count; ++b)
+                res.histogram[b] += s.histogram.count(b);
+        }
+        return res;
+    }
+
+    void reset() noexcept
+    {
+        for (auto& s : m_shards)
+        {
+            s.calls = 0;
+            s.errors = 0;
+            s.total_ns = 0;
+            s.convert_ns = 0;
+            s.bytes = 0;
+            s.max_ns = 0;
+            s.histogram.reset();
+        }
+    }
+
+    const std::string& name() const noexcept
+    {
+        return m_name;
+    }
+
+private:
+
+    struct alignas(64) Shard
+    {
+        std::atomic<uint64_t> calls{0};
+        std::atomic<uint64_t> errors{0};
+        std::atomic<uint64_t> total_ns{0};
+        std::atomic<uint64_t> convert_ns{0};
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<uint64_t> max_ns{0};
+        LatencyHistogram histogram;
+    };
+
+    static size_t shard() noexcept
+    {
+        static std::atomic<size_t> next{0};
+        thread_local const size_t idx = next.fetch_add(1, std::memory_order_relaxed) % shard_count;
+        return idx;
+    }
+
+    std::string m_name;
+    std::array<Shard, shard_count> m_shards;
+};
+
+/**
+ * @brief All instrumented functions. Entries are created once per function
+ * and never removed, so references stay valid.
+ */
+class CallStatsRegistry
+{
+public:
+
+    static CallStatsRegistry& instance()
+    {
+        static CallStatsRegistry registry;
+        return registry;
+    }
+
+    CallStats& get(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        for (auto& stats : m_stats)
+            if (stats->name() == name)
+                return *stats;
+        m_stats.push_back(std::make_unique<CallStats>(name));
+        return *m_stats.back();
+    }
+
+    std::vector<CallStats::Summary> summaries() const
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        std::vector<CallStats::Summary> res;
+        res.reserve(m_stats.size());
+        for (const auto& stats : m_stats)
+            res.push_back(stats->summary());
+        return res;
+    }
+
+    void reset()
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        for (auto& stats : m_stats)
+            stats->reset();
+    }
+
+    /**
+     * @brief Stats as a q table with a row per function:
+     * function, calls, errors, totalNs, convertNs, bytes, p50Ns, p99Ns,
+     * p999Ns, maxNs.
+     */
+    ::K table() const
+    {
+        const auto rows = summaries();
+        const auto n = static_cast<int64_t>(rows.size());
+
+        ::K names = ktn(KS, n);
+        std::array<::K, 9> cols;
+        for (auto& col : cols)
+            col = ktn(KJ, n);
+
+        for (int64_t i = 0; i < n; ++i)
+        {
+            const auto& row = rows[static_cast<size_t>(i)];
+            reinterpret_cast<char **>(names->G0)[i] = ss(const_cast<char *>(row.name.c_str()));
+            const uint64_t values[] = {
+                row.calls, row.errors, row.total_ns, row.convert_ns, row.bytes,
+                row.quantile(0.5), row.quantile(0.99), row.quantile(0.999), row.max_ns};
+            for (size_t c = 0; c < cols.size(); ++c)
+                reinterpret_cast<int64_t *>(cols[c]->G0)[i] = static_cast<int64_t>(values[c]);
+        }
+
+        const char *headers[] = {"function", "calls", "errors", "totalNs", "convertNs", "bytes", "p50Ns", "p99Ns", "p999Ns", "maxNs"};
+        ::K keys = ktn(KS, 10);
+        for (size_t i = 0; i < 10; ++i)
+            reinterpret_cast<char **>(keys->G0)[i] = ss(const_cast<char *>(headers[i]));
+        ::K values = knk(10, names, cols[0], cols[1], cols[2], cols[3], cols[4], cols[5], cols[6], cols[7], cols[8]);
+        return xT(xD(keys, values));
+    }
+
+private:
+    CallStatsRegistry() = default;
+
+    mutable std::mutex m_mutex;
+    std::vector<std::unique_ptr<CallStats>> m_stats;
+};
+
+namespace internal
+{
+
+/**
+ * @brief Approximate size in bytes of the data behind a K object. Lists are
+ * walked, symbols count their characters.
+ */
+inline uint64_t k_bytes(::K k) noexcept
+{
+    static constexpr uint8_t width[] = {8, 1, 16, 0, 1, 2, 4, 8, 4, 8, 1, 8, 8, 4, 4, 8, 8, 4, 4, 4};
+    if (!k)
+        return 0;
+    if (k->t < 0)
+        return 8;
+    if (k->t == 0 || (k->t >= 98 && k->t <= 99))
+    {
+        if (k->t == 98)
+            return k_bytes(k->k);
+        uint64_t res = 0;
+        const int64_t n = k->t == 99 ? 2 : k->n;
+        for (int64_t i = 0; i < n; ++i)
+            res += k_bytes(reinterpret_cast<::K *>(k->G0)[i]);
+        return res;
+    }
+    if (k->t == KS)
+    {
+        uint64_t res = 0;
+        for (int64_t i = 0; i < k->n; ++i)
+            res += strlen(reinterpret_cast<char **>(k->G0)[i]) + 1;
+        return res;
+    }
+    if (k->t < 20)
+        return static_cast<uint64_t>(k->n) * width[k->t];
+    // enumerations
+    if (k->t <= 76)
+        return static_cast<uint64_t>(k->n) * 8;
+    // functions and anything else whose n isn't a count of elements
+    return 0;
+}
+
+/**
+ * @brief Times one call of an instrumented export and records it on
+ * destruction.
+ */
+class CallTimer
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    explicit CallTimer(CallStats& stats) noexcept
+    : m_stats(stats)
+    , m_start(clock::now())
+    , m_converted(m_start)
+    { }
+
+    CallTimer(const CallTimer&) = delete;
+    CallTimer& operator=(const CallTimer&) = delete;
+
+    ~CallTimer()
+    {
+        const auto end = clock::now();
+        m_stats.record(
+            static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - m_start).count()),
+            static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(m_converted - m_start).count()),
+            m_bytes,
+            m_error);
+    }
+
+    // Arguments have been converted.
+    void converted() noexcept
+    {
+        m_converted = clock::now();
+    }
+
+    ::K returned(::K res) noexcept
+    {
+        m_bytes = k_bytes(res);
+        return res;
+    }
+
+    void failed() noexcept
+    {
+        m_error = true;
+    }
+
+private:
+    CallStats& m_stats;
+    clock::time_point m_start;
+    clock::time_point m_converted;
+    uint64_t m_bytes = 0;
+    bool m_error = false;
+};
+
+}
+
+}
+
+/**
+ * @brief Call the function with pre-converted arguments held in a tuple.
+ */
+#define QBIND_INSTRUMENTED_CALL(returns, fn)                                                              \
+    BOOST_PP_IF(returns,                                                                                  \
+        return qbind_timer.returned(qbind::Converter::to_q<qbind::ResultType<decltype(fn)>>(std::apply(fn, std::move(qbind_args)))), \
+        std::apply(fn, std::move(qbind_args)));
+
+/**
+ * @brief Export a function to Q recording call statistics.
+ *
+ * As QBIND_FN_EXPORT, but each call records its latency, the time spent
+ * converting arguments, the size of the result and whether it threw, under
+ * the exported name. Use QBIND_STATS_EXPORT to read the statistics from q.
+ *
+ * @param fn: Function to export
+ * @param name: Name to export function as (must be unique as its extern C)
+ * @param nargs: Number of arguments of function
+ * @param returns: 0 if doesn't return
+ */
+#define QBIND_FN_EXPORT_INSTRUMENTED(fn, name, nargs, returns)                                 \
+    extern "C"                                                                                 \
+    {                                                                                          \
+        QBIND_FN_SIGNATURE(name, nargs)                                                        \
+        {                                                                                      \
+            qbind::helpers::NonConstLvalueRefArgChecker<decltype(fn)>();                       \
+            static qbind::CallStats& qbind_stats = qbind::CallStatsRegistry::instance().get(#name); \
+            qbind::internal::CallTimer qbind_timer(qbind_stats);                               \
+            try                                                                                \
+            {                                                                                  \
+                auto qbind_args = std::make_tuple QBIND_ARGUMENTS(fn, nargs);                  \
+                qbind_timer.converted();                                                       \
+                QBIND_INSTRUMENTED_CALL(returns, fn)                                           \
+            }                                                                                  \
+            catch (const std::exception& e)                                                    \
+            {                                                                                  \
+                qbind_timer.failed();                                                          \
+                thread_local std::string errmsg;                                               \
+                errmsg = e.what();                                                             \
+                std::cerr << errmsg << std::endl;                                              \
+                return krr(errmsg.data());                                                     \
+            }                                                                                  \
+            return knk(0);                                                                     \
+        }                                                                                      \
+    }
+
+/**
+ * @brief Export a unary function returning the statistics of all
+ * instrumented functions as a table. Passing 1b resets them after reading.
+ *
+ * @param name: Name to export function as
+ */
+#define QBIND_STATS_EXPORT(name)                                       \
+    extern "C"                                                         \
+    {                                                                  \
+        K name(K reset)                                                \
+        {                                                              \
+            auto& registry = qbind::CallStatsRegistry::instance();     \
+            K res = registry.table();                                  \
+            if (reset && reset->t == -KB && reset->g)                  \
+                registry.reset();                                      \
+            return res;                                                \
+        }                                                              \
+    }
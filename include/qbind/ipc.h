@@ -0,0 +1,174 @@
+#pragma once
+
+#include <concepts>
+#include <stdexcept>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+
+#include <kx/kx.h>
+
+#include "k.h"
+
+namespace qbind
+{
+
+namespace internal
+{
+
+// Bytes of the IPC message header: endianness, message type, compression,
+// unused, then the int32 length of the message.
+constexpr size_t ipc_header_size = 8;
+
+/**
+ * @brief Per-thread cache of symbol lengths.
+ *
+ * Interned symbols never move or change, so their lengths can be keyed on
+ * the pointer. Symbol columns repeat a few distinct values many times, which
+ * turns a strlen per row in to a lookup per row.
+ */
+class SymbolLengthCache
+{
+public:
+
+    // Like SymbolCache, dropped when full.
+    static constexpr size_t max_size = 1 << 20;
+
+    static size_t get(const char *sym)
+    {
+        auto& cache = instance();
+        if (auto it = cache.find(sym); it != cache.end())
+            return it->second;
+        if (cache.size() >= max_size)
+            cache.clear();
+        const size_t len = strlen(sym);
+        cache.emplace(sym, len);
+        return len;
+    }
+
+private:
+
+    static std::unordered_map<const char *, size_t>& instance()
+    {
+        thread_local std::unordered_map<const char *, size_t> cache;
+        return cache;
+    }
+};
+
+// Width of an element of type t in memory, symbols as pointers. 0 if not
+// fixed width. Other than symbols, elements serialise at the same width.
+inline size_t k_width(signed char t) noexcept
+{
+    switch (t < 0 ? -t : t)
+    {
+        case KB: case KG: case KC:          return 1;
+        case UU:                            return 16;
+        case KH:                            return 2;
+        case KI: case KE: case KM: case KD:
+        case KU: case KV: case KT:          return 4;
+        case KJ: case KF: case KP: case KZ:
+        case KN: case KS:                   return 8;
+        default:                            return 0;
+    }
+}
+
+inline void check_ipc_level(signed char t, int level)
+{
+    const auto abs_t = t < 0 ? -t : t;
+    // timestamps and timespans came with protocol 1, guids with 3
+    const int required = abs_t == UU ? 3 : (abs_t == KP || abs_t == KN) ? 1 : 0;
+    if (level < required)
+        throw std::runtime_error("Type " + std::to_string(t) + " needs protocol level " + std::to_string(required) + ", have " + std::to_string(level));
+}
+
+// Bytes k serialises to, without the message header. Symbols are sized
+// before widths are looked up, as they serialise as strings.
+inline size_t serialised_size(::K k, int level)
+{
+    const signed char t = k->t;
+    check_ipc_level(t, level);
+
+    if (t == -KS || t == -128)
+        return 1 + SymbolLengthCache::get(k->s) + 1;
+    if (t < 0)
+    {
+        const size_t width = k_width(t);
+        if (!width)
+            throw std::runtime_error("Can't size atoms of type " + std::to_string(t));
+        return 1 + width;
+    }
+
+    // type, attribute and count
+    constexpr size_t vector_header = 1 + 1 + 4;
+    const size_t n = static_cast<size_t>(k->n);
+    if (t == 0)
+    {
+        size_t res = vector_header;
+        const ::K *items = reinterpret_cast<const ::K *>(k->G0);
+        for (size_t i = 0; i < n; ++i)
+            res += serialised_size(items[i], level);
+        return res;
+    }
+    if (t == KS)
+    {
+        size_t res = vector_header + n;
+        char * const *syms = reinterpret_cast<char * const *>(k->G0);
+        for (size_t i = 0; i < n; ++i)
+            res += SymbolLengthCache::get(syms[i]);
+        return res;
+    }
+    if (t < 20)
+        return vector_header + n * k_width(t);
+
+    switch (t)
+    {
+        case XT:
+            // type, attribute then the column dictionary
+            return 1 + 1 + serialised_size(k->k, level);
+        case XD: case 127:
+        {
+            const ::K *parts = reinterpret_cast<const ::K *>(k->G0);
+            return 1 + serialised_size(parts[0], level) + serialised_size(parts[1], level);
+        }
+        // primitives, including the generic null
+        case 101: case 102: case 103:
+            return 1 + 1;
+        default:
+            throw std::runtime_error("Can't size objects of type " + std::to_string(t));
+    }
+}
+
+}
+
+/**
+ * @brief Bytes k takes on the wire, the header included, as q's -22!.
+ *
+ * Only the structure is walked: fixed width vectors are sized from their
+ * count and symbols from cached lengths, nothing is serialised. Compression
+ * isn't accounted for, so this is the size before compressing.
+ *
+ * @param level: Protocol level the message is for. Types newer than the
+ * level throw, as serialising them would.
+ */
+inline size_t ipc_size(::K k, int level = 3)
+{
+    if (!k)
+        throw std::runtime_error("K is empty");
+    return internal::ipc_header_size + internal::serialised_size(k, level);
+}
+
+inline size_t ipc_size(const K& k, int level = 3)
+{
+    return ipc_size(k.get(), level);
+}
+
+// Atom, Vector, Tuple, Dictionary, EnumVector, StringColumn...
+template<class T>
+requires requires(const T& value) { { value.get() } -> std::convertible_to<K>; }
+size_t ipc_size(const T& value, int level = 3)
+{
+    return ipc_size(value.get(), level);
+}
+
+}
@@ -44,12 +44,14 @@ public:
     inline Iterator operator++(int) {Iterator tmp(*this); inc(m_ptr); return tmp;}
     inline Iterator operator--(int) {Iterator tmp(*this); dec(m_ptr); return tmp;}
 
-    inline difference_type operator-(const Iterator& rhs) const {return direction*(m_ptr-rhs.ptr);}
+    inline difference_type operator-(const Iterator& rhs) const {return direction*(m_ptr-rhs.m_ptr);}
     inline Iterator operator+(difference_type rhs) const {return Iterator(add(rhs));}
     inline Iterator operator-(difference_type rhs) const {return Iterator(sub(rhs));}
     friend inline Iterator operator+(difference_type lhs, const Iterator& rhs) {return Iterator(rhs.add(lhs));}
     friend inline Iterator operator-(difference_type lhs, const Iterator& rhs) {return Iterator(rhs.sub(lhs));}
     
+    bool operator==(const Iterator& rhs) const {return m_ptr == rhs.m_ptr;}
+
     auto operator<=>(const Iterator& rhs) const
     {
         if (m_ptr == rhs.m_ptr)
@@ -0,0 +1,640 @@
+#pragma once
+
+#include <filesystem>
+#include <limits>
+#include <stdexcept>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <kx/kx.h>
+
+#include "ipc.h"
+#include "k.h"
+#include "mapped_file.h"
+#include "symbol.h"
+#include "thread_pool.h"
+
+namespace qbind
+{
+
+namespace internal
+{
+
+// Journals lead with 0xff 0x01 then the header of a general list whose count
+// is the number of messages. Each message follows as a serialised object,
+// without the IPC message header.
+constexpr uint8_t journal_marker = 0xff;
+constexpr uint8_t journal_version = 0x01;
+constexpr size_t journal_header_size = 8;
+
+/**
+ * @brief Bytes taken by the serialised object at p, 0 if it runs past end or
+ * holds something which can't be walked (e.g. enumerations or foreigns).
+ * Only lengths are read, nothing is decoded.
+ */
+inline size_t ipc_object_size(const uint8_t *p, const uint8_t *end, int depth = 0) noexcept
+{
+    const auto remaining = [&](const uint8_t *q) { return static_cast<size_t>(end - q); };
+    const auto string_size = [&](const uint8_t *q) -> size_t
+    {
+        const void *nul = memchr(q, '\0', remaining(q));
+        return nul ? static_cast<size_t>(static_cast<const uint8_t *>(nul) - q) + 1 : 0;
+    };
+
+    // Deep nesting is corruption rather than data.
+    if (p >= end || depth > 64)
+        return 0;
+
+    const auto t = static_cast<signed char>(p[0]);
+    const uint8_t *q = p + 1;
+    if (t == -KS || t == -128)
+    {
+        const size_t n = string_size(q);
+        return n ? 1 + n : 0;
+    }
+    if (t < 0)
+    {
+        const size_t width = k_width(t);
+        return width && width <= remaining(q) ? 1 + width : 0;
+    }
+    if (t < 20)
+    {
+        // attribute and count
+        if (remaining(q) < 5)
+            return 0;
+        int32_t n;
+        memcpy(&n, q + 1, sizeof(n));
+        if (n < 0)
+            return 0;
+        q += 5;
+        if (t == 0)
+        {
+            for (int32_t i = 0; i < n; ++i)
+            {
+                const size_t size = ipc_object_size(q, end, depth + 1);
+                if (!size)
+                    return 0;
+                q += size;
+            }
+        }
+        else if (t == KS)
+        {
+            for (int32_t i = 0; i < n; ++i)
+            {
+                const size_t size = string_size(q);
+                if (!size)
+                    return 0;
+                q += size;
+            }
+        }
+        else
+        {
+            const size_t bytes = k_width(t) * static_cast<size_t>(n);
+            if (!k_width(t) || bytes > remaining(q))
+                return 0;
+            q += bytes;
+        }
+        return static_cast<size_t>(q - p);
+    }
+
+    size_t children = 0;
+    switch (t)
+    {
+        // table: attribute then the column dictionary
+        case XT:
+            if (remaining(q) < 1)
+                return 0;
+            q += 1;
+            children = 1;
+            break;
+        // dictionary and sorted dictionary: keys then values
+        case XD: case 127:
+            children = 2;
+            break;
+        // lambda: context then the source string
+        case 100:
+        {
+            const size_t n = string_size(q);
+            if (!n)
+                return 0;
+            q += n;
+            children = 1;
+            break;
+        }
+        // unary, binary and ternary primitives
+        case 101: case 102: case 103:
+            return remaining(q) >= 1 ? 2 : 0;
+        // projection and composition: count then the parts
+        case 104: case 105:
+        {
+            int32_t n;
+            if (remaining(q) < sizeof(n))
+                return 0;
+            memcpy(&n, q, sizeof(n));
+            if (n < 0)
+                return 0;
+            q += sizeof(n);
+            children = static_cast<size_t>(n);
+            break;
+        }
+        // adverbs
+        case 106: case 107: case 108: case 109: case 110: case 111:
+            children = 1;
+            break;
+        default:
+            return 0;
+    }
+    for (size_t i = 0; i < children; ++i)
+    {
+        const size_t size = ipc_object_size(q, end, depth + 1);
+        if (!size)
+            return 0;
+        q += size;
+    }
+    return static_cast<size_t>(q - p);
+}
+
+// Copy k in to the calling thread's memory.
+inline ::K copy_k(::K k)
+{
+    if (k->t < 0)
+    {
+        ::K res = ka(k->t);
+        memcpy(&res->g, &k->g, k_width(k->t));
+        return res;
+    }
+    if (k->t == 0)
+    {
+        K res{ktn(0, k->n)};
+        ::K *dst = res.data<::K>();
+        const ::K *src = reinterpret_cast<const ::K *>(k->G0);
+        for (int64_t i = 0; i < k->n; ++i)
+            dst[i] = copy_k(src[i]);
+        return res.release();
+    }
+    const size_t width = k_width(k->t);
+    if (!width)
+        throw std::runtime_error("Can't copy journal values of type " + std::to_string(k->t));
+    ::K res = ktn(k->t, k->n);
+    memcpy(res->G0, k->G0, width * static_cast<size_t>(k->n));
+    return res;
+}
+
+}
+
+/**
+ * @brief What to read from a journal.
+ */
+struct JournalOptions
+{
+    // Tables to keep, all if empty. Filtered before decoding.
+    std::vector<std::string> tables;
+    // Symbols to keep, all if empty. Rows are filtered on symbol_column.
+    std::vector<std::string> symbols;
+    // By tickerplant convention sym is the second column, after time.
+    size_t symbol_column = 1;
+    // Messages decoded per window, bounding the memory held at once.
+    size_t window = 1 << 16;
+    // Messages per parallel task.
+    size_t grain = 256;
+};
+
+/**
+ * @brief Updates to one table, as columns.
+ *
+ * Columns are vectors, or general lists for columns of strings or other
+ * nested values, in the order they were published.
+ */
+struct JournalBatch
+{
+    std::string table;
+    std::vector<K> columns;
+    size_t rows = 0;
+    size_t messages = 0;
+};
+
+/**
+ * @brief Reader for tickerplant journals, logs of (`upd;`table;data)
+ * messages as written by a tickerplant and replayed by -11!.
+ *
+ * The journal is mapped and indexed in one pass which only reads lengths.
+ * Like -11!(-2) indexing stops at the first message which doesn't fit, so a
+ * journal with a torn tail reads up to its last whole message.
+ *
+ * Replays decode messages with d9 in parallel on a ThreadPool then gather
+ * them in to columns per table, in journal order, on the calling thread.
+ * Messages to unwanted tables are skipped on their bytes without decoding.
+ * data may be a list of columns, a list of atoms (one row) or a table.
+ * Messages of other shapes are counted in skipped.
+ */
+class JournalReader
+{
+public:
+
+    explicit JournalReader(const std::filesystem::path& path)
+    : m_file(path)
+    {
+        const uint8_t *base = m_file.data();
+        if (m_file.size() < internal::journal_header_size || base[0] != internal::journal_marker || base[1] != internal::journal_version || base[2] != 0)
+            throw std::runtime_error(path.string() + ": not a journal");
+
+        const uint8_t *end = base + m_file.size();
+        size_t offset = internal::journal_header_size;
+        while (offset < m_file.size())
+        {
+            const size_t size = internal::ipc_object_size(base + offset, end);
+            if (!size)
+                break;
+            m_entries.push_back({offset, size});
+            offset += size;
+        }
+        m_valid_bytes = offset;
+    }
+
+    // Number of whole messages.
+    size_t size() const noexcept
+    {
+        return m_entries.size();
+    }
+
+    // Bytes up to the end of the last whole message.
+    size_t valid_bytes() const noexcept
+    {
+        return m_valid_bytes;
+    }
+
+    // True if the journal has bytes past its last whole message.
+    bool truncated() const noexcept
+    {
+        return m_valid_bytes != m_file.size();
+    }
+
+    /**
+     * @brief Serialised bytes of message pos, without an IPC header.
+     */
+    std::string_view bytes(size_t pos) const
+    {
+        const auto& entry = m_entries.at(pos);
+        return {reinterpret_cast<const char *>(m_file.data() + entry.offset), entry.size};
+    }
+
+    /**
+     * @brief Table a message updates, read from its bytes. Empty if it isn't
+     * of the form (`function;`table;data).
+     */
+    std::string_view table(size_t pos) const
+    {
+        const auto view = bytes(pos);
+        const char *p = view.data();
+        const char *end = p + view.size();
+        int32_t n;
+        if (view.size() < 8 || p[0] != 0)
+            return {};
+        memcpy(&n, p + 2, sizeof(n));
+        p += 6;
+        if (n < 3 || static_cast<signed char>(*p) != -KS)
+            return {};
+        p += strnlen(p + 1, static_cast<size_t>(end - p - 1)) + 2;
+        if (p >= end || static_cast<signed char>(*p) != -KS)
+            return {};
+        ++p;
+        return {p, strnlen(p, static_cast<size_t>(end - p))};
+    }
+
+    /**
+     * @brief Decode message pos on the calling thread.
+     */
+    K decode(size_t pos) const
+    {
+        return K{decode_entry(m_entries.at(pos))};
+    }
+
+    /**
+     * @brief Replay the journal, calling f(JournalBatch&&) for each table
+     * updated in each window of options.window messages.
+     */
+    template<class F>
+    void replay(const JournalOptions& options, F&& f, ThreadPool& pool = ThreadPool::instance())
+    {
+        run(options, pool, [&](std::vector<TableBuilder>& tables)
+        {
+            for (auto& table : tables)
+                f(table.build());
+            tables.clear();
+        });
+    }
+
+    /**
+     * @brief Replay the whole journal in to one batch per table, in the
+     * order tables first appear.
+     */
+    std::vector<JournalBatch> load(const JournalOptions& options = {}, ThreadPool& pool = ThreadPool::instance())
+    {
+        auto tables = run(options, pool, [](std::vector<TableBuilder>&) { });
+        std::vector<JournalBatch> res;
+        res.reserve(tables.size());
+        for (auto& table : tables)
+            res.push_back(table.build());
+        return res;
+    }
+
+    // Messages of the wanted tables which weren't updates, over all replays.
+    size_t skipped() const noexcept
+    {
+        return m_skipped;
+    }
+
+    // Advise the kernel how the journal will be read, see MappedFile.
+    void advise(int advice) const
+    {
+        m_file.advise(advice);
+    }
+
+private:
+
+    struct Entry
+    {
+        size_t offset;
+        size_t size;
+    };
+
+    // A message decoded on a worker, with the rows to keep.
+    struct Decoded
+    {
+        OwnedK message;
+        const char *table = nullptr;
+        const ::K *columns = nullptr;
+        size_t column_count = 0;
+        // A list of atoms is one row.
+        bool one_row = false;
+        bool all = true;
+        std::vector<uint32_t> rows;
+    };
+
+    class ColumnBuilder
+    {
+    public:
+
+        void append(::K value, const Decoded& msg)
+        {
+            if (msg.one_row)
+            {
+                // the row was filtered out
+                if (!msg.all && msg.rows.empty())
+                    return;
+                if (value->t < 0)
+                {
+                    set_type(static_cast<signed char>(-value->t));
+                    append_bytes(&value->g, 1);
+                }
+                else
+                {
+                    set_type(0);
+                    m_rows.emplace_back(internal::copy_k(value));
+                }
+                return;
+            }
+
+            if (value->t < 0 || XT <= value->t)
+                throw std::runtime_error("Journal column has type " + std::to_string(value->t) + ", expected a list");
+            set_type(value->t);
+            const size_t n = static_cast<size_t>(value->n);
+            if (value->t == 0)
+            {
+                const ::K *rows = reinterpret_cast<const ::K *>(value->G0);
+                if (msg.all)
+                    for (size_t i = 0; i < n; ++i)
+                        m_rows.emplace_back(internal::copy_k(rows[i]));
+                else
+                    for (auto i : msg.rows)
+                        m_rows.emplace_back(internal::copy_k(rows[i]));
+            }
+            else if (msg.all)
+                append_bytes(value->G0, n);
+            else
+                for (auto i : msg.rows)
+                    append_bytes(value->G0 + i * m_width, 1);
+        }
+
+        // Moves the rows of nested columns out.
+        K build()
+        {
+            if (m_type <= 0)
+            {
+                K res{ktn(0, static_cast<int64_t>(m_rows.size()))};
+                ::K *dst = res.data<::K>();
+                for (size_t i = 0; i < m_rows.size(); ++i)
+                    dst[i] = m_rows[i].release();
+                m_rows.clear();
+                return res;
+            }
+            K res{ktn(m_type, static_cast<int64_t>(m_bytes.size() / m_width))};
+            memcpy(res.data<uint8_t>(), m_bytes.data(), m_bytes.size());
+            return res;
+        }
+
+    private:
+
+        void set_type(signed char t)
+        {
+            if (m_type == -1)
+            {
+                m_type = t;
+                m_width = internal::k_width(t);
+                if (t != 0 && !m_width)
+                    throw std::runtime_error("Journal column has unsupported type " + std::to_string(t));
+            }
+            else if (m_type != t)
+                throw std::runtime_error("Journal column has type " + std::to_string(t) + ", expected " + std::to_string(m_type));
+        }
+
+        void append_bytes(const void *data, size_t n)
+        {
+            const auto *p = static_cast<const uint8_t *>(data);
+            m_bytes.insert(m_bytes.end(), p, p + n * m_width);
+        }
+
+        signed char m_type = -1;
+        size_t m_width = 0;
+        std::vector<uint8_t> m_bytes;
+        std::vector<K> m_rows;
+    };
+
+    struct TableBuilder
+    {
+        std::string name;
+        std::vector<ColumnBuilder> columns;
+        size_t rows = 0;
+        size_t messages = 0;
+
+        JournalBatch build()
+        {
+            JournalBatch res;
+            res.table = name;
+            res.columns.reserve(columns.size());
+            for (auto& col : columns)
+                res.columns.push_back(col.build());
+            res.rows = rows;
+            res.messages = messages;
+            return res;
+        }
+    };
+
+    ::K decode_entry(const Entry& entry) const
+    {
+        if (entry.size > static_cast<size_t>(std::numeric_limits<int32_t>::max()) - internal::ipc_header_size)
+            throw std::runtime_error("Journal message at " + std::to_string(entry.offset) + " is too large to decode");
+
+        // d9 wants a whole IPC message: little endian, async, uncompressed.
+        const auto total = static_cast<int32_t>(entry.size + internal::ipc_header_size);
+        ::K buffer = ktn(KG, total);
+        const uint8_t header[4] = {1, 0, 0, 0};
+        memcpy(buffer->G0, header, sizeof(header));
+        memcpy(buffer->G0 + 4, &total, sizeof(total));
+        memcpy(buffer->G0 + internal::ipc_header_size, m_file.data() + entry.offset, entry.size);
+
+        ::K res = d9(buffer);
+        r0(buffer);
+        if (!res)
+            throw std::runtime_error("Journal message at " + std::to_string(entry.offset) + " failed to decode");
+        if (res->t == -128)
+        {
+            const std::string error = res->s ? res->s : "";
+            r0(res);
+            throw std::runtime_error("Journal message at " + std::to_string(entry.offset) + " failed to decode: " + error);
+        }
+        return res;
+    }
+
+    /**
+     * @brief Decode and gather the journal a window at a time, calling
+     * on_window with the tables so far after each. on_window may take the
+     * tables, otherwise they keep gathering and are returned at the end.
+     */
+    template<class F>
+    std::vector<TableBuilder> run(const JournalOptions& options, ThreadPool& pool, F on_window)
+    {
+        std::unordered_set<std::string_view> tables(options.tables.begin(), options.tables.end());
+        std::unordered_set<const char *> symbols;
+        for (const auto& sym : options.symbols)
+            symbols.insert(internal::intern{}(sym));
+        const size_t window = options.window ? options.window : 1;
+
+        std::vector<TableBuilder> builders;
+        std::unordered_map<const char *, size_t> index;
+        for (size_t first = 0; first < m_entries.size(); first += window)
+        {
+            const size_t last = std::min(m_entries.size(), first + window);
+            std::vector<size_t> picks;
+            picks.reserve(last - first);
+            for (size_t i = first; i < last; ++i)
+                if (tables.empty() || tables.count(table(i)))
+                    picks.push_back(i);
+
+            std::vector<Decoded> decoded(picks.size());
+            pool.parallel_for(0, picks.size(), options.grain, [&](size_t begin, size_t end)
+            {
+                for (size_t j = begin; j < end; ++j)
+                    decoded[j] = unpack(OwnedK(decode_entry(m_entries[picks[j]])), symbols, options.symbol_column);
+            });
+
+            for (const auto& msg : decoded)
+            {
+                if (!msg.table)
+                {
+                    ++m_skipped;
+                    continue;
+                }
+                auto [it, added] = index.emplace(msg.table, builders.size());
+                if (added)
+                    builders.push_back({msg.table, std::vector<ColumnBuilder>(msg.column_count)});
+                auto& builder = builders[it->second];
+                if (builder.columns.size() != msg.column_count)
+                    throw std::runtime_error("Journal update to " + builder.name + " has " + std::to_string(msg.column_count) + " columns, expected " + std::to_string(builder.columns.size()));
+                for (size_t c = 0; c < msg.column_count; ++c)
+                    builder.columns[c].append(msg.columns[c], msg);
+                builder.rows += msg.all ? (msg.one_row ? 1 : static_cast<size_t>(msg.columns[0]->n)) : msg.rows.size();
+                builder.messages += 1;
+            }
+            // Window's messages are released on the threads which decoded them.
+            decoded.clear();
+
+            on_window(builders);
+            if (builders.empty())
+                index.clear();
+        }
+        return builders;
+    }
+
+    /**
+     * @brief Find the table and columns of a decoded message and pick the
+     * rows to keep. Runs on the decoding thread.
+     */
+    static Decoded unpack(OwnedK message, const std::unordered_set<const char *>& symbols, size_t symbol_column)
+    {
+        Decoded res;
+        ::K msg = message.get();
+        res.message = std::move(message);
+
+        if (msg->t != 0 || msg->n < 3)
+            return res;
+        const ::K *parts = reinterpret_cast<const ::K *>(msg->G0);
+        if (parts[1]->t != -KS)
+            return res;
+
+        ::K data = parts[2];
+        if (data->t == XT)
+            data = reinterpret_cast<const ::K *>(data->k->G0)[1];
+        if (data->t != 0 || data->n == 0)
+            return res;
+
+        const ::K *columns = reinterpret_cast<const ::K *>(data->G0);
+        const size_t column_count = static_cast<size_t>(data->n);
+        bool one_row = false;
+        for (size_t c = 0; c < column_count; ++c)
+            one_row |= columns[c]->t < 0;
+        const size_t rows = one_row ? 1 : static_cast<size_t>(columns[0]->n);
+        for (size_t c = 0; !one_row && c < column_count; ++c)
+            if (columns[c]->t >= XT || static_cast<size_t>(columns[c]->n) != rows)
+                return res;
+
+        res.table = parts[1]->s;
+        res.columns = columns;
+        res.column_count = column_count;
+        res.one_row = one_row;
+        if (symbols.empty())
+            return res;
+
+        if (symbol_column >= column_count)
+            throw std::runtime_error(std::string("Journal update to ") + res.table + " has no column " + std::to_string(symbol_column) + " to filter symbols on");
+        ::K sym = columns[symbol_column];
+        if (sym->t != (one_row ? -KS : KS))
+            throw std::runtime_error(std::string("Journal update to ") + res.table + " has no symbols in column " + std::to_string(symbol_column));
+
+        res.all = false;
+        if (one_row)
+        {
+            if (symbols.count(sym->s))
+                res.rows.push_back(0);
+            return res;
+        }
+        char * const *syms = reinterpret_cast<char * const *>(sym->G0);
+        for (size_t i = 0; i < rows; ++i)
+            if (symbols.count(syms[i]))
+                res.rows.push_back(static_cast<uint32_t>(i));
+        return res;
+    }
+
+    MappedFile m_file;
+    std::vector<Entry> m_entries;
+    size_t m_valid_bytes = 0;
+    size_t m_skipped = 0;
+};
+
+}
@@ -0,0 +1,391 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <filesystem>
+#include <mutex>
+#include <stdexcept>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <kx/kx.h>
+
+#include "journal.h"
+
+namespace qbind
+{
+
+/**
+ * @brief When a JournalWriter makes writes durable.
+ */
+enum class SyncPolicy
+{
+    // Leave it to the kernel. Fastest, but a crash of the host can lose the
+    // last few seconds of messages.
+    None,
+    // fdatasync after every group commit.
+    EachCommit,
+    // fdatasync at most once per sync_interval, and within sync_interval of
+    // a commit.
+    Interval
+};
+
+struct JournalWriterOptions
+{
+    // Commit once this many bytes are staged...
+    size_t commit_bytes = 1 << 20;
+    // ...or once the oldest staged message has waited this long.
+    std::chrono::microseconds commit_interval{1000};
+    SyncPolicy sync = SyncPolicy::EachCommit;
+    std::chrono::milliseconds sync_interval{100};
+    // Publishers block in append while this many bytes are staged.
+    size_t max_staged_bytes = 64 << 20;
+};
+
+/**
+ * @brief Appends messages to a tickerplant journal, in the format
+ * JournalReader and -11! read.
+ *
+ * Messages are serialised on the calling thread and copied in to a staging
+ * buffer. A dedicated I/O thread takes the whole buffer at a time and writes
+ * it in one call (group commit), then syncs it as the SyncPolicy says, so
+ * publishers never wait on the disk unless the staging buffer fills up.
+ *
+ * Opening an existing journal appends to it, cutting off any torn message
+ * at its end first.
+ *
+ * Errors on the I/O thread are rethrown from the next append or flush.
+ */
+class JournalWriter
+{
+public:
+
+    explicit JournalWriter(const std::filesystem::path& path, JournalWriterOptions options = {})
+    : m_path(path)
+    , m_options(options)
+    {
+        size_t end = internal::journal_header_size;
+        const bool exists = std::filesystem::exists(path) && std::filesystem::file_size(path) != 0;
+        if (exists)
+        {
+            const JournalReader existing(path);
+            end = existing.valid_bytes();
+            m_existing = existing.size();
+        }
+
+        m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (m_fd == -1)
+            throw_errno("open");
+        if (!exists)
+            write_header();
+        if (::ftruncate(m_fd, static_cast<off_t>(end)) == -1 || ::lseek(m_fd, static_cast<off_t>(end), SEEK_SET) == -1)
+        {
+            const int err = errno;
+            ::close(m_fd);
+            throw std::runtime_error("ftruncate " + m_path.string() + ": " + strerror(err));
+        }
+        m_last_sync = std::chrono::steady_clock::now();
+        m_thread = std::thread([this] { run(); });
+    }
+
+    JournalWriter(const JournalWriter&) = delete;
+    JournalWriter& operator=(const JournalWriter&) = delete;
+
+    // Commits everything appended, syncing unless the policy is None, then
+    // stops the I/O thread.
+    ~JournalWriter()
+    {
+        {
+            std::lock_guard<std::mutex> lk(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+        m_thread.join();
+        ::close(m_fd);
+    }
+
+    /**
+     * @brief Append a message, e.g. (`upd;`trade;data).
+     */
+    void append(::K message)
+    {
+        ::K bytes = b9(3, message);
+        if (!bytes)
+            throw std::runtime_error("Failed to serialise journal message");
+        if (bytes->t == -128)
+        {
+            const std::string error = bytes->s ? bytes->s : "Failed to serialise journal message";
+            r0(bytes);
+            throw std::runtime_error(error);
+        }
+        try
+        {
+            append_serialised({reinterpret_cast<const char *>(bytes->G0) + internal::ipc_header_size, static_cast<size_t>(bytes->n) - internal::ipc_header_size});
+        }
+        catch (...)
+        {
+            r0(bytes);
+            throw;
+        }
+        r0(bytes);
+    }
+
+    /**
+     * @brief Append (`upd;`table;data), the message a tickerplant logs.
+     */
+    void upd(const char *table, ::K data)
+    {
+        ::K message = knk(3, ks(const_cast<char *>("upd")), ks(const_cast<char *>(table)), r1(data));
+        try
+        {
+            append(message);
+        }
+        catch (...)
+        {
+            r0(message);
+            throw;
+        }
+        r0(message);
+    }
+
+    /**
+     * @brief Append a message already serialised in the IPC format, without
+     * the message header. The bytes are copied.
+     */
+    void append_serialised(std::string_view bytes)
+    {
+        std::unique_lock<std::mutex> lk(m_mutex);
+        m_space.wait(lk, [&] { return m_error || m_staging.size() < m_options.max_staged_bytes; });
+        rethrow();
+
+        if (m_staging.empty())
+            m_oldest = std::chrono::steady_clock::now();
+        m_staging.insert(m_staging.end(), bytes.begin(), bytes.end());
+        ++m_appended;
+        if (m_staging.size() >= m_options.commit_bytes)
+            m_cv.notify_one();
+    }
+
+    /**
+     * @brief Block until every message appended so far is written, and
+     * synced unless the policy is None.
+     */
+    void flush()
+    {
+        std::unique_lock<std::mutex> lk(m_mutex);
+        const uint64_t target = m_appended;
+        m_flush_requested = std::max(m_flush_requested, target);
+        m_cv.notify_one();
+        m_done.wait(lk, [&] { return m_error || m_synced >= target; });
+        rethrow();
+    }
+
+    // Messages written and synced as the policy says, since opening.
+    size_t synced() const
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        return m_synced;
+    }
+
+    // Messages in the journal, including those not yet written.
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        return m_existing + m_appended;
+    }
+
+    const std::filesystem::path& path() const noexcept
+    {
+        return m_path;
+    }
+
+private:
+
+    // The I/O thread: wait for a commit or sync to be due, take the staged
+    // messages and write them outside the lock.
+    void run()
+    {
+        std::vector<char> batch;
+        for (;;)
+        {
+            uint64_t taken = 0;
+            bool write = false;
+            bool sync = false;
+            {
+                std::unique_lock<std::mutex> lk(m_mutex);
+                while (!m_stop && !commit_due() && !sync_due())
+                {
+                    const auto deadline = next_deadline();
+                    if (deadline == std::chrono::steady_clock::time_point::max())
+                        m_cv.wait(lk);
+                    else
+                        m_cv.wait_until(lk, deadline);
+                }
+                write = m_appended > m_committed;
+                if (!write && !sync_due())
+                    return;
+
+                if (write)
+                    batch.swap(m_staging);
+                taken = m_appended;
+                switch (m_options.sync)
+                {
+                    case SyncPolicy::None:
+                        sync = false;
+                        break;
+                    case SyncPolicy::EachCommit:
+                        sync = true;
+                        break;
+                    case SyncPolicy::Interval:
+                        sync = m_stop || m_flush_requested > m_synced
+                            || std::chrono::steady_clock::now() >= m_last_sync + m_options.sync_interval;
+                        break;
+                }
+            }
+            if (write)
+                m_space.notify_all();
+
+            try
+            {
+                if (write)
+                    commit(batch, m_existing + taken);
+                if (sync && ::fdatasync(m_fd) == -1)
+                    throw_errno("fdatasync");
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lk(m_mutex);
+                m_error = std::current_exception();
+                m_space.notify_all();
+                m_done.notify_all();
+                return;
+            }
+            batch.clear();
+
+            {
+                std::lock_guard<std::mutex> lk(m_mutex);
+                m_committed = taken;
+                if (sync || m_options.sync == SyncPolicy::None)
+                    m_synced = taken;
+                if (sync)
+                    m_last_sync = std::chrono::steady_clock::now();
+            }
+            m_done.notify_all();
+        }
+    }
+
+    // Under the lock.
+    bool commit_due() const
+    {
+        if (m_appended == m_committed)
+            return false;
+        return m_staging.size() >= m_options.commit_bytes
+            || m_flush_requested > m_committed
+            || std::chrono::steady_clock::now() >= m_oldest + m_options.commit_interval;
+    }
+
+    // Under the lock. Only Interval leaves committed messages unsynced.
+    bool sync_due() const
+    {
+        if (m_synced == m_committed)
+            return false;
+        return m_stop
+            || m_flush_requested > m_synced
+            || std::chrono::steady_clock::now() >= m_last_sync + m_options.sync_interval;
+    }
+
+    // Under the lock. When the I/O thread must wake without being notified.
+    std::chrono::steady_clock::time_point next_deadline() const
+    {
+        auto deadline = std::chrono::steady_clock::time_point::max();
+        if (m_appended > m_committed)
+            deadline = m_oldest + m_options.commit_interval;
+        if (m_synced < m_committed)
+            deadline = std::min(deadline, m_last_sync + m_options.sync_interval);
+        return deadline;
+    }
+
+    // Write a batch and the new count. Runs on the I/O thread only.
+    void commit(const std::vector<char>& batch, uint64_t count)
+    {
+        const char *p = batch.data();
+        size_t size = batch.size();
+        while (size != 0)
+        {
+            const auto n = ::write(m_fd, p, std::min(size, internal::max_write));
+            if (n == -1)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw_errno("write");
+            }
+            p += n;
+            size -= static_cast<size_t>(n);
+        }
+
+        // The header count is a 32 bit int, which readers don't rely on.
+        const auto n = static_cast<int32_t>(std::min<uint64_t>(count, INT32_MAX));
+        if (::pwrite(m_fd, &n, sizeof(n), 4) != sizeof(n))
+            throw_errno("pwrite");
+    }
+
+    void write_header()
+    {
+        const uint8_t header[internal::journal_header_size] = {internal::journal_marker, internal::journal_version};
+        if (::pwrite(m_fd, header, sizeof(header), 0) != sizeof(header))
+        {
+            const int err = errno;
+            ::close(m_fd);
+            throw std::runtime_error("write " + m_path.string() + ": " + strerror(err));
+        }
+    }
+
+    void rethrow() const
+    {
+        if (m_error)
+            std::rethrow_exception(m_error);
+    }
+
+    [[noreturn]] void throw_errno(const char *call) const
+    {
+        throw std::runtime_error(std::string(call) + " " + m_path.string() + ": " + strerror(errno));
+    }
+
+    std::filesystem::path m_path;
+    JournalWriterOptions m_options;
+    int m_fd = -1;
+    std::thread m_thread;
+
+    mutable std::mutex m_mutex;
+    // wakes the I/O thread
+    std::condition_variable m_cv;
+    // wakes publishers waiting for space
+    std::condition_variable m_space;
+    // wakes flushers
+    std::condition_variable m_done;
+    std::vector<char> m_staging;
+    std::chrono::steady_clock::time_point m_oldest;
+    std::chrono::steady_clock::time_point m_last_sync;
+    // messages in the journal when it was opened
+    uint64_t m_existing = 0;
+    // counts of messages since then
+    uint64_t m_appended = 0;
+    uint64_t m_committed = 0;
+    uint64_t m_synced = 0;
+    uint64_t m_flush_requested = 0;
+    bool m_stop = false;
+    std::exception_ptr m_error;
+};
+
+}
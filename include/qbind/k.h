@@ -1,6 +1,7 @@
 #pragma once
 
 #include <optional>
+#include <utility>
 #include <variant>
 
 #include <kx/kx.h>
@@ -18,6 +19,10 @@ namespace qbind
  * Implements memory functions:
  *  - V r0(K)
  *  - K r1(K).
+ *
+ * A borrowed K refers to an object kept alive by someone else, e.g. the
+ * arguments of a function called from q. It never decrements the reference
+ * count. Copies of a borrowed K own their reference, moves stay borrowed.
  */
 class K
 {
@@ -41,6 +46,14 @@ public:
         return K(_r1(k));
     }
 
+    // Make a borrowed K. k must outlive it.
+    static K make_borrowed(::K k) noexcept
+    {
+        K res(k);
+        res.m_borrowed = true;
+        return res;
+    }
+
     // Copy constructors
     K(const K& other) noexcept
     :m_k(_r1(other.m_k))
@@ -49,14 +62,17 @@ public:
     // Move constructors
     K(K&& other) noexcept
     :m_k(other.m_k)
+    ,m_borrowed(other.m_borrowed)
     {
         other.m_k = nullptr;
+        other.m_borrowed = false;
     }
 
     // Destructor
     ~K()
     {
-        _r0(m_k);
+        if (!m_borrowed)
+            _r0(m_k);
     }
 
     // Operator=
@@ -67,8 +83,10 @@ public:
         // If already the same internal pointer don't do anything
         if (this != &other && m_k != other.m_k)
         {
-            _r0(m_k);
+            if (!m_borrowed)
+                _r0(m_k);
             m_k = _r1(other.m_k);
+            m_borrowed = false;
         }
         return *this;
     }
@@ -78,9 +96,12 @@ public:
     {
         if (this != &other)
         {
-            _r0(m_k);
+            if (!m_borrowed)
+                _r0(m_k);
             m_k = other.m_k;
+            m_borrowed = other.m_borrowed;
             other.m_k = nullptr;
+            other.m_borrowed = false;
         }
         return *this;
     }
@@ -91,9 +112,8 @@ public:
     // length invariant is broken.
     void swap(K& other) noexcept
     {
-        auto tmp = m_k;
-        m_k = other.m_k;
-        other.m_k = tmp;
+        std::swap(m_k, other.m_k);
+        std::swap(m_borrowed, other.m_borrowed);
     }
 
     // Reference counting starts and begins at 0. So should
@@ -111,6 +131,12 @@ public:
         return m_k != nullptr;
     }
 
+    // type code of the underlying object, 0 if empty
+    signed char type() const noexcept
+    {
+        return m_k ? m_k->t : 0;
+    }
+
     // size: 1 if atom else size
     size_t size() const noexcept
     {
@@ -196,10 +222,11 @@ public:
     }
 
     // Appending
-    // TODO: Check what these functions do to lhs, rhs and returned reference count.
+    // ja, jv and jk grow the object in place and may move it. Only a sole owner
+    // can allow that, so a borrowed or shared object is copied first.
 
     template<Type T>
-    void join_atom(typename internal::c_type<T>::Underlier value)
+    void join_atom(typename internal::c_type<T>::underlier value)
     {
         if (!m_k)
             throw std::runtime_error("Cannot append to null");
@@ -210,8 +237,12 @@ public:
             ss << "Array is not vector of " << T;
             throw std::runtime_error(ss.str());
         }
-        // Intern symbols and use js, else use ja with void*
-        m_k = T == Type::Symbol ? js(&m_k, ss(value)) : ja(&m_k, &value);
+        make_unique();
+        // Intern symbols (through the thread local cache) and use js, else use ja with void*
+        if constexpr (T == Type::Symbol)
+            m_k = js(&m_k, internal::intern{}(value));
+        else
+            m_k = ja(&m_k, &value);
     }
 
     // Append a K list y to K list x. Both lists must be of the same type.
@@ -223,6 +254,7 @@ public:
             throw std::runtime_error("Cannot append null");
         if (m_k->t != k.m_k->t || m_k->t < 0)
             throw std::runtime_error("Can only join list on to list");
+        make_unique();
         m_k = jv(&m_k, k.m_k);
     }
 
@@ -235,6 +267,7 @@ public:
             throw std::runtime_error("Cannot append null");
         if (m_k->t != 0 || k.m_k->t < 0)
             throw std::runtime_error("Can only append tuple to tuple");
+        make_unique();
         // Takes ownership of a reference to its argument y.
         // We use r1 to ensure everything maintains ownership.
         m_k = jk(&m_k, _r1(k.m_k));
@@ -254,11 +287,24 @@ public:
      */
     ::K release() noexcept
     {
-        auto temp = m_k;
+        // A borrowed reference isn't ours to give away, so take one first.
+        auto temp = m_borrowed ? _r1(m_k) : m_k;
         m_k = nullptr;
+        m_borrowed = false;
         return temp;
     }
 
+    bool borrowed() const noexcept
+    {
+        return m_borrowed;
+    }
+
+    // The underlying object, still owned by this K.
+    ::K get() const noexcept
+    {
+        return m_k;
+    }
+
     bool operator==(const K& rhs) const
     {
         return equal(m_k, rhs.m_k);
@@ -322,6 +368,7 @@ private:
             case KS: // Symbol
             case 0:  // Mixed
                 byte_size = sizeof(lhs); // ptr size
+                break;
             default:
                 throw std::logic_error("Unaccounted for type in checking K equals");
         };
@@ -361,6 +408,20 @@ private:
         return true;
     }
 
+    // Become the sole owner of a list, copying it unless already the only reference.
+    void make_unique()
+    {
+        if (!m_borrowed && m_k->r == 0)
+            return;
+        // jv takes a reference to each item of a mixed list
+        ::K copy = ktn(m_k->t, 0);
+        copy = jv(&copy, m_k);
+        if (!m_borrowed)
+            r0(m_k);
+        m_k = copy;
+        m_borrowed = false;
+    }
+
     void* data() const noexcept
     {
         return m_k ? (
@@ -467,6 +528,13 @@ private:
         {
             return Type::template dictionary_type_match(entry);
         }
+        else if constexpr (std::is_same_v<Type, EnumVector>)
+        {
+            if (20 <= entry->t && entry->t <= 76)
+                return std::nullopt;
+            return "Types did not match at depth " + std::to_string(Depth) + " index " + std::to_string(Idx) +
+                   ". Expected Enum but found type " + std::to_string(entry->t);
+        }
         // If atom/vector/nested vector
         else if constexpr (internal::is_instance_type<Type, NestedVector>::value || 
                       internal::is_instance_type<Type, Vector>::value ||
@@ -582,6 +650,7 @@ private:
 private:
 
     ::K m_k;
+    bool m_borrowed = false;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <filesystem>
+#include <stdexcept>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <utility>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace qbind
+{
+
+namespace internal
+{
+
+// Linux transfers at most this many bytes in one read or write.
+constexpr size_t max_write = 0x7ffff000;
+
+}
+
+/**
+ * @brief A whole file mapped in to memory.
+ *
+ * The mapping is private and writable: writes are never carried through to
+ * the file, but stay local to the pages they touch. That allows K headers in
+ * the mapping to be reference counted like any other K object.
+ *
+ * Empty files map to nullptr with size 0.
+ */
+class MappedFile
+{
+public:
+
+    MappedFile() noexcept = default;
+
+    explicit MappedFile(const std::filesystem::path& path)
+    : m_path(path)
+    {
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+            throw std::runtime_error("open " + path.string() + ": " + strerror(errno));
+
+        struct stat st;
+        if (::fstat(fd, &st) == -1)
+        {
+            const int err = errno;
+            ::close(fd);
+            throw std::runtime_error("fstat " + path.string() + ": " + strerror(err));
+        }
+        m_size = static_cast<size_t>(st.st_size);
+
+        if (m_size != 0)
+        {
+            void *addr = ::mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED)
+            {
+                const int err = errno;
+                ::close(fd);
+                throw std::runtime_error("mmap " + path.string() + ": " + strerror(err));
+            }
+            m_data = static_cast<uint8_t *>(addr);
+        }
+        // The mapping holds its own reference to the file.
+        ::close(fd);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept
+    : m_path(std::move(other.m_path))
+    , m_data(std::exchange(other.m_data, nullptr))
+    , m_size(std::exchange(other.m_size, 0))
+    { }
+
+    MappedFile& operator=(MappedFile&& other) noexcept
+    {
+        if (this != &other)
+        {
+            unmap();
+            m_path = std::move(other.m_path);
+            m_data = std::exchange(other.m_data, nullptr);
+            m_size = std::exchange(other.m_size, 0);
+        }
+        return *this;
+    }
+
+    ~MappedFile()
+    {
+        unmap();
+    }
+
+    uint8_t *data() const noexcept
+    {
+        return m_data;
+    }
+
+    size_t size() const noexcept
+    {
+        return m_size;
+    }
+
+    const std::filesystem::path& path() const noexcept
+    {
+        return m_path;
+    }
+
+    /**
+     * @brief Tell the kernel how the mapping will be read, e.g.
+     * MADV_SEQUENTIAL for scans so it reads ahead aggressively.
+     */
+    void advise(int advice) const
+    {
+        if (m_data && ::madvise(m_data, m_size, advice) == -1)
+            throw std::runtime_error("madvise " + m_path.string() + ": " + strerror(errno));
+    }
+
+private:
+
+    void unmap() noexcept
+    {
+        if (m_data)
+            ::munmap(m_data, m_size);
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    std::filesystem::path m_path;
+    uint8_t *m_data = nullptr;
+    size_t m_size = 0;
+};
+
+}
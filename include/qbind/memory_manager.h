@@ -66,13 +66,9 @@ private:
         // std::cout << "Constructed " << m_active_managers << " manager" << std::endl;
     }
 
-    static std::unique_ptr<std::thread::id> m_main_thread;
-    static size_t m_active_managers;
-    static std::mutex m_mutex;
+    static inline std::unique_ptr<std::thread::id> m_main_thread;
+    static inline size_t m_active_managers;
+    static inline std::mutex m_mutex;
 };
 
-std::unique_ptr<std::thread::id> MemoryManager::m_main_thread;
-size_t MemoryManager::m_active_managers;
-std::mutex MemoryManager::m_mutex;
-
 } // qbind
@@ -159,7 +159,7 @@ public:
     {
         if (!m_ptr.is<Vector<T>>())
             throw std::runtime_error("Nested vector is not flat, cannot append underlier.");
-        m_ptr.join_atom(to_underlier(value));
+        m_ptr.template join_atom<T>(to_underlier(value));
     }
 
     // Add atom if root of nested vector is tuple
@@ -204,7 +204,7 @@ public:
 
 private:
 
-    static constexpr typename internal::c_type<T>::to_underlier to_underlier;
+    static constexpr typename internal::c_type<T>::to_underlier to_underlier{};
 
     K m_ptr;
 
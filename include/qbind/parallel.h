@@ -0,0 +1,199 @@
+#pragma once
+
+#include <stdint.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <kx/kx.h>
+
+#include "k.h"
+#include "symbol.h"
+#include "thread_pool.h"
+#include "type.h"
+#include "vector.h"
+
+namespace qbind::parallel
+{
+
+/**
+ * Parallel algorithms over Vectors.
+ *
+ * Work is split in to chunks of grain elements and run on a ThreadPool, with
+ * the calling thread taking part. Results are allocated once, up front, on the
+ * calling thread and workers only write in to them, so no K objects cross
+ * threads.
+ *
+ * Elements are passed to functions as the Vector's value type (string_view
+ * for symbols). Symbols produced by a function are interned on the worker,
+ * which the MemoryManager makes safe by turning on the symbol lock (setm)
+ * once more than one thread has kdb memory.
+ */
+
+constexpr size_t default_grain = 1 << 14;
+
+namespace internal
+{
+
+template<Type T>
+const typename qbind::internal::c_type<T>::underlier *input(const Vector<T>& vec)
+{
+    return vec.get().template data<typename qbind::internal::c_type<T>::underlier>();
+}
+
+}
+
+/**
+ * @brief out[i] = f(in[i]) in to a new vector of type R.
+ */
+template<Type R, Type T, class F>
+Vector<R> transform(const Vector<T>& in, F f, size_t grain = default_grain, ThreadPool& pool = ThreadPool::instance())
+{
+    using out_type = typename qbind::internal::c_type<R>::underlier;
+
+    const size_t n = in.size();
+    K res{ktn(static_cast<signed char>(R), static_cast<int64_t>(n))};
+    const auto *src = internal::input(in);
+    out_type *dst = res.data<out_type>();
+
+    pool.parallel_for(0, n, grain, [&](size_t first, size_t last)
+    {
+        for (size_t i = first; i < last; ++i)
+        {
+            if constexpr (R == Type::Symbol)
+                dst[i] = qbind::internal::intern{}(f(typename Vector<T>::value(src[i])));
+            else
+                dst[i] = static_cast<out_type>(f(typename Vector<T>::value(src[i])));
+        }
+    });
+    return Vector<R>(std::move(res));
+}
+
+/**
+ * @brief Fold the vector with op, an associative operation with identity
+ * init. Chunks are reduced in parallel then combined in order.
+ *
+ * Each chunk is folded with op(Acc, value) and the chunk results are
+ * combined with combine(Acc, Acc).
+ */
+template<Type T, class Acc, class Op, class Combine>
+requires std::is_invocable_r_v<Acc, Combine&, Acc, Acc>
+Acc reduce(const Vector<T>& in, Acc init, Op op, Combine combine, size_t grain = default_grain, ThreadPool& pool = ThreadPool::instance())
+{
+    const size_t n = in.size();
+    if (n == 0)
+        return init;
+    if (grain == 0)
+        grain = 1;
+
+    const auto *src = internal::input(in);
+    std::vector<Acc> partial((n + grain - 1) / grain, init);
+    pool.parallel_for(0, n, grain, [&](size_t first, size_t last)
+    {
+        Acc acc = init;
+        for (size_t i = first; i < last; ++i)
+            acc = op(acc, typename Vector<T>::value(src[i]));
+        partial[first / grain] = acc;
+    });
+
+    Acc res = init;
+    for (const auto& acc : partial)
+        res = combine(res, acc);
+    return res;
+}
+
+/**
+ * @brief reduce where op also combines the chunk results, so must take
+ * (Acc, value) and (Acc, Acc), e.g. a sum where both are numbers.
+ */
+template<Type T, class Acc, class Op>
+Acc reduce(const Vector<T>& in, Acc init, Op op, size_t grain = default_grain, ThreadPool& pool = ThreadPool::instance())
+{
+    static_assert(std::is_invocable_r_v<Acc, Op&, Acc, Acc>,
+        "op must also combine two accumulators, op(Acc, Acc), else pass a separate combine");
+    return reduce(in, std::move(init), op, op, grain, pool);
+}
+
+/**
+ * @brief Inclusive scan with op, an associative operation with identity
+ * init. Two passes: chunk totals in parallel, then each chunk is scanned from
+ * the total of those before it.
+ */
+template<Type T, class Op>
+Vector<T> inclusive_scan(const Vector<T>& in, Op op, typename Vector<T>::value init, size_t grain = default_grain, ThreadPool& pool = ThreadPool::instance())
+{
+    static_assert(T != Type::Symbol, "Can't scan symbols");
+    using underlier = typename qbind::internal::c_type<T>::underlier;
+
+    const size_t n = in.size();
+    K res{ktn(static_cast<signed char>(T), static_cast<int64_t>(n))};
+    if (n == 0)
+        return Vector<T>(std::move(res));
+    if (grain == 0)
+        grain = 1;
+
+    const underlier *src = internal::input(in);
+    underlier *dst = res.data<underlier>();
+
+    std::vector<underlier> offset((n + grain - 1) / grain, init);
+    pool.parallel_for(0, n, grain, [&](size_t first, size_t last)
+    {
+        underlier acc = init;
+        for (size_t i = first; i < last; ++i)
+            acc = op(acc, src[i]);
+        offset[first / grain] = acc;
+    });
+
+    // exclusive scan of the chunk totals
+    underlier running = init;
+    for (auto& acc : offset)
+        running = op(running, std::exchange(acc, running));
+
+    pool.parallel_for(0, n, grain, [&](size_t first, size_t last)
+    {
+        underlier acc = offset[first / grain];
+        for (size_t i = first; i < last; ++i)
+            dst[i] = acc = op(acc, src[i]);
+    });
+    return Vector<T>(std::move(res));
+}
+
+template<Type T, class Pred>
+size_t count_if(const Vector<T>& in, Pred pred, size_t grain = default_grain, ThreadPool& pool = ThreadPool::instance())
+{
+    const size_t n = in.size();
+    if (grain == 0)
+        grain = 1;
+
+    const auto *src = internal::input(in);
+    std::vector<size_t> partial((n + grain - 1) / grain, 0);
+    pool.parallel_for(0, n, grain, [&](size_t first, size_t last)
+    {
+        size_t count = 0;
+        for (size_t i = first; i < last; ++i)
+            count += pred(typename Vector<T>::value(src[i])) ? 1 : 0;
+        partial[first / grain] = count;
+    });
+
+    size_t res = 0;
+    for (auto count : partial)
+        res += count;
+    return res;
+}
+
+/**
+ * @brief Call f on each element. Order is unspecified so f must be safe to
+ * call concurrently. To write results use transform.
+ */
+template<Type T, class F>
+void for_each(const Vector<T>& in, F f, size_t grain = default_grain, ThreadPool& pool = ThreadPool::instance())
+{
+    const auto *src = internal::input(in);
+    pool.parallel_for(0, in.size(), grain, [&](size_t first, size_t last)
+    {
+        for (size_t i = first; i < last; ++i)
+            f(typename Vector<T>::value(src[i]));
+    });
+}
+
+}
@@ -0,0 +1,428 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <kx/kx.h>
+
+#include "enum_vector.h"
+#include "k.h"
+#include "mapped_file.h"
+#include "type.h"
+#include "utils.h"
+#include "vector.h"
+
+namespace qbind
+{
+
+namespace internal
+{
+
+// kdb+ 3.x files lead with a K header: a marker byte, the file version, type,
+// attribute, 4 unused bytes (where the reference count sits) and the count.
+// The data follows, so a mapped header can be used as a K object directly.
+constexpr uint8_t disk_vector_marker = 0xfe;
+constexpr uint8_t disk_enum_marker = 0xfd;
+constexpr uint8_t disk_version = 0x20;
+constexpr size_t disk_header_size = 16;
+// Enumerations lead with the name of their domain. The vector header is on
+// the next page so the data stays page aligned.
+constexpr size_t disk_enum_name_offset = 8;
+constexpr size_t disk_enum_offset = 4096;
+// Objects q can't map, such as the symbol vectors in a sym or .d file, are
+// written as a marker, a version, then the object as sent over IPC: type,
+// attribute and a 4 byte count, then the data.
+constexpr uint8_t disk_object_marker = 0xff;
+constexpr uint8_t disk_object_version = 0x01;
+constexpr size_t disk_object_header_size = 8;
+// Nested columns are typed 77 plus the item type. The file holds the end
+// offset of each row in to the items, which are in the file named with a #.
+constexpr signed char disk_nested_base = 77;
+
+// Width of an element on disk, 0 if not fixed width.
+inline size_t disk_width(signed char t) noexcept
+{
+    switch (t)
+    {
+        case KB: case KG: case KC:          return 1;
+        case UU:                            return 16;
+        case KH:                            return 2;
+        case KI: case KE: case KM: case KD:
+        case KU: case KV: case KT:          return 4;
+        case KJ: case KF: case KP: case KZ:
+        case KN:                            return 8;
+        default:
+            return 20 <= t && t <= 76 ? sizeof(EnumVector::index) : 0;
+    }
+}
+
+[[noreturn]] inline void throw_bad_file(const MappedFile& file, const std::string& reason)
+{
+    throw std::runtime_error(file.path().string() + ": " + reason);
+}
+
+/**
+ * @brief Check the header of a mapped vector file and return it as a K
+ * object. Enumerations are found past their domain name.
+ */
+inline ::K disk_vector(const MappedFile& file)
+{
+    const uint8_t *base = file.data();
+    if (file.size() >= 8 && memcmp(base, "kxzipped", 8) == 0)
+        throw_bad_file(file, "compressed files are not supported");
+    if (file.size() < disk_header_size)
+        throw_bad_file(file, "too small for a header");
+    if ((base[0] != disk_vector_marker && base[0] != disk_enum_marker) || base[1] != disk_version)
+        throw_bad_file(file, "not a kdb+ 3 vector file");
+
+    size_t offset = 0;
+    if (base[0] == disk_enum_marker)
+    {
+        offset = disk_enum_offset;
+        if (file.size() < offset + disk_header_size)
+            throw_bad_file(file, "too small for an enumeration header");
+    }
+
+    ::K k = reinterpret_cast<::K>(const_cast<uint8_t *>(base + offset));
+    if (k->n < 0)
+        throw_bad_file(file, "negative count");
+    const bool nested = disk_nested_base < k->t && k->t < disk_nested_base + 20;
+    const size_t width = nested ? sizeof(int64_t) : disk_width(k->t);
+    if (width == 0)
+        throw_bad_file(file, "unsupported type " + std::to_string(k->t));
+    if ((file.size() - offset - disk_header_size) / width < static_cast<size_t>(k->n))
+        throw_bad_file(file, "truncated, header count is " + std::to_string(k->n));
+    return k;
+}
+
+}
+
+/**
+ * @brief Read a symbol vector file, e.g. a database's sym file or a table's
+ * .d file, interning its symbols.
+ */
+inline Vector<Type::Symbol> load_symbols(const std::filesystem::path& path)
+{
+    MappedFile file(path);
+    const uint8_t *base = file.data();
+    if (file.size() >= 8 && memcmp(base, "kxzipped", 8) == 0)
+        internal::throw_bad_file(file, "compressed files are not supported");
+    if (file.size() < internal::disk_object_header_size)
+        internal::throw_bad_file(file, "too small for a header");
+    if (base[0] != internal::disk_object_marker || base[1] != internal::disk_object_version)
+        internal::throw_bad_file(file, "not a kdb+ serialised object");
+    const auto t = static_cast<signed char>(base[2]);
+    if (t != KS)
+        internal::throw_bad_file(file, "expected a symbol vector, found type " + std::to_string(t));
+    int32_t count;
+    memcpy(&count, base + 4, sizeof(count));
+    if (count < 0)
+        internal::throw_bad_file(file, "negative count");
+
+    const size_t n = static_cast<size_t>(count);
+    const char *p = reinterpret_cast<const char *>(base + internal::disk_object_header_size);
+    const char *end = reinterpret_cast<const char *>(file.data() + file.size());
+
+    K res{ktn(KS, static_cast<int64_t>(n))};
+    char **out = res.data<char *>();
+    for (size_t i = 0; i < n; ++i)
+    {
+        const void *nul = memchr(p, '\0', static_cast<size_t>(end - p));
+        if (!nul)
+            internal::throw_bad_file(file, "truncated at symbol " + std::to_string(i));
+        const auto len = static_cast<const char *>(nul) - p;
+        // The symbols are distinct, so sn directly rather than through the cache.
+        out[i] = sn(const_cast<char *>(p), static_cast<I>(len));
+        p += len + 1;
+    }
+    return Vector<Type::Symbol>(std::move(res));
+}
+
+/**
+ * @brief Read only view over a mapped nested column. Rows are spans over the
+ * mapped items.
+ */
+template<Type T>
+class NestedColumn
+{
+public:
+
+    static_assert(T != Type::Symbol, "Nested symbol columns are not supported");
+
+    using underlier = typename internal::c_type<T>::underlier;
+
+    NestedColumn(const int64_t *ends, size_t rows, const underlier *items, size_t item_count) noexcept
+    : m_ends(ends)
+    , m_rows(rows)
+    , m_items(items)
+    , m_item_count(item_count)
+    { }
+
+    std::span<const underlier> operator[](size_t pos) const noexcept
+    {
+        const auto first = pos ? m_ends[pos - 1] : 0;
+        return {m_items + first, static_cast<size_t>(m_ends[pos] - first)};
+    }
+
+    std::span<const underlier> at(size_t pos) const
+    {
+        if (pos >= m_rows)
+            throw std::out_of_range("Attempted to access index " + std::to_string(pos) + " but length is " + std::to_string(m_rows));
+        const auto first = pos ? m_ends[pos - 1] : 0;
+        if (first < 0 || m_ends[pos] < first || static_cast<size_t>(m_ends[pos]) > m_item_count)
+            throw std::out_of_range("Row " + std::to_string(pos) + " lies outside the column's items");
+        return (*this)[pos];
+    }
+
+    size_t size() const noexcept
+    {
+        return m_rows;
+    }
+
+    bool empty() const noexcept
+    {
+        return m_rows == 0;
+    }
+
+    // All rows' items back to back, for scans which don't need the rows.
+    std::span<const underlier> items() const noexcept
+    {
+        return {m_items, m_item_count};
+    }
+
+private:
+    const int64_t *m_ends;
+    size_t m_rows;
+    const underlier *m_items;
+    size_t m_item_count;
+};
+
+/**
+ * @brief Read only view over a splayed table on disk, e.g. a table in an HDB
+ * partition.
+ *
+ * Column files are mapped rather than read, so nothing is copied and pages
+ * are brought in by the kernel as they're touched. Columns come out as
+ * qbind objects over the mapping:
+ *  - fixed width columns as Vector<T>,
+ *  - enumerated symbol columns as EnumVector against the database's sym,
+ *  - nested columns (with their # file) as NestedColumn<T>.
+ *
+ * Headers are checked on open: version, type, and that each file holds as
+ * many elements as its header says. Compressed columns aren't supported.
+ *
+ * Columns are only valid while the table is, and must not be handed to q or
+ * modified. The mapping is private, so reference counting them is fine.
+ */
+class SplayedTable
+{
+public:
+
+    /**
+     * @brief Open the table in dir. If it has enumerated columns the sym
+     * file is loaded from the nearest parent directory which has one, the
+     * database root for both splayed and partitioned tables.
+     */
+    explicit SplayedTable(const std::filesystem::path& dir)
+    {
+        open(dir);
+        if (has_enumerations())
+            m_domain = load_symbols(find_sym(dir));
+    }
+
+    /**
+     * @brief Open the table in dir enumerated against domain. Use this to
+     * share one domain across the partitions of a database.
+     */
+    SplayedTable(const std::filesystem::path& dir, Vector<Type::Symbol> domain)
+    : m_domain(std::move(domain))
+    {
+        open(dir);
+    }
+
+    SplayedTable(const SplayedTable&) = delete;
+    SplayedTable& operator=(const SplayedTable&) = delete;
+    SplayedTable(SplayedTable&&) = default;
+    SplayedTable& operator=(SplayedTable&&) = default;
+
+    // Column names in .d order
+    const std::vector<std::string>& columns() const noexcept
+    {
+        return m_names;
+    }
+
+    bool contains(std::string_view name) const noexcept
+    {
+        for (const auto& col : m_columns)
+            if (col.name == name)
+                return true;
+        return false;
+    }
+
+    // Number of rows
+    size_t size() const noexcept
+    {
+        return m_rows;
+    }
+
+    /**
+     * @brief Type of a column as on disk: 1 to 19 for fixed width, 20 to 76
+     * for enumerations, 77 plus the item type for nested columns.
+     */
+    signed char type(std::string_view name) const
+    {
+        return find(name).header->t;
+    }
+
+    // Attribute of a column: 0 none, 1 s, 2 u, 3 p, 4 g.
+    int attribute(std::string_view name) const
+    {
+        return find(name).header->u;
+    }
+
+    template<Type T>
+    Vector<T> column(std::string_view name) const
+    {
+        const auto& col = find(name);
+        if (col.header->t != static_cast<signed char>(T))
+            throw_column_type(col, static_cast<signed char>(T));
+        return Vector<T>(K::make_borrowed(col.header), internal::unchecked);
+    }
+
+    EnumVector enumerated(std::string_view name) const
+    {
+        const auto& col = find(name);
+        if (col.header->t < 20 || 76 < col.header->t)
+            throw_column_type(col, 20);
+        if (!m_domain)
+            throw std::runtime_error("No sym domain for enumerated column " + col.name);
+        return EnumVector(K::make_borrowed(col.header), *m_domain);
+    }
+
+    template<Type T>
+    NestedColumn<T> nested(std::string_view name) const
+    {
+        using underlier = typename internal::c_type<T>::underlier;
+        const auto& col = find(name);
+        if (col.header->t != internal::disk_nested_base + static_cast<signed char>(T))
+            throw_column_type(col, internal::disk_nested_base + static_cast<signed char>(T));
+
+        const auto *ends = reinterpret_cast<const int64_t *>(col.header->G0);
+        const size_t rows = static_cast<size_t>(col.header->n);
+        const size_t item_count = static_cast<size_t>(col.items->n);
+        if (rows && (ends[rows - 1] < 0 || static_cast<size_t>(ends[rows - 1]) > item_count))
+            throw std::runtime_error("Nested column " + col.name + " ends past its " + std::to_string(item_count) + " items");
+        return {ends, rows, reinterpret_cast<const underlier *>(col.items->G0), item_count};
+    }
+
+    // Domain enumerated columns resolve against, if any.
+    const std::optional<Vector<Type::Symbol>>& domain() const noexcept
+    {
+        return m_domain;
+    }
+
+    /**
+     * @brief Advise the kernel how every column will be read, e.g.
+     * MADV_SEQUENTIAL before a full scan or MADV_WILLNEED to prefetch.
+     */
+    void advise(int advice) const
+    {
+        for (const auto& col : m_columns)
+        {
+            col.file.advise(advice);
+            col.items_file.advise(advice);
+        }
+    }
+
+private:
+
+    struct Column
+    {
+        std::string name;
+        MappedFile file;
+        MappedFile items_file;
+        ::K header = nullptr;
+        ::K items = nullptr;
+    };
+
+    void open(const std::filesystem::path& dir)
+    {
+        const auto names = load_symbols(dir / ".d");
+        for (size_t i = 0; i < names.size(); ++i)
+            m_names.emplace_back(static_cast<const char *>(names[i]));
+
+        m_columns.reserve(m_names.size());
+        for (const auto& name : m_names)
+        {
+            Column col;
+            col.name = name;
+            col.file = MappedFile(dir / name);
+            col.header = internal::disk_vector(col.file);
+            const auto t = col.header->t;
+            if (t == KS)
+                internal::throw_bad_file(col.file, "symbol columns must be enumerated");
+            if (t > internal::disk_nested_base)
+            {
+                col.items_file = MappedFile(dir / (name + "#"));
+                col.items = internal::disk_vector(col.items_file);
+                if (col.items->t != t - internal::disk_nested_base)
+                    internal::throw_bad_file(col.items_file, "item type " + std::to_string(col.items->t) + " does not match column type " + std::to_string(t));
+            }
+
+            const auto rows = static_cast<size_t>(col.header->n);
+            if (!m_columns.empty() && rows != m_rows)
+                internal::throw_bad_file(col.file, "has " + std::to_string(rows) + " rows, expected " + std::to_string(m_rows));
+            m_rows = rows;
+            m_columns.push_back(std::move(col));
+        }
+    }
+
+    bool has_enumerations() const noexcept
+    {
+        for (const auto& col : m_columns)
+            if (20 <= col.header->t && col.header->t <= 76)
+                return true;
+        return false;
+    }
+
+    static std::filesystem::path find_sym(const std::filesystem::path& dir)
+    {
+        auto p = std::filesystem::absolute(dir);
+        if (!p.has_filename())
+            p = p.parent_path();
+        for (; p.has_relative_path(); p = p.parent_path())
+        {
+            const auto sym = p.parent_path() / "sym";
+            if (std::filesystem::is_regular_file(sym))
+                return sym;
+        }
+        throw std::runtime_error("No sym file found above " + dir.string());
+    }
+
+    const Column& find(std::string_view name) const
+    {
+        for (const auto& col : m_columns)
+            if (col.name == name)
+                return col;
+        throw std::out_of_range("No column " + std::string(name));
+    }
+
+    [[noreturn]] static void throw_column_type(const Column& col, int expected)
+    {
+        throw std::runtime_error("Column " + col.name + " has type " + std::to_string(col.header->t) + ", expected " + std::to_string(expected));
+    }
+
+    std::vector<std::string> m_names;
+    std::vector<Column> m_columns;
+    size_t m_rows = 0;
+    std::optional<Vector<Type::Symbol>> m_domain;
+};
+
+}
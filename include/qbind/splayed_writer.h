@@ -0,0 +1,599 @@
+#pragma once
+
+#include <algorithm>
+#include <filesystem>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <kx/kx.h>
+
+#include "enum_vector.h"
+#include "k.h"
+#include "splayed.h"
+#include "string_column.h"
+#include "thread_pool.h"
+#include "type.h"
+#include "vector.h"
+
+namespace qbind
+{
+
+namespace internal
+{
+
+/**
+ * @brief Buffered writer over a file. Small writes are gathered in to the
+ * buffer and large ones go straight to the file, so files go out in a few
+ * large sequential writes whatever the shape of the data.
+ */
+class FileWriter
+{
+public:
+
+    // Create or truncate path.
+    FileWriter(const std::filesystem::path& path, size_t buffer_size)
+    : m_path(path)
+    {
+        open(O_TRUNC, buffer_size);
+    }
+
+    // Open path, creating it if need be, and write from offset on. Anything
+    // past where writing stops is cut off on close.
+    FileWriter(const std::filesystem::path& path, size_t buffer_size, off_t offset)
+    : m_path(path)
+    {
+        open(0, buffer_size);
+        if (::lseek(m_fd, offset, SEEK_SET) == -1)
+            throw_errno("lseek");
+        m_offset = offset;
+    }
+
+    FileWriter(const FileWriter&) = delete;
+    FileWriter& operator=(const FileWriter&) = delete;
+
+    ~FileWriter()
+    {
+        if (m_fd != -1)
+            ::close(m_fd);
+    }
+
+    /**
+     * @brief Reserve size bytes up front so the file system can allocate
+     * the file in one extent. Ignored where the file system can't.
+     */
+    void preallocate(size_t size)
+    {
+        if (size != 0 && ::fallocate(m_fd, 0, 0, static_cast<off_t>(size)) == -1 && errno != EOPNOTSUPP)
+            throw_errno("fallocate");
+    }
+
+    void write(const void *data, size_t size)
+    {
+        if (m_buffer.size() + size <= m_buffer.capacity())
+        {
+            append(data, size);
+            return;
+        }
+        flush();
+        if (size < m_buffer.capacity())
+            append(data, size);
+        else
+            write_all(data, size);
+    }
+
+    // Overwrite bytes already written, e.g. a header count.
+    void write_at(off_t offset, const void *data, size_t size)
+    {
+        flush();
+        if (::pwrite(m_fd, data, size, offset) != static_cast<ssize_t>(size))
+            throw_errno("pwrite");
+    }
+
+    // Offset the next write goes to.
+    off_t offset() const noexcept
+    {
+        return m_offset + static_cast<off_t>(m_buffer.size());
+    }
+
+    void close()
+    {
+        flush();
+        if (::ftruncate(m_fd, m_offset) == -1)
+            throw_errno("ftruncate");
+        if (::close(std::exchange(m_fd, -1)) == -1)
+            throw_errno("close");
+    }
+
+private:
+
+    void open(int flags, size_t buffer_size)
+    {
+        m_fd = ::open(m_path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | flags, 0644);
+        if (m_fd == -1)
+            throw_errno("open");
+        m_buffer.reserve(buffer_size);
+    }
+
+    void append(const void *data, size_t size)
+    {
+        const auto *p = static_cast<const char *>(data);
+        m_buffer.insert(m_buffer.end(), p, p + size);
+    }
+
+    void flush()
+    {
+        write_all(m_buffer.data(), m_buffer.size());
+        m_buffer.clear();
+    }
+
+    void write_all(const void *data, size_t size)
+    {
+        const auto *p = static_cast<const char *>(data);
+        while (size != 0)
+        {
+            const auto n = ::write(m_fd, p, std::min(size, max_write));
+            if (n == -1)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw_errno("write");
+            }
+            p += n;
+            size -= static_cast<size_t>(n);
+            m_offset += n;
+        }
+    }
+
+    [[noreturn]] void throw_errno(const char *call) const
+    {
+        throw std::runtime_error(std::string(call) + " " + m_path.string() + ": " + strerror(errno));
+    }
+
+    std::filesystem::path m_path;
+    int m_fd = -1;
+    off_t m_offset = 0;
+    std::vector<char> m_buffer;
+};
+
+inline void write_disk_header(FileWriter& out, uint8_t marker, signed char t, uint8_t attr, int64_t n)
+{
+    uint8_t head[disk_header_size] = {marker, disk_version, static_cast<uint8_t>(t), attr};
+    memcpy(head + 8, &n, sizeof(n));
+    out.write(head, sizeof(head));
+}
+
+// The count of a serialised object, which q holds in 4 bytes.
+inline int32_t object_count(const std::filesystem::path& path, size_t n)
+{
+    if (n > static_cast<size_t>(std::numeric_limits<int32_t>::max()))
+        throw std::runtime_error(path.string() + ": too many symbols, " + std::to_string(n));
+    return static_cast<int32_t>(n);
+}
+
+inline void write_object_header(FileWriter& out, signed char t, int32_t n)
+{
+    uint8_t head[disk_object_header_size] = {disk_object_marker, disk_object_version, static_cast<uint8_t>(t), 0};
+    memcpy(head + 4, &n, sizeof(n));
+    out.write(head, sizeof(head));
+}
+
+inline void write_symbol_file(const std::filesystem::path& path, const std::vector<std::string>& values, size_t buffer_size)
+{
+    const int32_t n = object_count(path, values.size());
+    FileWriter out(path, buffer_size);
+    write_object_header(out, KS, n);
+    for (const auto& value : values)
+        out.write(value.c_str(), value.size() + 1);
+    out.close();
+}
+
+}
+
+/**
+ * @brief A database's sym file, opened to enumerate against.
+ *
+ * Like .Q.en, symbols not already in the domain are added to the end of it,
+ * so existing codes never change. New symbols are only held in memory until
+ * save appends them to the file.
+ */
+class SymFile
+{
+public:
+
+    // Open path, or start an empty domain if there's no file yet.
+    explicit SymFile(std::filesystem::path path)
+    : m_path(std::move(path))
+    {
+        if (!std::filesystem::exists(m_path))
+            return;
+
+        const auto domain = load_symbols(m_path);
+        const size_t n = domain.size();
+        char * const *syms = domain.get().data<char *>();
+        m_symbols.assign(syms, syms + n);
+        m_codes.reserve(n);
+        m_saved_bytes = internal::disk_object_header_size;
+        for (size_t i = 0; i < n; ++i)
+        {
+            m_codes.emplace(syms[i], static_cast<EnumVector::index>(i));
+            m_saved_bytes += strlen(syms[i]) + 1;
+        }
+        m_saved = n;
+    }
+
+    /**
+     * @brief Codes of values in the domain, adding those not in it yet. The
+     * null symbol enumerates to the null index, as in EnumVector.
+     */
+    std::vector<EnumVector::index> enumerate(const Vector<Type::Symbol>& values)
+    {
+        const size_t n = values.size();
+        char * const *syms = values.get().data<char *>();
+        std::vector<EnumVector::index> res(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (syms[i][0] == '\0')
+            {
+                res[i] = EnumVector::null_index;
+                continue;
+            }
+            const auto [it, added] = m_codes.emplace(syms[i], static_cast<EnumVector::index>(m_symbols.size()));
+            if (added)
+                m_symbols.push_back(syms[i]);
+            res[i] = it->second;
+        }
+        return res;
+    }
+
+    /**
+     * @brief Append symbols added since the last save to the file. The
+     * symbols go out before the count, so a failed save leaves the file as
+     * it was as far as q can tell, and the next save writes over the tail.
+     */
+    void save(size_t buffer_size = 1 << 20)
+    {
+        if (m_saved == m_symbols.size() && m_saved_bytes != 0)
+            return;
+
+        const int32_t n = internal::object_count(m_path, m_symbols.size());
+        const bool create = m_saved_bytes == 0;
+        internal::FileWriter out(m_path, buffer_size, static_cast<off_t>(m_saved_bytes));
+        if (create)
+            internal::write_object_header(out, KS, 0);
+        for (size_t i = m_saved; i < m_symbols.size(); ++i)
+            out.write(m_symbols[i], strlen(m_symbols[i]) + 1);
+
+        out.write_at(4, &n, sizeof(n));
+        const auto bytes = static_cast<size_t>(out.offset());
+        out.close();
+        m_saved = m_symbols.size();
+        m_saved_bytes = bytes;
+    }
+
+    // The domain including unsaved symbols.
+    Vector<Type::Symbol> domain() const
+    {
+        K res{ktn(KS, static_cast<int64_t>(m_symbols.size()))};
+        std::copy(m_symbols.begin(), m_symbols.end(), res.data<char *>());
+        return Vector<Type::Symbol>(std::move(res));
+    }
+
+    size_t size() const noexcept
+    {
+        return m_symbols.size();
+    }
+
+    const std::filesystem::path& path() const noexcept
+    {
+        return m_path;
+    }
+
+private:
+    std::filesystem::path m_path;
+    // Interned, so keyed on pointer.
+    std::vector<char *> m_symbols;
+    std::unordered_map<const char *, EnumVector::index> m_codes;
+    size_t m_saved = 0;
+    // Bytes of the file in use, 0 if there's no file.
+    size_t m_saved_bytes = 0;
+};
+
+/**
+ * @brief Write a splayed table, e.g. a table in an HDB partition, in the
+ * layout SplayedTable reads and q maps.
+ *
+ * Columns are added then written together:
+ *  - fixed width vectors are written as they are,
+ *  - symbol vectors are enumerated against a SymFile, as are enumerated
+ *    vectors once resolved through their own domain,
+ *  - string columns (general lists of char vectors) as nested char columns.
+ *
+ * write saves the sym file, writes the columns in parallel, one task per
+ * column, then writes .d last so a table is only complete once all of its
+ * columns are. Column data is only read by the tasks, no K objects are
+ * created or released off the calling thread.
+ *
+ * Columns are referenced, not copied, so must not be changed until write
+ * returns.
+ */
+class SplayedWriter
+{
+public:
+
+    // For tables without symbol columns.
+    explicit SplayedWriter(std::filesystem::path dir)
+    : m_dir(std::move(dir))
+    { }
+
+    // Enumerate symbol columns against sym, which must outlive the writer.
+    SplayedWriter(std::filesystem::path dir, SymFile& sym)
+    : m_dir(std::move(dir))
+    , m_sym(&sym)
+    { }
+
+    SplayedWriter(const SplayedWriter&) = delete;
+    SplayedWriter& operator=(const SplayedWriter&) = delete;
+
+    template<Type T>
+    void add(std::string name, const Vector<T>& column)
+    {
+        add(std::move(name), column.get());
+    }
+
+    void add(std::string name, const StringColumn& column)
+    {
+        add(std::move(name), column.get());
+    }
+
+    /**
+     * @brief Add an enumerated column, which needs its domain. Its symbols
+     * are enumerated again against the sym file, which may not be its domain.
+     */
+    void add(std::string name, const EnumVector& column)
+    {
+        add(std::move(name), column.resolve().get());
+    }
+
+    /**
+     * @brief Add a column of any supported type, checked at runtime.
+     * Enumerations don't carry their domain, so add them as an EnumVector.
+     */
+    void add(std::string name, const K& column)
+    {
+        if (!column)
+            throw std::runtime_error("K is empty");
+        check_name(name);
+        if (!m_columns.empty() && column.size() != m_rows)
+            throw std::runtime_error("Column " + name + " has " + std::to_string(column.size()) + " rows, expected " + std::to_string(m_rows));
+
+        Column col;
+        col.name = std::move(name);
+        col.t = column.type();
+        if (col.t == KS)
+        {
+            if (!m_sym)
+                throw std::runtime_error("Column " + col.name + " is symbols but there's no sym file to enumerate against");
+            col.codes = m_sym->enumerate(Vector<Type::Symbol>(column, internal::unchecked));
+            col.t = 20;
+        }
+        else if (col.t == 0)
+        {
+            // checks the rows are strings
+            const StringColumn strings(column);
+            col.ends.reserve(strings.size());
+            int64_t end = 0;
+            for (const auto& row : strings)
+                col.ends.push_back(end += static_cast<int64_t>(row.size()));
+            col.t = internal::disk_nested_base + KC;
+            col.data = column;
+        }
+        else if (20 <= col.t && col.t <= 76)
+            throw std::runtime_error("Column " + col.name + " is enumerated, add it as an EnumVector with its domain");
+        else if (0 < col.t && internal::disk_width(col.t) != 0)
+            col.data = column;
+        else
+            throw std::runtime_error("Column " + col.name + " has unsupported type " + std::to_string(col.t));
+
+        m_rows = column.size();
+        m_columns.push_back(std::move(col));
+    }
+
+    /**
+     * @brief Add every column of an unkeyed table, as passed to an export.
+     * The table can't have enumerated columns, see add.
+     */
+    void add_table(::K table)
+    {
+        if (!table || table->t != XT)
+            throw std::runtime_error("Expected a table. Found type: " + std::to_string(table ? table->t : 0));
+        ::K *dict = reinterpret_cast<::K *>(table->k->G0);
+        char **names = reinterpret_cast<char **>(dict[0]->G0);
+        ::K *columns = reinterpret_cast<::K *>(dict[1]->G0);
+        for (int64_t i = 0; i < dict[0]->n; ++i)
+            add(names[i], K::make_borrowed(columns[i]));
+    }
+
+    /**
+     * @brief Set p# on a column, usually the one the table is sorted on.
+     * Each value must be in a single run, which write checks.
+     */
+    void parted(std::string name)
+    {
+        m_parted = std::move(name);
+    }
+
+    /**
+     * @brief Reserve each file's full size before writing it, see
+     * FileWriter::preallocate.
+     */
+    void preallocate(bool on) noexcept
+    {
+        m_preallocate = on;
+    }
+
+    // Size of the per column write buffer.
+    void buffer_size(size_t size) noexcept
+    {
+        m_buffer_size = size;
+    }
+
+    void write(ThreadPool& pool = ThreadPool::instance())
+    {
+        if (m_parted)
+        {
+            auto& col = find(*m_parted);
+            check_parted(col);
+            col.attr = 3;
+        }
+
+        std::filesystem::create_directories(m_dir);
+        if (m_sym && std::any_of(m_columns.begin(), m_columns.end(), [](const auto& col) { return col.t == 20; }))
+            m_sym->save(m_buffer_size);
+
+        TaskGroup group(pool);
+        for (const auto& col : m_columns)
+            group.run([this, &col]() { write_column(col); });
+        group.wait();
+
+        std::vector<std::string> names;
+        names.reserve(m_columns.size());
+        for (const auto& col : m_columns)
+            names.push_back(col.name);
+        internal::write_symbol_file(m_dir / ".d", names, m_buffer_size);
+    }
+
+private:
+
+    struct Column
+    {
+        std::string name;
+        // type as on disk
+        signed char t = 0;
+        uint8_t attr = 0;
+        // fixed width and string columns
+        K data;
+        // enumerated symbol columns
+        std::vector<EnumVector::index> codes;
+        // string columns, the end of each row in the items
+        std::vector<int64_t> ends;
+    };
+
+    void write_column(const Column& col) const
+    {
+        const auto n = static_cast<int64_t>(m_rows);
+        internal::FileWriter out(m_dir / col.name, m_buffer_size);
+        if (col.t == 20)
+        {
+            const size_t bytes = m_rows * sizeof(EnumVector::index);
+            if (m_preallocate)
+                out.preallocate(internal::disk_enum_offset + internal::disk_header_size + bytes);
+
+            std::vector<char> page(internal::disk_enum_offset, 0);
+            page[0] = static_cast<char>(internal::disk_enum_marker);
+            page[1] = static_cast<char>(internal::disk_version);
+            page[2] = col.t;
+            page[3] = static_cast<char>(col.attr);
+            const auto domain = m_sym->path().filename().string();
+            memcpy(page.data() + internal::disk_enum_name_offset, domain.data(), std::min(domain.size(), page.size() - internal::disk_enum_name_offset - 1));
+            out.write(page.data(), page.size());
+            internal::write_disk_header(out, internal::disk_vector_marker, col.t, col.attr, n);
+            out.write(col.codes.data(), bytes);
+        }
+        else if (col.t > internal::disk_nested_base)
+        {
+            const int64_t items = col.ends.empty() ? 0 : col.ends.back();
+            if (m_preallocate)
+                out.preallocate(internal::disk_header_size + m_rows * sizeof(int64_t));
+            internal::write_disk_header(out, internal::disk_vector_marker, col.t, col.attr, n);
+            out.write(col.ends.data(), col.ends.size() * sizeof(int64_t));
+
+            internal::FileWriter items_out(m_dir / (col.name + "#"), m_buffer_size);
+            if (m_preallocate)
+                items_out.preallocate(internal::disk_header_size + static_cast<size_t>(items));
+            internal::write_disk_header(items_out, internal::disk_vector_marker, KC, 0, items);
+            const ::K *rows = col.data.data<::K>();
+            for (size_t i = 0; i < m_rows; ++i)
+            {
+                if (rows[i]->t == KC)
+                    items_out.write(rows[i]->G0, static_cast<size_t>(rows[i]->n));
+                else
+                    items_out.write(&rows[i]->g, 1);
+            }
+            items_out.close();
+        }
+        else
+        {
+            const size_t bytes = m_rows * internal::disk_width(col.t);
+            if (m_preallocate)
+                out.preallocate(internal::disk_header_size + bytes);
+            internal::write_disk_header(out, internal::disk_vector_marker, col.t, col.attr, n);
+            out.write(col.data.data<uint8_t>(), bytes);
+        }
+        out.close();
+    }
+
+    /**
+     * @brief Check no value appears in more than one run. Values are
+     * compared on their bytes.
+     */
+    void check_parted(const Column& col) const
+    {
+        if (col.t > internal::disk_nested_base)
+            throw std::runtime_error("p# is not supported on nested column " + col.name);
+
+        const size_t width = col.t == 20 ? sizeof(EnumVector::index) : internal::disk_width(col.t);
+        const char *data = col.t == 20
+            ? reinterpret_cast<const char *>(col.codes.data())
+            : col.data.data<char>();
+
+        std::unordered_set<std::string_view> seen;
+        for (size_t i = 0; i < m_rows; ++i)
+        {
+            const std::string_view value(data + i * width, width);
+            if (i != 0 && value == std::string_view(data + (i - 1) * width, width))
+                continue;
+            if (!seen.insert(value).second)
+                throw std::runtime_error("u-fail: column " + col.name + " is not parted, a value recurs at row " + std::to_string(i));
+        }
+    }
+
+    void check_name(const std::string& name) const
+    {
+        if (name.empty() || name == ".d" || name.find('/') != std::string::npos || name.back() == '#')
+            throw std::runtime_error("Invalid column name: " + name);
+        if (std::any_of(m_columns.begin(), m_columns.end(), [&](const auto& col) { return col.name == name; }))
+            throw std::runtime_error("Duplicate column: " + name);
+    }
+
+    Column& find(const std::string& name)
+    {
+        for (auto& col : m_columns)
+            if (col.name == name)
+                return col;
+        throw std::out_of_range("No column " + name);
+    }
+
+    std::filesystem::path m_dir;
+    SymFile *m_sym = nullptr;
+    std::vector<Column> m_columns;
+    size_t m_rows = 0;
+    std::optional<std::string> m_parted;
+    bool m_preallocate = false;
+    size_t m_buffer_size = 1 << 20;
+};
+
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <kx/kx.h>
+
+#include "k.h"
+#include "type.h"
+
+namespace qbind
+{
+
+/**
+ * @brief Read only view over a string column, a general list of char vectors.
+ *
+ * NestedVector<Type::Char> goes through index vectors and variants for every
+ * access and hands out a wrapper per row. This checks the column once and
+ * keeps a view per row, so access is O(1) and allocation free. Char atoms in
+ * the column are treated as strings of length 1.
+ *
+ * The views point in to the K object held by the column and are valid for as
+ * long as the column is.
+ */
+class StringColumn
+{
+public:
+
+    using value_type     = std::string_view;
+    using const_iterator = std::vector<std::string_view>::const_iterator;
+
+    StringColumn(K data)
+    :m_ptr(std::move(data))
+    {
+        if (!m_ptr)
+            throw std::runtime_error("K is empty");
+        if (m_ptr.type() != 0)
+            throw std::runtime_error("String column must be a general list. Found type: " + std::to_string(m_ptr.type()));
+
+        const size_t n = m_ptr.size();
+        ::K *rows = m_ptr.data<::K>();
+        m_rows.reserve(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            ::K row = rows[i];
+            if (row->t == KC)
+                m_rows.emplace_back(reinterpret_cast<const char *>(row->G0), static_cast<size_t>(row->n));
+            else if (row->t == -KC)
+                m_rows.emplace_back(reinterpret_cast<const char *>(&row->g), 1);
+            else
+                throw std::runtime_error("String column row " + std::to_string(i) + " is not a string. Found type: " + std::to_string(row->t));
+        }
+    }
+
+    std::string_view operator[](size_t pos) const noexcept
+    {
+        return m_rows[pos];
+    }
+
+    std::string_view at(size_t pos) const
+    {
+        if (pos >= size())
+            throw std::out_of_range("Attempted to access index " + std::to_string(pos) + " but length is " + std::to_string(size()));
+        return m_rows[pos];
+    }
+
+    const_iterator begin() const noexcept
+    {
+        return m_rows.begin();
+    }
+
+    const_iterator end() const noexcept
+    {
+        return m_rows.end();
+    }
+
+    bool empty() const noexcept
+    {
+        return m_rows.empty();
+    }
+
+    size_t size() const noexcept
+    {
+        return m_rows.size();
+    }
+
+    // Index of the first row equal to value, size() if absent.
+    size_t find(const std::string_view& value) const noexcept
+    {
+        for (size_t i = 0; i < m_rows.size(); ++i)
+            if (m_rows[i] == value)
+                return i;
+        return m_rows.size();
+    }
+
+    K get() const
+    {
+        return m_ptr;
+    }
+
+private:
+    K m_ptr;
+    std::vector<std::string_view> m_rows;
+};
+
+/**
+ * @brief Build a string column from many strings.
+ *
+ * Characters are appended to a single buffer as they arrive with an offset
+ * per row. On build the outer list is allocated once at its final size and
+ * each row is copied in with a memcpy, so there is no joining or resizing of
+ * K objects.
+ */
+class StringColumnBuilder
+{
+public:
+
+    explicit StringColumnBuilder(size_t expected_rows = 0, size_t expected_chars = 0)
+    {
+        m_offsets.reserve(expected_rows + 1);
+        m_offsets.push_back(0);
+        m_chars.reserve(expected_chars);
+    }
+
+    void push_back(const std::string_view& value)
+    {
+        m_chars.append(value);
+        m_offsets.push_back(m_chars.size());
+    }
+
+    template<class iterator_type>
+    void append(iterator_type first, iterator_type last)
+    {
+        for (; first != last; ++first)
+            push_back(*first);
+    }
+
+    size_t size() const noexcept
+    {
+        return m_offsets.size() - 1;
+    }
+
+    /**
+     * @brief Lay out the rows seen so far as a general list of char vectors.
+     * The builder is left empty.
+     */
+    StringColumn build()
+    {
+        const size_t n = size();
+        K k{ktn(0, static_cast<int64_t>(n))};
+        ::K *rows = k.data<::K>();
+        for (size_t i = 0; i < n; ++i)
+        {
+            const size_t len = m_offsets[i + 1] - m_offsets[i];
+            rows[i] = ktn(KC, static_cast<int64_t>(len));
+            if (len)
+                memcpy(rows[i]->G0, m_chars.data() + m_offsets[i], len);
+        }
+        m_chars.clear();
+        m_offsets.resize(1);
+        return {std::move(k)};
+    }
+
+private:
+    std::string m_chars;
+    std::vector<size_t> m_offsets;
+};
+
+}
@@ -1,7 +1,14 @@
 #pragma once
 
+#include <ostream>
+#include <stdint.h>
 #include <string.h>
 #include <string_view>
+#include <unordered_map>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 #include <kx/kx.h>
 
@@ -11,12 +18,134 @@ namespace qbind
 namespace internal
 {
 
+/**
+ * @brief Per-thread cache in front of sn.
+ *
+ * Once more than one thread is initialised by the MemoryManager, setm(1) is
+ * on and every call to sn takes kdb's global symbol lock. Interned symbols
+ * are never freed, so a view over an interned symbol is valid for the life
+ * of the process. We key the cache on that view, meaning a hit does not
+ * allocate and does not reach sn. Only misses take the lock.
+ */
+class SymbolCache
+{
+public:
+
+    // Upper bound on entries per thread. The cache is dropped when reached
+    // so threads that see an unbounded set of symbols don't grow forever.
+    static constexpr size_t max_size = 1 << 20;
+
+    [[nodiscard]]
+    static char * get(const std::string_view& value)
+    {
+        auto& cache = instance();
+        if (auto it = cache.find(value); it != cache.end())
+            return it->second;
+
+        if (cache.size() >= max_size)
+            cache.clear();
+        char *sym = sn(const_cast<char *>(value.data()), value.size());
+        // Key on the interned data rather than the callers buffer. Use the
+        // interned length in case value contained a null byte.
+        cache.emplace(std::string_view{sym}, sym);
+        return sym;
+    }
+
+    // Number of symbols cached on this thread.
+    static size_t size() noexcept
+    {
+        return instance().size();
+    }
+
+    // Drop all symbols cached on this thread.
+    static void clear() noexcept
+    {
+        instance().clear();
+    }
+
+private:
+
+    static std::unordered_map<std::string_view, char *>& instance()
+    {
+        thread_local std::unordered_map<std::string_view, char *> cache;
+        return cache;
+    }
+};
+
+// Pointer scans over interned symbols.
+//
+// Once a probe is interned, finding it in a symbol vector is a scan for a
+// pointer value. These compare 4 (AVX2) or 2 (SSE2) pointers per instruction
+// falling back to a scalar loop for the tail and other platforms.
+
+/**
+ * @brief Index of the first occurrence of needle in [first, first + n), n if absent.
+ */
+inline size_t find_pointer(char * const * first, size_t n, const char *needle) noexcept
+{
+    size_t i = 0;
+#if defined(__AVX2__) && UINTPTR_MAX == UINT64_MAX
+    const __m256i probe = _mm256_set1_epi64x(static_cast<long long>(reinterpret_cast<uintptr_t>(needle)));
+    for (; i + 8 <= n; i += 8)
+    {
+        const auto lo = _mm256_cmpeq_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(first + i)), probe);
+        const auto hi = _mm256_cmpeq_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(first + i + 4)), probe);
+        const int mask = _mm256_movemask_pd(_mm256_castsi256_pd(lo)) |
+                         (_mm256_movemask_pd(_mm256_castsi256_pd(hi)) << 4);
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+#elif defined(__SSE2__) && UINTPTR_MAX == UINT64_MAX
+    const __m128i probe = _mm_set1_epi64x(static_cast<long long>(reinterpret_cast<uintptr_t>(needle)));
+    for (; i + 4 <= n; i += 4)
+    {
+        // No 64 bit compare in SSE2: compare 32 bit halves and require both to match.
+        auto lo = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(first + i)), probe);
+        auto hi = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(first + i + 2)), probe);
+        lo = _mm_and_si128(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 3, 0, 1)));
+        hi = _mm_and_si128(hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(2, 3, 0, 1)));
+        const int mask = _mm_movemask_pd(_mm_castsi128_pd(lo)) |
+                         (_mm_movemask_pd(_mm_castsi128_pd(hi)) << 2);
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+#endif
+    for (; i < n; ++i)
+        if (first[i] == needle)
+            return i;
+    return n;
+}
+
+/**
+ * @brief Number of occurrences of needle in [first, first + n).
+ */
+inline size_t count_pointer(char * const * first, size_t n, const char *needle) noexcept
+{
+    size_t i = 0;
+    size_t count = 0;
+#if defined(__AVX2__) && UINTPTR_MAX == UINT64_MAX
+    const __m256i probe = _mm256_set1_epi64x(static_cast<long long>(reinterpret_cast<uintptr_t>(needle)));
+    // Matches are -1 in each lane so subtracting accumulates a count per lane.
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + 4 <= n; i += 4)
+        acc = _mm256_sub_epi64(acc, _mm256_cmpeq_epi64(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first + i)), probe));
+    alignas(32) uint64_t lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), acc);
+    count = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+    // Branch free so the compiler can vectorise where intrinsics aren't used.
+    for (; i < n; ++i)
+        count += first[i] == needle;
+    return count;
+}
+
 struct intern
 {
     [[nodiscard]]
-    char * operator()(const std::string_view& value) const noexcept
+    char * operator()(const std::string_view& value) const
     {
-        return sn(const_cast<char *>(value.data()), value.size());
+        return SymbolCache::get(value);
     }
 };
 
@@ -63,6 +192,18 @@ public:
 
     // Compare
 
+    // Symbols are interned so equality is pointer identity.
+    bool operator==(const SymbolReference& rhs) const
+    {
+        return m_ptr == rhs.m_ptr;
+    }
+
+    // A view may not be interned so compare its bytes.
+    bool operator==(const std::string_view& rhs) const
+    {
+        return strncmp(m_ptr, rhs.data(), rhs.size()) == 0 && m_ptr[rhs.size()] == '\0';
+    }
+
     // Compare to other symbol references.
     auto operator<=>(const SymbolReference& rhs) const
     {
@@ -88,13 +229,13 @@ public:
     }
 
 private:
-    static constexpr internal::intern intern;
+    static constexpr internal::intern intern{};
     char *&m_ptr;
 };
 
-std::ostream& operator<<(std::ostream& os, const SymbolReference &s)
+inline std::ostream& operator<<(std::ostream& os, const SymbolReference &s)
 {
-    return os << s;
+    return os << static_cast<const char *>(s);
 }
 
 /**
@@ -142,7 +283,6 @@ public:
     inline SymbolPointer operator+(difference_type rhs) const {return SymbolPointer(m_ptr + rhs);}
     inline SymbolPointer operator-(difference_type rhs) const {return SymbolPointer(m_ptr - rhs);}
     friend inline SymbolPointer operator+(difference_type lhs, const SymbolPointer& rhs) {return SymbolPointer(lhs + rhs.m_ptr);}
-    friend inline SymbolPointer operator-(difference_type lhs, const SymbolPointer& rhs) {return SymbolPointer(lhs - rhs.m_ptr);}
 
     inline bool operator<=>(const SymbolPointer &rhs) const { return m_ptr - rhs.m_ptr; }
 
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string.h>
+#include <vector>
+
+#include <kx/kx.h>
+
+#include "k.h"
+#include "symbol.h"
+#include "type.h"
+#include "vector.h"
+
+namespace qbind
+{
+
+/**
+ * @brief Build a symbol column from a stream of strings.
+ *
+ * Intended for loading symbol columns from files or feeds where the strings
+ * arrive one at a time and the row count is not known up front. Strings are
+ * interned through the thread's SymbolCache, so only the first sight of each
+ * distinct string reaches sn. Rows are held as interned pointers and the
+ * column is laid out with a single ktn and memcpy on build.
+ */
+class SymbolBuilder
+{
+public:
+
+    explicit SymbolBuilder(size_t expected_rows = 0)
+    {
+        m_syms.reserve(expected_rows);
+    }
+
+    void push_back(const std::string_view& value)
+    {
+        m_syms.push_back(internal::intern{}(value));
+    }
+
+    template<class iterator_type>
+    void append(iterator_type first, iterator_type last)
+    {
+        for (; first != last; ++first)
+            push_back(*first);
+    }
+
+    size_t size() const noexcept
+    {
+        return m_syms.size();
+    }
+
+    /**
+     * @brief Lay out the rows seen so far as a symbol vector. The builder is
+     * left empty so can be reused for the next batch of the same feed.
+     */
+    Vector<Type::Symbol> build()
+    {
+        K k{ktn(KS, static_cast<int64_t>(m_syms.size()))};
+        if (!m_syms.empty())
+            memcpy(k.data<char *>(), m_syms.data(), m_syms.size() * sizeof(char *));
+        m_syms.clear();
+        return {std::move(k)};
+    }
+
+private:
+    std::vector<char *> m_syms;
+};
+
+}
@@ -0,0 +1,459 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <latch>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <kx/kx.h>
+
+#include "memory_manager.h"
+
+namespace qbind
+{
+
+/**
+ * @brief A work stealing pool of worker threads.
+ *
+ * Each worker has its own deque. Tasks submitted from a worker go on its own
+ * deque and are run newest first, tasks from other threads are shared out.
+ * Idle workers steal the oldest task from the others. Waiting on a TaskGroup
+ * runs queued tasks rather than blocking, so nested parallelism can't
+ * deadlock the pool.
+ *
+ * Workers initialise the kdb memory system on start up and release it on
+ * exit through the MemoryManager, so tasks may allocate K objects. Those
+ * objects belong to the allocating thread's memory pool. Either hand them
+ * back to that thread, or hold them in an OwnedK which defers the r0 to the
+ * owning thread when released elsewhere.
+ */
+class ThreadPool
+{
+    // Objects released to a thread from elsewhere, waiting for it to r0 them.
+    struct Deferred
+    {
+        std::mutex mutex;
+        std::vector<::K> objects;
+    };
+
+public:
+
+    // Index of a thread which isn't a worker of the pool.
+    static constexpr int external = -1;
+
+    // Identifies the thread an object was allocated on. Every thread,
+    // worker or not, has its own.
+    using Owner = std::shared_ptr<Deferred>;
+
+    explicit ThreadPool(size_t threads = std::thread::hardware_concurrency())
+    : m_exit(static_cast<std::ptrdiff_t>(threads ? threads : 1))
+    {
+        if (threads == 0)
+            threads = 1;
+        m_queues.reserve(threads);
+        for (size_t i = 0; i < threads; ++i)
+            m_queues.push_back(std::make_unique<Queue>());
+        m_workers.reserve(threads);
+        for (size_t i = 0; i < threads; ++i)
+            m_workers.emplace_back([this, i] { run(static_cast<int>(i)); });
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Finishes the queued tasks then joins the workers.
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lk(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+        for (auto& worker : m_workers)
+            worker.join();
+        drain_deferred();
+    }
+
+    // Queue a task. Tasks must not throw, see TaskGroup for that.
+    void submit(std::function<void()> task)
+    {
+        const int self = index();
+        const size_t target = self != external
+            ? static_cast<size_t>(self)
+            : m_next.fetch_add(1, std::memory_order_relaxed) % m_queues.size();
+        {
+            // Counted first so it never drops below zero. Under the lock so a
+            // worker about to sleep can't miss it.
+            std::lock_guard<std::mutex> lk(m_mutex);
+            ++m_pending;
+        }
+        {
+            std::lock_guard<std::mutex> lk(m_queues[target]->mutex);
+            m_queues[target]->tasks.push_back(std::move(task));
+        }
+        m_cv.notify_one();
+    }
+
+    /**
+     * @brief Run one queued task on the calling thread if there is one.
+     * Workers take from their own deque first, everyone then steals.
+     */
+    bool try_run_one()
+    {
+        std::function<void()> task;
+        if (!pop(task))
+            return false;
+        task();
+        return true;
+    }
+
+    size_t size() const noexcept
+    {
+        return m_workers.size();
+    }
+
+    // Index of the calling thread's worker in this pool, or external.
+    int index() const noexcept
+    {
+        return tl_pool == this ? tl_index : external;
+    }
+
+    // The calling thread as an owner.
+    static const Owner& owner()
+    {
+        return tl_local.deferred;
+    }
+
+    /**
+     * @brief r0 k on the thread which owns it, now if that is the calling
+     * thread, else when the owner next finishes a task, waits on a TaskGroup
+     * or calls drain_deferred. An object released to a thread which has
+     * exited is never freed, its memory pool is gone.
+     */
+    static void release(::K k, const Owner& owner)
+    {
+        if (!k)
+            return;
+        if (!tl_exiting && owner == tl_local.deferred)
+        {
+            r0(k);
+            return;
+        }
+        std::lock_guard<std::mutex> lk(owner->mutex);
+        owner->objects.push_back(k);
+    }
+
+    // r0 anything released to the calling thread from elsewhere.
+    static void drain_deferred()
+    {
+        if (tl_exiting)
+            return;
+        std::vector<::K> objects;
+        {
+            std::lock_guard<std::mutex> lk(tl_local.deferred->mutex);
+            objects.swap(tl_local.deferred->objects);
+        }
+        for (auto k : objects)
+            r0(k);
+    }
+
+    /**
+     * @brief Call f(first, last) over chunks of [begin, end) of at most grain
+     * elements, in parallel, returning when all are done. The calling thread
+     * takes part.
+     */
+    template<class F>
+    void parallel_for(size_t begin, size_t end, size_t grain, F&& f);
+
+    // Pool shared by qbind, one worker per core.
+    static ThreadPool& instance()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+private:
+
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool pop(std::function<void()>& task)
+    {
+        const int self = index();
+        const size_t n = m_queues.size();
+
+        // own deque, newest first
+        if (self != external)
+        {
+            auto& own = *m_queues[static_cast<size_t>(self)];
+            std::lock_guard<std::mutex> lk(own.mutex);
+            if (!own.tasks.empty())
+            {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                taken();
+                return true;
+            }
+        }
+
+        // steal, oldest first
+        const size_t start = self != external ? static_cast<size_t>(self) + 1 : m_next.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < n; ++i)
+        {
+            auto& victim = *m_queues[(start + i) % n];
+            std::lock_guard<std::mutex> lk(victim.mutex);
+            if (!victim.tasks.empty())
+            {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                taken();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void taken()
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        --m_pending;
+    }
+
+    void run(int idx)
+    {
+        tl_pool = this;
+        tl_index = idx;
+        MemoryManager::initialise();
+
+        for (;;)
+        {
+            if (try_run_one())
+            {
+                drain_deferred();
+                continue;
+            }
+            std::unique_lock<std::mutex> lk(m_mutex);
+            m_cv.wait(lk, [this] { return m_stop || m_pending > 0; });
+            if (m_stop && m_pending == 0)
+                break;
+        }
+
+        // No more tasks run once every worker is here, so nothing more can be
+        // released to this worker. Clear up before the memory pool goes.
+        m_exit.arrive_and_wait();
+        drain_deferred();
+    }
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_workers;
+    std::atomic<size_t> m_next{0};
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    size_t m_pending = 0;
+    bool m_stop = false;
+    std::latch m_exit;
+
+    static inline thread_local ThreadPool *tl_pool = nullptr;
+    static inline thread_local int tl_index = external;
+    // Set once the calling thread's thread_locals are being destroyed, e.g.
+    // when a static pool is destroyed at exit after the main thread's.
+    // Trivially destructible, so still readable then.
+    static inline thread_local bool tl_exiting = false;
+
+    struct Local
+    {
+        Local()
+        : deferred(std::make_shared<Deferred>())
+        {
+        }
+
+        ~Local()
+        {
+            tl_exiting = true;
+        }
+
+        Owner deferred;
+    };
+    static inline thread_local Local tl_local;
+};
+
+/**
+ * @brief Fork/join over a ThreadPool.
+ *
+ * Tasks are run with run and joined with wait. The first exception thrown by
+ * a task is rethrown from wait. wait runs queued tasks while it waits, so
+ * groups can be nested from within tasks.
+ */
+class TaskGroup
+{
+public:
+
+    explicit TaskGroup(ThreadPool& pool = ThreadPool::instance())
+    : m_pool(pool)
+    , m_state(std::make_shared<State>())
+    { }
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    // Tasks must not outlive what they capture, so always join.
+    ~TaskGroup()
+    {
+        try
+        {
+            wait();
+        }
+        catch (...)
+        { }
+    }
+
+    template<class F>
+    void run(F&& f)
+    {
+        m_state->outstanding.fetch_add(1, std::memory_order_relaxed);
+        m_pool.submit([state = m_state, f = std::forward<F>(f)]() mutable
+        {
+            try
+            {
+                f();
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lk(state->mutex);
+                if (!state->error)
+                    state->error = std::current_exception();
+            }
+            state->outstanding.fetch_sub(1, std::memory_order_release);
+        });
+    }
+
+    void wait()
+    {
+        while (m_state->outstanding.load(std::memory_order_acquire) != 0)
+        {
+            if (!m_pool.try_run_one())
+                std::this_thread::yield();
+        }
+        ThreadPool::drain_deferred();
+
+        std::exception_ptr error;
+        {
+            std::lock_guard<std::mutex> lk(m_state->mutex);
+            error = std::exchange(m_state->error, nullptr);
+        }
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+private:
+
+    struct State
+    {
+        std::atomic<size_t> outstanding{0};
+        std::mutex mutex;
+        std::exception_ptr error;
+    };
+
+    ThreadPool& m_pool;
+    std::shared_ptr<State> m_state;
+};
+
+template<class F>
+void ThreadPool::parallel_for(size_t begin, size_t end, size_t grain, F&& f)
+{
+    if (begin >= end)
+        return;
+    if (grain == 0)
+        grain = 1;
+
+    TaskGroup group(*this);
+    // Keep the first chunk for the calling thread.
+    for (size_t first = begin + grain; first < end; first += grain)
+    {
+        const size_t last = end - first < grain ? end : first + grain;
+        group.run([&f, first, last] { f(first, last); });
+    }
+    f(begin, end - begin < grain ? end : begin + grain);
+    group.wait();
+}
+
+/**
+ * @brief Owns a K object and releases it on the thread it was allocated on,
+ * wherever it is destroyed.
+ */
+class OwnedK
+{
+public:
+
+    OwnedK() noexcept = default;
+
+    // Take ownership of k, allocated on the calling thread.
+    explicit OwnedK(::K k) noexcept
+    : m_k(k)
+    , m_owner(ThreadPool::owner())
+    { }
+
+    OwnedK(const OwnedK&) = delete;
+    OwnedK& operator=(const OwnedK&) = delete;
+
+    OwnedK(OwnedK&& other) noexcept
+    : m_k(std::exchange(other.m_k, nullptr))
+    , m_owner(std::move(other.m_owner))
+    { }
+
+    OwnedK& operator=(OwnedK&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            m_k = std::exchange(other.m_k, nullptr);
+            m_owner = std::move(other.m_owner);
+        }
+        return *this;
+    }
+
+    ~OwnedK()
+    {
+        reset();
+    }
+
+    ::K get() const noexcept
+    {
+        return m_k;
+    }
+
+    // Thread the object was allocated on.
+    const ThreadPool::Owner& owner() const noexcept
+    {
+        return m_owner;
+    }
+
+    // Hand ownership back. Only safe on the owning thread.
+    ::K release() noexcept
+    {
+        return std::exchange(m_k, nullptr);
+    }
+
+    void reset()
+    {
+        if (m_k)
+            ThreadPool::release(std::exchange(m_k, nullptr), m_owner);
+    }
+
+private:
+    ::K m_k = nullptr;
+    ThreadPool::Owner m_owner;
+};
+
+}
@@ -19,9 +19,17 @@ public:
     {
         if (!m_ptr)
             throw std::runtime_error("K is empty");
-        m_ptr.is_with_info<Tuple<Types...>>(m_ptr);
+        m_ptr.is_with_info<Tuple<Types...>>();
     }
 
+    /**
+     * @brief Initialise from a K object already known to be a list of the
+     * right length. Elements are checked when they are accessed with get.
+     */
+    Tuple(K data, internal::unchecked_t) noexcept
+    :m_ptr(std::move(data))
+    { }
+
     Tuple(Types&&... elements)
     {
         size_t idx = 0;
@@ -83,12 +91,18 @@ public:
 
     // TODO: Move to std::tuple_cat like method.
     /**
-     * @brief On append a new tuple is returned. The existing tuple remains as
-     * a view. Therefore an edit to a common index will edit both tuples.
-     * 
-     * Type checking on this is already done, so fine to mutate m_ptr underneath
+     * @brief On append a new tuple is returned, sharing the appended list with
+     * this one.
+     *
+     * The list is appended to in place only if this tuple holds its sole
+     * reference. A list that is shared or borrowed (e.g. a q argument) is
+     * copied first, so other holders never see the append. The copy shares
+     * the elements themselves rather than copying them. A later append to
+     * either tuple copies again while the list is shared.
+     *
+     * Type checking on this is already done, so fine to replace m_ptr underneath
      * as long as the returned tuple is constructed in a valid state. That leaves
-     * this as an appropriate constrained view.
+     * this as a constrained view of the leading elements.
      */
     template<typename T>
     Tuple<Types..., T> cat(T value)
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <array>
 #include <sstream>
 #include <stdexcept>
+#include <stdint.h>
+#include <type_traits>
 
 #include <kx/kx.h>
 
@@ -37,7 +40,7 @@ enum class Type : signed char
     Time = KT,
 };
 
-std::ostream& operator<<(std::ostream& os, const Type &t) 
+inline std::ostream& operator<<(std::ostream& os, const Type &t) 
 {
     static const char *type_txt[] = {
             "Boolean", "GUID", "UNKNOWN", "Byte",     // 1 - 4
@@ -59,10 +62,11 @@ enum class Structure : char
     NestedVector,   // 0 where all children are 0 or same type
     Table,          // 98
     Dictionary,     // 99
-    KeyedTable
+    KeyedTable,
+    Enum            // 20 to 76
 };
 
-std::ostream& operator<<(std::ostream& os, const Structure &s) 
+inline std::ostream& operator<<(std::ostream& os, const Structure &s) 
 {
     switch (s)
     {
@@ -74,6 +78,7 @@ std::ostream& operator<<(std::ostream& os, const Structure &s)
         case Structure::Table:          return os << "Table";
         case Structure::Dictionary:     return os << "Dictionary";
         case Structure::KeyedTable:     return os << "Keyed Table";
+        case Structure::Enum:           return os << "Enum";
     }
     return os << "UNKNOWN";
 }
@@ -155,6 +160,35 @@ template<> struct c_type<Type::Minute>  { C_TYPE_TRAITS(int32_t) };
 template<> struct c_type<Type::Second>  { C_TYPE_TRAITS(int32_t) };
 template<> struct c_type<Type::Time>    { C_TYPE_TRAITS(int32_t) };
 
+/**
+ * @brief Map plain C++ type to the Type with that underlier. Where several
+ * types share an underlier (e.g. Long, Timestamp) the plain numeric type is
+ * chosen.
+ */
+template<typename T> struct q_type;
+template<> struct q_type<bool>      { static constexpr Type value = Type::Boolean; };
+template<> struct q_type<uint8_t>   { static constexpr Type value = Type::Byte; };
+template<> struct q_type<int16_t>   { static constexpr Type value = Type::Short; };
+template<> struct q_type<int32_t>   { static constexpr Type value = Type::Int; };
+template<> struct q_type<int64_t>   { static constexpr Type value = Type::Long; };
+template<> struct q_type<float>     { static constexpr Type value = Type::Real; };
+template<> struct q_type<double>    { static constexpr Type value = Type::Float; };
+template<> struct q_type<char>      { static constexpr Type value = Type::Char; };
+
+// kx's J is long long, a different type to int64_t where that is long.
+template<typename T>
+    requires std::is_same_v<T, long long> && (!std::is_same_v<long long, int64_t>)
+struct q_type<T>    { static constexpr Type value = Type::Long; };
+
+template<typename T, typename = void>
+struct has_q_type : std::false_type {};
+
+template<typename T>
+struct has_q_type<T, std::void_t<decltype(q_type<T>::value)>> : std::true_type {};
+
+template<typename T>
+constexpr bool has_q_type_v = has_q_type<T>::value;
+
 }
 
 }
\ No newline at end of file
@@ -60,4 +60,15 @@ public:
 template <typename T, typename... Ts>
 constexpr std::size_t index_of_v = index_of<T, Ts...>::value;
 
+/**
+ * @brief Tag for constructors which skip type checking as the caller has
+ * already done it.
+ */
+struct unchecked_t
+{
+    explicit unchecked_t() = default;
+};
+
+inline constexpr unchecked_t unchecked{};
+
 }
\ No newline at end of file
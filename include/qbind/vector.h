@@ -1,6 +1,9 @@
 #pragma once
 
+#include <algorithm>
+#include <limits>
 #include <optional>
+#include <unordered_set>
 
 #include <kx/kx.h>
 
@@ -8,6 +11,7 @@
 #include "k.h"
 #include "symbol.h"
 #include "type.h"
+#include "utils.h"
 
 namespace qbind
 {
@@ -42,6 +46,11 @@ public:
         m_ptr.is_with_info<Vector<T>>();
     }
 
+    // Initialise from a K object already known to be a vector of type T
+    Vector(K data, internal::unchecked_t) noexcept
+    :m_ptr(std::move(data))
+    { }
+
     // Create empty array of set length
     Vector(int64_t length)
     {
@@ -61,15 +70,13 @@ public:
             throw std::runtime_error("Length must be non-negative");
         }
         m_ptr = K{ktn(static_cast<signed char>(T), last-first)};
-        auto it = m_ptr.data<underlier>();
-        std::transform(first, last, it, to_underlier);
+        fill(first, last, m_ptr.data<underlier>());
     }
 
     Vector(std::initializer_list<value> list)
     {
         m_ptr = K{ktn(static_cast<signed char>(T), list.size())};
-        auto it = m_ptr.data<underlier>();
-        std::transform(list.begin(), list.end(), it, to_underlier);
+        fill(list.begin(), list.end(), m_ptr.data<underlier>());
     }
 
     template<qbind::Type Q=T, typename = typename std::enable_if<Q == Type::Char>::type>
@@ -186,7 +193,7 @@ public:
 
     void push_back(value value)
     {
-        m_ptr.join_atom(to_underlier(value));
+        m_ptr.template join_atom<T>(to_underlier(value));
     }
 
     void push_back(const Vector<T>& vec)
@@ -194,6 +201,67 @@ public:
         m_ptr.join_lists(vec.m_ptr);
     }
 
+    // Lookup
+    // Symbols are interned, so the probe is interned once and the vector is
+    // scanned for its pointer rather than comparing strings element by element.
+    // Note this adds the probe to the symbol table, as q does for a literal.
+
+    // Index of first occurrence of value, size() if absent.
+    ENABLE_IF_SYMBOL
+    size_t find(const std::string_view& value) const
+    {
+        return internal::find_pointer(m_ptr.data<char *>(), size(), to_underlier(value));
+    }
+
+    ENABLE_IF_SYMBOL
+    size_t count(const std::string_view& value) const
+    {
+        return internal::count_pointer(m_ptr.data<char *>(), size(), to_underlier(value));
+    }
+
+    ENABLE_IF_SYMBOL
+    bool contains(const std::string_view& value) const
+    {
+        return find(value) < size();
+    }
+
+    /**
+     * @brief q's in: for each element whether it is present in other.
+     * 
+     * Small sets are scanned, larger ones are hashed on pointer.
+     */
+    ENABLE_IF_SYMBOL
+    Vector<Type::Boolean> in(const Vector<Type::Symbol>& other) const
+    {
+        Vector<Type::Boolean> res(static_cast<int64_t>(size()));
+        bool *out = res.data();
+        char * const *syms = m_ptr.data<char *>();
+        char * const *set = other.get().template data<char *>();
+        const size_t n = size();
+        const size_t set_size = other.size();
+        if (set_size <= 32)
+        {
+            for (size_t i = 0; i < n; ++i)
+                out[i] = internal::find_pointer(set, set_size, syms[i]) < set_size;
+        }
+        else
+        {
+            const std::unordered_set<const char *> lookup(set, set + set_size);
+            for (size_t i = 0; i < n; ++i)
+                out[i] = lookup.count(syms[i]) != 0;
+        }
+        return res;
+    }
+
+    /**
+     * @brief Element wise equality. Symbol vectors compare pointers as 
+     * their elements are interned.
+     */
+    bool operator==(const Vector& rhs) const
+    {
+        return m_ptr == rhs.m_ptr;
+    }
+
     /**
      * @brief The relative order of the first-pair of non-equivalent elements in lhs
      * and rhs if there are such elements, lhs.size() <=> rhs.size() otherwise.
@@ -222,13 +290,25 @@ public:
 
 private:
 
+    // Symbols are interned through the thread's cache, everything else is copied.
+    template<class iterator_type>
+    static void fill(iterator_type first, iterator_type last, underlier *out)
+    {
+        if constexpr (T == Type::Symbol)
+        {
+            std::transform(first, last, out, internal::intern{});
+        }
+        else
+            std::transform(first, last, out, to_underlier);
+    }
+
     void check_in_range(size_t pos)
     {
         if (pos >= m_ptr.size())
             throw std::out_of_range("Attempted to access index " + std::to_string(pos) + " but length is " + std::to_string(size()));
     }
 
-    static constexpr typename internal::c_type<T>::to_underlier to_underlier;
+    static constexpr typename internal::c_type<T>::to_underlier to_underlier{};
 
     K m_ptr;
 };
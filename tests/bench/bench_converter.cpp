@@ -0,0 +1,151 @@
+#include <benchmark/benchmark.h>
+
+#include <span>
+#include <vector>
+
+#include "qbind/atom.h"
+#include "qbind/converter.h"
+#include "qbind/function.h"
+#include "qbind/instrument.h"
+#include "qbind/tuple.h"
+#include "qbind/vector.h"
+
+namespace q = qbind;
+namespace a = qbind::a;
+namespace v = qbind::v;
+
+// Converter round trips: K argument in to C++ and the result back out.
+
+static void BM_Converter_Atom(benchmark::State& state)
+{
+    ::K k = kj(42);
+    q::K k_owner{k};
+    for (auto _ : state)
+    {
+        auto atom = q::Converter::to_cpp<a::j>(k);
+        ::K res = q::Converter::to_q(std::move(atom));
+        benchmark::DoNotOptimize(res);
+        r0(res);
+    }
+}
+BENCHMARK(BM_Converter_Atom);
+
+static void BM_Converter_Vector(benchmark::State& state)
+{
+    ::K k = ktn(KF, 1024);
+    q::K k_owner{k};
+    for (auto _ : state)
+    {
+        auto vec = q::Converter::to_cpp<v::f>(k);
+        ::K res = q::Converter::to_q(std::move(vec));
+        benchmark::DoNotOptimize(res);
+        r0(res);
+    }
+}
+BENCHMARK(BM_Converter_Vector);
+
+static void BM_Converter_Tuple(benchmark::State& state)
+{
+    ::K k = knk(3, kj(1), kf(2.0), ktn(KJ, 8));
+    q::K k_owner{k};
+    for (auto _ : state)
+    {
+        auto tuple = q::Converter::to_cpp<q::Tuple<a::j, a::f, v::j>>(k);
+        ::K res = q::Converter::to_q(std::move(tuple));
+        benchmark::DoNotOptimize(res);
+        r0(res);
+    }
+}
+BENCHMARK(BM_Converter_Tuple);
+
+static void BM_Converter_Span(benchmark::State& state)
+{
+    ::K k = ktn(KF, 1024);
+    q::K k_owner{k};
+    for (auto _ : state)
+        benchmark::DoNotOptimize(q::Converter::to_cpp<std::span<const double>>(k));
+}
+BENCHMARK(BM_Converter_Span);
+
+// Copies in to a new vector.
+static void BM_Converter_StdVector(benchmark::State& state)
+{
+    const std::vector<double> values(static_cast<size_t>(state.range(0)), 1.0);
+    for (auto _ : state)
+    {
+        ::K res = q::Converter::to_q(values);
+        benchmark::DoNotOptimize(res);
+        r0(res);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0) * sizeof(double));
+}
+BENCHMARK(BM_Converter_StdVector)->Arg(1 << 10)->Arg(1 << 20);
+
+// Export trampolines: the overhead of calling through the exported C
+// function over calling the C++ function directly.
+
+static a::j identity(a::j x)
+{
+    return x;
+}
+
+static a::j add(a::j x, a::j y)
+{
+    return {static_cast<int64_t>(x) + static_cast<int64_t>(y)};
+}
+
+QBIND_FN_EXPORT(identity, bench_identity, 1, 1)
+QBIND_FN_EXPORT(add, bench_add, 2, 1)
+QBIND_FN_EXPORT_INSTRUMENTED(add, bench_add_instrumented, 2, 1)
+
+static void BM_Export_Direct(benchmark::State& state)
+{
+    a::j x{int64_t{1}};
+    a::j y{int64_t{2}};
+    for (auto _ : state)
+        benchmark::DoNotOptimize(add(x, y));
+}
+BENCHMARK(BM_Export_Direct);
+
+static void BM_Export_Identity(benchmark::State& state)
+{
+    ::K x = kj(1);
+    q::K x_owner{x};
+    for (auto _ : state)
+    {
+        ::K res = bench_identity(x);
+        benchmark::DoNotOptimize(res);
+        r0(res);
+    }
+}
+BENCHMARK(BM_Export_Identity);
+
+static void BM_Export_Add(benchmark::State& state)
+{
+    ::K x = kj(1);
+    q::K x_owner{x};
+    ::K y = kj(2);
+    q::K y_owner{y};
+    for (auto _ : state)
+    {
+        ::K res = bench_add(x, y);
+        benchmark::DoNotOptimize(res);
+        r0(res);
+    }
+}
+BENCHMARK(BM_Export_Add);
+
+static void BM_Export_AddInstrumented(benchmark::State& state)
+{
+    ::K x = kj(1);
+    q::K x_owner{x};
+    ::K y = kj(2);
+    q::K y_owner{y};
+    for (auto _ : state)
+    {
+        ::K res = bench_add_instrumented(x, y);
+        benchmark::DoNotOptimize(res);
+        r0(res);
+    }
+}
+BENCHMARK(BM_Export_AddInstrumented);
@@ -0,0 +1,365 @@
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <kx/kx.h>
+
+#include "connection.h"
+#include "send_pipeline.h"
+#include "subscriber.h"
+
+#include "qbind/type.h"
+
+namespace q = qbind;
+
+// Payloads: a steadily increasing column compresses well, random doubles don't.
+
+static std::vector<int64_t> make_ascending(size_t n)
+{
+    std::vector<int64_t> values(n);
+    for (size_t i = 0; i < n; ++i)
+        values[i] = static_cast<int64_t>(1000 + i / 8);
+    return values;
+}
+
+static std::vector<double> make_random(size_t n)
+{
+    std::mt19937_64 gen(42);
+    std::uniform_real_distribution<double> dist;
+    std::vector<double> values(n);
+    for (auto& x : values)
+        x = dist(gen);
+    return values;
+}
+
+static Buffer copy_of(const Buffer& buf)
+{
+    auto *ptr = static_cast<uint8_t *>(malloc(buf.size()));
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    std::memcpy(ptr, buf.get(), buf.size());
+    return {ptr, buf.size(), buf.endianness()};
+}
+
+// A compressed payload as received: the uncompressed message size then the blocks.
+static Buffer as_received(const Buffer& compressed, size_t payload_size)
+{
+    const size_t size = 4 + compressed.size();
+    Buffer res{static_cast<uint8_t *>(malloc(size)), size};
+    if (res.get() == nullptr)
+        throw std::bad_alloc();
+    res.write_at(static_cast<uint32_t>(8 + payload_size), 0);
+    std::memcpy(res.get() + 4, compressed.get(), compressed.size());
+    return res;
+}
+
+static void BM_IPC_SerializeAtom(benchmark::State& state)
+{
+    Serializer ser(6);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(ser.serialize<q::Type::Long>(int64_t{42}));
+}
+BENCHMARK(BM_IPC_SerializeAtom);
+
+static void BM_IPC_SerializeVector(benchmark::State& state)
+{
+    Serializer ser(6);
+    const auto values = make_ascending(static_cast<size_t>(state.range(0)));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(ser.serialize<q::Type::Long>(values.begin(), values.end()));
+    state.SetBytesProcessed(state.iterations() * state.range(0) * sizeof(int64_t));
+}
+BENCHMARK(BM_IPC_SerializeVector)->Arg(1 << 10)->Arg(1 << 20);
+
+static void BM_IPC_Compress(benchmark::State& state)
+{
+    Serializer ser(6);
+    const auto values = make_ascending(static_cast<size_t>(state.range(0)));
+    const auto payload = ser.serialize<q::Type::Long>(values.begin(), values.end());
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        auto in = copy_of(payload);
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(compress(std::move(in)));
+    }
+    state.SetBytesProcessed(state.iterations() * payload.size());
+}
+BENCHMARK(BM_IPC_Compress)->Arg(1 << 10)->Arg(1 << 20);
+
+// Incompressible input is scanned until the output passes half the input.
+static void BM_IPC_CompressRandom(benchmark::State& state)
+{
+    Serializer ser(6);
+    const auto values = make_random(static_cast<size_t>(state.range(0)));
+    const auto payload = ser.serialize<q::Type::Float>(values.begin(), values.end());
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        auto in = copy_of(payload);
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(compress(std::move(in)));
+    }
+    state.SetBytesProcessed(state.iterations() * payload.size());
+}
+BENCHMARK(BM_IPC_CompressRandom)->Arg(1 << 10)->Arg(1 << 20);
+
+// The same input through a connection's compression policy, which gives up
+// on it from a sample or from earlier messages.
+static void BM_IPC_EncodeRandomAdaptive(benchmark::State& state)
+{
+    Serializer ser(6);
+    const auto values = make_random(static_cast<size_t>(state.range(0)));
+    const auto payload = ser.serialize<q::Type::Float>(values.begin(), values.end());
+    CompressionPolicy policy;
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        auto in = copy_of(payload);
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(encode_header(in, MessageType::Async, 6, &policy));
+    }
+    state.SetBytesProcessed(state.iterations() * payload.size());
+}
+BENCHMARK(BM_IPC_EncodeRandomAdaptive)->Arg(1 << 10)->Arg(1 << 20);
+
+static void BM_IPC_Decompress(benchmark::State& state)
+{
+    Serializer ser(6);
+    const auto values = make_ascending(static_cast<size_t>(state.range(0)));
+    const auto payload = ser.serialize<q::Type::Long>(values.begin(), values.end());
+    const auto compressed = compress(copy_of(payload));
+    if (compressed.size() >= payload.size())
+    {
+        state.SkipWithError("Payload did not compress");
+        return;
+    }
+    const auto received = as_received(compressed, payload.size());
+    for (auto _ : state)
+        benchmark::DoNotOptimize(decompress(received, 1));
+    state.SetBytesProcessed(state.iterations() * payload.size());
+}
+BENCHMARK(BM_IPC_Decompress)->Arg(1 << 10)->Arg(1 << 20);
+
+// kdb's own serialisation for comparison.
+
+static void BM_IPC_B9(benchmark::State& state)
+{
+    ::K vec = ktn(KJ, state.range(0));
+    const auto values = make_ascending(static_cast<size_t>(state.range(0)));
+    std::memcpy(vec->G0, values.data(), values.size() * sizeof(int64_t));
+    for (auto _ : state)
+    {
+        ::K bytes = b9(3, vec);
+        benchmark::DoNotOptimize(bytes);
+        r0(bytes);
+    }
+    r0(vec);
+    state.SetBytesProcessed(state.iterations() * state.range(0) * sizeof(int64_t));
+}
+BENCHMARK(BM_IPC_B9)->Arg(1 << 10)->Arg(1 << 20);
+
+static void BM_IPC_D9(benchmark::State& state)
+{
+    ::K vec = ktn(KJ, state.range(0));
+    const auto values = make_ascending(static_cast<size_t>(state.range(0)));
+    std::memcpy(vec->G0, values.data(), values.size() * sizeof(int64_t));
+    ::K bytes = b9(3, vec);
+    r0(vec);
+    for (auto _ : state)
+    {
+        ::K res = d9(bytes);
+        benchmark::DoNotOptimize(res);
+        r0(res);
+    }
+    r0(bytes);
+    state.SetBytesProcessed(state.iterations() * state.range(0) * sizeof(int64_t));
+}
+BENCHMARK(BM_IPC_D9)->Arg(1 << 10)->Arg(1 << 20);
+
+// Decoding a vector from a sender of the other endianness: a read per
+// element against one bulk read_array.
+
+static Buffer foreign_endian_longs(size_t n)
+{
+    constexpr auto foreign = std::endian::native == std::endian::little ? std::endian::big : std::endian::little;
+    const size_t size = n * sizeof(int64_t);
+    Buffer res{static_cast<uint8_t *>(malloc(size)), size, foreign};
+    if (res.get() == nullptr)
+        throw std::bad_alloc();
+    const auto values = make_ascending(n);
+    std::memcpy(res.get(), values.data(), size);
+    return res;
+}
+
+static void BM_IPC_ByteSwapScalar(benchmark::State& state)
+{
+    const size_t n = static_cast<size_t>(state.range(0));
+    const auto payload = foreign_endian_longs(n);
+    std::vector<int64_t> out(n);
+    for (auto _ : state)
+    {
+        size_t idx = 0;
+        for (auto& x : out)
+            x = payload.read<int64_t>(idx);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0) * sizeof(int64_t));
+}
+BENCHMARK(BM_IPC_ByteSwapScalar)->Arg(1 << 10)->Arg(1 << 20);
+
+static void BM_IPC_ByteSwapBulk(benchmark::State& state)
+{
+    const size_t n = static_cast<size_t>(state.range(0));
+    const auto payload = foreign_endian_longs(n);
+    std::vector<int64_t> out(n);
+    for (auto _ : state)
+    {
+        size_t idx = 0;
+        payload.read_array(idx, out.data(), n);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0) * sizeof(int64_t));
+}
+BENCHMARK(BM_IPC_ByteSwapBulk)->Arg(1 << 10)->Arg(1 << 20);
+
+// Round trip of a message header between two threads over a local socket.
+// Arg is the spin budget in microseconds, 0 for blocking receives.
+static void BM_IPC_SocketRoundTrip(benchmark::State& state)
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+    {
+        state.SkipWithError("socketpair failed");
+        return;
+    }
+    BusyPollOptions options;
+    options.spin_budget = std::chrono::microseconds(state.range(0));
+    Socket local(fds[0], true);
+    Socket remote(fds[1], true);
+    local.set_busy_poll(options);
+    remote.set_busy_poll(options);
+
+    const uint8_t header[8] = {1};
+    std::thread echo([&] {
+        for (;;)
+        {
+            const auto msg = remote.recv(sizeof(header));
+            if (msg.size() != sizeof(header) || msg.get()[1] != 0)
+                return;
+            remote.send(msg.get(), msg.size());
+        }
+    });
+    for (auto _ : state)
+    {
+        local.send(header, sizeof(header));
+        benchmark::DoNotOptimize(local.recv(sizeof(header)));
+    }
+    const uint8_t stop[8] = {1, 1};
+    local.send(stop, sizeof(stop));
+    echo.join();
+}
+BENCHMARK(BM_IPC_SocketRoundTrip)->Arg(0)->Arg(100)->UseRealTime();
+
+// 64 compressible 512KB messages through a SendPipeline whose pool has Arg
+// threads, to a peer which discards them.
+static void BM_IPC_SendPipeline(benchmark::State& state)
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+    {
+        state.SkipWithError("socketpair failed");
+        return;
+    }
+    std::thread sink([fd = fds[1]] {
+        uint8_t buf[64_KB];
+        // credentials and capability, then the agreed level
+        if (::read(fd, buf, 2) != 2)
+            return;
+        const uint8_t level = 6;
+        if (::write(fd, &level, 1) != 1)
+            return;
+        while (0 < ::read(fd, buf, sizeof(buf)))
+        {}
+        ::close(fd);
+    });
+
+    constexpr size_t messages = 64;
+    Serializer ser(6);
+    const auto values = make_ascending(64_KB);
+    const auto payload = ser.serialize<q::Type::Long>(values.begin(), values.end());
+    {
+        // compressed as if remote
+        SocketConnection<Socket> conn(Socket(fds[0], false), "", 6);
+        qbind::ThreadPool pool(static_cast<size_t>(state.range(0)));
+        SendPipeline<Socket> pipeline(conn, {}, pool);
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            std::vector<Buffer> batch;
+            for (size_t i = 0; i < messages; ++i)
+                batch.push_back(copy_of(payload));
+            state.ResumeTiming();
+            for (auto& msg : batch)
+                pipeline.send_async(std::move(msg));
+            pipeline.flush();
+        }
+        ::shutdown(fds[0], SHUT_WR);
+    }
+    sink.join();
+    state.SetBytesProcessed(state.iterations() * messages * payload.size());
+}
+BENCHMARK(BM_IPC_SendPipeline)->Arg(1)->Arg(4)->UseRealTime();
+
+// (`upd;`trade;(price;size;sym)) with Arg rows, decoded in to column buffers.
+static void BM_IPC_SubscriberDecode(benchmark::State& state)
+{
+    const size_t rows = static_cast<size_t>(state.range(0));
+    const auto put_header = [](std::vector<uint8_t>& out, signed char t, size_t n) {
+        out.push_back(static_cast<uint8_t>(t));
+        out.push_back(0);
+        const auto count = static_cast<int32_t>(n);
+        out.insert(out.end(), reinterpret_cast<const uint8_t *>(&count), reinterpret_cast<const uint8_t *>(&count) + sizeof(count));
+    };
+    const auto put_symbol = [](std::vector<uint8_t>& out, const char *s) {
+        out.insert(out.end(), s, s + strlen(s) + 1);
+    };
+
+    std::vector<uint8_t> msg;
+    put_header(msg, 0, 3);
+    msg.push_back(static_cast<uint8_t>(-KS));
+    put_symbol(msg, "upd");
+    msg.push_back(static_cast<uint8_t>(-KS));
+    put_symbol(msg, "trade");
+    put_header(msg, 0, 3);
+    const auto prices = make_random(rows);
+    put_header(msg, KF, rows);
+    msg.insert(msg.end(), reinterpret_cast<const uint8_t *>(prices.data()), reinterpret_cast<const uint8_t *>(prices.data() + rows));
+    const auto sizes = make_ascending(rows);
+    put_header(msg, KJ, rows);
+    msg.insert(msg.end(), reinterpret_cast<const uint8_t *>(sizes.data()), reinterpret_cast<const uint8_t *>(sizes.data() + rows));
+    put_header(msg, KS, rows);
+    static const char *syms[] = {"AAPL", "MSFT", "GOOG", "AMZN"};
+    for (size_t i = 0; i < rows; ++i)
+        put_symbol(msg, syms[i % 4]);
+
+    Buffer payload{static_cast<uint8_t *>(malloc(msg.size())), msg.size()};
+    if (payload.get() == nullptr)
+        throw std::bad_alloc();
+    std::memcpy(payload.get(), msg.data(), msg.size());
+
+    size_t consumed = 0;
+    SubscriberOptions options;
+    options.batch_rows = 1 << 20;
+    Subscriber sub([&](const TableBuffer& table) { consumed += table.rows(); }, options);
+    for (auto _ : state)
+        sub.process(payload);
+    sub.flush();
+    benchmark::DoNotOptimize(consumed);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_IPC_SubscriberDecode)->Arg(1)->Arg(1 << 10);
@@ -0,0 +1,130 @@
+#include <benchmark/benchmark.h>
+
+#include <utility>
+
+#include "qbind/atom.h"
+#include "qbind/k.h"
+#include "qbind/vector.h"
+
+namespace q = qbind;
+namespace a = qbind::a;
+namespace v = qbind::v;
+
+// K: ownership and reference counting
+
+static void BM_K_Copy(benchmark::State& state)
+{
+    const q::K k{ktn(KJ, 16)};
+    for (auto _ : state)
+    {
+        q::K copy(k);
+        benchmark::DoNotOptimize(copy);
+    }
+}
+BENCHMARK(BM_K_Copy);
+
+static void BM_K_Move(benchmark::State& state)
+{
+    q::K k{ktn(KJ, 16)};
+    for (auto _ : state)
+    {
+        q::K moved(std::move(k));
+        benchmark::DoNotOptimize(moved);
+        k = std::move(moved);
+    }
+}
+BENCHMARK(BM_K_Move);
+
+static void BM_K_Borrowed(benchmark::State& state)
+{
+    ::K k = ktn(KJ, 16);
+    q::K owner{k};
+    for (auto _ : state)
+    {
+        auto borrowed = q::K::make_borrowed(k);
+        benchmark::DoNotOptimize(borrowed);
+    }
+}
+BENCHMARK(BM_K_Borrowed);
+
+static void BM_K_Refcount(benchmark::State& state)
+{
+    ::K k = ktn(KJ, 16);
+    q::K owner{k};
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(r1(k));
+        r0(k);
+    }
+}
+BENCHMARK(BM_K_Refcount);
+
+static void BM_K_Allocate(benchmark::State& state)
+{
+    const auto n = state.range(0);
+    for (auto _ : state)
+    {
+        q::K k{ktn(KJ, n)};
+        benchmark::DoNotOptimize(k);
+    }
+}
+BENCHMARK(BM_K_Allocate)->Arg(1)->Arg(1 << 10)->Arg(1 << 20);
+
+// Wrappers: construction with type validation, and without as the Converter
+// does for arguments it has already checked.
+
+static void BM_Atom_Construct(benchmark::State& state)
+{
+    const q::K k{kj(42)};
+    for (auto _ : state)
+    {
+        a::j atom(k);
+        benchmark::DoNotOptimize(atom);
+    }
+}
+BENCHMARK(BM_Atom_Construct);
+
+static void BM_Atom_ConstructUnchecked(benchmark::State& state)
+{
+    ::K k = kj(42);
+    q::K owner{k};
+    for (auto _ : state)
+    {
+        a::j atom(q::K::make_borrowed(k), q::internal::unchecked);
+        benchmark::DoNotOptimize(atom);
+    }
+}
+BENCHMARK(BM_Atom_ConstructUnchecked);
+
+static void BM_Vector_Construct(benchmark::State& state)
+{
+    const q::K k{ktn(KJ, 1024)};
+    for (auto _ : state)
+    {
+        v::j vec(k);
+        benchmark::DoNotOptimize(vec);
+    }
+}
+BENCHMARK(BM_Vector_Construct);
+
+static void BM_Vector_ConstructUnchecked(benchmark::State& state)
+{
+    ::K k = ktn(KJ, 1024);
+    q::K owner{k};
+    for (auto _ : state)
+    {
+        v::j vec(q::K::make_borrowed(k), q::internal::unchecked);
+        benchmark::DoNotOptimize(vec);
+    }
+}
+BENCHMARK(BM_Vector_ConstructUnchecked);
+
+static void BM_Vector_Create(benchmark::State& state)
+{
+    for (auto _ : state)
+    {
+        v::j vec{1, 2, 3, 4, 5, 6, 7, 8};
+        benchmark::DoNotOptimize(vec);
+    }
+}
+BENCHMARK(BM_Vector_Create);
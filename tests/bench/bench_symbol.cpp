@@ -0,0 +1,41 @@
+#include <benchmark/benchmark.h>
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "qbind/symbol.h"
+
+namespace q = qbind;
+
+static std::vector<std::string> make_names(size_t n)
+{
+    std::vector<std::string> names;
+    names.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+        names.push_back("ticker" + std::to_string(i));
+    return names;
+}
+
+// sn directly, the cost SymbolCache saves on a hit.
+static void BM_Intern_Sn(benchmark::State& state)
+{
+    const auto names = make_names(state.range(0));
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        const auto& name = names[i++ % names.size()];
+        benchmark::DoNotOptimize(sn(const_cast<char *>(name.data()), static_cast<I>(name.size())));
+    }
+}
+BENCHMARK(BM_Intern_Sn)->Arg(64)->Arg(1 << 14);
+
+static void BM_Intern_SymbolCache(benchmark::State& state)
+{
+    const auto names = make_names(state.range(0));
+    const q::internal::intern intern;
+    size_t i = 0;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(intern(names[i++ % names.size()]));
+}
+BENCHMARK(BM_Intern_SymbolCache)->Arg(64)->Arg(1 << 14);
@@ -0,0 +1,142 @@
+#include <benchmark/benchmark.h>
+
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "qbind/dictionary.h"
+#include "qbind/vector.h"
+
+namespace q = qbind;
+namespace v = qbind::v;
+
+static v::j make_longs(int64_t n)
+{
+    v::j vec(n);
+    std::iota(vec.begin(), vec.end(), int64_t{0});
+    return vec;
+}
+
+static v::s make_symbols(int64_t n)
+{
+    v::s vec(n);
+    for (int64_t i = 0; i < n; ++i)
+        vec[i] = "sym" + std::to_string(i);
+    return vec;
+}
+
+// Iteration: raw pointer as the baseline, then index and iterator access.
+
+static void BM_Vector_IterateRaw(benchmark::State& state)
+{
+    const auto vec = make_longs(state.range(0));
+    for (auto _ : state)
+    {
+        const int64_t *data = vec.get().data<int64_t>();
+        int64_t sum = 0;
+        for (size_t i = 0; i < vec.size(); ++i)
+            sum += data[i];
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Vector_IterateRaw)->Arg(1 << 10)->Arg(1 << 20);
+
+static void BM_Vector_IterateIndex(benchmark::State& state)
+{
+    const auto vec = make_longs(state.range(0));
+    for (auto _ : state)
+    {
+        int64_t sum = 0;
+        for (size_t i = 0; i < vec.size(); ++i)
+            sum += vec[i];
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Vector_IterateIndex)->Arg(1 << 10)->Arg(1 << 20);
+
+static void BM_Vector_IterateRange(benchmark::State& state)
+{
+    const auto vec = make_longs(state.range(0));
+    for (auto _ : state)
+    {
+        int64_t sum = 0;
+        for (const auto x : vec)
+            sum += x;
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Vector_IterateRange)->Arg(1 << 10)->Arg(1 << 20);
+
+static void BM_Vector_IterateSymbols(benchmark::State& state)
+{
+    const auto vec = make_symbols(state.range(0));
+    for (auto _ : state)
+    {
+        size_t length = 0;
+        for (size_t i = 0; i < vec.size(); ++i)
+            length += std::string_view(vec[i]).size();
+        benchmark::DoNotOptimize(length);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Vector_IterateSymbols)->Arg(1 << 10);
+
+// push_back: appends one at a time, growing in place through ja.
+
+static void BM_Vector_PushBack(benchmark::State& state)
+{
+    const auto n = state.range(0);
+    for (auto _ : state)
+    {
+        v::j vec(int64_t{0});
+        for (int64_t i = 0; i < n; ++i)
+            vec.push_back(i);
+        benchmark::DoNotOptimize(vec);
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_Vector_PushBack)->Arg(1 << 10)->Arg(1 << 16);
+
+static void BM_Vector_PushBackSymbol(benchmark::State& state)
+{
+    const auto n = state.range(0);
+    std::vector<std::string> names;
+    for (int64_t i = 0; i < 64; ++i)
+        names.push_back("sym" + std::to_string(i));
+
+    for (auto _ : state)
+    {
+        v::s vec(int64_t{0});
+        for (int64_t i = 0; i < n; ++i)
+            vec.push_back(names[i % names.size()]);
+        benchmark::DoNotOptimize(vec);
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_Vector_PushBackSymbol)->Arg(1 << 10);
+
+// Dictionary::find: a linear scan of the keys, so probe the last key.
+
+static void BM_Dictionary_FindLong(benchmark::State& state)
+{
+    const auto n = state.range(0);
+    q::Dictionary<v::j, v::j> dict(make_longs(n), make_longs(n));
+    const int64_t key = n - 1;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(dict.find(key));
+}
+BENCHMARK(BM_Dictionary_FindLong)->Arg(16)->Arg(1 << 10);
+
+static void BM_Dictionary_FindSymbol(benchmark::State& state)
+{
+    const auto n = state.range(0);
+    q::Dictionary<v::s, v::j> dict(make_symbols(n), make_longs(n));
+    const std::string key = "sym" + std::to_string(n - 1);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(dict.find(std::string_view{key}));
+}
+BENCHMARK(BM_Dictionary_FindSymbol)->Arg(16)->Arg(1 << 10);
@@ -0,0 +1,17 @@
+#include <benchmark/benchmark.h>
+
+#include "qbind/memory_manager.h"
+
+// Benchmarks run on the main thread, which needs the kdb memory system for
+// the K objects they allocate.
+int main(int argc, char** argv)
+{
+    qbind::MemoryManager::initialise();
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
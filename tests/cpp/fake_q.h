@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "connection.h"
+
+/**
+ * @brief Stand ins for the q end of a connection, shared by the connection
+ * tests.
+ */
+namespace fake_q
+{
+
+inline std::string local_hostname()
+{
+    char buf[256];
+    ::gethostname(buf, sizeof(buf));
+    return buf;
+}
+
+/**
+ * @brief Listens where Socket looks for a local q process on port.
+ */
+class UnixListener
+{
+public:
+
+    explicit UnixListener(uint16_t port)
+    : m_path("/tmp/kx." + std::to_string(port))
+    {
+        m_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, m_path.c_str());
+        ::unlink(m_path.c_str());
+        if (::bind(m_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(m_fd, 4) != 0)
+        {
+            ::close(m_fd);
+            throw std::runtime_error("Can't listen on " + m_path);
+        }
+    }
+
+    UnixListener(const UnixListener&) = delete;
+    UnixListener& operator=(const UnixListener&) = delete;
+
+    ~UnixListener()
+    {
+        ::close(m_fd);
+        ::unlink(m_path.c_str());
+    }
+
+    // The next connection, -1 once shut down.
+    int accept()
+    {
+        return ::accept(m_fd, nullptr, nullptr);
+    }
+
+    // Wake a blocked accept.
+    void shutdown()
+    {
+        ::shutdown(m_fd, SHUT_RDWR);
+    }
+
+private:
+    std::string m_path;
+    int m_fd;
+};
+
+/**
+ * @brief Plays q over a connected fd, which it owns, with blocking reads and
+ * writes. Reads throw once the other end has gone.
+ */
+class Peer
+{
+public:
+
+    explicit Peer(int fd)
+    : m_fd(fd)
+    {}
+
+    Peer(const Peer&) = delete;
+    Peer& operator=(const Peer&) = delete;
+
+    ~Peer()
+    {
+        close();
+    }
+
+    // Credentials and level up to a null, answered with level 6.
+    void handshake()
+    {
+        char c;
+        do
+            read_exact(&c, 1);
+        while (c != '\0');
+        const uint8_t level = 6;
+        if (::send(m_fd, &level, 1, MSG_NOSIGNAL) != 1)
+            throw std::runtime_error("send failed");
+    }
+
+    std::pair<std::string, MessageType> read_message()
+    {
+        uint8_t header[message_header_size];
+        read_exact(header, sizeof(header));
+        if (header[0] != 1 || header[2] != 0)
+            throw std::runtime_error("expected an uncompressed little endian message");
+        int32_t size;
+        memcpy(&size, header + 4, sizeof(size));
+        std::string payload(static_cast<size_t>(size) - message_header_size, '\0');
+        read_exact(payload.data(), payload.size());
+        return {std::move(payload), static_cast<MessageType>(header[1])};
+    }
+
+    void write_message(const std::string& payload, MessageType type)
+    {
+        std::string message(message_header_size, '\0');
+        message[0] = 1;
+        message[1] = static_cast<char>(type);
+        const auto size = static_cast<int32_t>(message_header_size + payload.size());
+        memcpy(message.data() + 4, &size, sizeof(size));
+        message += payload;
+        if (::send(m_fd, message.data(), message.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(message.size()))
+            throw std::runtime_error("send failed");
+    }
+
+    // End the connection, waking a blocked read, but keep the fd until close.
+    void shutdown()
+    {
+        if (m_fd != -1)
+            ::shutdown(m_fd, SHUT_RDWR);
+    }
+
+    void close()
+    {
+        if (m_fd != -1)
+            ::close(std::exchange(m_fd, -1));
+    }
+
+private:
+
+    void read_exact(void* p, size_t size)
+    {
+        auto* out = static_cast<char*>(p);
+        while (size != 0)
+        {
+            const auto n = ::recv(m_fd, out, size, 0);
+            if (n <= 0)
+                throw std::runtime_error("connection closed");
+            out += n;
+            size -= static_cast<size_t>(n);
+        }
+    }
+
+    int m_fd;
+};
+
+}
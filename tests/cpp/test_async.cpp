@@ -0,0 +1,134 @@
+#include <catch2/catch.hpp>
+
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include <poll.h>
+
+#include "qbind/async.h"
+#include "qbind/memory_manager.h"
+
+// q's event loop only exists inside q, so stand in for the two functions
+// the dispatcher uses: sd1 registers the completion fd and dot calls back.
+namespace
+{
+    ::K (*registered)(I) = nullptr;
+    int registered_fd = -1;
+    std::vector<::K> callbacks;
+}
+
+extern "C" K sd1(I fd, K (*fn)(I))
+{
+    registered_fd = fd;
+    registered = fn;
+    return nullptr;
+}
+
+extern "C" K dot(K, K x)
+{
+    callbacks.push_back(r1(x));
+    return knk(0);
+}
+
+std::vector<int64_t> scale(std::span<const int64_t> values, std::span<const int64_t> factor)
+{
+    std::vector<int64_t> res(values.begin(), values.end());
+    for (auto& v : res)
+        v *= factor[0];
+    return res;
+}
+
+std::vector<int64_t> fails(std::span<const int64_t>)
+{
+    throw std::runtime_error("bad input");
+}
+
+std::vector<int64_t> throws_int(std::span<const int64_t>)
+{
+    throw 42;
+}
+
+QBIND_FN_EXPORT_ASYNC(scale, async_scale, 2, 1)
+QBIND_FN_EXPORT_ASYNC(fails, async_fails, 1, 1)
+QBIND_FN_EXPORT_ASYNC(throws_int, async_throws_int, 1, 1)
+
+namespace
+{
+    // Run q's side of the event loop until n callbacks have been made.
+    void pump(size_t n)
+    {
+        while (callbacks.size() < n)
+        {
+            pollfd p{registered_fd, POLLIN, 0};
+            REQUIRE(poll(&p, 1, 5000) == 1);
+            registered(registered_fd);
+        }
+    }
+
+    // The (success;result) pair the callback was given.
+    ::K pair(size_t i)
+    {
+        REQUIRE(callbacks[i]->n == 1);
+        return reinterpret_cast<::K*>(callbacks[i]->G0)[0];
+    }
+
+    std::string_view error(::K p)
+    {
+        ::K msg = reinterpret_cast<::K*>(p->G0)[1];
+        return {reinterpret_cast<const char*>(msg->G0), static_cast<size_t>(msg->n)};
+    }
+}
+
+TEST_CASE("ASYNC_DISPATCHER")
+{
+    qbind::MemoryManager::initialise();
+    ::K callback = ka(100);
+
+    ::K values = ktn(KJ, 3);
+    for (int64_t i = 0; i < 3; ++i)
+        reinterpret_cast<int64_t*>(values->G0)[i] = i + 1;
+    ::K factor = kj(10);
+
+    ::K res = async_scale(callback, values, factor);
+    REQUIRE(res->t == 0);
+    r0(res);
+    // The worker had its own copies, q's arguments were never referenced.
+    REQUIRE(values->r == 0);
+    REQUIRE(factor->r == 0);
+    pump(1);
+
+    ::K ok = pair(0);
+    REQUIRE(reinterpret_cast<::K*>(ok->G0)[0]->g == 1);
+    ::K scaled = reinterpret_cast<::K*>(ok->G0)[1];
+    REQUIRE(scaled->t == KJ);
+    REQUIRE(scaled->n == 3);
+    REQUIRE(reinterpret_cast<int64_t*>(scaled->G0)[2] == 30);
+
+    r0(async_fails(callback, values));
+    pump(2);
+    REQUIRE(reinterpret_cast<::K*>(pair(1)->G0)[0]->g == 0);
+    REQUIRE(error(pair(1)) == "bad input");
+
+    // Anything thrown is reported, not just std::exceptions.
+    r0(async_throws_int(callback, values));
+    pump(3);
+    REQUIRE(reinterpret_cast<::K*>(pair(2)->G0)[0]->g == 0);
+    REQUIRE(error(pair(2)) == "Unknown exception");
+
+    // Only functions can be called back.
+    res = async_scale(factor, values, factor);
+    REQUIRE(res->t == -128);
+    r0(res);
+
+    REQUIRE(callback->r == 0);
+    for (auto c : callbacks)
+        r0(c);
+    callbacks.clear();
+    r0(callback);
+    r0(values);
+    r0(factor);
+}
@@ -0,0 +1,250 @@
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "async_connection.h"
+#include "fake_q.h"
+
+namespace
+{
+    Buffer buffer(const std::string& bytes)
+    {
+        auto* p = static_cast<uint8_t*>(malloc(bytes.size() ? bytes.size() : 1));
+        memcpy(p, bytes.data(), bytes.size());
+        return {p, bytes.size()};
+    }
+
+    std::string to_string(const Buffer& buff)
+    {
+        return {reinterpret_cast<const char*>(buff.get()), buff.size()};
+    }
+
+    // Plays q on the far end of a socketpair, blocking on its own thread
+    // which is joined, after the connection has gone, on destruction.
+    class FakeQ : public fake_q::Peer
+    {
+    public:
+
+        template<class F>
+        FakeQ(int fd, F script)
+        : fake_q::Peer(fd)
+        , m_thread([this, script]
+        {
+            try
+            {
+                handshake();
+                script(*this);
+            }
+            catch (...)
+            {
+                m_error = std::current_exception();
+            }
+        })
+        {}
+
+        ~FakeQ()
+        {
+            if (m_thread.joinable())
+                m_thread.join();
+        }
+
+        // Rethrow what went wrong on the peer's thread.
+        void check()
+        {
+            m_thread.join();
+            m_thread = std::thread();
+            if (m_error)
+                std::rethrow_exception(m_error);
+        }
+
+    private:
+        std::exception_ptr m_error;
+        std::thread m_thread;
+    };
+
+    Task<std::string> query(AsyncConnection& conn, std::string payload)
+    {
+        co_return to_string(co_await conn.query(buffer(payload)));
+    }
+
+    // Results or errors, so when_all waits for everything.
+    Task<std::string> outcome(Task<std::string> task)
+    {
+        try
+        {
+            co_return co_await task;
+        }
+        catch (const std::exception& e)
+        {
+            co_return std::string("error: ") + e.what();
+        }
+    }
+
+    Task<std::string> recv(AsyncConnection& conn)
+    {
+        auto [message, type] = co_await conn.recv();
+        co_return (type == MessageType::Async ? "async " : "sync ") + to_string(message);
+    }
+}
+
+TEST_CASE("ASYNC_CONNECTION")
+{
+    int fds[2];
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    EventLoop loop;
+
+    SECTION("responses are matched first in first out")
+    {
+        std::vector<std::string> seen;
+        FakeQ q(fds[1], [&seen](FakeQ& q)
+        {
+            // read them all before answering any
+            for (int i = 0; i < 3; ++i)
+            {
+                auto [payload, type] = q.read_message();
+                if (type != MessageType::Sync)
+                    throw std::runtime_error("expected a sync message");
+                seen.push_back(payload);
+            }
+            for (const auto& payload : seen)
+                q.write_message("re " + payload, MessageType::Response);
+        });
+        AsyncConnection conn(loop, Socket(fds[0], true));
+
+        const auto results = loop.run([&]() -> Task<std::vector<std::string>>
+        {
+            std::vector<Task<std::string>> tasks;
+            for (const char* payload : {"a", "bb", "ccc"})
+                tasks.push_back(query(conn, payload));
+            co_return co_await when_all(loop, std::move(tasks));
+        }());
+        q.check();
+
+        REQUIRE(results == std::vector<std::string>{"re a", "re bb", "re ccc"});
+        REQUIRE(seen == std::vector<std::string>{"a", "bb", "ccc"});
+        REQUIRE(conn.in_flight() == 0);
+    }
+
+    SECTION("writers take turns")
+    {
+        // Big enough to fill the socket buffer, so the first writer is
+        // suspended part way through while the others wait their turn.
+        const size_t big = 1 << 20;
+        std::promise<void> go;
+        std::vector<std::string> seen;
+        FakeQ q(fds[1], [&seen, go = go.get_future().share()](FakeQ& q)
+        {
+            if (go.wait_for(std::chrono::seconds(10)) != std::future_status::ready)
+                throw std::runtime_error("never told to read");
+            for (int i = 0; i < 3; ++i)
+            {
+                auto [payload, type] = q.read_message();
+                // an interleaved message would mix its bytes with another's
+                if (payload.find_first_not_of(payload[0]) != std::string::npos)
+                    throw std::runtime_error("message " + std::to_string(i) + " was interleaved");
+                seen.push_back(payload);
+                q.write_message(payload.substr(0, 1), MessageType::Response);
+            }
+        });
+        AsyncConnection conn(loop, Socket(fds[0], true));
+
+        size_t in_flight = 0;
+        // runs once each query has written what it can or queued
+        const auto count = [&]() -> Task<void>
+        {
+            co_await loop.schedule();
+            in_flight = conn.in_flight();
+            go.set_value();
+        };
+        const auto results = loop.run([&]() -> Task<std::vector<std::string>>
+        {
+            loop.spawn(count());
+            std::vector<Task<std::string>> tasks;
+            tasks.push_back(query(conn, std::string(big, 'x')));
+            tasks.push_back(query(conn, std::string(big, 'y')));
+            tasks.push_back(query(conn, "z"));
+            co_return co_await when_all(loop, std::move(tasks));
+        }());
+        q.check();
+
+        REQUIRE(in_flight == 3);
+        REQUIRE(results == std::vector<std::string>{"x", "y", "z"});
+        REQUIRE(seen.size() == 3);
+        REQUIRE(seen[0].size() == big);
+        REQUIRE(seen[1].size() == big);
+        REQUIRE(conn.in_flight() == 0);
+    }
+
+    SECTION("pushed messages reach recv")
+    {
+        FakeQ q(fds[1], [](FakeQ& q)
+        {
+            q.write_message("first", MessageType::Async);
+            auto [sent, sent_type] = q.read_message();
+            if (sent != "note" || sent_type != MessageType::Async)
+                throw std::runtime_error("expected the async message");
+            auto [question, type] = q.read_message();
+            // a push between a query and its response
+            q.write_message("second", MessageType::Async);
+            q.write_message("re " + question, MessageType::Response);
+            q.write_message("callback", MessageType::Sync);
+        });
+        AsyncConnection conn(loop, Socket(fds[0], true));
+
+        const auto results = loop.run([&]() -> Task<std::vector<std::string>>
+        {
+            std::vector<std::string> res;
+            res.push_back(co_await recv(conn));
+            co_await conn.send_async(buffer("note"));
+            res.push_back(co_await query(conn, "q"));
+            res.push_back(co_await recv(conn));
+            res.push_back(co_await recv(conn));
+            co_return res;
+        }());
+        q.check();
+
+        REQUIRE(results == std::vector<std::string>{"async first", "re q", "async second", "sync callback"});
+    }
+
+    SECTION("failure wakes every pending operation")
+    {
+        FakeQ q(fds[1], [](FakeQ& q)
+        {
+            q.read_message();
+            q.read_message();
+            q.close();
+        });
+        AsyncConnection conn(loop, Socket(fds[0], true));
+
+        const auto results = loop.run([&]() -> Task<std::vector<std::string>>
+        {
+            std::vector<Task<std::string>> tasks;
+            tasks.push_back(outcome(query(conn, "a")));
+            tasks.push_back(outcome(recv(conn)));
+            tasks.push_back(outcome(query(conn, "b")));
+            co_return co_await when_all(loop, std::move(tasks));
+        }());
+        q.check();
+
+        for (const auto& result : results)
+            REQUIRE(result.starts_with("error: "));
+        REQUIRE(conn.failed());
+        REQUIRE(conn.in_flight() == 0);
+
+        // and later operations fail straight away
+        const auto later = loop.run(outcome(query(conn, "c")));
+        REQUIRE(later.starts_with("error: "));
+    }
+}
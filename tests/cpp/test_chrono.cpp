@@ -0,0 +1,83 @@
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <limits>
+#include <vector>
+
+#include "qbind/chrono.h"
+#include "qbind/memory_manager.h"
+
+using namespace std::chrono;
+
+TEST_CASE("CHRONO_SCALAR")
+{
+    // 2000.01.01D00:00:00.000000001
+    REQUIRE(qbind::to_sys_time(1) == sys_days{2000y/January/1} + 1ns);
+    REQUIRE(qbind::to_timestamp(sys_days{1970y/January/1}) == -946684800000000000LL);
+    REQUIRE(qbind::to_sys_days(0) == sys_days{2000y/January/1});
+    REQUIRE(qbind::to_date(sys_days{1999y/December/31}) == -1);
+
+    REQUIRE(qbind::to_year_month(0) == 2000y/January);
+    REQUIRE(qbind::to_year_month(-1) == 1999y/December);
+    REQUIRE(qbind::to_year_month(25) == 2002y/February);
+    REQUIRE(qbind::to_month(1999y/November) == -2);
+
+    REQUIRE(qbind::datetime_to_timestamp(1.5) == 3 * qbind::internal::ns_per_day / 2);
+    REQUIRE(qbind::datetime_to_timestamp(-0.25) == -qbind::internal::ns_per_day / 4);
+}
+
+TEST_CASE("CHRONO_NULLS")
+{
+    constexpr auto nj = std::numeric_limits<int64_t>::min();
+    constexpr auto wj = std::numeric_limits<int64_t>::max();
+    constexpr auto ni = std::numeric_limits<int32_t>::min();
+    constexpr auto nan = std::numeric_limits<double>::quiet_NaN();
+    constexpr auto inf = std::numeric_limits<double>::infinity();
+
+    std::vector<int64_t> ts{nj, wj, -wj, 0};
+    std::vector<int64_t> unix(ts.size());
+    qbind::timestamp_to_unix_ns(ts.data(), unix.data(), ts.size());
+    REQUIRE(unix == std::vector<int64_t>{nj, wj, -wj, 946684800000000000LL});
+    qbind::unix_ns_to_timestamp(unix.data(), unix.data(), unix.size());
+    REQUIRE(unix == ts);
+
+    std::vector<int32_t> dates{ni, 1};
+    std::vector<int32_t> days(dates.size());
+    qbind::date_to_unix_days(dates.data(), days.data(), dates.size());
+    REQUIRE(days == std::vector<int32_t>{ni, 10958});
+
+    std::vector<double> dt{nan, inf, -inf, 1e300, 0.0};
+    std::vector<int64_t> out(dt.size());
+    qbind::datetime_to_timestamp(dt.data(), out.data(), dt.size());
+    REQUIRE(out == std::vector<int64_t>{nj, wj, -wj, wj, 0});
+
+    REQUIRE_FALSE(qbind::to_year_month(ni).ok());
+    REQUIRE(qbind::to_month(qbind::to_year_month(ni)) == ni);
+}
+
+TEST_CASE("CHRONO_VIEW")
+{
+    qbind::MemoryManager::initialise();
+
+    qbind::Vector<qbind::Type::Date> dates{0, 366};
+    qbind::ChronoView view(dates);
+    REQUIRE(view.size() == 2);
+    REQUIRE(view[0] == sys_days{2000y/January/1});
+    REQUIRE(view.at(1) == sys_days{2001y/January/1});
+    REQUIRE_THROWS(view.at(2));
+
+    qbind::Vector<qbind::Type::Timestamp> ts{0, 1000};
+    auto unix = qbind::to_unix_ns(ts);
+    auto back = qbind::from_unix_ns(unix.data(), unix.size());
+    REQUIRE((back == ts));
+
+    constexpr auto ni = std::numeric_limits<int32_t>::min();
+    qbind::Vector<qbind::Type::Month> months{-1, 0, 25, ni};
+    auto yms = qbind::to_year_months(months);
+    REQUIRE(yms.size() == 4);
+    REQUIRE(yms[0] == 1999y/December);
+    REQUIRE(yms[2] == 2002y/February);
+    REQUIRE_FALSE(yms[3].ok());
+    auto months_back = qbind::from_year_months(yms.data(), yms.size());
+    REQUIRE((months_back == months));
+}
@@ -0,0 +1,430 @@
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "connection.h"
+#include "fake_q.h"
+
+TEST_CASE("THROW_ERRNO")
+{
+    errno = ECONNREFUSED;
+    try
+    {
+        THROW_ERRNO_IF(true);
+        FAIL("Expected a std::system_error");
+    }
+    catch (const std::system_error& e)
+    {
+        REQUIRE(e.code().value() == ECONNREFUSED);
+        REQUIRE(e.code().category() == std::system_category());
+        // location first, then the errno's description
+        const std::string what = e.what();
+        REQUIRE(what.find("test_connection.cpp line ") != std::string::npos);
+        REQUIRE(what.find(std::system_category().message(ECONNREFUSED)) != std::string::npos);
+    }
+
+    errno = EBADF;
+    REQUIRE_NOTHROW([] { THROW_ERRNO_IF(false); }());
+}
+
+TEST_CASE("BUFFER_READ_UNALIGNED")
+{
+    // reads land at any offset in a message, so none may assume alignment
+    auto* raw = static_cast<uint8_t*>(malloc(32));
+    Buffer buff(raw, 32, std::endian::big);
+    size_t idx = 1;
+    buff.write<int32_t>(0x01020304, idx);
+    buff.write<int64_t>(-2, idx);
+    buff.write_at<double>(1.5, 19);
+
+    REQUIRE(raw[1] == 0x01);
+    REQUIRE(raw[4] == 0x04);
+
+    idx = 1;
+    REQUIRE(buff.read<int32_t>(idx) == 0x01020304);
+    REQUIRE(idx == 5);
+    REQUIRE(buff.read<int64_t>(idx) == -2);
+    REQUIRE(idx == 13);
+    REQUIRE(buff.read_at<int32_t>(1) == 0x01020304);
+    REQUIRE(buff.read_at<double>(19) == 1.5);
+}
+
+namespace
+{
+    // Reverse each element a byte at a time.
+    std::vector<uint8_t> naive_swap(const std::vector<uint8_t>& in, size_t width)
+    {
+        std::vector<uint8_t> res(in);
+        for (size_t i = 0; i + width <= res.size(); i += width)
+            std::reverse(res.begin() + i, res.begin() + i + width);
+        return res;
+    }
+
+    std::vector<uint8_t> pattern(size_t bytes)
+    {
+        std::vector<uint8_t> res(bytes);
+        for (size_t i = 0; i < bytes; ++i)
+            res[i] = static_cast<uint8_t>(i * 7 + 1);
+        return res;
+    }
+}
+
+TEST_CASE("BYTESWAP")
+{
+    SECTION("widths and tails")
+    {
+        // counts either side of the 16 and 32 byte blocks
+        for (size_t width : {1, 2, 4, 8, 16})
+            for (size_t count = 0; count < 80; ++count)
+            {
+                const auto in = pattern(count * width);
+                const auto expected = naive_swap(in, width);
+
+                std::vector<uint8_t> out(in.size());
+                byteswap(out.data(), in.data(), count, width);
+                REQUIRE(out == expected);
+
+                auto in_place = in;
+                byteswap(in_place.data(), in_place.data(), count, width);
+                REQUIRE(in_place == expected);
+            }
+    }
+
+#ifdef QBIND_BYTESWAP_SIMD
+    SECTION("each instruction set the CPU has")
+    {
+        const auto in = pattern(8 * 37);
+        for (size_t width : {2, 4, 8})
+        {
+            const int mask_index = detail::byteswap_mask_index(width);
+            const auto expected = naive_swap(in, width);
+            std::vector<detail::byteswap_blocks> kernels;
+            if (__builtin_cpu_supports("ssse3"))
+                kernels.push_back(detail::byteswap_ssse3);
+            if (__builtin_cpu_supports("avx2"))
+                kernels.push_back(detail::byteswap_avx2);
+            for (auto kernel : kernels)
+            {
+                std::vector<uint8_t> out(in.size());
+                const size_t done = kernel(out.data(), in.data(), in.size(), mask_index);
+                // whole 16 byte blocks only
+                REQUIRE(done == in.size() / 16 * 16);
+                REQUIRE(std::equal(out.begin(), out.begin() + done, expected.begin()));
+            }
+        }
+    }
+#endif
+
+    SECTION("buffer reads")
+    {
+        std::vector<int64_t> values(41);
+        for (size_t i = 0; i < values.size(); ++i)
+            values[i] = static_cast<int64_t>(i) * 0x0102030405060708 - 3;
+        const size_t bytes = values.size() * sizeof(int64_t);
+
+        auto* raw = static_cast<uint8_t*>(malloc(1 + bytes));
+        Buffer buff(raw, 1 + bytes, std::endian::big);
+        size_t idx = 1;
+        for (auto x : values)
+            buff.write<int64_t>(x, idx);
+
+        std::vector<int64_t> out(values.size());
+        idx = 1;
+        buff.read_array(idx, out.data(), out.size());
+        REQUIRE(idx == 1 + bytes);
+        REQUIRE(out == values);
+
+        // in place, then read as native
+        buff.to_native_at(1, values.size(), sizeof(int64_t));
+        buff.set_endianness(std::endian::native);
+        REQUIRE(buff.read_at<int64_t>(1 + 40 * sizeof(int64_t)) == values[40]);
+    }
+}
+
+TEST_CASE("SOCKET_MOVE")
+{
+    const fake_q::UnixListener listener(47611);
+    Socket a(fake_q::local_hostname(), 47611);
+    REQUIRE(a.is_unix_domain_socket());
+
+    // a moved socket is still a unix domain socket, so isn't compressed
+    Socket b(std::move(a));
+    REQUIRE(b.is_unix_domain_socket());
+
+    Socket c(fake_q::local_hostname(), 47611);
+    Socket d(std::move(c));
+    d = std::move(b);
+    REQUIRE(d.is_unix_domain_socket());
+}
+
+TEST_CASE("SPIN_RECV")
+{
+    int fds[2];
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    Socket local(fds[0], true);
+    Socket remote(fds[1], true);
+
+    const std::vector<uint8_t> message = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+    // the message in pieces, a pause before each
+    const auto send_pieces = [&](std::chrono::microseconds pause)
+    {
+        return std::thread([&remote, &message, pause]
+        {
+            for (size_t i = 0; i < message.size(); i += 3)
+            {
+                std::this_thread::sleep_for(pause);
+                remote.send(message.data() + i, std::min<size_t>(3, message.size() - i));
+            }
+        });
+    };
+
+    BusyPollOptions options;
+    SECTION("partial reads while spinning")
+    {
+        options.spin_budget = std::chrono::seconds(10);
+        local.set_busy_poll(options);
+        auto sender = send_pieces(std::chrono::microseconds(500));
+        const auto received = local.recv(message.size());
+        sender.join();
+        REQUIRE(std::vector<uint8_t>(received.get(), received.get() + received.size()) == message);
+    }
+
+    SECTION("partial reads past the budget")
+    {
+        // spins out on the first piece then blocks for the rest
+        options.spin_budget = std::chrono::microseconds(50);
+        local.set_busy_poll(options);
+        auto sender = send_pieces(std::chrono::milliseconds(5));
+        const auto received = local.recv(message.size());
+        sender.join();
+        REQUIRE(std::vector<uint8_t>(received.get(), received.get() + received.size()) == message);
+    }
+
+    SECTION("peer closes")
+    {
+        options.spin_budget = std::chrono::milliseconds(100);
+        local.set_busy_poll(options);
+        remote.send(message.data(), 3);
+        ::shutdown(remote.fd(), SHUT_WR);
+
+        // what arrived before the close, then nothing
+        REQUIRE(local.recv(message.size()).size() == 3);
+        REQUIRE(local.recv(message.size()).size() == 0);
+
+        local.set_busy_poll({});
+        REQUIRE(local.recv(message.size()).size() == 0);
+    }
+}
+
+namespace
+{
+    Buffer make_buffer(const std::vector<uint8_t>& bytes)
+    {
+        auto* p = static_cast<uint8_t*>(malloc(bytes.size()));
+        std::copy(bytes.begin(), bytes.end(), p);
+        return {p, bytes.size()};
+    }
+
+    std::vector<uint8_t> to_vector(const Buffer& buff)
+    {
+        return {buff.get(), buff.get() + buff.size()};
+    }
+
+    std::vector<uint8_t> ascending_longs(size_t count)
+    {
+        std::vector<uint8_t> res(count * sizeof(int64_t));
+        for (size_t i = 0; i < count; ++i)
+        {
+            const auto v = static_cast<int64_t>(i);
+            std::memcpy(res.data() + i * sizeof(v), &v, sizeof(v));
+        }
+        return res;
+    }
+
+    // xorshift bytes, which don't compress
+    std::vector<uint8_t> noise(size_t bytes)
+    {
+        std::vector<uint8_t> res(bytes);
+        uint32_t x = 2463534242;
+        for (auto& b : res)
+        {
+            x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+            b = static_cast<uint8_t>(x);
+        }
+        return res;
+    }
+
+    // Leaves garbage where compress's locals will be
+    [[gnu::noinline]] void dirty_stack()
+    {
+        volatile uint8_t junk[16384];
+        for (size_t i = 0; i < sizeof(junk); ++i)
+            junk[i] = 0xff;
+    }
+}
+
+TEST_CASE("COMPRESS")
+{
+    const auto payload = ascending_longs(1000);
+
+    const auto clean = to_vector(compress(make_buffer(payload)));
+    REQUIRE(clean.size() < payload.size() / 2);
+
+    // the offset cache must start empty, whatever was on the stack
+    dirty_stack();
+    REQUIRE(to_vector(compress(make_buffer(payload))) == clean);
+
+    // incompressible input comes back as it was
+    const auto random = noise(4096);
+    auto in = make_buffer(random);
+    const auto* in_ptr = in.get();
+    const auto out = compress(std::move(in));
+    REQUIRE(out.get() == in_ptr);
+    REQUIRE(to_vector(out) == random);
+}
+
+namespace
+{
+    // A compressed payload as it arrives: the uncompressed message size, then the data.
+    Buffer as_received(const Buffer& compressed, size_t payload_size)
+    {
+        auto* p = static_cast<uint8_t*>(malloc(4 + compressed.size()));
+        Buffer res(p, 4 + compressed.size());
+        res.write_at<uint32_t>(static_cast<uint32_t>(payload_size + 8), 0);
+        std::memcpy(p + 4, compressed.get(), compressed.size());
+        return res;
+    }
+
+    void require_round_trip(const std::vector<uint8_t>& payload)
+    {
+        const auto compressed = compress(make_buffer(payload));
+        REQUIRE(compressed.size() < payload.size());
+        REQUIRE(to_vector(decompress(as_received(compressed, payload.size()), 1)) == payload);
+    }
+}
+
+TEST_CASE("DECOMPRESS")
+{
+    SECTION("ascending longs")
+    {
+        require_round_trip(ascending_longs(1000));
+    }
+    SECTION("zeros")
+    {
+        // every run overlaps the bytes it is copied to
+        require_round_trip(std::vector<uint8_t>(5000, 0));
+    }
+    SECTION("repeated pattern")
+    {
+        std::vector<uint8_t> payload;
+        for (int i = 0; i < 400; ++i)
+            for (uint8_t b : {'a', 'b', 'c', 'd', 'e', 'f', 'g'})
+                payload.push_back(b);
+        require_round_trip(payload);
+    }
+}
+
+TEST_CASE("COMPRESSION_POLICY")
+{
+    using namespace std::chrono_literals;
+    // below the sample threshold, so judged on what came before
+    const auto small = make_buffer(ascending_longs(500));
+
+    SECTION("large payloads judged on a sample")
+    {
+        CompressionPolicy policy;
+        REQUIRE_FALSE(policy.should_compress(make_buffer(noise(128 * 1024)), MessageType::Async));
+        REQUIRE(policy.should_compress(make_buffer(ascending_longs(16 * 1024)), MessageType::Async));
+
+        // only the sample was compressed
+        const auto stats = policy.stats(MessageType::Async);
+        REQUIRE(stats.skipped == 1);
+        REQUIRE(stats.attempted == 0);
+        REQUIRE(stats.sampled);
+    }
+
+    SECTION("message types kept apart")
+    {
+        CompressionPolicy policy;
+        policy.record(MessageType::Async, 3000, 3000, 1ms);
+        REQUIRE_FALSE(policy.should_compress(small, MessageType::Async));
+        REQUIRE(policy.should_compress(small, MessageType::Sync));
+        policy.record(MessageType::Sync, 3000, 300, 1ms);
+
+        REQUIRE(policy.stats(MessageType::Async).ratio == 1.0);
+        REQUIRE(policy.stats(MessageType::Async).skipped == 1);
+        REQUIRE(policy.stats(MessageType::Sync).ratio == Approx(0.1));
+        REQUIRE(policy.stats(MessageType::Sync).compressed == 1);
+        REQUIRE_FALSE(policy.stats(MessageType::Response).sampled);
+    }
+
+    SECTION("retried every retry_interval")
+    {
+        CompressionPolicyOptions options;
+        options.retry_interval = 4;
+        CompressionPolicy policy(options);
+        policy.record(MessageType::Async, 3000, 3000, 1ms);
+        for (int i = 0; i < 3; ++i)
+            REQUIRE_FALSE(policy.should_compress(small, MessageType::Async));
+        REQUIRE(policy.should_compress(small, MessageType::Async));
+        REQUIRE(policy.stats(MessageType::Async).skipped == 3);
+        REQUIRE(policy.stats(MessageType::Async).since_attempt == 0);
+        REQUIRE_FALSE(policy.should_compress(small, MessageType::Async));
+    }
+
+    SECTION("link faster than compressing")
+    {
+        // at 3000 bytes a millisecond compressing saves 2.7MB a second
+        CompressionPolicyOptions options;
+        options.link_bytes_per_second = 1e9;
+        CompressionPolicy fast(options);
+        fast.record(MessageType::Async, 3000, 300, 1ms);
+        REQUIRE_FALSE(fast.should_compress(small, MessageType::Async));
+
+        options.link_bytes_per_second = 1e6;
+        CompressionPolicy slow(options);
+        slow.record(MessageType::Async, 3000, 300, 1ms);
+        REQUIRE(slow.should_compress(small, MessageType::Async));
+    }
+
+    SECTION("moved")
+    {
+        static_assert(std::is_move_assignable_v<SocketConnection<Socket>>);
+        CompressionPolicy policy;
+        policy.record(MessageType::Async, 3000, 300, 1ms);
+        CompressionPolicy moved(std::move(policy));
+        REQUIRE(moved.stats(MessageType::Async).compressed == 1);
+        CompressionPolicy assigned;
+        assigned = std::move(moved);
+        REQUIRE(assigned.stats(MessageType::Async).compressed == 1);
+    }
+
+    SECTION("encode_header")
+    {
+        const auto payload = ascending_longs(1000);
+        auto local = make_buffer(payload);
+        const auto [local_header, local_size] = encode_header(local, MessageType::Async, 3, nullptr);
+        REQUIRE(local_size == message_header_size);
+        REQUIRE(local_header.get()[2] == 0);
+        REQUIRE(to_vector(local) == payload);
+
+        CompressionPolicy policy;
+        auto remote = make_buffer(payload);
+        const auto [remote_header, remote_size] = encode_header(remote, MessageType::Async, 3, &policy);
+        REQUIRE(remote_header.get()[2] == 1);
+        REQUIRE(remote.size() < payload.size() / 2);
+        REQUIRE(policy.stats(MessageType::Async).compressed == 1);
+    }
+}
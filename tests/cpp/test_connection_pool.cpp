@@ -0,0 +1,251 @@
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "connection_pool.h"
+#include "fake_q.h"
+
+namespace
+{
+    /**
+     * A q process on a local port, answering every query with its name
+     * after delay. Listens where Socket looks for a local q, with a thread
+     * per connection.
+     */
+    class FakeReplica
+    {
+    public:
+
+        FakeReplica(uint16_t port, std::string name, std::chrono::milliseconds delay = {})
+        : m_listener(port)
+        , m_name(std::move(name))
+        , m_delay(delay)
+        , m_acceptor([this] { accept_loop(); })
+        {}
+
+        ~FakeReplica()
+        {
+            m_listener.shutdown();
+            m_acceptor.join();
+            drop();
+            for (auto& t : m_sessions)
+                t.join();
+        }
+
+        // End every connection, as if q had restarted.
+        void drop()
+        {
+            std::lock_guard<std::mutex> lk(m_mutex);
+            for (auto& peer : m_peers)
+                peer->shutdown();
+        }
+
+        size_t accepted() const
+        {
+            return m_accepted;
+        }
+
+        size_t answered() const
+        {
+            return m_answered;
+        }
+
+    private:
+
+        void accept_loop()
+        {
+            for (;;)
+            {
+                const int fd = m_listener.accept();
+                if (fd == -1)
+                    return;
+                std::lock_guard<std::mutex> lk(m_mutex);
+                auto& peer = *m_peers.emplace_back(std::make_unique<fake_q::Peer>(fd));
+                m_sessions.emplace_back([this, &peer] { serve(peer); });
+                ++m_accepted;
+            }
+        }
+
+        void serve(fake_q::Peer& peer)
+        {
+            try
+            {
+                peer.handshake();
+                for (;;)
+                {
+                    peer.read_message();
+                    std::this_thread::sleep_for(m_delay);
+                    peer.write_message(m_name, MessageType::Response);
+                    ++m_answered;
+                }
+            }
+            catch (const std::runtime_error&)
+            {
+                // dropped, or the pool went away
+            }
+        }
+
+        fake_q::UnixListener m_listener;
+        std::string m_name;
+        std::chrono::milliseconds m_delay;
+        std::mutex m_mutex;
+        // closed once every session has been joined
+        std::vector<std::unique_ptr<fake_q::Peer>> m_peers;
+        std::vector<std::thread> m_sessions;
+        std::atomic<size_t> m_accepted{0};
+        std::atomic<size_t> m_answered{0};
+        std::thread m_acceptor;
+    };
+
+    // Wait on the loop, so the connections keep being served.
+    Task<void> sleep_for(EventLoop& loop, std::chrono::milliseconds delay)
+    {
+        const int fd = ::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if (fd == -1)
+            throw std::runtime_error("timerfd_create failed");
+        itimerspec spec{};
+        spec.it_value.tv_sec = delay.count() / 1000;
+        spec.it_value.tv_nsec = (delay.count() % 1000) * 1000000 + 1;
+        ::timerfd_settime(fd, 0, &spec, nullptr);
+        co_await loop.readable(fd);
+        loop.forget(fd);
+        ::close(fd);
+    }
+
+    Task<std::string> query(ConnectionPool& pool)
+    {
+        auto* p = static_cast<uint8_t*>(malloc(1));
+        *p = 0;
+        const auto res = co_await pool.query(Buffer(p, 1));
+        co_return std::string(reinterpret_cast<const char*>(res.get()), res.size());
+    }
+
+    std::vector<Replica> replicas(std::initializer_list<uint16_t> ports)
+    {
+        std::vector<Replica> res;
+        for (auto port : ports)
+            res.push_back({fake_q::local_hostname(), port});
+        return res;
+    }
+}
+
+TEST_CASE("CONNECTION_POOL")
+{
+    EventLoop loop;
+    ConnectionPoolOptions options;
+    options.reconnect_min = std::chrono::milliseconds(10);
+    options.reconnect_max = std::chrono::milliseconds(20);
+
+    SECTION("wait_connected")
+    {
+        FakeReplica a(47621, "a");
+        // nothing listens on the second port
+        ConnectionPool pool(loop, replicas({47621, 47622}), options);
+        loop.run(pool.wait_connected(1));
+        REQUIRE(pool.connected() == 1);
+        REQUIRE(loop.run(query(pool)) == "a");
+
+        // the second member comes up later
+        FakeReplica b(47622, "b");
+        loop.run(pool.wait_connected(2));
+        REQUIRE(pool.connected() == 2);
+    }
+
+    SECTION("wait_connected throws once the pool closes")
+    {
+        auto pool = std::make_unique<ConnectionPool>(loop, replicas({47623}), options);
+        std::string error;
+        const auto wait = [&]() -> Task<void>
+        {
+            try
+            {
+                co_await pool->wait_connected(1);
+            }
+            catch (const std::exception& e)
+            {
+                error = e.what();
+            }
+        };
+        loop.run([&]() -> Task<void>
+        {
+            loop.spawn(wait());
+            co_await sleep_for(loop, std::chrono::milliseconds(30));
+            pool.reset();
+            co_await sleep_for(loop, std::chrono::milliseconds(1));
+        }());
+        REQUIRE(error == "Connection pool closed");
+    }
+
+    SECTION("queries go to the least loaded member")
+    {
+        FakeReplica slow(47624, "slow", std::chrono::milliseconds(50));
+        FakeReplica fast(47625, "fast");
+        ConnectionPool pool(loop, replicas({47624, 47625}), options);
+        loop.run(pool.wait_connected(2));
+
+        // one at a time until both have answered, ties take turns
+        for (int i = 0; i < 4 && (pool.latency(0).count() == 0 || pool.latency(1).count() == 0); ++i)
+            loop.run(query(pool));
+        REQUIRE(pool.latency(0) > pool.latency(1));
+
+        // a query on the slow member costs more than many on the fast one
+        const size_t before = slow.answered();
+        const auto results = loop.run([&]() -> Task<std::vector<std::string>>
+        {
+            std::vector<Task<std::string>> tasks;
+            for (int i = 0; i < 10; ++i)
+                tasks.push_back(query(pool));
+            auto all = when_all(loop, std::move(tasks));
+            co_return co_await all;
+        }());
+        REQUIRE(results == std::vector<std::string>(10, "fast"));
+        REQUIRE(slow.answered() == before);
+        REQUIRE(pool.in_flight(1) == 0);
+    }
+
+    SECTION("a failed member is reconnected")
+    {
+        FakeReplica a(47626, "a");
+        FakeReplica b(47627, "b");
+        ConnectionPool pool(loop, replicas({47626, 47627}), options);
+        loop.run(pool.wait_connected(2));
+        REQUIRE(a.accepted() == 1);
+
+        a.drop();
+        size_t lowest = pool.connected();
+        loop.run([&]() -> Task<void>
+        {
+            // noticed by the member's watcher, then reconnected after the
+            // backoff
+            const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+            while ((a.accepted() < 2 || pool.connected() < 2) && std::chrono::steady_clock::now() < deadline)
+            {
+                co_await sleep_for(loop, std::chrono::milliseconds(5));
+                lowest = std::min(lowest, pool.connected());
+            }
+        }());
+        REQUIRE(lowest == 1);
+        REQUIRE(a.accepted() == 2);
+        REQUIRE(pool.connected() == 2);
+
+        // and serves queries again
+        std::vector<std::string> results;
+        for (int i = 0; i < 4; ++i)
+            results.push_back(loop.run(query(pool)));
+        REQUIRE(std::count(results.begin(), results.end(), "a") != 0);
+    }
+}
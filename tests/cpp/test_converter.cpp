@@ -0,0 +1,180 @@
+#include <catch2/catch.hpp>
+
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "qbind/atom.h"
+#include "qbind/converter.h"
+#include "qbind/enum_vector.h"
+#include "qbind/function.h"
+#include "qbind/memory_manager.h"
+#include "qbind/tuple.h"
+#include "qbind/vector.h"
+
+// Rows per symbol, counted on the codes.
+std::vector<int64_t> counts(qbind::EnumVector syms)
+{
+    std::vector<int64_t> res;
+    for (const auto& rows : syms.group())
+        res.push_back(static_cast<int64_t>(rows.size()));
+    return res;
+}
+
+QBIND_FN_EXPORT(counts, qcounts, 1, 1)
+
+TEST_CASE("CONVERTER_VIEWS")
+{
+    qbind::MemoryManager::initialise();
+
+    SECTION("SPAN")
+    {
+        ::K list = ktn(KF, 3);
+        qbind::K owner{list};
+        auto span = qbind::Converter::to_cpp<std::span<const double>>(list);
+        REQUIRE(span.size() == 3);
+        // Bound on to the kdb memory, not a copy.
+        REQUIRE(span.data() == owner.data<double>());
+
+        ::K atom = kj(7);
+        qbind::K atom_owner{atom};
+        auto single = qbind::Converter::to_cpp<std::span<const int64_t>>(atom);
+        REQUIRE(single.size() == 1);
+        REQUIRE(single[0] == 7);
+
+        // kx's J, long long, as well as int64_t
+        auto js = qbind::Converter::to_cpp<std::span<const J>>(atom);
+        REQUIRE(js.size() == 1);
+        REQUIRE(js[0] == 7);
+
+        REQUIRE_THROWS(qbind::Converter::to_cpp<std::span<const int32_t>>(list));
+    }
+
+    SECTION("STRING_VIEW")
+    {
+        ::K str = kp(const_cast<char *>("hello"));
+        qbind::K str_owner{str};
+        REQUIRE(qbind::Converter::to_cpp<std::string_view>(str) == "hello");
+        ::K sym = ks(const_cast<char *>("world"));
+        qbind::K sym_owner{sym};
+        REQUIRE(qbind::Converter::to_cpp<std::string_view>(sym) == "world");
+    }
+
+    SECTION("RETURN")
+    {
+        qbind::K vec{qbind::Converter::to_q(std::vector<int32_t>{1, 2, 3})};
+        REQUIRE(vec.size() == 3);
+        REQUIRE(vec.data<int32_t>()[2] == 3);
+
+        qbind::K longs{qbind::Converter::to_q(std::vector<J>{4, 5})};
+        REQUIRE(longs.type() == KJ);
+        REQUIRE(longs.data<int64_t>()[1] == 5);
+
+        qbind::K flags{qbind::Converter::to_q(std::vector<bool>{true, false})};
+        REQUIRE(flags.data<bool>()[0]);
+        REQUIRE_FALSE(flags.data<bool>()[1]);
+
+        qbind::K str{qbind::Converter::to_q(std::string("abc"))};
+        REQUIRE(std::string_view(str.data<char>(), str.size()) == "abc");
+    }
+}
+
+TEST_CASE("CONVERTER_BORROWED_ARGUMENTS")
+{
+    qbind::MemoryManager::initialise();
+
+    ::K arg = ktn(KJ, 2);
+    {
+        // No reference taken for the argument.
+        auto vec = qbind::Converter::to_cpp<qbind::Vector<qbind::Type::Long>>(arg);
+        REQUIRE(arg->r == 0);
+        REQUIRE(vec.get().borrowed() == false); // get() returns an owning copy
+        REQUIRE(arg->r == 0);
+
+        // Returning an argument takes a reference for the caller.
+        ::K res = qbind::Converter::to_q(std::move(vec));
+        REQUIRE(res == arg);
+        REQUIRE(arg->r == 1);
+        r0(res);
+    }
+    REQUIRE(arg->r == 0);
+
+    REQUIRE_THROWS(qbind::Converter::to_cpp<qbind::Vector<qbind::Type::Int>>(arg));
+    REQUIRE_THROWS(qbind::Converter::to_cpp<qbind::Atom<qbind::Type::Long>>(arg));
+    REQUIRE_THROWS(qbind::Converter::to_cpp<qbind::Tuple<qbind::Atom<qbind::Type::Long>>>(arg));
+    r0(arg);
+}
+
+TEST_CASE("BORROWED_APPEND")
+{
+    qbind::MemoryManager::initialise();
+
+    ::K arg = ktn(KJ, 2);
+    auto* longs = reinterpret_cast<int64_t*>(arg->G0);
+    longs[0] = 1;
+    longs[1] = 2;
+    {
+        // Appending to an argument appends to a copy, q's object is untouched.
+        auto vec = qbind::Converter::to_cpp<qbind::Vector<qbind::Type::Long>>(arg);
+        vec.push_back(3);
+        vec.push_back(qbind::Vector<qbind::Type::Long>{4, 5});
+        REQUIRE(vec.size() == 5);
+        REQUIRE(vec[4] == 5);
+        REQUIRE(arg->n == 2);
+        REQUIRE(longs[1] == 2);
+        REQUIRE(arg->r == 0);
+    }
+    REQUIRE(arg->r == 0);
+
+    ::K item = kj(1);
+    ::K list = knk(2, item, kj(2));
+    {
+        auto k = qbind::K::make_borrowed(list);
+        k.tuple_append(qbind::K{ktn(KJ, 0)});
+        REQUIRE_FALSE(k.borrowed());
+        REQUIRE(k.size() == 3);
+        REQUIRE(list->n == 2);
+        // the copy holds its own reference to the shared items
+        REQUIRE(item->r == 1);
+    }
+    REQUIRE(item->r == 0);
+    r0(list);
+
+    // Copies share an object, so an append must not show through another copy.
+    qbind::K a{ktn(KJ, 1)};
+    qbind::K b = a;
+    a.join_atom<qbind::Type::Long>(7);
+    REQUIRE(a.size() == 2);
+    REQUIRE(b.size() == 1);
+    REQUIRE(b.use_count() == 1);
+    r0(arg);
+}
+
+TEST_CASE("CONVERTER_ENUM")
+{
+    qbind::MemoryManager::initialise();
+
+    qbind::Vector<qbind::Type::Symbol> domain{"a", "b", "c"};
+    qbind::EnumVector e(qbind::Vector<qbind::Type::Symbol>{"c", "a", "", "c"}, domain);
+    ::K arg = e.get().get();
+
+    // Bound on to the codes, without a domain.
+    auto codes = qbind::Converter::to_cpp<qbind::EnumVector>(arg);
+    REQUIRE(codes.data() == e.data());
+    REQUIRE_FALSE(codes.has_domain());
+    REQUIRE(codes.group() == std::vector<std::vector<size_t>>{{1}, {}, {0, 3}});
+    REQUIRE((codes == e));
+    REQUIRE_THROWS(codes.symbol(0));
+    codes.set_domain(domain);
+    REQUIRE(codes.symbol(0) == "c");
+    REQUIRE(arg->r == 0);
+
+    qbind::K res{qcounts(arg)};
+    REQUIRE(res.type() == KJ);
+    REQUIRE(std::vector<int64_t>(res.data<int64_t>(), res.data<int64_t>() + res.size()) == std::vector<int64_t>{1, 0, 2});
+
+    qbind::K error{qcounts(domain.get().get())};
+    REQUIRE(error.type() == -128);
+    REQUIRE_THROWS(qbind::Converter::to_cpp<qbind::EnumVector>(domain.get().get()));
+}
@@ -0,0 +1,24 @@
+#include <catch2/catch.hpp>
+
+#include <string_view>
+
+#include "qbind/dictionary.h"
+#include "qbind/memory_manager.h"
+#include "qbind/vector.h"
+
+TEST_CASE("DICTIONARY_KEYS_VALUES")
+{
+    qbind::Dictionary<qbind::v::s, qbind::v::j> dict(qbind::v::s{"a", "b", "c"}, qbind::v::j{10, 20, 30});
+    REQUIRE(dict.size() == 3);
+
+    const auto keys = dict.keys();
+    REQUIRE(keys.size() == 3);
+    REQUIRE(std::string_view{keys[1]} == "b");
+
+    const auto values = dict.values();
+    REQUIRE(values.size() == 3);
+    REQUIRE(values[2] == 30);
+
+    REQUIRE(dict.find(std::string_view{"c"}) == 2);
+    REQUIRE(dict.find(std::string_view{"d"}) == 3);
+}
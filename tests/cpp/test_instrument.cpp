@@ -0,0 +1,188 @@
+#include <catch2/catch.hpp>
+
+#include <span>
+#include <stdexcept>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "qbind/instrument.h"
+#include "qbind/memory_manager.h"
+
+std::vector<int64_t> twice(std::span<const int64_t> values)
+{
+    std::vector<int64_t> res(values.begin(), values.end());
+    for (auto& v : res)
+        v *= 2;
+    return res;
+}
+
+std::vector<int64_t> rejects(std::span<const int64_t>)
+{
+    throw std::runtime_error("bad input");
+}
+
+QBIND_FN_EXPORT_INSTRUMENTED(twice, instrumented_twice, 1, 1)
+QBIND_FN_EXPORT_INSTRUMENTED(rejects, instrumented_rejects, 1, 1)
+QBIND_STATS_EXPORT(instrumented_stats)
+
+namespace
+{
+    // Column of a stats table by name.
+    ::K column(::K table, const std::string& name)
+    {
+        ::K keys = reinterpret_cast<::K *>(table->k->G0)[0];
+        ::K values = reinterpret_cast<::K *>(table->k->G0)[1];
+        for (int64_t i = 0; i < keys->n; ++i)
+        {
+            if (name == reinterpret_cast<char **>(keys->G0)[i])
+                return reinterpret_cast<::K *>(values->G0)[i];
+        }
+        throw std::out_of_range("No column " + name);
+    }
+
+    // Row of a function, -1 if absent.
+    int64_t row(::K table, const std::string& function)
+    {
+        ::K names = column(table, "function");
+        for (int64_t i = 0; i < names->n; ++i)
+        {
+            if (function == reinterpret_cast<char **>(names->G0)[i])
+                return i;
+        }
+        return -1;
+    }
+
+    int64_t value(::K table, const std::string& name, int64_t i)
+    {
+        return reinterpret_cast<int64_t *>(column(table, name)->G0)[i];
+    }
+
+    // Call the stats export as q would, with a boolean it doesn't own.
+    qbind::K stats(bool reset)
+    {
+        const qbind::K arg{kb(reset)};
+        return qbind::K{instrumented_stats(arg.get())};
+    }
+}
+
+TEST_CASE("LATENCY_HISTOGRAM")
+{
+    using H = qbind::LatencyHistogram;
+
+    // Small values are exact.
+    for (uint64_t v = 0; v < H::sub_count; ++v)
+        REQUIRE(H::lower_bound(H::bucket(v)) == v);
+
+    // Larger values land in a bucket no wider than 1/sub_count of its value.
+    for (uint64_t v : {16ULL, 17ULL, 1000ULL, 123456789ULL, 1ULL << 40, ~0ULL})
+    {
+        const auto b = H::bucket(v);
+        REQUIRE(b < H::bucket_count);
+        REQUIRE(H::lower_bound(b) <= v);
+        REQUIRE(v - H::lower_bound(b) <= H::lower_bound(b) / H::sub_count);
+        if (b + 1 < H::bucket_count)
+            REQUIRE(v < H::lower_bound(b + 1));
+    }
+}
+
+TEST_CASE("CALL_STATS")
+{
+    qbind::CallStats stats("f");
+    for (uint64_t i = 1; i <= 100; ++i)
+        stats.record(i * 1000, 10, 8, i == 100);
+
+    auto summary = stats.summary();
+    REQUIRE(summary.calls == 100);
+    REQUIRE(summary.errors == 1);
+    REQUIRE(summary.convert_ns == 1000);
+    REQUIRE(summary.bytes == 800);
+    REQUIRE(summary.max_ns == 100000);
+    // Quantiles are to within a bucket.
+    REQUIRE(summary.quantile(0.5) <= 50000);
+    REQUIRE(summary.quantile(0.5) >= 50000 - 50000 / qbind::LatencyHistogram::sub_count);
+    REQUIRE(summary.quantile(1.0) <= summary.max_ns);
+
+    stats.reset();
+    REQUIRE(stats.summary().calls == 0);
+}
+
+TEST_CASE("K_BYTES")
+{
+    qbind::MemoryManager::initialise();
+
+    ::K longs = ktn(KJ, 10);
+    REQUIRE(qbind::internal::k_bytes(longs) == 80);
+    ::K list = knk(2, longs, kj(1));
+    REQUIRE(qbind::internal::k_bytes(list) == 88);
+    r0(list);
+
+    // Enumerations hold a long index per element.
+    ::K enums = ktn(20, 3);
+    REQUIRE(qbind::internal::k_bytes(enums) == 24);
+    r0(enums);
+
+    // A function's n isn't a count of elements.
+    ::K fn = ka(100);
+    fn->n = 1000;
+    REQUIRE(qbind::internal::k_bytes(fn) == 0);
+    r0(fn);
+}
+
+TEST_CASE("INSTRUMENTED_EXPORT")
+{
+    qbind::MemoryManager::initialise();
+    // start from nothing
+    stats(true);
+
+    ::K longs = ktn(KJ, 2);
+    reinterpret_cast<int64_t *>(longs->G0)[0] = 1;
+    reinterpret_cast<int64_t *>(longs->G0)[1] = 2;
+    for (int i = 0; i < 3; ++i)
+    {
+        qbind::K res{instrumented_twice(longs)};
+        REQUIRE(res.type() == KJ);
+        REQUIRE(res.data<int64_t>()[1] == 4);
+    }
+    // fails converting its argument, or in the function
+    ::K floats = ktn(KF, 1);
+    qbind::K mismatch{instrumented_twice(floats)};
+    REQUIRE(mismatch.type() == -128);
+    qbind::K error{instrumented_rejects(longs)};
+    REQUIRE(error.type() == -128);
+    REQUIRE(std::string(error.get()->s) == "bad input");
+    r0(floats);
+    r0(longs);
+
+    const auto read = stats(true);
+    ::K table = read.get();
+    REQUIRE(table->t == XT);
+    ::K keys = reinterpret_cast<::K *>(table->k->G0)[0];
+    std::vector<std::string> names;
+    for (int64_t i = 0; i < keys->n; ++i)
+        names.emplace_back(reinterpret_cast<char **>(keys->G0)[i]);
+    REQUIRE(names == std::vector<std::string>{"function", "calls", "errors", "totalNs", "convertNs", "bytes", "p50Ns", "p99Ns", "p999Ns", "maxNs"});
+
+    const auto t = row(table, "instrumented_twice");
+    REQUIRE(t >= 0);
+    REQUIRE(value(table, "calls", t) == 4);
+    REQUIRE(value(table, "errors", t) == 1);
+    // two longs returned by each successful call
+    REQUIRE(value(table, "bytes", t) == 3 * 16);
+    REQUIRE(value(table, "totalNs", t) >= value(table, "convertNs", t));
+    REQUIRE(value(table, "p50Ns", t) <= value(table, "maxNs", t));
+
+    const auto f = row(table, "instrumented_rejects");
+    REQUIRE(f >= 0);
+    REQUIRE(value(table, "calls", f) == 1);
+    REQUIRE(value(table, "errors", f) == 1);
+    REQUIRE(value(table, "bytes", f) == 0);
+
+    // read with 1b, so cleared after
+    const auto after = stats(false);
+    const auto cleared = row(after.get(), "instrumented_twice");
+    REQUIRE(cleared >= 0);
+    REQUIRE(value(after.get(), "calls", cleared) == 0);
+    REQUIRE(value(after.get(), "errors", cleared) == 0);
+    REQUIRE(value(after.get(), "maxNs", cleared) == 0);
+}
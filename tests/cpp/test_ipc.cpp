@@ -0,0 +1,55 @@
+#include <catch2/catch.hpp>
+
+#include "qbind/atom.h"
+#include "qbind/dictionary.h"
+#include "qbind/ipc.h"
+#include "qbind/memory_manager.h"
+#include "qbind/tuple.h"
+#include "qbind/vector.h"
+
+TEST_CASE("IPC_SIZE")
+{
+    qbind::MemoryManager::initialise();
+
+    SECTION("MATCHES_-22!")
+    {
+        REQUIRE(qbind::ipc_size(qbind::Atom<qbind::Type::Int>(1)) == 13);
+        REQUIRE(qbind::ipc_size(qbind::Vector<qbind::Type::Long>{1, 2, 3}) == 38);
+        REQUIRE(qbind::ipc_size(qbind::Atom<qbind::Type::Symbol>("abc")) == 13);
+        REQUIRE(qbind::ipc_size(qbind::Vector<qbind::Type::Symbol>{"a", "bc"}) == 19);
+        REQUIRE(qbind::ipc_size(qbind::Vector<qbind::Type::Long>{}) == 14);
+
+        qbind::Tuple<qbind::Atom<qbind::Type::Int>, qbind::Atom<qbind::Type::Symbol>> tuple(
+            qbind::Atom<qbind::Type::Int>(1), qbind::Atom<qbind::Type::Symbol>("a"));
+        REQUIRE(qbind::ipc_size(tuple) == 22);
+
+        qbind::Dictionary<qbind::Vector<qbind::Type::Symbol>, qbind::Vector<qbind::Type::Long>> dict(
+            qbind::Vector<qbind::Type::Symbol>{"a", "b"}, qbind::Vector<qbind::Type::Long>{1, 2});
+        REQUIRE(qbind::ipc_size(dict) == 41);
+    }
+
+    SECTION("MATCHES_SERIALISATION")
+    {
+        qbind::Vector<qbind::Type::Symbol> syms{"", "a", "longer symbol"};
+        qbind::Vector<qbind::Type::Float> floats{1.0, 2.0};
+        ::K list = knk(2, syms.get().release(), floats.get().release());
+        qbind::K list_owner{list};
+
+        ::K bytes = b9(3, list);
+        qbind::K bytes_owner{bytes};
+        REQUIRE(qbind::ipc_size(list) == static_cast<size_t>(bytes->n));
+
+        // walked in place, owned or not
+        REQUIRE(qbind::ipc_size(list_owner) == static_cast<size_t>(bytes->n));
+        REQUIRE(qbind::ipc_size(qbind::K::make_borrowed(list)) == static_cast<size_t>(bytes->n));
+        REQUIRE(list->r == 0);
+        REQUIRE_THROWS(qbind::ipc_size(qbind::K()));
+    }
+
+    SECTION("PROTOCOL_LEVEL")
+    {
+        qbind::Vector<qbind::Type::Timestamp> ts{0};
+        REQUIRE(qbind::ipc_size(ts, 1) == 14 + 8);
+        REQUIRE_THROWS(qbind::ipc_size(ts, 0));
+    }
+}
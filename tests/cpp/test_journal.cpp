@@ -0,0 +1,312 @@
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "qbind/journal.h"
+#include "qbind/journal_writer.h"
+#include "qbind/memory_manager.h"
+#include "qbind/thread_pool.h"
+#include "qbind/vector.h"
+
+namespace
+{
+
+// Serialise in the IPC format, without message headers, as a tickerplant
+// writes its journal.
+
+void put_int(std::string& out, int32_t n)
+{
+    out.append(reinterpret_cast<const char *>(&n), sizeof(n));
+}
+
+void put_list_header(std::string& out, signed char t, int32_t n)
+{
+    out += static_cast<char>(t);
+    out += '\0';
+    put_int(out, n);
+}
+
+void put_symbol(std::string& out, const std::string& s)
+{
+    out += static_cast<char>(-KS);
+    out.append(s.c_str(), s.size() + 1);
+}
+
+void put_long(std::string& out, int64_t x)
+{
+    out += static_cast<char>(-KJ);
+    out.append(reinterpret_cast<const char *>(&x), sizeof(x));
+}
+
+void put_longs(std::string& out, std::initializer_list<int64_t> xs)
+{
+    put_list_header(out, KJ, static_cast<int32_t>(xs.size()));
+    for (auto x : xs)
+        out.append(reinterpret_cast<const char *>(&x), sizeof(x));
+}
+
+void put_symbols(std::string& out, std::initializer_list<std::string> xs)
+{
+    put_list_header(out, KS, static_cast<int32_t>(xs.size()));
+    for (const auto& x : xs)
+        out.append(x.c_str(), x.size() + 1);
+}
+
+void put_string(std::string& out, const std::string& s)
+{
+    put_list_header(out, KC, static_cast<int32_t>(s.size()));
+    out += s;
+}
+
+// (`upd;`table;data) with data of columns
+std::string update(const std::string& table, int32_t columns)
+{
+    std::string out;
+    put_list_header(out, 0, 3);
+    put_symbol(out, "upd");
+    put_symbol(out, table);
+    put_list_header(out, 0, columns);
+    return out;
+}
+
+std::filesystem::path write_journal()
+{
+    std::vector<std::string> messages;
+
+    auto trade = update("trade", 3);
+    put_longs(trade, {1, 2, 3});
+    put_symbols(trade, {"a", "b", "a"});
+    put_list_header(trade, 0, 3);
+    for (const char *s : {"x", "yy", "z"})
+        put_string(trade, s);
+    messages.push_back(trade);
+
+    auto quote = update("quote", 2);
+    put_longs(quote, {10, 20});
+    put_symbols(quote, {"a", "c"});
+    messages.push_back(quote);
+
+    // one row as atoms
+    auto row = update("trade", 3);
+    put_long(row, 4);
+    put_symbol(row, "b");
+    put_string(row, "w");
+    messages.push_back(row);
+
+    // not an update
+    std::string other;
+    put_list_header(other, 0, 2);
+    put_symbol(other, "foo");
+    put_long(other, 1);
+    messages.push_back(other);
+
+    std::string journal = {static_cast<char>(0xff), 0x01};
+    put_list_header(journal, 0, static_cast<int32_t>(messages.size()));
+    for (const auto& msg : messages)
+        journal += msg;
+    // torn write
+    journal += update("trade", 3).substr(0, 9);
+
+    const auto path = std::filesystem::temp_directory_path() / ("qbind_journal_" + std::to_string(getpid()));
+    std::ofstream(path, std::ios::binary) << journal;
+    return path;
+}
+
+std::string_view symbol(const qbind::K& k, size_t i)
+{
+    return k.data<char *>()[i];
+}
+
+std::string_view string(const qbind::K& k, size_t i)
+{
+    const ::K row = k.data<::K>()[i];
+    return {reinterpret_cast<const char *>(row->G0), static_cast<size_t>(row->n)};
+}
+
+}
+
+TEST_CASE("JOURNAL_READER")
+{
+    qbind::MemoryManager::initialise();
+    qbind::ThreadPool pool(2);
+    const auto path = write_journal();
+    qbind::JournalReader reader(path);
+
+    SECTION("INDEX")
+    {
+        REQUIRE(reader.size() == 4);
+        REQUIRE(reader.truncated());
+        REQUIRE(reader.table(0) == "trade");
+        REQUIRE(reader.table(1) == "quote");
+        REQUIRE(reader.table(3).empty());
+        REQUIRE(reader.decode(1).type() == 0);
+    }
+
+    SECTION("LOAD")
+    {
+        qbind::JournalOptions options;
+        options.grain = 1;
+        const auto batches = reader.load(options, pool);
+        REQUIRE(reader.skipped() == 1);
+        REQUIRE(batches.size() == 2);
+
+        const auto& trade = batches[0];
+        REQUIRE(trade.table == "trade");
+        REQUIRE(trade.rows == 4);
+        REQUIRE(trade.messages == 2);
+        REQUIRE(trade.columns[0].type() == KJ);
+        REQUIRE(trade.columns[0].data<int64_t>()[3] == 4);
+        REQUIRE(symbol(trade.columns[1], 3) == "b");
+        REQUIRE(trade.columns[2].type() == 0);
+        REQUIRE(string(trade.columns[2], 1) == "yy");
+        REQUIRE(string(trade.columns[2], 3) == "w");
+
+        REQUIRE(batches[1].table == "quote");
+        REQUIRE(batches[1].rows == 2);
+    }
+
+    SECTION("FILTER")
+    {
+        qbind::JournalOptions options;
+        options.tables = {"trade"};
+        options.symbols = {"a"};
+        auto batches = reader.load(options, pool);
+        REQUIRE(batches.size() == 1);
+        REQUIRE(batches[0].rows == 2);
+        for (const auto& column : batches[0].columns)
+            REQUIRE(column.size() == batches[0].rows);
+        REQUIRE(batches[0].columns[0].data<int64_t>()[1] == 3);
+        REQUIRE(string(batches[0].columns[2], 1) == "z");
+
+        // keeps the row sent as atoms
+        options.symbols = {"b"};
+        batches = reader.load(options, pool);
+        REQUIRE(batches[0].rows == 2);
+        for (const auto& column : batches[0].columns)
+            REQUIRE(column.size() == batches[0].rows);
+        REQUIRE(batches[0].columns[0].data<int64_t>()[1] == 4);
+        REQUIRE(string(batches[0].columns[2], 1) == "w");
+    }
+
+    SECTION("REPLAY")
+    {
+        qbind::JournalOptions options;
+        options.window = 1;
+        std::vector<std::string> tables;
+        reader.replay(options, [&](qbind::JournalBatch&& batch) { tables.push_back(batch.table); }, pool);
+        REQUIRE(tables == std::vector<std::string>{"trade", "quote", "trade"});
+    }
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("JOURNAL_WRITER")
+{
+    qbind::MemoryManager::initialise();
+    const auto path = std::filesystem::temp_directory_path() / ("qbind_journal_writer_" + std::to_string(getpid()));
+    std::filesystem::remove(path);
+
+    qbind::JournalWriterOptions options;
+    options.commit_bytes = 256;
+    options.sync = qbind::SyncPolicy::Interval;
+    {
+        qbind::JournalWriter writer(path, options);
+        for (int64_t i = 0; i < 100; ++i)
+        {
+            qbind::Vector<qbind::Type::Long> price{i};
+            qbind::Vector<qbind::Type::Symbol> sym{i % 2 ? "a" : "b"};
+            ::K data = knk(2, price.get().release(), sym.get().release());
+            writer.upd("trade", data);
+            r0(data);
+        }
+        writer.flush();
+        REQUIRE(writer.size() == 100);
+        REQUIRE(qbind::JournalReader(path).size() == 100);
+
+        std::string row;
+        put_list_header(row, 0, 3);
+        put_symbol(row, "upd");
+        put_symbol(row, "quote");
+        put_list_header(row, 0, 1);
+        put_long(row, 7);
+        writer.append_serialised(row);
+    }
+
+    // a torn tail is cut off on open, then appended after
+    {
+        const std::string torn(3, '\0');
+        std::ofstream(path, std::ios::binary | std::ios::app) << torn;
+        qbind::JournalWriter writer(path, options);
+        REQUIRE(writer.size() == 101);
+        std::string row;
+        put_list_header(row, 0, 3);
+        put_symbol(row, "upd");
+        put_symbol(row, "quote");
+        put_list_header(row, 0, 1);
+        put_long(row, 8);
+        writer.append_serialised(row);
+    }
+
+    qbind::JournalReader reader(path);
+    REQUIRE(reader.size() == 102);
+    REQUIRE_FALSE(reader.truncated());
+    const auto batches = reader.load();
+    REQUIRE(batches.size() == 2);
+    REQUIRE(batches[0].rows == 100);
+    REQUIRE(batches[0].columns[0].data<int64_t>()[99] == 99);
+    REQUIRE(batches[1].columns[0].data<int64_t>()[1] == 8);
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("JOURNAL_WRITER_SYNC")
+{
+    qbind::MemoryManager::initialise();
+    const auto path = std::filesystem::temp_directory_path() / ("qbind_journal_sync_" + std::to_string(getpid()));
+    std::filesystem::remove(path);
+
+    std::string row;
+    put_list_header(row, 0, 3);
+    put_symbol(row, "upd");
+    put_symbol(row, "quote");
+    put_list_header(row, 0, 1);
+    put_long(row, 7);
+
+    qbind::JournalWriterOptions options;
+    options.sync = qbind::SyncPolicy::Interval;
+    options.sync_interval = std::chrono::milliseconds(50);
+
+    SECTION("IDLE")
+    {
+        // committed within the interval of opening, then synced once it's
+        // passed though nothing more is appended
+        qbind::JournalWriter writer(path, options);
+        writer.append_serialised(row);
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (writer.synced() == 0 && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        REQUIRE(writer.synced() == 1);
+    }
+
+    SECTION("FLUSH")
+    {
+        // a flush after the commit still waits for the sync
+        options.sync_interval = std::chrono::hours(1);
+        qbind::JournalWriter writer(path, options);
+        writer.append_serialised(row);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        writer.flush();
+        REQUIRE(writer.synced() == 1);
+    }
+
+    std::filesystem::remove(path);
+}
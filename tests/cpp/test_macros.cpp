@@ -1,5 +1,6 @@
 #include <catch2/catch.hpp>
 
+#include "qbind/async.h"
 #include "qbind/function.h"
 
 #define STRi(x) #x
@@ -314,3 +315,23 @@ TEST_CASE("QBIND_FN_EXPORT")
                 "} "
             "}" == res);  
 }
+
+TEST_CASE("QBIND_ASYNC_PARAMETERS")
+{
+    // Callback only
+    std::string res = STR(QBIND_ASYNC_PARAMETERS(0));
+    REQUIRE("(K karr_cb )" == res);
+    // Callback then arguments
+    res = STR(QBIND_ASYNC_PARAMETERS(2));
+    REQUIRE("(K karr_cb , K karr0 , K karr1)" == res);
+
+    // Held arguments exclude the callback
+    res = STR((QBIND_ASYNC_ARGS(0)));
+    REQUIRE("(std::vector<K>{})" == res);
+    res = STR((QBIND_ASYNC_ARGS(2)));
+    REQUIRE("(std::vector<K>{ karr0 , karr1})" == res);
+
+    // The worker's copies take the parameters' names
+    res = STR((QBIND_ASYNC_UNPACK(2)));
+    REQUIRE("(K karr0 = args[0]; K karr1 = args[1];)" == res);
+}
@@ -0,0 +1,81 @@
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "qbind/memory_manager.h"
+#include "qbind/parallel.h"
+#include "qbind/thread_pool.h"
+#include "qbind/vector.h"
+
+TEST_CASE("PARALLEL_ALGORITHMS")
+{
+    qbind::MemoryManager::initialise();
+    qbind::ThreadPool pool(4);
+
+    // Not a multiple of the grain so the last chunk is short.
+    std::vector<int64_t> values(1003);
+    std::iota(values.begin(), values.end(), 1);
+    qbind::Vector<qbind::Type::Long> vec(values.begin(), values.end());
+    const size_t grain = 64;
+
+    SECTION("TRANSFORM")
+    {
+        auto res = qbind::parallel::transform<qbind::Type::Float>(vec, [](int64_t x) { return x * 0.5; }, grain, pool);
+        REQUIRE(res.size() == vec.size());
+        for (size_t i = 0; i < res.size(); ++i)
+            REQUIRE(res[i] == values[i] * 0.5);
+    }
+
+    SECTION("TRANSFORM_SYMBOL")
+    {
+        auto res = qbind::parallel::transform<qbind::Type::Symbol>(vec, [](int64_t x)
+        {
+            return std::string("s") + std::to_string(x % 3);
+        }, grain, pool);
+        qbind::Vector<qbind::Type::Symbol> expected{"s1", "s2", "s0"};
+        for (size_t i = 0; i < 3; ++i)
+            REQUIRE(res[i] == expected[i]);
+        REQUIRE(res.count("s0") == 334);
+    }
+
+    SECTION("REDUCE")
+    {
+        auto sum = qbind::parallel::reduce(vec, int64_t{0}, [](int64_t a, int64_t b) { return a + b; }, grain, pool);
+        REQUIRE(sum == 1003LL * 1004 / 2);
+
+        // Folding symbols to a count needs a separate combine.
+        qbind::Vector<qbind::Type::Symbol> syms{"a", "bb", "ccc"};
+        auto length = qbind::parallel::reduce(syms, size_t{0},
+            [](size_t acc, std::string_view s) { return acc + s.size(); },
+            [](size_t a, size_t b) { return a + b; }, 1, pool);
+        REQUIRE(length == 6);
+    }
+
+    SECTION("SCAN")
+    {
+        auto sums = qbind::parallel::inclusive_scan(vec, [](int64_t a, int64_t b) { return a + b; }, 0, grain, pool);
+        std::vector<int64_t> expected(values.size());
+        std::partial_sum(values.begin(), values.end(), expected.begin());
+        for (size_t i = 0; i < expected.size(); ++i)
+            REQUIRE(sums[i] == expected[i]);
+    }
+
+    SECTION("COUNT_IF")
+    {
+        REQUIRE(qbind::parallel::count_if(vec, [](int64_t x) { return x % 2 == 0; }, grain, pool) == 501);
+    }
+
+    SECTION("FOR_EACH")
+    {
+        // Each element is visited exactly once.
+        std::vector<std::atomic<int>> visits(values.size() + 1);
+        qbind::parallel::for_each(vec, [&](int64_t x) { ++visits[static_cast<size_t>(x)]; }, grain, pool);
+        REQUIRE(visits[0] == 0);
+        for (size_t i = 1; i < visits.size(); ++i)
+            REQUIRE(visits[i] == 1);
+    }
+}
@@ -0,0 +1,229 @@
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "fake_q.h"
+#include "send_pipeline.h"
+
+namespace
+{
+    // Lets a test hold up or fail the encodes of a pipeline, and its writes.
+    struct Gate
+    {
+        std::mutex mutex;
+        std::condition_variable cv;
+        // the next encode waits for release
+        bool hold_next = false;
+        bool held = false;
+        // the next encode throws
+        bool fail_next = false;
+        size_t failed = 0;
+        std::atomic<bool> fail_sends{false};
+
+        void hold()
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            hold_next = true;
+        }
+
+        void fail()
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            fail_next = true;
+        }
+
+        void release()
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            held = false;
+            cv.notify_all();
+        }
+
+        template<class P>
+        void wait_until(P pred)
+        {
+            std::unique_lock<std::mutex> lk(mutex);
+            cv.wait(lk, pred);
+        }
+
+        // On the pool, as each message is encoded.
+        void encode()
+        {
+            std::unique_lock<std::mutex> lk(mutex);
+            if (std::exchange(fail_next, false))
+            {
+                ++failed;
+                cv.notify_all();
+                throw std::runtime_error("encode failed");
+            }
+            if (std::exchange(hold_next, false))
+            {
+                held = true;
+                cv.notify_all();
+                cv.wait(lk, [this] { return !held; });
+            }
+        }
+    };
+
+    // A unix socket, which SocketConnection encodes for, passing through
+    // the gate.
+    class GatedSocket : public Socket
+    {
+    public:
+
+        GatedSocket(int fd, Gate& gate) noexcept
+        : Socket(fd, true)
+        , m_gate(&gate)
+        {}
+
+        size_t send(const uint8_t* ptr, size_t size, int flags = 0) const
+        {
+            if (m_gate->fail_sends)
+                throw std::runtime_error("send failed");
+            return Socket::send(ptr, size, flags);
+        }
+
+        bool is_unix_domain_socket() const
+        {
+            m_gate->encode();
+            return true;
+        }
+
+    private:
+        Gate *m_gate;
+    };
+
+    Buffer buffer(const std::string& bytes)
+    {
+        auto* p = static_cast<uint8_t*>(malloc(bytes.size()));
+        memcpy(p, bytes.data(), bytes.size());
+        return {p, bytes.size()};
+    }
+
+    bool readable(int fd, std::chrono::milliseconds timeout)
+    {
+        pollfd p{fd, POLLIN, 0};
+        return ::poll(&p, 1, static_cast<int>(timeout.count())) == 1;
+    }
+
+    std::pair<std::string, MessageType> async(std::string payload)
+    {
+        return {std::move(payload), MessageType::Async};
+    }
+}
+
+TEST_CASE("SEND_PIPELINE")
+{
+    using namespace std::chrono_literals;
+    int fds[2];
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    fake_q::Peer q(fds[1]);
+    Gate gate;
+    std::thread handshake([&q] { q.handshake(); });
+    const SocketConnection<GatedSocket> conn(GatedSocket(fds[0], gate));
+    handshake.join();
+
+    qbind::ThreadPool pool(4);
+    SendPipelineOptions options;
+    options.max_queued = 4;
+
+    SECTION("wire order")
+    {
+        SendPipeline<GatedSocket> pipeline(conn, options, pool);
+        gate.hold();
+        pipeline.send_async(buffer("m0"));
+        gate.wait_until([&gate] { return gate.held; });
+        // the rest encode, but are written after the first
+        for (const char *m : {"m1", "m2", "m3"})
+            pipeline.send_async(buffer(m));
+        REQUIRE_FALSE(readable(fds[1], 50ms));
+        gate.release();
+        pipeline.flush();
+        for (const char *m : {"m0", "m1", "m2", "m3"})
+            REQUIRE(q.read_message() == async(m));
+    }
+
+    SECTION("flush waits for the queue")
+    {
+        SendPipeline<GatedSocket> pipeline(conn, options, pool);
+        gate.hold();
+        pipeline.send_async(buffer("a"));
+        gate.wait_until([&gate] { return gate.held; });
+        std::atomic<bool> flushed{false};
+        std::thread flusher([&pipeline, &flushed]
+        {
+            pipeline.flush();
+            flushed = true;
+        });
+        std::this_thread::sleep_for(50ms);
+        REQUIRE_FALSE(flushed);
+        gate.release();
+        flusher.join();
+        REQUIRE(readable(fds[1], 0ms));
+        REQUIRE(q.read_message() == async("a"));
+    }
+
+    SECTION("send_async blocks at max_queued")
+    {
+        options.max_queued = 2;
+        SendPipeline<GatedSocket> pipeline(conn, options, pool);
+        gate.hold();
+        pipeline.send_async(buffer("a"));
+        gate.wait_until([&gate] { return gate.held; });
+        pipeline.send_async(buffer("b"));
+        std::atomic<bool> queued{false};
+        std::thread sender([&pipeline, &queued]
+        {
+            pipeline.send_async(buffer("c"));
+            queued = true;
+        });
+        std::this_thread::sleep_for(50ms);
+        REQUIRE_FALSE(queued);
+        gate.release();
+        sender.join();
+        pipeline.flush();
+        for (const char *m : {"a", "b", "c"})
+            REQUIRE(q.read_message() == async(m));
+    }
+
+    SECTION("encode error")
+    {
+        SendPipeline<GatedSocket> pipeline(conn, options, pool);
+        gate.hold();
+        pipeline.send_async(buffer("a"));
+        gate.wait_until([&gate] { return gate.held; });
+        gate.fail();
+        pipeline.send_async(buffer("b"));
+        gate.wait_until([&gate] { return gate.failed == 1; });
+        pipeline.send_async(buffer("c"));
+        gate.release();
+
+        // a went before the failure, c is dropped after it
+        REQUIRE_THROWS_WITH(pipeline.flush(), "encode failed");
+        REQUIRE_THROWS_WITH(pipeline.send_async(buffer("d")), "encode failed");
+        REQUIRE(q.read_message() == async("a"));
+        REQUIRE_FALSE(readable(fds[1], 0ms));
+    }
+
+    SECTION("write error")
+    {
+        SendPipeline<GatedSocket> pipeline(conn, options, pool);
+        gate.fail_sends = true;
+        pipeline.send_async(buffer("a"));
+        REQUIRE_THROWS_WITH(pipeline.flush(), "send failed");
+        REQUIRE_THROWS_WITH(pipeline.send_async(buffer("b")), "send failed");
+        REQUIRE_FALSE(readable(fds[1], 0ms));
+    }
+}
@@ -0,0 +1,397 @@
+#include <catch2/catch.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <unistd.h>
+
+#include "qbind/memory_manager.h"
+#include "qbind/splayed.h"
+#include "qbind/splayed_writer.h"
+#include "qbind/string_column.h"
+#include "qbind/thread_pool.h"
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+// Write a file as kdb+ 3.x does: marker, version, type, attribute, 4 unused
+// bytes and the count, then the data.
+void write_header(std::ofstream& out, uint8_t marker, signed char t, uint8_t attr, int64_t n)
+{
+    const uint8_t head[8] = {marker, 0x20, static_cast<uint8_t>(t), attr, 0, 0, 0, 0};
+    out.write(reinterpret_cast<const char *>(head), sizeof(head));
+    out.write(reinterpret_cast<const char *>(&n), sizeof(n));
+}
+
+template<class T>
+void write_vector(const fs::path& path, signed char t, const std::vector<T>& data, uint8_t attr = 0)
+{
+    std::ofstream out(path, std::ios::binary);
+    write_header(out, 0xfe, t, attr, static_cast<int64_t>(data.size()));
+    out.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size() * sizeof(T)));
+}
+
+// Symbol vectors are written as q serialises them: 0xff, version 1, then the
+// IPC encoding of the vector without its message header.
+void write_symbols(const fs::path& path, const std::vector<std::string>& syms)
+{
+    std::ofstream out(path, std::ios::binary);
+    const int32_t n = static_cast<int32_t>(syms.size());
+    const uint8_t head[4] = {0xff, 0x01, KS, 0};
+    out.write(reinterpret_cast<const char *>(head), sizeof(head));
+    out.write(reinterpret_cast<const char *>(&n), sizeof(n));
+    for (const auto& s : syms)
+        out.write(s.c_str(), static_cast<std::streamsize>(s.size() + 1));
+}
+
+void write_enum(const fs::path& path, const std::vector<int64_t>& codes)
+{
+    std::ofstream out(path, std::ios::binary);
+    std::vector<char> head(4096, 0);
+    head[0] = static_cast<char>(0xfd);
+    head[1] = 0x20;
+    head[2] = 20;
+    memcpy(head.data() + 8, "sym", 3);
+    out.write(head.data(), static_cast<std::streamsize>(head.size()));
+    write_header(out, 0, 20, 0, static_cast<int64_t>(codes.size()));
+    out.write(reinterpret_cast<const char *>(codes.data()), static_cast<std::streamsize>(codes.size() * sizeof(int64_t)));
+}
+
+void write_bytes(const fs::path& path, const std::vector<uint8_t>& bytes)
+{
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+}
+
+std::vector<uint8_t> read_bytes(const fs::path& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+// Files written by q 4.0:
+//   `:sym set `a`bb`ccc
+const std::vector<uint8_t> q_sym_file = {
+    0xff, 0x01, 0x0b, 0x00, 0x03, 0x00, 0x00, 0x00,
+    'a', 0x00, 'b', 'b', 0x00, 'c', 'c', 'c', 0x00,
+};
+//   `:t/ set .Q.en[`:.] ([] a:`x`y; b:1 2)
+// the table's .d, and its sym file holding only `x`y
+const std::vector<uint8_t> q_d_file = {
+    0xff, 0x01, 0x0b, 0x00, 0x02, 0x00, 0x00, 0x00,
+    'a', 0x00, 'b', 0x00,
+};
+const std::vector<uint8_t> q_enum_sym_file = {
+    0xff, 0x01, 0x0b, 0x00, 0x02, 0x00, 0x00, 0x00,
+    'x', 0x00, 'y', 0x00,
+};
+
+struct TempDb
+{
+    TempDb()
+    : root(fs::temp_directory_path() / ("qbind_splayed_" + std::to_string(getpid())))
+    , table(root / "2024.01.02" / "trade")
+    {
+        fs::create_directories(table);
+        write_symbols(root / "sym", {"AAPL", "MSFT", "IBM"});
+        write_symbols(table / ".d", {"sym", "price", "size", "cond"});
+        write_enum(table / "sym", {1, 0, 1});
+        write_vector<double>(table / "price", KF, {10.5, 20.25, 30.0});
+        write_vector<int32_t>(table / "size", KI, {100, 200, 300}, 1);
+        write_vector<int64_t>(table / "cond", 77 + KC, {2, 2, 5});
+        write_vector<char>(table / "cond#", KC, {'A', 'B', 'C', 'D', 'E'});
+    }
+
+    ~TempDb()
+    {
+        fs::remove_all(root);
+    }
+
+    fs::path root;
+    fs::path table;
+};
+
+}
+
+TEST_CASE("SPLAYED_TABLE")
+{
+    qbind::MemoryManager::initialise();
+    TempDb db;
+
+    SECTION("COLUMNS")
+    {
+        qbind::SplayedTable t(db.table);
+        REQUIRE(t.columns() == std::vector<std::string>{"sym", "price", "size", "cond"});
+        REQUIRE(t.size() == 3);
+        REQUIRE(t.contains("price"));
+        REQUIRE_FALSE(t.contains("bid"));
+        REQUIRE(t.type("price") == KF);
+        REQUIRE(t.type("sym") == 20);
+        REQUIRE(t.type("cond") == 77 + KC);
+        REQUIRE(t.attribute("size") == 1);
+    }
+
+    SECTION("FIXED_WIDTH")
+    {
+        qbind::SplayedTable t(db.table);
+        auto price = t.column<qbind::Type::Float>("price");
+        REQUIRE(price.size() == 3);
+        REQUIRE(price[1] == 20.25);
+        auto size = t.column<qbind::Type::Int>("size");
+        REQUIRE(size[2] == 300);
+
+        REQUIRE_THROWS(t.column<qbind::Type::Long>("price"));
+        REQUIRE_THROWS_AS(t.column<qbind::Type::Float>("bid"), std::out_of_range);
+    }
+
+    SECTION("ENUMERATED")
+    {
+        // sym is found at the database root, above the partition
+        qbind::SplayedTable t(db.table);
+        auto sym = t.enumerated("sym");
+        REQUIRE(sym.size() == 3);
+        REQUIRE(sym[0] == 1);
+        REQUIRE(sym.symbol(0) == "MSFT");
+        REQUIRE(sym.symbol(1) == "AAPL");
+        REQUIRE(sym.count("MSFT") == 2);
+    }
+
+    SECTION("NESTED")
+    {
+        qbind::SplayedTable t(db.table);
+        auto cond = t.nested<qbind::Type::Char>("cond");
+        REQUIRE(cond.size() == 3);
+        REQUIRE(cond[0].size() == 2);
+        REQUIRE(std::string_view(cond[0].data(), cond[0].size()) == "AB");
+        REQUIRE(cond.at(1).empty());
+        REQUIRE(std::string_view(cond[2].data(), cond[2].size()) == "CDE");
+        REQUIRE_THROWS_AS(cond.at(3), std::out_of_range);
+    }
+
+    SECTION("SHARED_DOMAIN")
+    {
+        auto domain = qbind::load_symbols(db.root / "sym");
+        REQUIRE(domain.size() == 3);
+        qbind::SplayedTable t(db.table, domain);
+        REQUIRE(t.enumerated("sym").symbol(2) == "MSFT");
+    }
+
+    SECTION("BAD_FILES")
+    {
+        // truncated
+        {
+            std::ofstream out(db.table / "price", std::ios::binary);
+            write_header(out, 0xfe, KF, 0, 3);
+            const double x = 1.0;
+            out.write(reinterpret_cast<const char *>(&x), sizeof(x));
+        }
+        REQUIRE_THROWS_WITH(qbind::SplayedTable(db.table), Catch::Contains("truncated"));
+
+        // compressed
+        {
+            std::ofstream out(db.table / "price", std::ios::binary);
+            out << "kxzipped and more bytes";
+        }
+        REQUIRE_THROWS_WITH(qbind::SplayedTable(db.table), Catch::Contains("compressed"));
+
+        // length mismatch
+        write_vector<double>(db.table / "price", KF, {1.0, 2.0});
+        REQUIRE_THROWS_WITH(qbind::SplayedTable(db.table), Catch::Contains("rows"));
+    }
+}
+
+TEST_CASE("SYMBOL_FILES")
+{
+    qbind::MemoryManager::initialise();
+    TempDb db;
+    const auto path = db.root / "q_sym";
+
+    write_bytes(path, q_sym_file);
+    auto syms = qbind::load_symbols(path);
+    REQUIRE(syms.size() == 3);
+    REQUIRE(std::string_view(syms[0]) == "a");
+    REQUIRE(std::string_view(syms[2]) == "ccc");
+
+    write_bytes(path, q_d_file);
+    auto cols = qbind::load_symbols(path);
+    REQUIRE(cols.size() == 2);
+    REQUIRE(std::string_view(cols[1]) == "b");
+
+    write_bytes(path, q_enum_sym_file);
+    REQUIRE(std::string_view(qbind::load_symbols(path)[1]) == "y");
+
+    // an empty sym file
+    write_bytes(path, {0xff, 0x01, 0x0b, 0x00, 0x00, 0x00, 0x00, 0x00});
+    REQUIRE(qbind::load_symbols(path).size() == 0);
+
+    // not a symbol vector: `:x set 1 2j
+    write_bytes(path, {0xff, 0x01, 0x07, 0x00, 0x02, 0x00, 0x00, 0x00});
+    REQUIRE_THROWS_WITH(qbind::load_symbols(path), Catch::Contains("expected a symbol vector"));
+
+    // count past the end of the file
+    auto truncated = q_sym_file;
+    truncated[4] = 4;
+    write_bytes(path, truncated);
+    REQUIRE_THROWS_WITH(qbind::load_symbols(path), Catch::Contains("truncated"));
+
+    truncated[4] = 0xff;
+    truncated[7] = 0xff;
+    write_bytes(path, truncated);
+    REQUIRE_THROWS_WITH(qbind::load_symbols(path), Catch::Contains("negative"));
+
+    // the mapped vector header q uses for columns
+    write_vector<int64_t>(path, KS, {});
+    REQUIRE_THROWS_WITH(qbind::load_symbols(path), Catch::Contains("serialised object"));
+}
+
+TEST_CASE("SYMBOL_FILES_WRITTEN")
+{
+    qbind::MemoryManager::initialise();
+    qbind::ThreadPool pool(2);
+    TempDb db;
+
+    SECTION("AS_Q")
+    {
+        // the table q writes for `:t/ set .Q.en[`:.] ([] a:`x`y; b:1 2)
+        const auto sym = db.root / "q" / "sym";
+        const auto table = db.root / "q" / "t";
+        fs::create_directories(table);
+        qbind::SymFile domain(sym);
+        qbind::SplayedWriter writer(table, domain);
+        writer.add("a", qbind::Vector<qbind::Type::Symbol>{"x", "y"});
+        writer.add("b", qbind::Vector<qbind::Type::Long>{1, 2});
+        writer.write(pool);
+
+        REQUIRE(read_bytes(table / ".d") == q_d_file);
+        REQUIRE(read_bytes(sym) == q_enum_sym_file);
+    }
+
+    SECTION("APPEND")
+    {
+        // appending to q's sym file leaves what `:sym set `a`bb`ccc`dd would
+        const auto sym = db.root / "q_sym";
+        write_bytes(sym, q_sym_file);
+        qbind::SymFile domain(sym);
+        REQUIRE(domain.enumerate({"bb", "dd"}) == std::vector<qbind::EnumVector::index>{1, 3});
+        domain.save();
+
+        auto expected = q_sym_file;
+        expected[4] = 4;
+        expected.insert(expected.end(), {'d', 'd', 0x00});
+        REQUIRE(read_bytes(sym) == expected);
+
+        // and it opens again where it left off
+        qbind::SymFile reopened(sym);
+        REQUIRE(reopened.enumerate({"ee"}) == std::vector<qbind::EnumVector::index>{4});
+        reopened.save();
+        REQUIRE(qbind::load_symbols(sym).size() == 5);
+        REQUIRE(read_bytes(sym).size() == expected.size() + 3);
+    }
+}
+
+TEST_CASE("SPLAYED_WRITER")
+{
+    qbind::MemoryManager::initialise();
+    qbind::ThreadPool pool(2);
+    TempDb db;
+    const auto table = db.root / "2024.01.03" / "trade";
+
+    qbind::Vector<qbind::Type::Symbol> sym{"IBM", "IBM", "GOOG", ""};
+    qbind::Vector<qbind::Type::Long> size{1, 2, 3, 4};
+    qbind::StringColumnBuilder builder;
+    for (const char *s : {"A", "", "BC", "DEF"})
+        builder.push_back(s);
+    const auto cond = builder.build();
+
+    SECTION("ROUND_TRIP")
+    {
+        qbind::SymFile domain(db.root / "sym");
+        qbind::SplayedWriter writer(table, domain);
+        writer.add("sym", sym);
+        writer.add("size", size);
+        writer.add("cond", cond);
+        writer.parted("sym");
+        writer.preallocate(true);
+        writer.write(pool);
+
+        // existing codes are kept, new symbols appended
+        const auto saved = qbind::load_symbols(db.root / "sym");
+        REQUIRE(saved.size() == 4);
+        REQUIRE(std::string_view(saved[0]) == "AAPL");
+        REQUIRE(std::string_view(saved[3]) == "GOOG");
+
+        qbind::SplayedTable t(table);
+        REQUIRE(t.columns() == std::vector<std::string>{"sym", "size", "cond"});
+        REQUIRE(t.size() == 4);
+        REQUIRE(t.attribute("sym") == 3);
+
+        auto syms = t.enumerated("sym");
+        REQUIRE(syms[0] == 2);
+        REQUIRE(syms.symbol(2) == "GOOG");
+        REQUIRE(syms.symbol(3).empty());
+        REQUIRE(t.column<qbind::Type::Long>("size")[3] == 4);
+
+        auto strings = t.nested<qbind::Type::Char>("cond");
+        REQUIRE(strings[1].empty());
+        REQUIRE(std::string_view(strings[3].data(), strings[3].size()) == "DEF");
+        REQUIRE(strings.items().size() == 6);
+    }
+
+    SECTION("ENUMERATED")
+    {
+        // enumerated against a domain that isn't the sym file
+        qbind::Vector<qbind::Type::Symbol> own{"GOOG", "MSFT"};
+        const qbind::EnumVector ticker(qbind::Vector<qbind::Type::Symbol>{"MSFT", "GOOG", "", "MSFT"}, own);
+        qbind::Vector<qbind::Type::Symbol> names{"ticker", "size"};
+        ::K columns = knk(2, ticker.get().release(), size.get().release());
+        const qbind::K trade{xT(xD(names.get().release(), columns))};
+
+        qbind::SymFile domain(db.root / "sym");
+        // the codes alone can't be written
+        qbind::SplayedWriter from_table(table, domain);
+        REQUIRE_THROWS_WITH(from_table.add_table(trade.get()), Catch::Contains("enumerated"));
+        qbind::SplayedWriter codes_only(table, domain);
+        REQUIRE_THROWS(codes_only.add("ticker", qbind::EnumVector(ticker.get())));
+
+        qbind::SplayedWriter writer(table, domain);
+        writer.add("ticker", ticker);
+        writer.add("size", size);
+        writer.write(pool);
+
+        qbind::SplayedTable t(table);
+        REQUIRE(t.columns() == std::vector<std::string>{"ticker", "size"});
+        auto tickers = t.enumerated("ticker");
+        // MSFT is already in the sym file, GOOG is added to its end
+        REQUIRE(tickers[0] == 1);
+        REQUIRE(tickers[1] == 3);
+        REQUIRE(tickers.symbol(0) == "MSFT");
+        REQUIRE(tickers.symbol(2).empty());
+        REQUIRE(tickers.symbol(3) == "MSFT");
+    }
+
+    SECTION("CHECKS")
+    {
+        qbind::SplayedWriter writer(table);
+        REQUIRE_THROWS(writer.add("sym", sym));
+        writer.add("size", size);
+        REQUIRE_THROWS(writer.add("size", size));
+        REQUIRE_THROWS(writer.add("short", qbind::Vector<qbind::Type::Long>{1}));
+        REQUIRE_THROWS(writer.add("bad#", size));
+
+        writer.add("cond", cond);
+        writer.parted("cond");
+        REQUIRE_THROWS(writer.write(pool));
+
+        qbind::SplayedWriter unparted(table);
+        unparted.add("size", qbind::Vector<qbind::Type::Long>{1, 2, 1});
+        unparted.parted("size");
+        REQUIRE_THROWS_WITH(unparted.write(pool), Catch::Contains("not parted"));
+        // .d goes out last, so nothing is written for a failed table
+        REQUIRE_FALSE(std::filesystem::exists(table / ".d"));
+    }
+}
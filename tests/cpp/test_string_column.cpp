@@ -0,0 +1,47 @@
+#include <catch2/catch.hpp>
+
+#include <string>
+#include <vector>
+
+#include "qbind/memory_manager.h"
+#include "qbind/string_column.h"
+
+TEST_CASE("STRING_COLUMN")
+{
+    qbind::MemoryManager::initialise();
+
+    SECTION("VIEW")
+    {
+        // ("ab";"c";"";"xyz") with "c" as a char atom
+        qbind::K list{knk(4, kp(const_cast<char *>("ab")), kc('c'), ktn(KC, 0), kp(const_cast<char *>("xyz")))};
+        qbind::StringColumn col(list);
+        REQUIRE(col.size() == 4);
+        REQUIRE(col[0] == "ab");
+        REQUIRE(col[1] == "c");
+        REQUIRE(col[2].empty());
+        REQUIRE(col.at(3) == "xyz");
+        REQUIRE(col.find("xyz") == 3);
+        REQUIRE(col.find("missing") == col.size());
+        REQUIRE_THROWS(col.at(4));
+    }
+
+    SECTION("NOT_STRINGS")
+    {
+        REQUIRE_THROWS(qbind::StringColumn(qbind::K{knk(2, kp(const_cast<char *>("ab")), kj(1))}));
+        REQUIRE_THROWS(qbind::StringColumn(qbind::K{ktn(KC, 2)}));
+    }
+
+    SECTION("BUILDER")
+    {
+        std::vector<std::string> rows{"order1", "", "client_ref_42"};
+        qbind::StringColumnBuilder builder(rows.size());
+        builder.append(rows.begin(), rows.end());
+        REQUIRE(builder.size() == 3);
+
+        auto col = builder.build();
+        REQUIRE(builder.size() == 0);
+        REQUIRE(col.size() == rows.size());
+        for (size_t i = 0; i < rows.size(); ++i)
+            REQUIRE(col[i] == rows[i]);
+    }
+}
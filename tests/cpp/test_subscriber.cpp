@@ -0,0 +1,411 @@
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include "qbind/k.h"
+#include "qbind/memory_manager.h"
+
+#include "subscriber.h"
+
+namespace
+{
+    template<class T>
+    T *data(::K k)
+    {
+        return reinterpret_cast<T *>(k->G0);
+    }
+
+    ::K longs(std::initializer_list<int64_t> xs)
+    {
+        ::K k = ktn(KJ, static_cast<J>(xs.size()));
+        std::copy(xs.begin(), xs.end(), data<int64_t>(k));
+        return k;
+    }
+
+    ::K floats(std::initializer_list<double> xs)
+    {
+        ::K k = ktn(KF, static_cast<J>(xs.size()));
+        std::copy(xs.begin(), xs.end(), data<double>(k));
+        return k;
+    }
+
+    ::K symbols(std::initializer_list<const char *> xs)
+    {
+        ::K k = ktn(KS, static_cast<J>(xs.size()));
+        S *out = data<S>(k);
+        for (const char *x : xs)
+            *out++ = ss(const_cast<S>(x));
+        return k;
+    }
+
+    ::K strings(std::initializer_list<const char *> xs)
+    {
+        ::K k = ktn(0, static_cast<J>(xs.size()));
+        ::K *out = data<::K>(k);
+        for (const char *x : xs)
+            *out++ = kp(const_cast<S>(x));
+        return k;
+    }
+
+    ::K list(std::initializer_list<::K> xs)
+    {
+        ::K k = ktn(0, static_cast<J>(xs.size()));
+        std::copy(xs.begin(), xs.end(), data<::K>(k));
+        return k;
+    }
+
+    ::K table(std::initializer_list<const char *> names, std::initializer_list<::K> columns)
+    {
+        return xT(xD(symbols(names), list(columns)));
+    }
+
+    // The payload of msg as b9 serialises it, without the message header.
+    Buffer payload(::K msg)
+    {
+        const qbind::K owner{msg};
+        const qbind::K bytes{b9(3, msg)};
+        const size_t size = static_cast<size_t>(bytes.get()->n) - message_header_size;
+        auto *p = static_cast<uint8_t *>(malloc(size));
+        memcpy(p, bytes.get()->G0 + message_header_size, size);
+        return {p, size};
+    }
+
+    // (`upd;name;data)
+    Buffer upd(const char *name, ::K data)
+    {
+        return payload(list({ks(const_cast<S>("upd")), ks(const_cast<S>(name)), data}));
+    }
+
+    template<qbind::Type Type>
+    std::vector<typename qbind::internal::c_type<Type>::underlier> values(const ColumnBuffer& column)
+    {
+        std::vector<typename qbind::internal::c_type<Type>::underlier> res;
+        for (size_t i = 0; i < column.chunks(); ++i)
+        {
+            const auto chunk = column.template chunk<Type>(i);
+            res.insert(res.end(), chunk.begin(), chunk.end());
+        }
+        return res;
+    }
+
+    std::vector<std::string> symbols(const ColumnBuffer& column)
+    {
+        std::vector<std::string> res;
+        for (const char *s : values<qbind::Type::Symbol>(column))
+            res.emplace_back(s);
+        return res;
+    }
+
+    std::vector<std::string> strings(const ColumnBuffer& column)
+    {
+        std::vector<std::string> res;
+        for (size_t i = 0; i < column.size(); ++i)
+            res.emplace_back(column.string(i));
+        return res;
+    }
+
+    std::vector<std::string> names(const TableBuffer& table)
+    {
+        std::vector<std::string> res;
+        for (const auto& column : table.columns())
+            res.push_back(column.name());
+        return res;
+    }
+
+    // Writes IPC as a big endian sender does.
+    struct BigEndian
+    {
+        std::string out;
+
+        template<class T>
+        void put(T x)
+        {
+            char bytes[sizeof(T)];
+            memcpy(bytes, &x, sizeof(T));
+            std::reverse(bytes, bytes + sizeof(T));
+            out.append(bytes, sizeof(T));
+        }
+
+        void list_header(signed char t, int32_t n)
+        {
+            out += static_cast<char>(t);
+            out += '\0';
+            put(n);
+        }
+
+        void symbol(const char *s)
+        {
+            out.append(s, strlen(s) + 1);
+        }
+
+        Buffer buffer() const
+        {
+            auto *p = static_cast<uint8_t *>(malloc(out.size()));
+            memcpy(p, out.data(), out.size());
+            return {p, out.size(), std::endian::big};
+        }
+    };
+
+    using Guid = std::array<uint8_t, 16>;
+
+    const Guid guid_a{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+    const Guid guid_b{15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0};
+}
+
+TEST_CASE("SUBSCRIBER")
+{
+    qbind::MemoryManager::initialise();
+    std::vector<size_t> consumed;
+    SubscriberOptions options;
+    // small, so updates cross chunks
+    options.chunk_rows = 3;
+    Subscriber sub([&consumed](const TableBuffer& t) { consumed.push_back(t.rows()); }, options);
+
+    SECTION("table")
+    {
+        // ([] time:"p"$1 2; sym:`a`b; price:1.5 2.5; size:10 20; note:("x";"yz"))
+        ::K time = ktn(KP, 2);
+        data<int64_t>(time)[0] = 1;
+        data<int64_t>(time)[1] = 2;
+        REQUIRE(sub.process(upd("trade", table({"time", "sym", "price", "size", "note"},
+            {time, symbols({"a", "b"}), floats({1.5, 2.5}), longs({10, 20}), strings({"x", "yz"})}))));
+
+        const TableBuffer *t = sub.table("trade");
+        REQUIRE(t != nullptr);
+        REQUIRE(t->rows() == 2);
+        REQUIRE(names(*t) == std::vector<std::string>{"time", "sym", "price", "size", "note"});
+        REQUIRE(t->column("time").type() == KP);
+        REQUIRE(t->column("note").type() == 0);
+        REQUIRE(values<qbind::Type::Timestamp>(t->column("time")) == std::vector<int64_t>{1, 2});
+        REQUIRE(symbols(t->column("sym")) == std::vector<std::string>{"a", "b"});
+        REQUIRE(values<qbind::Type::Float>(t->column("price")) == std::vector<double>{1.5, 2.5});
+        REQUIRE(values<qbind::Type::Long>(t->column("size")) == std::vector<int64_t>{10, 20});
+        REQUIRE(strings(t->column("note")) == std::vector<std::string>{"x", "yz"});
+
+        // a single row for the same table
+        REQUIRE(sub.process(upd("trade", list({ktj(-KP, 3), ks(const_cast<S>("c")), kf(3.5), kj(30), kp(const_cast<S>("zzz"))}))));
+        REQUIRE(t->rows() == 3);
+        REQUIRE(symbols(t->column("sym")) == std::vector<std::string>{"a", "b", "c"});
+        REQUIRE(strings(t->column("note")) == std::vector<std::string>{"x", "yz", "zzz"});
+        REQUIRE(sub.messages() == 2);
+    }
+
+    SECTION("list of columns")
+    {
+        // (1 2 3j;`a`b`a;1.5 2.5 3.5;("x";"";"abc"))
+        const auto data = [] { return list({longs({1, 2, 3}), symbols({"a", "b", "a"}), floats({1.5, 2.5, 3.5}), strings({"x", "", "abc"})}); };
+        REQUIRE(sub.process(upd("quote", data())));
+
+        const TableBuffer *t = sub.table("quote");
+        REQUIRE(names(*t) == std::vector<std::string>{"x", "x1", "x2", "x3"});
+        REQUIRE(values<qbind::Type::Long>(t->column("x")) == std::vector<int64_t>{1, 2, 3});
+        REQUIRE(symbols(t->column("x1")) == std::vector<std::string>{"a", "b", "a"});
+        REQUIRE(values<qbind::Type::Float>(t->column("x2")) == std::vector<double>{1.5, 2.5, 3.5});
+        REQUIRE(strings(t->column("x3")) == std::vector<std::string>{"x", "", "abc"});
+
+        // named by set_columns, and symbols are interned
+        sub.set_columns("named", {"id", "sym"});
+        REQUIRE(sub.process(upd("named", list({longs({1}), symbols({"a"})}))));
+        REQUIRE(names(*sub.table("named")) == std::vector<std::string>{"id", "sym"});
+        REQUIRE(sub.table("named")->column("sym").chunk<qbind::Type::Symbol>(0)[0] == t->column("x1").chunk<qbind::Type::Symbol>(0)[0]);
+
+        // not updates, or updates that don't match the table
+        REQUIRE_FALSE(sub.process(payload(list({ks(const_cast<S>("foo")), ks(const_cast<S>("quote")), data()}))));
+        REQUIRE_THROWS(sub.process(upd("quote", list({longs({1}), symbols({"a"})}))));
+        REQUIRE_THROWS(sub.process(upd("quote", list({longs({1, 2}), symbols({"a"}), floats({1}), strings({"x"})}))));
+        REQUIRE_THROWS(sub.process(upd("quote", list({floats({1}), symbols({"a"}), floats({1}), strings({"x"})}))));
+        REQUIRE(t->rows() == 3);
+    }
+
+    SECTION("single row of atoms")
+    {
+        // (1j;`a;1.5;"hello";enlist "x";"c";0x2a;1i)
+        REQUIRE(sub.process(upd("row", list({kj(1), ks(const_cast<S>("a")), kf(1.5), kp(const_cast<S>("hello")), kp(const_cast<S>("x")), kc('c'), kg(42), ki(1)}))));
+        REQUIRE(sub.process(upd("row", list({kj(2), ks(const_cast<S>("b")), kf(2.5), kp(const_cast<S>("")), kp(const_cast<S>("yz")), kc('d'), kg(43), ki(2)}))));
+
+        const TableBuffer *t = sub.table("row");
+        REQUIRE(t->rows() == 2);
+        REQUIRE(values<qbind::Type::Long>(t->column("x")) == std::vector<int64_t>{1, 2});
+        REQUIRE(symbols(t->column("x1")) == std::vector<std::string>{"a", "b"});
+        REQUIRE(values<qbind::Type::Float>(t->column("x2")) == std::vector<double>{1.5, 2.5});
+        // strings, even of one character
+        REQUIRE(t->column("x3").type() == 0);
+        REQUIRE(strings(t->column("x3")) == std::vector<std::string>{"hello", ""});
+        REQUIRE(strings(t->column("x4")) == std::vector<std::string>{"x", "yz"});
+        // a char atom is a char column
+        REQUIRE(values<qbind::Type::Char>(t->column("x5")) == std::vector<char>{'c', 'd'});
+        REQUIRE(values<qbind::Type::Byte>(t->column("x6")) == std::vector<uint8_t>{42, 43});
+        REQUIRE(values<qbind::Type::Int>(t->column("x7")) == std::vector<int32_t>{1, 2});
+    }
+
+    SECTION("swapped endian")
+    {
+        // (1 2j;1.5 2.5;1 2i;1 2h;`a`bc;("x";"yz");guids) from a little
+        // endian sender...
+        ::K guids = ktn(UU, 2);
+        memcpy(data<uint8_t>(guids), guid_a.data(), 16);
+        memcpy(data<uint8_t>(guids) + 16, guid_b.data(), 16);
+        ::K ints = ktn(KI, 2);
+        data<int32_t>(ints)[0] = 1;
+        data<int32_t>(ints)[1] = 2;
+        ::K shorts = ktn(KH, 2);
+        data<int16_t>(shorts)[0] = 1;
+        data<int16_t>(shorts)[1] = 2;
+        REQUIRE(sub.process(upd("little", list({longs({1, 2}), floats({1.5, 2.5}), ints, shorts, symbols({"a", "bc"}), strings({"x", "yz"}), guids}))));
+
+        // ...and a big endian one
+        BigEndian big;
+        big.list_header(0, 3);
+        big.out += static_cast<char>(-KS);
+        big.symbol("upd");
+        big.out += static_cast<char>(-KS);
+        big.symbol("big");
+        big.list_header(0, 7);
+        big.list_header(KJ, 2);
+        big.put<int64_t>(1);
+        big.put<int64_t>(2);
+        big.list_header(KF, 2);
+        big.put(1.5);
+        big.put(2.5);
+        big.list_header(KI, 2);
+        big.put<int32_t>(1);
+        big.put<int32_t>(2);
+        big.list_header(KH, 2);
+        big.put<int16_t>(1);
+        big.put<int16_t>(2);
+        big.list_header(KS, 2);
+        big.symbol("a");
+        big.symbol("bc");
+        big.list_header(0, 2);
+        big.list_header(KC, 1);
+        big.out += "x";
+        big.list_header(KC, 2);
+        big.out += "yz";
+        big.list_header(UU, 2);
+        big.out.append(reinterpret_cast<const char *>(guid_a.data()), 16);
+        big.out.append(reinterpret_cast<const char *>(guid_b.data()), 16);
+        REQUIRE(sub.process(big.buffer()));
+
+        for (const char *name : {"little", "big"})
+        {
+            const TableBuffer *t = sub.table(name);
+            REQUIRE(t->rows() == 2);
+            REQUIRE(values<qbind::Type::Long>(t->column("x")) == std::vector<int64_t>{1, 2});
+            REQUIRE(values<qbind::Type::Float>(t->column("x1")) == std::vector<double>{1.5, 2.5});
+            REQUIRE(values<qbind::Type::Int>(t->column("x2")) == std::vector<int32_t>{1, 2});
+            REQUIRE(values<qbind::Type::Short>(t->column("x3")) == std::vector<int16_t>{1, 2});
+            REQUIRE(symbols(t->column("x4")) == std::vector<std::string>{"a", "bc"});
+            REQUIRE(strings(t->column("x5")) == std::vector<std::string>{"x", "yz"});
+            // GUIDs are bytes, never swapped
+            REQUIRE(values<qbind::Type::GUID>(t->column("x6")) == std::vector<Guid>{guid_a, guid_b});
+        }
+    }
+
+    SECTION("chunk boundaries")
+    {
+        REQUIRE(sub.process(upd("t", list({longs({1, 2}), symbols({"a", "b"}), strings({"r1", "r2"})}))));
+        // fills the first chunk, the second, and starts a third
+        REQUIRE(sub.process(upd("t", list({longs({3, 4, 5, 6, 7}), symbols({"c", "d", "e", "f", "g"}), strings({"r3", "r4", "r5", "r6", "r7"})}))));
+
+        const TableBuffer *t = sub.table("t");
+        REQUIRE(t->rows() == 7);
+        const auto& x = t->column("x");
+        REQUIRE(x.chunks() == 3);
+        REQUIRE(x.chunk<qbind::Type::Long>(0).size() == 3);
+        REQUIRE(x.chunk<qbind::Type::Long>(1).size() == 3);
+        REQUIRE(x.chunk<qbind::Type::Long>(2).size() == 1);
+        REQUIRE_THROWS(x.chunk<qbind::Type::Long>(3));
+        REQUIRE_THROWS(x.chunk<qbind::Type::Float>(0));
+        REQUIRE(values<qbind::Type::Long>(x) == std::vector<int64_t>{1, 2, 3, 4, 5, 6, 7});
+        REQUIRE(symbols(t->column("x1")) == std::vector<std::string>{"a", "b", "c", "d", "e", "f", "g"});
+        REQUIRE(strings(t->column("x2")) == std::vector<std::string>{"r1", "r2", "r3", "r4", "r5", "r6", "r7"});
+
+        // cleared once consumed, keeping its chunks
+        const auto *first = x.chunk<qbind::Type::Long>(0).data();
+        sub.flush();
+        REQUIRE(consumed == std::vector<size_t>{7});
+        REQUIRE(t->rows() == 0);
+        REQUIRE(x.chunks() == 0);
+        REQUIRE(sub.process(upd("t", list({longs({8, 9, 10, 11}), symbols({"h", "i", "j", "k"}), strings({"r8", "r9", "r10", "r11"})}))));
+        REQUIRE(x.chunks() == 2);
+        REQUIRE(x.chunk<qbind::Type::Long>(0).data() == first);
+        REQUIRE(values<qbind::Type::Long>(x) == std::vector<int64_t>{8, 9, 10, 11});
+        REQUIRE(strings(t->column("x2")) == std::vector<std::string>{"r8", "r9", "r10", "r11"});
+    }
+
+    SECTION("all strings single row")
+    {
+        // char vectors without atoms are columns of a new table
+        REQUIRE(sub.process(upd("chars", strings({"ab", "cd"}))));
+        const TableBuffer *chars = sub.table("chars");
+        REQUIRE(chars->rows() == 2);
+        REQUIRE(chars->column("x").type() == KC);
+        REQUIRE(values<qbind::Type::Char>(chars->column("x")) == std::vector<char>{'a', 'b'});
+        REQUIRE(values<qbind::Type::Char>(chars->column("x1")) == std::vector<char>{'c', 'd'});
+
+        // but a row of a table whose columns are all strings
+        REQUIRE(sub.process(upd("text", list({strings({"ab", "c"}), strings({"d", "ef"})}))));
+        REQUIRE(sub.process(upd("text", strings({"x", "yz"}))));
+        const TableBuffer *text = sub.table("text");
+        REQUIRE(text->rows() == 3);
+        REQUIRE(strings(text->column("x")) == std::vector<std::string>{"ab", "c", "x"});
+        REQUIRE(strings(text->column("x1")) == std::vector<std::string>{"d", "ef", "yz"});
+
+        // and with an atom it's always a row
+        REQUIRE(sub.process(upd("mixed", list({kj(1), kp(const_cast<S>("ab")), kp(const_cast<S>("cd"))}))));
+        REQUIRE(sub.table("mixed")->rows() == 1);
+        REQUIRE(strings(sub.table("mixed")->column("x2")) == std::vector<std::string>{"cd"});
+    }
+
+    SECTION("corrupt counts")
+    {
+        // (`upd;`bad;enlist column) up to the column's header
+        const auto message = []
+        {
+            BigEndian big;
+            big.list_header(0, 3);
+            big.out += static_cast<char>(-KS);
+            big.symbol("upd");
+            big.out += static_cast<char>(-KS);
+            big.symbol("bad");
+            big.list_header(0, 1);
+            return big;
+        };
+        const auto longs_of = [&message](int32_t n)
+        {
+            BigEndian big = message();
+            big.list_header(KJ, n);
+            big.put<int64_t>(1);
+            big.put<int64_t>(2);
+            return big.buffer();
+        };
+        REQUIRE(sub.process(longs_of(2)));
+        REQUIRE_THROWS_WITH(sub.process(longs_of(3)), Catch::Contains("Truncated"));
+        REQUIRE_THROWS_WITH(sub.process(longs_of(-1)), Catch::Contains("Corrupt count"));
+        REQUIRE_THROWS_WITH(sub.process(longs_of(0x7fffffff)), Catch::Contains("Truncated"));
+
+        // large vectors' 8 byte counts, the first wrapping n * 8 to 0
+        const auto large = [&message](signed char t, int64_t n)
+        {
+            BigEndian big = message();
+            big.out += static_cast<char>(t);
+            big.out += static_cast<char>(128);
+            big.put(n);
+            big.put<int64_t>(1);
+            return big.buffer();
+        };
+        REQUIRE_THROWS_WITH(sub.process(large(KJ, int64_t(1) << 61)), Catch::Contains("Truncated"));
+        REQUIRE_THROWS_WITH(sub.process(large(KJ, -2)), Catch::Contains("Corrupt count"));
+        REQUIRE_THROWS_WITH(sub.process(large(KS, 9)), Catch::Contains("Truncated"));
+        REQUIRE_THROWS_WITH(sub.process(large(0, 2)), Catch::Contains("Truncated"));
+
+        // and the good message before them went in whole
+        REQUIRE(values<qbind::Type::Long>(sub.table("bad")->column("x")) == std::vector<int64_t>{1, 2});
+    }
+}
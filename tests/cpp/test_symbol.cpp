@@ -0,0 +1,143 @@
+#include <catch2/catch.hpp>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "qbind/enum_vector.h"
+#include "qbind/memory_manager.h"
+#include "qbind/symbol.h"
+#include "qbind/symbol_builder.h"
+#include "qbind/vector.h"
+
+TEST_CASE("SYMBOL_CACHE")
+{
+    qbind::MemoryManager::initialise();
+    qbind::internal::SymbolCache::clear();
+    const qbind::internal::intern intern;
+
+    SECTION("SAME_CONTENT_SAME_POINTER")
+    {
+        // Different buffers with the same content intern to the same symbol.
+        std::string a = "cache_test_sym";
+        std::string b = "cache_test_sym";
+        auto pa = intern(a);
+        auto pb = intern(b);
+        REQUIRE(pa == pb);
+        REQUIRE(pa == sn(const_cast<char *>("cache_test_sym"), 14));
+        REQUIRE(qbind::internal::SymbolCache::size() == 1);
+    }
+
+    SECTION("NOT_NULL_TERMINATED")
+    {
+        // Only the viewed characters are interned.
+        std::string_view view{"prefix_suffix", 6};
+        auto p = intern(view);
+        REQUIRE(std::string_view{p} == "prefix");
+        REQUIRE(intern("prefix") == p);
+        REQUIRE(qbind::internal::SymbolCache::size() == 1);
+    }
+
+    SECTION("MISSES_GROW_CACHE")
+    {
+        REQUIRE(intern("a_sym") != intern("b_sym"));
+        REQUIRE(qbind::internal::SymbolCache::size() == 2);
+        qbind::internal::SymbolCache::clear();
+        REQUIRE(qbind::internal::SymbolCache::size() == 0);
+        // Still interns correctly after a clear.
+        REQUIRE(intern("a_sym") == sn(const_cast<char *>("a_sym"), 5));
+    }
+}
+
+TEST_CASE("SYMBOL_BUILDER")
+{
+    qbind::MemoryManager::initialise();
+    qbind::internal::SymbolCache::clear();
+
+    std::vector<std::string> rows;
+    for (auto i = 0; i < 1000; ++i)
+        rows.push_back("tick" + std::to_string(i % 7));
+
+    qbind::SymbolBuilder builder(rows.size());
+    builder.append(rows.begin(), rows.end());
+    REQUIRE(builder.size() == rows.size());
+
+    const auto col = builder.build();
+    REQUIRE(col.size() == rows.size());
+    const auto syms = col.get().data<char *>();
+    // One intern per distinct value.
+    REQUIRE(qbind::internal::SymbolCache::size() == 7);
+    for (size_t i = 0; i < rows.size(); ++i)
+    {
+        REQUIRE(rows[i] == col[i]);
+        REQUIRE(syms[i] == syms[i % 7]);
+    }
+
+    // Build leaves the builder empty for the next batch.
+    REQUIRE(builder.size() == 0);
+    builder.push_back("tick3");
+    builder.push_back("other");
+    const auto next = builder.build();
+    REQUIRE(next.size() == 2);
+    REQUIRE(next.get().data<char *>()[0] == syms[3]);
+    REQUIRE(std::string_view{next[1]} == "other");
+    REQUIRE(builder.build().size() == 0);
+}
+
+TEST_CASE("SYMBOL_SEARCH")
+{
+    qbind::MemoryManager::initialise();
+
+    // Long enough to cover the vectorised loop and its tail.
+    std::vector<std::string> rows;
+    for (auto i = 0; i < 37; ++i)
+        rows.push_back("s" + std::to_string(i % 5));
+    qbind::Vector<qbind::Type::Symbol> vec(rows.begin(), rows.end());
+
+    REQUIRE(vec.find("s0") == 0);
+    REQUIRE(vec.find("s3") == 3);
+    REQUIRE(vec.find("missing") == vec.size());
+    REQUIRE(vec.count("s1") == 8);
+    REQUIRE(vec.count("missing") == 0);
+    REQUIRE(vec.contains("s4"));
+    REQUIRE_FALSE(vec.contains("s5"));
+
+    qbind::Vector<qbind::Type::Symbol> set{"s2", "s4"};
+    auto in = vec.in(set);
+    for (size_t i = 0; i < vec.size(); ++i)
+        REQUIRE(in[i] == (i % 5 == 2 || i % 5 == 4));
+
+    qbind::Vector<qbind::Type::Symbol> copy(rows.begin(), rows.end());
+    REQUIRE((vec == copy));
+    REQUIRE_FALSE((vec == set));
+}
+
+TEST_CASE("ENUM_VECTOR")
+{
+    qbind::MemoryManager::initialise();
+
+    qbind::Vector<qbind::Type::Symbol> domain{"a", "b", "c"};
+    qbind::Vector<qbind::Type::Symbol> values{"c", "a", "", "c"};
+    qbind::EnumVector e(values, domain);
+
+    REQUIRE(e.type_code() == 20);
+    REQUIRE(e.size() == 4);
+    REQUIRE(e[0] == 2);
+    REQUIRE(e[2] == qbind::EnumVector::null_index);
+    REQUIRE(e.symbol(1) == "a");
+    REQUIRE(e.count("c") == 2);
+    REQUIRE(e.find("b") == e.size());
+    REQUIRE((e.resolve() == values));
+    REQUIRE_THROWS(qbind::EnumVector(qbind::Vector<qbind::Type::Symbol>{"d"}, domain));
+
+    // Keys enumerated against a different domain are matched on symbol.
+    qbind::Vector<qbind::Type::Symbol> other{"c", "b"};
+    qbind::EnumVector keys(qbind::Vector<qbind::Type::Symbol>{"b", "c"}, other);
+    REQUIRE(e.lookup(keys) == std::vector<size_t>{1, 2, 2, 1});
+    REQUIRE((e == qbind::EnumVector(e.get(), domain)));
+
+    // Rows by code, nulls left out.
+    REQUIRE(e.group() == std::vector<std::vector<size_t>>{{1}, {}, {0, 3}});
+    REQUIRE(keys.group() == std::vector<std::vector<size_t>>{{1}, {0}});
+    REQUIRE(qbind::EnumVector(qbind::Vector<qbind::Type::Symbol>{}, domain).group().size() == 3);
+}
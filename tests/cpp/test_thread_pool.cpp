@@ -0,0 +1,118 @@
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "qbind/memory_manager.h"
+#include "qbind/thread_pool.h"
+
+TEST_CASE("THREAD_POOL")
+{
+    qbind::MemoryManager::initialise();
+    qbind::ThreadPool pool(4);
+
+    SECTION("PARALLEL_FOR")
+    {
+        std::vector<int64_t> data(10007);
+        std::iota(data.begin(), data.end(), 0);
+        std::atomic<int64_t> sum{0};
+        pool.parallel_for(0, data.size(), 100, [&](size_t first, size_t last)
+        {
+            sum += std::accumulate(data.begin() + first, data.begin() + last, int64_t{0});
+        });
+        REQUIRE(sum == 10007LL * 10006 / 2);
+    }
+
+    SECTION("NESTED")
+    {
+        // Inner loops wait from worker threads, which must not deadlock.
+        std::atomic<size_t> count{0};
+        pool.parallel_for(0, 16, 1, [&](size_t, size_t)
+        {
+            pool.parallel_for(0, 64, 4, [&](size_t first, size_t last) { count += last - first; });
+        });
+        REQUIRE(count == 16 * 64);
+    }
+
+    SECTION("EXCEPTION")
+    {
+        qbind::TaskGroup group(pool);
+        group.run([] { throw std::runtime_error("failed"); });
+        group.run([] {});
+        REQUIRE_THROWS_WITH(group.wait(), "failed");
+    }
+
+    SECTION("DEFERRED_RELEASE")
+    {
+        // Allocated on a worker, released on this thread. An extra reference
+        // shows which thread does the r0: only the owner drops it to 0.
+        std::vector<qbind::OwnedK> objects(32);
+        pool.parallel_for(0, objects.size(), 1, [&](size_t first, size_t)
+        {
+            objects[first] = qbind::OwnedK(r1(ktn(KJ, 100)));
+            // long enough for the workers to take some
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        });
+        // This thread runs some chunks too, so owns some of them.
+        std::vector<::K> raw;
+        std::vector<bool> here;
+        for (auto& obj : objects)
+        {
+            REQUIRE(obj.get());
+            raw.push_back(obj.get());
+            here.push_back(obj.owner() == qbind::ThreadPool::owner());
+        }
+        REQUIRE(std::count(here.begin(), here.end(), false) > 0);
+        objects.clear();
+        qbind::ThreadPool::drain_deferred();
+        for (size_t i = 0; i < raw.size(); ++i)
+            REQUIRE(raw[i]->r == (here[i] ? 0 : 1));
+
+        // Workers release theirs after their next task.
+        const auto released = [&] { return std::all_of(raw.begin(), raw.end(), [](::K k) { return k->r == 0; }); };
+        for (int i = 0; i < 10000 && !released(); ++i)
+        {
+            qbind::TaskGroup group(pool);
+            for (size_t t = 0; t < pool.size(); ++t)
+                group.run([] { std::this_thread::sleep_for(std::chrono::microseconds(10)); });
+            group.wait();
+        }
+        REQUIRE(released());
+        for (auto k : raw)
+            r0(k);
+    }
+
+    SECTION("DEFERRED_RELEASE_EXTERNAL")
+    {
+        // Each external thread owns its objects, they aren't shared out.
+        ::K k = nullptr;
+        qbind::OwnedK obj;
+        int after_other = -1;
+        int after_owner = -1;
+        std::thread([&]
+        {
+            qbind::MemoryManager::initialise();
+            k = r1(ktn(KJ, 100));
+            obj = qbind::OwnedK(k);
+
+            std::thread([&]
+            {
+                qbind::MemoryManager::initialise();
+                obj.reset();
+                qbind::ThreadPool::drain_deferred();
+                after_other = k->r;
+            }).join();
+
+            qbind::ThreadPool::drain_deferred();
+            after_owner = k->r;
+        }).join();
+        REQUIRE(after_other == 1);
+        REQUIRE(after_owner == 0);
+        r0(k);
+    }
+}
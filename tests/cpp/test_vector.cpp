@@ -0,0 +1,29 @@
+#include <catch2/catch.hpp>
+
+#include <iterator>
+#include <numeric>
+#include <vector>
+
+#include "qbind/memory_manager.h"
+#include "qbind/vector.h"
+
+TEST_CASE("VECTOR_ITERATOR")
+{
+    qbind::Vector<qbind::Type::Long> vec{1, 2, 3, 4};
+
+    REQUIRE(vec.begin() == vec.begin());
+    REQUIRE(vec.begin() != vec.end());
+    REQUIRE(vec.end() - vec.begin() == 4);
+    REQUIRE(std::distance(vec.cbegin(), vec.cend()) == 4);
+
+    std::vector<int64_t> forward;
+    for (auto x : vec)
+        forward.push_back(x);
+    REQUIRE(forward == std::vector<int64_t>{1, 2, 3, 4});
+
+    // reverse iterators measure distance in their own direction
+    REQUIRE(vec.rend() - vec.rbegin() == 4);
+    REQUIRE(std::vector<int64_t>(vec.rbegin(), vec.rend()) == std::vector<int64_t>{4, 3, 2, 1});
+
+    REQUIRE(std::accumulate(vec.begin(), vec.end(), int64_t{0}) == 10);
+}
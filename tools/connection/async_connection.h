@@ -0,0 +1,1048 @@
+#pragma once
+
+#include <array>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "connection.h"
+
+template<class T = void>
+class Task;
+
+namespace detail
+{
+
+class TaskPromiseBase
+{
+public:
+
+    // Tasks are lazy: nothing runs until they're awaited.
+    std::suspend_always initial_suspend() const noexcept
+    {
+        return {};
+    }
+
+    struct FinalAwaiter
+    {
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        // Symmetric transfer back to the awaiting coroutine, so long chains
+        // of tasks completing synchronously don't grow the stack.
+        template<class Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) const noexcept
+        {
+            const auto continuation = handle.promise().m_continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept
+        {}
+    };
+
+    FinalAwaiter final_suspend() const noexcept
+    {
+        return {};
+    }
+
+    void unhandled_exception() noexcept
+    {
+        m_error = std::current_exception();
+    }
+
+    std::coroutine_handle<> m_continuation;
+
+protected:
+
+    void rethrow() const
+    {
+        if (m_error)
+            std::rethrow_exception(m_error);
+    }
+
+    std::exception_ptr m_error;
+};
+
+template<class T>
+class TaskPromiseResult : public TaskPromiseBase
+{
+public:
+
+    template<class U>
+    void return_value(U&& value)
+    {
+        m_value.emplace(std::forward<U>(value));
+    }
+
+    T result()
+    {
+        rethrow();
+        return std::move(*m_value);
+    }
+
+private:
+    std::optional<T> m_value;
+};
+
+template<>
+class TaskPromiseResult<void> : public TaskPromiseBase
+{
+public:
+
+    void return_void() const noexcept
+    {}
+
+    void result() const
+    {
+        rethrow();
+    }
+};
+
+}
+
+/**
+ * @brief A lazily started coroutine returning T, run by co_await-ing it.
+ *
+ * A task is owned by whoever holds it and may be awaited once. To run one
+ * without awaiting it, hand it to EventLoop::spawn.
+ */
+template<class T>
+class [[nodiscard]] Task
+{
+public:
+
+    struct promise_type : detail::TaskPromiseResult<T>
+    {
+        Task get_return_object() noexcept
+        {
+            return Task{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+    };
+
+    Task(Task&& other) noexcept
+    : m_handle(std::exchange(other.m_handle, {}))
+    {}
+
+    Task& operator=(Task&& other) noexcept
+    {
+        if (this != &other)
+        {
+            if (m_handle)
+                m_handle.destroy();
+            m_handle = std::exchange(other.m_handle, {});
+        }
+        return *this;
+    }
+
+    ~Task()
+    {
+        if (m_handle)
+            m_handle.destroy();
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        m_handle.promise().m_continuation = awaiting;
+        return m_handle;
+    }
+
+    T await_resume()
+    {
+        return m_handle.promise().result();
+    }
+
+private:
+
+    explicit Task(std::coroutine_handle<promise_type> handle) noexcept
+    : m_handle(handle)
+    {}
+
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+/**
+ * @brief Single threaded executor resuming coroutines as their sockets
+ * become ready, on epoll.
+ *
+ * One thread calls run and every coroutine spawned on the loop runs on it,
+ * so many sessions share a thread without locking each other out. Waiting
+ * on a file descriptor (readable, writable, forget) is for the loop thread
+ * only; spawn, post, schedule and stop may be called from any thread.
+ *
+ * An exception escaping a spawned task stops the loop and is rethrown from
+ * run. Spawned tasks still suspended when the loop is destroyed are
+ * destroyed with it.
+ */
+class EventLoop
+{
+    class Detached;
+
+public:
+
+    EventLoop()
+    {
+        m_epoll = epoll_create1(EPOLL_CLOEXEC);
+        THROW_ERRNO_IF(m_epoll == -1);
+        m_wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_wakeup == -1)
+        {
+            ::close(m_epoll);
+            THROW_ERRNO_IF(true);
+        }
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = m_wakeup;
+        if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wakeup, &event) == -1)
+        {
+            ::close(m_wakeup);
+            ::close(m_epoll);
+            THROW_ERRNO_IF(true);
+        }
+    }
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    ~EventLoop()
+    {
+        // Destroying a spawned task's frame destroys the tasks it awaits.
+        for (void *address : m_detached)
+            std::coroutine_handle<>::from_address(address).destroy();
+        ::close(m_wakeup);
+        ::close(m_epoll);
+    }
+
+    /**
+     * @brief Resume coroutines until stop is called.
+     */
+    void run()
+    {
+        std::array<epoll_event, 64> events;
+        for (;;)
+        {
+            std::coroutine_handle<> next;
+            {
+                std::lock_guard<std::mutex> lk(m_mutex);
+                if (m_stop)
+                {
+                    m_stop = false;
+                    return;
+                }
+                if (!m_ready.empty())
+                {
+                    next = m_ready.front();
+                    m_ready.pop_front();
+                }
+                else
+                    m_sleeping = true;
+            }
+
+            if (next)
+            {
+                next.resume();
+                if (m_error)
+                {
+                    // the failed task may have asked to stop as it unwound
+                    std::lock_guard<std::mutex> lk(m_mutex);
+                    m_stop = false;
+                    std::rethrow_exception(std::exchange(m_error, {}));
+                }
+                continue;
+            }
+
+            const int n = epoll_wait(m_epoll, events.data(), static_cast<int>(events.size()), -1);
+            {
+                std::lock_guard<std::mutex> lk(m_mutex);
+                m_sleeping = false;
+            }
+            if (n == -1)
+            {
+                THROW_ERRNO_IF(errno != EINTR);
+                continue;
+            }
+            for (int i = 0; i < n; ++i)
+                dispatch(events[i]);
+        }
+    }
+
+    /**
+     * @brief Run a task to completion on this loop, from the thread that
+     * would otherwise call run.
+     */
+    template<class T>
+    T run(Task<T> task)
+    {
+        std::optional<std::conditional_t<std::is_void_v<T>, bool, T>> result;
+        spawn(complete(*this, std::move(task), result));
+        run();
+        if constexpr (!std::is_void_v<T>)
+            return std::move(*result);
+    }
+
+    // Thread safe.
+    void stop()
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_stop = true;
+        wake();
+    }
+
+    /**
+     * @brief Start a task on the loop without awaiting it. Thread safe.
+     */
+    void spawn(Task<void> task)
+    {
+        const auto handle = drive(*this, std::move(task)).handle();
+        handle.promise().loop = this;
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_detached.insert(handle.address());
+        m_ready.push_back(handle);
+        wake();
+    }
+
+    /**
+     * @brief Queue a suspended coroutine to be resumed. Thread safe.
+     */
+    void post(std::coroutine_handle<> handle)
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_ready.push_back(handle);
+        wake();
+    }
+
+    /**
+     * @brief co_await to continue on the loop thread.
+     */
+    auto schedule() noexcept
+    {
+        struct Awaiter
+        {
+            EventLoop& loop;
+
+            bool await_ready() const noexcept
+            {
+                return false;
+            }
+
+            void await_suspend(std::coroutine_handle<> handle)
+            {
+                loop.post(handle);
+            }
+
+            void await_resume() const noexcept
+            {}
+        };
+        return Awaiter{*this};
+    }
+
+    /**
+     * @brief co_await until fd is readable, has hung up or has an error.
+     * One reader and one writer may wait on a descriptor at a time.
+     */
+    auto readable(int fd) noexcept
+    {
+        return FdAwaiter{*this, fd, false};
+    }
+
+    // As readable, for writing.
+    auto writable(int fd) noexcept
+    {
+        return FdAwaiter{*this, fd, true};
+    }
+
+    /**
+     * @brief Stop watching fd, before closing it.
+     *
+     * @return The coroutines that were waiting on it, which won't be resumed
+     * by the loop. The caller decides how they learn the descriptor is gone,
+     * typically by setting an error then posting them.
+     */
+    std::vector<std::coroutine_handle<>> forget(int fd)
+    {
+        std::vector<std::coroutine_handle<>> res;
+        const auto it = m_watches.find(fd);
+        if (it == m_watches.end())
+            return res;
+        if (it->second.reader)
+            res.push_back(it->second.reader);
+        if (it->second.writer)
+            res.push_back(it->second.writer);
+        if (it->second.registered)
+            epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, nullptr);
+        m_watches.erase(it);
+        return res;
+    }
+
+private:
+
+    struct Watch
+    {
+        std::coroutine_handle<> reader;
+        std::coroutine_handle<> writer;
+        bool registered = false;
+    };
+
+    struct FdAwaiter
+    {
+        EventLoop& loop;
+        int fd;
+        bool write;
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            loop.watch(fd, write, handle);
+        }
+
+        void await_resume() const noexcept
+        {}
+    };
+
+    // A spawned task: starts suspended, destroys itself when done.
+    class Detached
+    {
+    public:
+
+        struct promise_type
+        {
+            Detached get_return_object() noexcept
+            {
+                return Detached{std::coroutine_handle<promise_type>::from_promise(*this)};
+            }
+
+            std::suspend_always initial_suspend() const noexcept
+            {
+                return {};
+            }
+
+            struct FinalAwaiter
+            {
+                bool await_ready() const noexcept
+                {
+                    return false;
+                }
+
+                void await_suspend(std::coroutine_handle<promise_type> handle) const noexcept
+                {
+                    EventLoop& loop = *handle.promise().loop;
+                    {
+                        std::lock_guard<std::mutex> lk(loop.m_mutex);
+                        loop.m_detached.erase(handle.address());
+                    }
+                    handle.destroy();
+                }
+
+                void await_resume() const noexcept
+                {}
+            };
+
+            FinalAwaiter final_suspend() const noexcept
+            {
+                return {};
+            }
+
+            void return_void() const noexcept
+            {}
+
+            // drive catches everything
+            void unhandled_exception() const noexcept
+            {
+                std::terminate();
+            }
+
+            EventLoop *loop = nullptr;
+        };
+
+        std::coroutine_handle<promise_type> handle() const noexcept
+        {
+            return m_handle;
+        }
+
+    private:
+
+        explicit Detached(std::coroutine_handle<promise_type> handle) noexcept
+        : m_handle(handle)
+        {}
+
+        std::coroutine_handle<promise_type> m_handle;
+    };
+
+    static Detached drive(EventLoop& loop, Task<void> task)
+    {
+        try
+        {
+            co_await task;
+        }
+        catch (...)
+        {
+            if (!loop.m_error)
+                loop.m_error = std::current_exception();
+        }
+    }
+
+    template<class T, class Result>
+    static Task<void> complete(EventLoop& loop, Task<T> task, std::optional<Result>& result)
+    {
+        struct Stop
+        {
+            EventLoop& loop;
+            ~Stop()
+            {
+                loop.stop();
+            }
+        } stop{loop};
+
+        if constexpr (std::is_void_v<T>)
+        {
+            co_await task;
+            result.emplace(true);
+        }
+        else
+            result.emplace(co_await task);
+    }
+
+    void watch(int fd, bool write, std::coroutine_handle<> handle)
+    {
+        auto& watch = m_watches[fd];
+        auto& waiter = write ? watch.writer : watch.reader;
+        if (waiter)
+            throw std::logic_error("A coroutine is already waiting to " + std::string(write ? "write" : "read") + " fd " + std::to_string(fd));
+        waiter = handle;
+        update(fd, watch);
+    }
+
+    void update(int fd, Watch& watch)
+    {
+        // Hang ups are reported whatever the mask, so an idle descriptor is
+        // removed rather than left registered without events.
+        if (!watch.reader && !watch.writer)
+        {
+            if (watch.registered)
+                THROW_ERRNO_IF(epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, nullptr) == -1);
+            watch.registered = false;
+            return;
+        }
+        epoll_event event{};
+        event.events = (watch.reader ? uint32_t{EPOLLIN} : 0u) | (watch.writer ? uint32_t{EPOLLOUT} : 0u);
+        event.data.fd = fd;
+        THROW_ERRNO_IF(epoll_ctl(m_epoll, watch.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &event) == -1);
+        watch.registered = true;
+    }
+
+    void dispatch(const epoll_event& event)
+    {
+        const int fd = event.data.fd;
+        if (fd == m_wakeup)
+        {
+            uint64_t count;
+            while (::read(m_wakeup, &count, sizeof(count)) == sizeof(count))
+                ;
+            return;
+        }
+
+        const auto it = m_watches.find(fd);
+        if (it == m_watches.end())
+            return;
+        auto& watch = it->second;
+        const bool failed = event.events & (EPOLLERR | EPOLLHUP);
+        std::coroutine_handle<> reader;
+        std::coroutine_handle<> writer;
+        if (watch.reader && (failed || event.events & EPOLLIN))
+            reader = std::exchange(watch.reader, {});
+        if (watch.writer && (failed || event.events & EPOLLOUT))
+            writer = std::exchange(watch.writer, {});
+        update(fd, watch);
+
+        std::lock_guard<std::mutex> lk(m_mutex);
+        if (reader)
+            m_ready.push_back(reader);
+        if (writer)
+            m_ready.push_back(writer);
+    }
+
+    // Under the lock.
+    void wake()
+    {
+        if (m_sleeping)
+        {
+            const uint64_t one = 1;
+            [[maybe_unused]] const auto rc = ::write(m_wakeup, &one, sizeof(one));
+        }
+    }
+
+    int m_epoll = -1;
+    int m_wakeup = -1;
+    // loop thread only
+    std::unordered_map<int, Watch> m_watches;
+    std::exception_ptr m_error;
+
+    std::mutex m_mutex;
+    std::deque<std::coroutine_handle<>> m_ready;
+    std::unordered_set<void *> m_detached;
+    bool m_sleeping = false;
+    bool m_stop = false;
+};
+
+/**
+ * @brief Await every task, running them concurrently on loop.
+ *
+ * @return Results in the order of tasks. If any task throws, the first
+ * exception is rethrown once they have all finished.
+ */
+template<class T>
+Task<std::vector<T>> when_all(EventLoop& loop, std::vector<Task<T>> tasks)
+{
+    struct Join
+    {
+        std::vector<std::optional<T>> results;
+        size_t remaining = 0;
+        std::exception_ptr error;
+        std::coroutine_handle<> parent;
+    };
+
+    struct Child
+    {
+        static Task<void> run(EventLoop& loop, std::shared_ptr<Join> join, size_t i, Task<T> task)
+        {
+            try
+            {
+                join->results[i].emplace(co_await task);
+            }
+            catch (...)
+            {
+                if (!join->error)
+                    join->error = std::current_exception();
+            }
+            if (--join->remaining == 0 && join->parent)
+                loop.post(join->parent);
+        }
+    };
+
+    struct Awaiter
+    {
+        Join& join;
+
+        bool await_ready() const noexcept
+        {
+            return join.remaining == 0;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle) noexcept
+        {
+            join.parent = handle;
+        }
+
+        void await_resume() const noexcept
+        {}
+    };
+
+    // Shared with the children, which finish after we stop waiting if the
+    // loop is torn down early.
+    auto join = std::make_shared<Join>();
+    join->results.resize(tasks.size());
+    join->remaining = tasks.size();
+    for (size_t i = 0; i < tasks.size(); ++i)
+        loop.spawn(Child::run(loop, join, i, std::move(tasks[i])));
+    co_await Awaiter{*join};
+
+    if (join->error)
+        std::rethrow_exception(join->error);
+    std::vector<T> res;
+    res.reserve(join->results.size());
+    for (auto& result : join->results)
+        res.push_back(std::move(*result));
+    co_return res;
+}
+
+/**
+ * @brief A connection whose queries are awaited on an EventLoop.
+ *
+ * Any number of coroutines may query the same connection at once: their
+ * messages are written in turn and, as q answers sync messages in order,
+ * responses are matched to queries first in first out. Messages that
+ * aren't responses, e.g. async messages the server pushes, queue up for
+ * recv.
+ *
+ * The handshake is done blocking in the constructor, after which the socket
+ * is non-blocking and only the loop thread may use the connection, which
+ * must be destroyed before the loop. If the connection fails or is
+ * destroyed, every pending operation throws.
+ */
+class AsyncConnection
+{
+public:
+
+    AsyncConnection(EventLoop& loop, Socket&& socket, const std::string& credentials = "", uint8_t level = 6,
+                    CompressionPolicyOptions compression = {})
+    : m_state(std::make_shared<State>(loop, std::move(socket), credentials, level, compression))
+    {
+        const int fd = m_state->fd();
+        const int flags = fcntl(fd, F_GETFL);
+        THROW_ERRNO_IF(flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1);
+        loop.spawn(read_loop(m_state));
+    }
+
+    AsyncConnection(const AsyncConnection&) = delete;
+    AsyncConnection& operator=(const AsyncConnection&) = delete;
+
+    ~AsyncConnection()
+    {
+        m_state->fail(std::make_exception_ptr(std::runtime_error("Connection closed")));
+    }
+
+    /**
+     * @brief Send payload as a sync message and await the response.
+     */
+    Task<Buffer> query(Buffer payload)
+    {
+        return query_impl(m_state, std::move(payload));
+    }
+
+    /**
+     * @brief Send payload as an async message, completing once written.
+     */
+    Task<void> send_async(Buffer payload)
+    {
+        return write_message(m_state, std::move(payload), MessageType::Async, nullptr);
+    }
+
+    /**
+     * @brief Await the next message that isn't a response to a query.
+     */
+    Task<std::pair<Buffer, MessageType>> recv()
+    {
+        return recv_impl(m_state);
+    }
+
+    // Queries sent or waiting to be sent, without a response yet.
+    size_t in_flight() const noexcept
+    {
+        return m_state->queries;
+    }
+
+    bool failed() const noexcept
+    {
+        return static_cast<bool>(m_state->error);
+    }
+
+    uint8_t protocol_level() const noexcept
+    {
+        return m_state->conn.protocol_level();
+    }
+
+    const CompressionPolicy& compression() const noexcept
+    {
+        return m_state->conn.compression();
+    }
+
+private:
+
+    // Where a query or recv waits for its message.
+    struct Slot
+    {
+        std::optional<Buffer> message;
+        MessageType type = MessageType::Response;
+        std::exception_ptr error;
+        std::coroutine_handle<> waiter;
+        bool done = false;
+    };
+
+    struct SlotAwaiter
+    {
+        Slot& slot;
+
+        bool await_ready() const noexcept
+        {
+            return slot.done;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle) noexcept
+        {
+            slot.waiter = handle;
+        }
+
+        std::pair<Buffer, MessageType> await_resume()
+        {
+            if (slot.error)
+                std::rethrow_exception(slot.error);
+            return {std::move(*slot.message), slot.type};
+        }
+    };
+
+    // Shared by the connection and its in flight coroutines, so they can
+    // finish (by throwing) after the connection is gone. The socket closes
+    // when the last of them lets go.
+    struct State
+    {
+        State(EventLoop& loop, Socket&& socket, const std::string& credentials, uint8_t level, CompressionPolicyOptions compression)
+        : loop(loop)
+        , conn(std::move(socket), credentials, level, compression)
+        {}
+
+        int fd() const noexcept
+        {
+            return conn.connection().fd();
+        }
+
+        void rethrow() const
+        {
+            if (error)
+                std::rethrow_exception(error);
+        }
+
+        // Hand a finished slot back to its waiter.
+        void complete(Slot& slot)
+        {
+            slot.done = true;
+            if (slot.waiter)
+                loop.post(slot.waiter);
+        }
+
+        void dispatch(Buffer message, MessageType type)
+        {
+            if (type == MessageType::Response)
+            {
+                if (pending.empty())
+                    throw std::runtime_error("Response without a query");
+                Slot& slot = *pending.front();
+                pending.pop_front();
+                slot.message.emplace(std::move(message));
+                complete(slot);
+            }
+            else if (!receivers.empty())
+            {
+                Slot& slot = *receivers.front();
+                receivers.pop_front();
+                slot.message.emplace(std::move(message));
+                slot.type = type;
+                complete(slot);
+            }
+            else
+                inbox.emplace_back(std::move(message), type);
+        }
+
+        // Fail every waiter, once. Coroutines waiting on the socket are
+        // resumed to find the error.
+        void fail(std::exception_ptr e)
+        {
+            if (error)
+                return;
+            error = e;
+            // The descriptor closes once the last coroutine using it is
+            // done, but the peer should see the connection end now.
+            ::shutdown(fd(), SHUT_RDWR);
+            for (auto handle : loop.forget(fd()))
+                loop.post(handle);
+            for (auto handle : std::exchange(writers, {}))
+                loop.post(handle);
+            for (auto *slots : {&pending, &receivers})
+            {
+                for (Slot *slot : std::exchange(*slots, {}))
+                {
+                    slot->error = e;
+                    complete(*slot);
+                }
+            }
+        }
+
+        EventLoop& loop;
+        SocketConnection<Socket> conn;
+        std::exception_ptr error;
+        // a message is being written, others queue in writers
+        bool writing = false;
+        std::deque<std::coroutine_handle<>> writers;
+        std::deque<Slot *> pending;
+        std::deque<Slot *> receivers;
+        std::deque<std::pair<Buffer, MessageType>> inbox;
+        // awaited queries not yet answered or failed, written or not
+        size_t queries = 0;
+    };
+
+    // Taking turns to write whole messages.
+    struct WriteTurn
+    {
+        State& state;
+
+        bool await_ready() noexcept
+        {
+            if (state.error)
+                return true;
+            if (state.writing)
+                return false;
+            state.writing = true;
+            return true;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            state.writers.push_back(handle);
+        }
+
+        // The turn is handed over on resume, unless failed.
+        void await_resume() const
+        {
+            state.rethrow();
+        }
+    };
+
+    static void end_turn(State& state)
+    {
+        if (state.writers.empty())
+        {
+            state.writing = false;
+            return;
+        }
+        state.loop.post(state.writers.front());
+        state.writers.pop_front();
+    }
+
+    static Task<void> write_all(State& state, const uint8_t *data, size_t size)
+    {
+        while (size != 0)
+        {
+            const auto n = ::send(state.fd(), data, size, MSG_NOSIGNAL);
+            if (n == -1)
+            {
+                if (errno == EINTR)
+                    continue;
+                THROW_ERRNO_IF(errno != EAGAIN && errno != EWOULDBLOCK);
+                co_await state.loop.writable(state.fd());
+                state.rethrow();
+                continue;
+            }
+            data += n;
+            size -= static_cast<size_t>(n);
+        }
+    }
+
+    static Task<Buffer> read_exact(State& state, size_t size)
+    {
+        Buffer res{static_cast<uint8_t *>(malloc(size)), size};
+        if (res.get() == nullptr && size != 0)
+            throw std::bad_alloc();
+        size_t received = 0;
+        while (received < size)
+        {
+            const auto n = ::recv(state.fd(), res.get() + received, size - received, 0);
+            if (n == 0)
+                throw std::runtime_error("Connection closed by peer");
+            if (n == -1)
+            {
+                if (errno == EINTR)
+                    continue;
+                THROW_ERRNO_IF(errno != EAGAIN && errno != EWOULDBLOCK);
+                co_await state.loop.readable(state.fd());
+                state.rethrow();
+                continue;
+            }
+            received += static_cast<size_t>(n);
+        }
+        co_return res;
+    }
+
+    static Task<void> read_loop(std::shared_ptr<State> state)
+    {
+        try
+        {
+            while (!state->error)
+            {
+                const auto header = parse_header(co_await read_exact(*state, message_header_size));
+                state->rethrow();
+                auto payload = decode_payload(co_await read_exact(*state, header.payload_size), header);
+                state->rethrow();
+                state->dispatch(std::move(payload), header.type);
+            }
+        }
+        catch (...)
+        {
+            state->fail(std::current_exception());
+        }
+    }
+
+    static Task<void> write_message(std::shared_ptr<State> state, Buffer payload, MessageType type, Slot *response)
+    {
+        co_await WriteTurn{*state};
+        // responses come back in the order messages are written
+        if (response)
+            state->pending.push_back(response);
+        try
+        {
+            auto [header, header_size] = state->conn.encode(payload, type);
+            co_await write_all(*state, header.get(), header_size);
+            co_await write_all(*state, payload.get(), payload.size());
+        }
+        catch (...)
+        {
+            // a partly written message leaves the stream unusable
+            state->fail(std::current_exception());
+            throw;
+        }
+        end_turn(*state);
+    }
+
+    static Task<Buffer> query_impl(std::shared_ptr<State> state, Buffer payload)
+    {
+        struct Count
+        {
+            State& state;
+
+            explicit Count(State& state) noexcept
+            : state(state)
+            {
+                ++state.queries;
+            }
+
+            ~Count()
+            {
+                --state.queries;
+            }
+        } count{*state};
+
+        Slot slot;
+        co_await write_message(state, std::move(payload), MessageType::Sync, &slot);
+        co_return (co_await SlotAwaiter{slot}).first;
+    }
+
+    static Task<std::pair<Buffer, MessageType>> recv_impl(std::shared_ptr<State> state)
+    {
+        if (!state->inbox.empty())
+        {
+            auto res = std::move(state->inbox.front());
+            state->inbox.pop_front();
+            co_return res;
+        }
+        state->rethrow();
+        Slot slot;
+        state->receivers.push_back(&slot);
+        co_return co_await SlotAwaiter{slot};
+    }
+
+    std::shared_ptr<State> m_state;
+};
@@ -0,0 +1,1599 @@
+#pragma once
+
+#include <array>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <sstream>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <chrono>
+
+#include <errno.h>
+
+#include <bit> // endian
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <netdb.h>
+#include <arpa/inet.h>
+
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// fix SOCK_NONBLOCK for e.g. macOS
+#ifndef SOCK_NONBLOCK
+#include <fcntl.h>
+#define SOCK_NONBLOCK O_NONBLOCK
+#endif
+
+// dummy SOCK_CLOEXEC for macOS
+#ifndef SOCK_CLOEXEC
+#define SOCK_CLOEXEC 0
+#endif
+
+// signals
+#include <sys/signal.h>
+
+#include <algorithm>
+#include <array>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define QBIND_BYTESWAP_SIMD
+#include <immintrin.h>
+#endif
+
+#include <qbind/type.h>
+
+inline auto operator""_KB( const unsigned long long x ){ return 1024*x; }
+inline auto operator""_MB( const unsigned long long x ){ return 1024*1024*x; }
+inline auto operator""_GB( const unsigned long long x ){ return 1024*1024*1024*x; }
+
+// c.java has a write mechanism which boils down to
+//   void w(byte x){
+//     wBuff[wBuffPos++]=x;
+//   }
+// You then write to the socket using outStream.write(wBuff)
+
+[[noreturn]] inline void throw_errno(const std::string& file, int line, const std::string& function)
+{
+    const auto errno_orig = errno;
+    std::ostringstream ss;
+    ss << file << " line " << line << " in " << function;
+    // system_category formats the message thread safely, without the
+    // differing GNU and XSI strerror_r signatures.
+    throw std::system_error({errno_orig, std::system_category()}, ss.str());
+}
+
+#define THROW_ERRNO_IF(x)                               \
+    if (x)                                              \
+        throw_errno(__FILE__, __LINE__, __FUNCTION__);
+
+/**
+ * @brief Convert value to native endian
+ * 
+ * https://mklimenko.github.io/english/2018/08/22/robust-endian-swap/
+ * 
+ * @tparam T Type to convert
+ * @param t Value to convert
+ * @param val_endian Endian of current representation.
+ * @return std::enable_if_t<std::is_arithmetic_v<T>, T> Value in native endianness.
+ */
+template<typename T>
+typename std::enable_if_t<std::is_arithmetic_v<T>, T>
+to_native_endian( T t, std::endian val_endian) noexcept
+{
+    if (val_endian == std::endian::native || sizeof(T) == 1)
+        return std::forward<T>(t);
+    // memcpy through an unsigned integer so this compiles to one bswap
+    if constexpr (sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8)
+    {
+        using U = std::conditional_t<sizeof(T) == 2, uint16_t, std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>>;
+        U raw;
+        std::memcpy(&raw, &t, sizeof(T));
+        if constexpr (sizeof(T) == 2)
+            raw = __builtin_bswap16(raw);
+        else if constexpr (sizeof(T) == 4)
+            raw = __builtin_bswap32(raw);
+        else
+            raw = __builtin_bswap64(raw);
+        std::memcpy(&t, &raw, sizeof(T));
+        return t;
+    }
+    else
+    {
+        std::array<uint8_t, sizeof(T)> raw;
+        std::memcpy(raw.data(), &t, sizeof(T));
+        std::reverse(raw.begin(), raw.end());
+        std::memcpy(&t, raw.data(), sizeof(T));
+        return t;
+    }
+}
+
+namespace detail
+{
+
+// pshufb control reversing each width byte element of a 16 byte lane
+constexpr std::array<uint8_t, 16> byteswap_mask(size_t width) noexcept
+{
+    std::array<uint8_t, 16> res{};
+    for (size_t i = 0; i < 16; ++i)
+        res[i] = static_cast<uint8_t>(i / width * width + (width - 1 - i % width));
+    return res;
+}
+
+// Guids are bytes, never swapped, so only the numeric widths.
+alignas(16) inline constexpr std::array<uint8_t, 16> byteswap_masks[] = {
+    byteswap_mask(2), byteswap_mask(4), byteswap_mask(8)};
+
+// Index in to byteswap_masks, -1 if width isn't 2, 4 or 8.
+constexpr int byteswap_mask_index(size_t width) noexcept
+{
+    switch (width)
+    {
+        case 2:  return 0;
+        case 4:  return 1;
+        case 8:  return 2;
+        default: return -1;
+    }
+}
+
+#ifdef QBIND_BYTESWAP_SIMD
+
+// The shuffles are compiled for their instruction set whatever the build
+// targets, and only called once the CPU is known to have it. Each swaps
+// whole blocks and returns the bytes done.
+
+__attribute__((target("ssse3")))
+inline size_t byteswap_ssse3(uint8_t *dst, const uint8_t *src, size_t bytes, int mask_index) noexcept
+{
+    const __m128i mask = _mm_load_si128(reinterpret_cast<const __m128i *>(byteswap_masks[mask_index].data()));
+    size_t i = 0;
+    for (; i + 16 <= bytes; i += 16)
+    {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_shuffle_epi8(x, mask));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+inline size_t byteswap_avx2(uint8_t *dst, const uint8_t *src, size_t bytes, int mask_index) noexcept
+{
+    const __m128i mask = _mm_load_si128(reinterpret_cast<const __m128i *>(byteswap_masks[mask_index].data()));
+    const __m256i mask256 = _mm256_broadcastsi128_si256(mask);
+    size_t i = 0;
+    for (; i + 32 <= bytes; i += 32)
+    {
+        const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_shuffle_epi8(x, mask256));
+    }
+    for (; i + 16 <= bytes; i += 16)
+    {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_shuffle_epi8(x, mask));
+    }
+    return i;
+}
+
+using byteswap_blocks = size_t (*)(uint8_t *, const uint8_t *, size_t, int) noexcept;
+
+// The widest shuffle this CPU runs, nullptr if none. Checked once.
+inline byteswap_blocks byteswap_simd() noexcept
+{
+    static const byteswap_blocks blocks = []() -> byteswap_blocks
+    {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return byteswap_avx2;
+        if (__builtin_cpu_supports("ssse3"))
+            return byteswap_ssse3;
+        return nullptr;
+    }();
+    return blocks;
+}
+
+#endif
+
+// Swap elements of a builtin width from byte i, a bswap each.
+template<class U>
+inline void byteswap_scalar(uint8_t *dst, const uint8_t *src, size_t i, size_t bytes) noexcept
+{
+    for (; i < bytes; i += sizeof(U))
+    {
+        U x;
+        std::memcpy(&x, src + i, sizeof(U));
+        x = to_native_endian(x, std::endian::native == std::endian::little ? std::endian::big : std::endian::little);
+        std::memcpy(dst + i, &x, sizeof(U));
+    }
+}
+
+}
+
+/**
+ * @brief Reverse the bytes of count elements of width bytes each, from src
+ * in to dst. dst may be src to swap in place, but mustn't otherwise overlap.
+ *
+ * On x86, whole blocks of 2, 4 and 8 byte elements go through a byte
+ * shuffle, 32 bytes at a time where the CPU has AVX2 or 16 with SSSE3, so a
+ * vector payload swaps at close to memcpy speed. The instruction set is
+ * picked at run time, so no -m flags are needed. Tails, other widths and
+ * other targets swap an element at a time.
+ */
+inline void byteswap(uint8_t *dst, const uint8_t *src, size_t count, size_t width) noexcept
+{
+    const size_t bytes = count * width;
+    if (width <= 1)
+    {
+        if (dst != src)
+            std::memcpy(dst, src, bytes);
+        return;
+    }
+
+    size_t i = 0;
+#ifdef QBIND_BYTESWAP_SIMD
+    if (const int mask_index = detail::byteswap_mask_index(width); mask_index != -1)
+        if (const auto blocks = detail::byteswap_simd())
+            i = blocks(dst, src, bytes, mask_index);
+#endif
+    switch (width)
+    {
+        case 2: detail::byteswap_scalar<uint16_t>(dst, src, i, bytes); return;
+        case 4: detail::byteswap_scalar<uint32_t>(dst, src, i, bytes); return;
+        case 8: detail::byteswap_scalar<uint64_t>(dst, src, i, bytes); return;
+    }
+    for (; i < bytes; i += width)
+    {
+        if (dst == src)
+            std::reverse(dst + i, dst + i + width);
+        else
+            std::reverse_copy(src + i, src + i + width, dst + i);
+    }
+}
+
+/**
+ * @brief Opt-in low latency receive for a Socket.
+ *
+ * A blocking recv puts the thread to sleep until data arrives, so every
+ * message pays for a wakeup and a context switch. Spinning on a non-blocking
+ * recv instead keeps the thread hot at the cost of a core. Only worth it with
+ * a core to spare for each receiving thread, which pinning helps guarantee:
+ * a spinning thread sharing a core with its sender just delays it. Receiving
+ * threads pin themselves, see pin_current_thread.
+ */
+struct BusyPollOptions
+{
+    // How long a recv polls with MSG_DONTWAIT before falling back to
+    // blocking. Zero disables spinning.
+    std::chrono::microseconds spin_budget{};
+    // SO_BUSY_POLL: how long the kernel polls the device queue on a blocking
+    // read (Linux only, raising it may need CAP_NET_ADMIN). Zero leaves it
+    // at the system default.
+    std::chrono::microseconds kernel_busy_poll{};
+};
+
+/**
+ * @brief Pin the calling thread to a core, e.g. a thread spinning on a
+ * socket's recv.
+ */
+inline void pin_current_thread(int cpu)
+{
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (const int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set); rc != 0)
+        throw std::system_error({rc, std::system_category()}, "pthread_setaffinity_np");
+#else
+    (void)cpu;
+    throw std::runtime_error("Thread pinning is not supported on this platform");
+#endif
+}
+
+// Tell the core we're in a spin-wait loop.
+inline void cpu_relax() noexcept
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// TODO: Get all addresses for local and first for remote.
+// Make right version of TCP or DOMAIN socket given an address, along with the right options (no delay, reuse socket?)
+// Perform a handshake
+// SSL handshake (OpenSSL)?
+// Serialisation layer
+// Emscripten support
+
+class Buffer
+{
+public:
+    struct Deleter
+    {
+        void operator()(uint8_t* ptr) {
+            if(ptr)
+                free(ptr);
+        }
+    };
+
+    Buffer(uint8_t* ptr, size_t size, std::endian endianness = std::endian::native)
+    : m_pointer(std::unique_ptr<uint8_t, Deleter>(ptr))
+    , m_size(size)
+    , m_endianness(endianness)
+    {}
+
+    uint8_t* get() const
+    {
+        return m_pointer.get();
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    std::endian endianness() const
+    {
+        return m_endianness;
+    }
+
+    void set_endianness(std::endian e)
+    {
+        m_endianness = e;
+    }
+
+    /**
+     * @brief Read from a buffer and get result in machine native endianness
+     * 
+     * @tparam T Type to read
+     * @param current_idx Where to read from. Advanced on read (no bounds checks done)
+     * @return std::enable_if_t<std::is_arithmetic_v<T>, T> 
+     */
+    template<class T>
+    typename std::enable_if_t<std::is_arithmetic_v<T>, T>
+    read(size_t& current_idx) const noexcept
+    {
+        T res;
+        std::memcpy(&res, m_pointer.get() + current_idx, sizeof(T));
+        current_idx += sizeof(T);
+        return to_native_endian(res, m_endianness);
+    }
+
+    /**
+     * @brief Like read but doesn't change current_idx
+     */
+    template<class T>
+    typename std::enable_if_t<std::is_arithmetic_v<T>, T>
+    read_at(size_t current_idx) const noexcept
+    {
+        T res;
+        std::memcpy(&res, m_pointer.get() + current_idx, sizeof(T));
+        return to_native_endian(res, m_endianness);
+    }
+
+    /**
+     * @brief Read count values of T from current_idx in to out, in machine
+     * native endianness. current_idx is advanced past them.
+     *
+     * This is the decode path for vector payloads: a single memcpy when the
+     * sender's endianness matches ours, a bulk byteswap otherwise.
+     */
+    template<class T>
+    typename std::enable_if_t<std::is_arithmetic_v<T>, void>
+    read_array(size_t& current_idx, T* out, size_t count) const noexcept
+    {
+        const uint8_t *src = m_pointer.get() + current_idx;
+        if (m_endianness == std::endian::native)
+            std::memcpy(out, src, count * sizeof(T));
+        else
+            byteswap(reinterpret_cast<uint8_t *>(out), src, count, sizeof(T));
+        current_idx += count * sizeof(T);
+    }
+
+    /**
+     * @brief Swap count values of width bytes at current_idx to machine
+     * native endianness in place, for payloads read straight out of the
+     * buffer. Does nothing if the buffer is already native. The rest of the
+     * buffer keeps its endianness, so swap each range only once.
+     */
+    void to_native_at(size_t current_idx, size_t count, size_t width) noexcept
+    {
+        if (m_endianness != std::endian::native)
+            byteswap(m_pointer.get() + current_idx, m_pointer.get() + current_idx, count, width);
+    }
+
+    /**
+     * @brief Write to buffer in buffer specified endianness.
+     * 
+     * @tparam T Type to write
+     * @param value Value to write
+     * @param current_idx Index to write at (no bounds checks done)
+     * @return std::enable_if_t<std::is_arithmetic_v<T>, T> 
+     */
+    template<class T>
+    typename std::enable_if_t<std::is_arithmetic_v<T>, void>
+    write(T value, size_t& current_idx)
+    {
+        value = to_native_endian(value, m_endianness);
+        std::memcpy(m_pointer.get() + current_idx, &value, sizeof(T));
+        current_idx += sizeof(T);
+    }
+
+    /**
+     * @brief Like write but doesn't change current_idx
+     */
+    template<class T>
+    typename std::enable_if_t<std::is_arithmetic_v<T>, void>
+    write_at(T value, size_t current_idx)
+    {
+        value = to_native_endian(value, m_endianness);
+        std::memcpy(m_pointer.get() + current_idx, &value, sizeof(T));
+    }  
+
+private:
+    std::unique_ptr<uint8_t, Deleter> m_pointer;
+    size_t m_size;
+    std::endian m_endianness;
+};
+
+class Socket
+{
+private:
+    // https://www.binarytides.com/hostname-to-ip-address-c-sockets-linux/
+    static std::vector<std::string> hostname_to_ips(const std::string& hostname)
+    {
+        struct addrinfo hints, *servinfo, *p;
+        memset(&hints, 0, sizeof hints);
+
+        // AF_UNSPEC: Returns socket addresses for any address family (either IPv4
+        // or IPv6, for example) that can be used with node and service.
+        // Alternative force using AF_INET or AF_INET6.
+        hints.ai_family = AF_UNSPEC;
+        // TCP socket
+        hints.ai_socktype = SOCK_STREAM;
+
+        // Using nullptr so that the port number of the returned address will be uninitialized.
+        if (int rc = getaddrinfo(hostname.c_str(), nullptr, &hints, &servinfo); rc != 0)
+        {
+            throw std::runtime_error(gai_strerror(rc));
+        }
+
+        std::vector<std::string> ips;
+        for (p = servinfo; p != nullptr; p = p->ai_next)
+        {
+            switch (p->ai_addr->sa_family)
+            {
+            case AF_INET:
+            {
+                auto addr = reinterpret_cast<struct sockaddr_in *>(p->ai_addr);
+                char ip_addr[INET_ADDRSTRLEN];
+                THROW_ERRNO_IF(inet_ntop(AF_INET, &addr->sin_addr, ip_addr, INET_ADDRSTRLEN) == nullptr);
+                ips.emplace_back(ip_addr);
+                break;
+            }
+            case AF_INET6:
+            {
+                auto addr = reinterpret_cast<struct sockaddr_in6 *>(p->ai_addr);
+                char ip_addr[INET6_ADDRSTRLEN];
+                THROW_ERRNO_IF(inet_ntop(AF_INET6, &addr->sin6_addr, ip_addr, INET6_ADDRSTRLEN) == nullptr);
+                ips.emplace_back(ip_addr);
+                break;
+            }
+            default:
+                throw std::runtime_error("Unknown address family: " + std::to_string(p->ai_addr->sa_family));
+            };
+        }
+        freeaddrinfo(servinfo); // all done with this structure
+        if (ips.empty())
+            throw std::runtime_error("Failed to find address for " + hostname);
+        return ips;
+    }
+
+    static std::string gethostname()
+    {
+        // Hostnames are limited to 255 characters (plus a null termination byte).
+        char buf[256];
+        THROW_ERRNO_IF(::gethostname(buf, 256) != 0);
+        return buf;
+    }
+
+    int m_fd;
+    bool m_is_unix_domain_socket;
+
+public:
+    /**
+     * @brief Construct a new Socket object
+     * 
+     * @param hostname : hostname to connect to
+     * @param port : port on host to connect to
+     * @param credentials : credentials of the form "username:password"
+     * @param timeout : Use 0 for no timeout
+     * @param use_tls : Use TLS connection
+     */
+    Socket(const std::string& hostname, 
+               uint16_t port, 
+               std::chrono::microseconds timeout = {}, // TODO:
+               bool use_tls = false) // TODO:
+    {
+        static const auto local_ips = hostname_to_ips(gethostname());
+        const auto ip = hostname_to_ips(hostname).front();
+        // Domain
+        // If ip of requested hostname is local => AF_UNIX = AF_LOCAL
+        //                                ipv4  => AF_INET
+        //                                ipv6  => AF_INET6
+        // Look for : as IPv4-mapped IPv6 addresses can be like ::FFFF:204.152.189.116
+        auto domain = std::find(local_ips.begin(), local_ips.end(), ip) != local_ips.end() ? AF_UNIX :
+                      ip.find(':') != std::string::npos ? AF_INET6 : AF_INET;
+        // Type
+        // SOCK_STREAM = TCP
+        // Protocol
+        // No protocol number defined for KX IPC
+        //  | SOCK_NONBLOCK | SOCK_CLOEXEC
+        int fd = socket(domain, SOCK_STREAM, 0);
+        THROW_ERRNO_IF(fd == -1);
+
+        // Set tcp nodelay and keep alive like java.c
+        const int opt_true = 1;
+        THROW_ERRNO_IF(setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &opt_true, sizeof(opt_true)) == -1);
+        if (domain != AF_UNIX)
+            THROW_ERRNO_IF(setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt_true, sizeof(opt_true)) == -1);
+        if (0 < timeout.count())
+        {
+            struct timeval tv
+            {
+                .tv_sec = static_cast<int>(timeout.count() / 1000000),
+                .tv_usec = static_cast<int>(timeout.count() % 1000000)
+            };
+            THROW_ERRNO_IF(setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == -1);
+            THROW_ERRNO_IF(setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) == -1);
+        }
+
+        // Connect
+        switch (domain)
+        {
+            // TODO: Do memset on addrs and then set fields explicitly as recommended by book (listing 57-1)
+            case AF_INET:
+            {
+                struct sockaddr_in addr {
+                    .sin_family = AF_INET,
+                    .sin_port = htons(port)
+                };
+                auto rc = inet_pton(AF_INET, ip.c_str(), &addr.sin_addr);
+                if (rc == 0)
+                    throw std::runtime_error("Invalid IPv4 address");
+                else THROW_ERRNO_IF(rc == -1); 
+
+                THROW_ERRNO_IF(connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == -1);
+                break;
+            }
+            case AF_INET6:
+            {
+                struct sockaddr_in6 addr {
+                    .sin6_family = AF_INET6,
+                    .sin6_port = htons(port)
+                };
+                auto rc = inet_pton(AF_INET6, ip.c_str(), &addr.sin6_addr);
+                if (rc == 0)
+                    throw std::runtime_error("Invalid IPv6 address");
+                else THROW_ERRNO_IF(rc == -1); 
+
+                THROW_ERRNO_IF(connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == -1);
+                break;                
+            }
+            case AF_UNIX:
+            {
+                const auto path = "/tmp/kx." + std::to_string(port);
+                struct sockaddr_un addr {
+                    .sun_family = AF_UNIX,
+                };
+                strcpy(addr.sun_path, path.c_str());
+                THROW_ERRNO_IF(connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == -1);
+                break; 
+            }
+            default:
+                throw std::runtime_error("Unknown address family: " + std::to_string(domain));
+        }
+
+        m_fd = fd;
+        m_is_unix_domain_socket = domain == AF_UNIX;
+    }
+
+    /**
+     * @brief Take ownership of a connected descriptor, e.g. from accept or
+     * socketpair.
+     */
+    Socket(int fd, bool is_unix_domain_socket) noexcept
+    : m_fd(fd)
+    , m_is_unix_domain_socket(is_unix_domain_socket)
+    {}
+
+    // No copy
+    Socket(const Socket &other) = delete;
+    Socket &operator=(const Socket &other) = delete;
+
+    // Move
+    Socket(Socket&& other) noexcept
+    :m_fd(other.m_fd)
+    ,m_is_unix_domain_socket(other.m_is_unix_domain_socket)
+    ,m_busy_poll(other.m_busy_poll)
+    {
+        other.m_fd = -1;
+    }
+
+    Socket& operator=(Socket&& other) noexcept
+    {
+        if (this != &other)
+        {
+            std::swap(m_fd, other.m_fd);
+            std::swap(m_is_unix_domain_socket, other.m_is_unix_domain_socket);
+            std::swap(m_busy_poll, other.m_busy_poll);
+        }
+        return *this;
+    }
+
+    ~Socket()
+    {
+        if (m_fd != -1)
+        {
+            close(m_fd);
+            m_fd = -1;
+        }
+        // TODO: (UDS) When the socket is no longer required, its pathname entry can (and generally
+        // should) be removed using unlink() (or remove()). page 1167. - ONLY IF SERVER??
+    }
+
+    size_t send(const uint8_t* ptr, size_t size, int flags = 0) const
+    {
+        // May want to switch to using per message flags. i.e. drop SOCK_NONBLOCK for
+        // MSG_DONTWAIT (since Linux 2.2) which gives the same behaviour, but can
+        // optionally be enable (otherwise sends which might cause blocking fail)
+        auto sent_bytes = ::send(m_fd, ptr, size, flags);
+        THROW_ERRNO_IF(sent_bytes == -1);
+        return sent_bytes;
+    }
+
+    Buffer peek(size_t size) const
+    {
+        void *buf = malloc(size);
+        if (buf == nullptr)
+            throw std::bad_alloc();
+        // Can use MSG_DONTWAIT here too.
+        THROW_ERRNO_IF(::recv(m_fd, buf, size, MSG_PEEK) == -1);
+        return {static_cast<uint8_t*>(buf), size};
+    }
+
+    /**
+     * @brief Set how recv waits for data. Configure before moving the socket
+     * in to a SocketConnection, so the handshake uses it too.
+     */
+    void set_busy_poll(const BusyPollOptions& options)
+    {
+        if (0 < options.kernel_busy_poll.count())
+        {
+#if defined(SO_BUSY_POLL)
+            const int usec = static_cast<int>(options.kernel_busy_poll.count());
+            THROW_ERRNO_IF(setsockopt(m_fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) == -1);
+#else
+            throw std::runtime_error("SO_BUSY_POLL is not supported on this platform");
+#endif
+        }
+        m_busy_poll = options;
+    }
+
+    const BusyPollOptions& busy_poll() const noexcept
+    {
+        return m_busy_poll;
+    }
+
+    // Should be able to make recv wait for expected number of bytes
+    Buffer recv(size_t size, int flags = 0) const
+    {
+        void *buf = malloc(size);
+        if (buf == nullptr)
+            throw std::bad_alloc();
+        auto received_bytes = 0 < m_busy_poll.spin_budget.count() ?
+            spin_recv(static_cast<uint8_t *>(buf), size, flags) :
+            ::recv(m_fd, buf, size, flags);
+        if (received_bytes == -1)
+            free(buf);
+        THROW_ERRNO_IF(received_bytes== -1);
+        // peer closed
+        if (received_bytes == 0)
+        {
+            free(buf);
+            return {nullptr, 0};
+        }
+        if (received_bytes < size)
+        {
+            buf = realloc(buf, received_bytes);
+            if (buf == nullptr)
+            {
+                free(buf);
+                throw std::bad_alloc();
+            }
+        }
+        return {static_cast<uint8_t *>(buf), static_cast<size_t>(received_bytes)};
+    }
+
+    bool is_unix_domain_socket() const
+    {
+        return m_is_unix_domain_socket;
+    }
+
+    int fd() const noexcept
+    {
+        return m_fd;
+    }
+
+private:
+
+    /**
+     * @brief Poll with MSG_DONTWAIT until size bytes arrive, then block for
+     * whatever is left once the spin budget runs out.
+     *
+     * Unlike a single blocking recv this reads the full size unless the peer
+     * closes, as a non-blocking recv returns whatever has arrived so far.
+     *
+     * @return Bytes received, or -1 with errno set.
+     */
+    ssize_t spin_recv(uint8_t *buf, size_t size, int flags) const
+    {
+        const auto deadline = std::chrono::steady_clock::now() + m_busy_poll.spin_budget;
+        bool spinning = true;
+        size_t received = 0;
+        while (received < size)
+        {
+            const auto n = ::recv(m_fd, buf + received, size - received, spinning ? flags | MSG_DONTWAIT : flags);
+            if (0 < n)
+            {
+                received += static_cast<size_t>(n);
+                continue;
+            }
+            // peer closed
+            if (n == 0)
+                break;
+            if (errno == EINTR)
+                continue;
+            // a blocking recv only fails with these on a SO_RCVTIMEO timeout
+            if (!spinning || (errno != EAGAIN && errno != EWOULDBLOCK))
+                return -1;
+            cpu_relax();
+            spinning = std::chrono::steady_clock::now() < deadline;
+        }
+        return static_cast<ssize_t>(received);
+    }
+
+    BusyPollOptions m_busy_poll;
+};
+
+/**
+ * @brief Compress the payload buffer.
+ * 
+ * Original: https://github.com/KxSystems/javakdb/blob/master/src/main/java/kx/c.java#L500
+ * 
+ * @param in: Payload buffer (not header/whole message length).
+ * @return Buffer: if compression successful return compressed buffer, else original buffer.
+ */
+inline Buffer compress(Buffer in_buff)
+{
+    const size_t in_length = in_buff.size(); // origSize
+    uint8_t *in = in_buff.get();
+
+    // compression is only used if compressed data is less than half the size of the original message.
+    // 8 + in_length = sizeof(header) + sizeof(message length) + uncompressed payload length
+    const size_t out_length = (8 + in_length) / 2; // e
+    uint8_t *out = static_cast<uint8_t *>(malloc(out_length)); // wBuff
+    if (out == nullptr)
+        throw std::bad_alloc();
+
+    // Setup compression variables
+    // i: Mask to turn on bits in the header.
+    uint8_t block_header_mask = 0;
+    // f: Current block header
+    uint8_t current_block_header = 0;
+
+    // s/s0: Index on input buffer on current/previous iteration.
+    size_t in_idx = 0; //    = header_size + buf_size_size;
+    size_t in_idx_prev = 0;
+
+    // h/h0: xor_offset between in_idx and in_idx+1
+    uint8_t xor_offset, xor_offset_prev;
+
+    // c: Index where current block header will go when done. After header, compressed size, full size.
+    size_t header_idx = 0; //   = header_size + (2 * buf_size_size);
+
+    // d: start point to start writing from
+    size_t out_idx = header_idx;
+
+    // a: Cache where offset=index occurred. (0 initialised => offset hasn't occurred yet)
+    size_t xor_offset_cache[256] = {};
+    // p: Last time current offset occurred
+    size_t xor_offset_prev_idx = 0;
+    // g: Whether to invalidate cache (true) or check for a run (false)
+    bool invalidate_cache = false;
+
+    // r: Run start index
+    size_t run_start_idx = 0;
+    // q: Final index to look to when searching for runs.
+    size_t look_until_idx = 0; 
+
+    // t from c.java unused -> same as in_length
+
+    for (; in_idx < in_length; block_header_mask *= 2)
+    {
+        // Start a new block: overflow allows this to be activated each 8 iterations
+        if (block_header_mask == 0)
+        {
+            // if you're within 17 bytes then return original buffer as wont be < 1/2 original size.
+            // Technically this could be 9 as a block can be as small as 9 bytes, but this saves
+            // always checking indexes as you know you're clear if you have 17 bytes still free.
+            if (out_length-17 < out_idx)
+            {
+                free(out);
+                return in_buff;
+            }
+
+            block_header_mask = {1};
+            out[header_idx] = current_block_header; // store old block header.
+            header_idx = out_idx++; // TODO: Check: This is assignment then increment.
+            current_block_header = {0};
+        }
+
+        invalidate_cache=(in_idx>in_length - 3) || // don't save by compressing a run at this point.
+                   (0 == ( // index has not occurred before
+                       xor_offset_prev_idx=xor_offset_cache[
+                           xor_offset=in[in_idx]^in[in_idx+1]
+                       ])) ||
+                   (in[in_idx] != in[xor_offset_prev_idx]); // different start value for offset
+
+        if(in_idx_prev)
+        {
+            xor_offset_cache[xor_offset_prev] = in_idx_prev;
+            in_idx_prev = 0;
+        }
+
+        // if invalidating cache write the new start byte for the offset in to the out buffer
+        if (invalidate_cache)
+        {
+            xor_offset_prev = xor_offset;
+            in_idx_prev = in_idx;
+            out[out_idx++] = in[in_idx++];
+        }
+        else
+        {
+            xor_offset_cache[xor_offset] = in_idx;
+            current_block_header |= block_header_mask;
+            xor_offset_prev_idx += 2; // after the the two start bytes
+            run_start_idx = in_idx += 2;
+            look_until_idx = std::min(in_idx + 255, in_length);
+            // check for the run
+            while(in[xor_offset_prev_idx] == in[in_idx] && ++in_idx < look_until_idx)
+                ++xor_offset_prev_idx;
+
+            out[out_idx++] = xor_offset;
+            out[out_idx++] = in_idx - run_start_idx;
+        }
+    }
+    out[header_idx] = current_block_header;
+    Buffer res{static_cast<uint8_t *>(realloc(out, out_idx)), out_idx, in_buff.endianness()};
+    if (res.get() == nullptr)
+    {
+        // no need to throw as red destructor will do cleanup
+        throw std::bad_alloc();
+    }
+    return res;
+}
+
+/**
+ * @brief Decompress a compressed payload buffer.
+ * 
+ * Original: https://github.com/KxSystems/javakdb/blob/master/src/main/java/kx/c.java#L562
+ * 
+ * @param in_buff: Buffer to decompress containing compressed payload only.
+ * @param level: 1 if 4 byte size, 2 if 8 byte size
+ * @return Buffer: A decompressed message payload
+ */
+inline Buffer decompress(const Buffer& in_buff, uint8_t level)
+{
+    const uint8_t *in = in_buff.get();
+    // d: Index in input buff. (start after size of payload)
+    size_t in_idx = level == 1 ? 4 : 8;
+
+    // read uncompressed length, which leads the payload, and make appropriate buffer. It is the
+    // length of the whole message so remove 8 bytes for the header.
+    const size_t out_length = (level == 1 ? in_buff.read_at<uint32_t>(0) : in_buff.read_at<uint64_t>(0)) - 8;
+    // dst: Buffer for decompressed payload
+    uint8_t *out = static_cast<uint8_t *>(malloc(out_length)); 
+    if (out == nullptr)
+        throw std::bad_alloc();
+    // s: Current index in output buffer
+    size_t out_idx = 0;
+
+    // Setup compression variables
+    // i: Mask to turn on bits in the header.
+    uint8_t block_header_mask = 0;
+    // f: Current block header
+    uint8_t current_block_header = 0;
+
+    // a: Cache where offset=index occurred.
+    size_t xor_offset_cache[256];
+    // p: Index up to which cache has been populated
+    size_t cache_valid_to_idx = 0;
+
+    // n: run length after first two bytes in run.
+    size_t run_length = 0;
+    // r: Index to copy from, from previous occurrence of run.
+    size_t run_start_idx = 0;
+
+    while (out_idx < out_length)
+    {
+        if (block_header_mask == 0)
+        {
+            current_block_header = in[in_idx++];
+            block_header_mask = 1;
+        }
+
+        if ((current_block_header&block_header_mask) != 0)
+        {
+            // get the two bytes which start the run (i.e. from which the offset was obtained)
+            // and the rest of the run (stored in input buffer) in to output buffer
+            run_start_idx = xor_offset_cache[in[in_idx++]];
+            run_length = in[in_idx++];
+            // the run may overlap where it is copied to so go byte by byte
+            for (size_t i = 0; i < 2 + run_length; ++i)
+                out[out_idx + i] = out[run_start_idx + i];
+            out_idx += 2;
+        }
+        else
+        {
+            // get the new starter byte for the xor_offset
+            out[out_idx++] = in[in_idx++];
+        }
+
+        // The right of an assignment is sequenced first, so increment separately.
+        for (; cache_valid_to_idx < out_idx-1; ++cache_valid_to_idx)
+            xor_offset_cache[out[cache_valid_to_idx] ^ out[cache_valid_to_idx + 1]] = cache_valid_to_idx;
+
+        if ((current_block_header&block_header_mask) != 0)
+            cache_valid_to_idx = out_idx += run_length;
+
+        block_header_mask *= 2; // will cycle to 0 via overflow
+    }
+
+    return {out, out_idx, in_buff.endianness()};
+}
+
+enum class MessageType : uint8_t
+{
+    Async = 0,
+    Sync = 1,
+    Response = 2
+};
+
+// Bytes of the fixed message header: endianness, message type, compression,
+// size multiplier, then the uint32 residual of the message size.
+constexpr size_t message_header_size = 8;
+
+struct CompressionPolicyOptions
+{
+    // Payloads at least this large are judged on a sample before all of
+    // them is compressed, 0 to never sample.
+    size_t sample_threshold = 64_KB;
+    // Bytes compressed as the sample, taken in slices spread over the payload.
+    size_t sample_size = 4_KB;
+    // Bandwidth of the link in bytes per second, 0 if unknown. Compression
+    // is skipped where the time it takes exceeds the send time it saves.
+    double link_bytes_per_second = 0;
+    // Smaller payloads of a message type that stops paying are still tried
+    // every nth message, so changes in them are noticed.
+    size_t retry_interval = 32;
+    // Weight of the newest observation in the ratio and throughput averages.
+    double ewma_alpha = 0.25;
+};
+
+struct CompressionStats
+{
+    // messages sent compressed
+    size_t compressed = 0;
+    // messages compressed in full, whether it paid or not
+    size_t attempted = 0;
+    // messages sent uncompressed on the policy's estimate alone
+    size_t skipped = 0;
+    // payload bytes of attempted messages, and what was sent of them
+    size_t bytes_in = 0;
+    size_t bytes_out = 0;
+    // average compressed to original size of attempts and samples, taking 1
+    // for those that didn't reach half, as then the original is sent
+    double ratio = 0;
+    // average bytes compressed per second
+    double throughput = 0;
+    // whether ratio and throughput have been observed
+    bool sampled = false;
+    // messages skipped since the last attempt
+    size_t since_attempt = 0;
+};
+
+/**
+ * @brief Decides which messages of a connection are worth compressing.
+ *
+ * compress only keeps its result if it halves the payload, so an
+ * incompressible payload, e.g. of floats, costs a full pass for nothing.
+ * The policy keeps averages of the compression ratio and throughput per
+ * message type, and skips compression while they say it won't pay: while
+ * messages mostly fail to halve, or when a link_bytes_per_second is given
+ * and compressing takes longer than sending the bytes it saves. Large
+ * payloads are each judged on a sample of their own instead, so one that
+ * won't compress costs only the sample.
+ *
+ * Local connections are never compressed, so don't consult a policy.
+ * Thread safe, so messages of a connection may be compressed in parallel
+ * (see SendPipeline).
+ */
+class CompressionPolicy
+{
+public:
+    CompressionPolicy(CompressionPolicyOptions options = {})
+    : m_options(options)
+    {}
+
+    // Not to be moved while in use, so a moved connection keeps its stats.
+    CompressionPolicy(CompressionPolicy&& other) noexcept
+    : m_options(other.m_options)
+    {
+        std::lock_guard<std::mutex> lk(other.m_mutex);
+        m_stats = other.m_stats;
+    }
+
+    CompressionPolicy& operator=(CompressionPolicy&& other) noexcept
+    {
+        if (this != &other)
+        {
+            std::scoped_lock lk(m_mutex, other.m_mutex);
+            m_options = other.m_options;
+            m_stats = other.m_stats;
+        }
+        return *this;
+    }
+
+    /**
+     * @brief Whether to compress payload, to be sent as msg_type. Followed
+     * by a call to record if so.
+     */
+    bool should_compress(const Buffer& payload, MessageType msg_type)
+    {
+        const size_t size = payload.size();
+        if (m_options.sample_threshold != 0 && m_options.sample_threshold <= size && m_options.sample_size < size)
+        {
+            const auto [in_size, out_size, elapsed] = sample(payload);
+            std::lock_guard<std::mutex> lk(m_mutex);
+            auto& s = m_stats[static_cast<size_t>(msg_type)];
+            // the sample also refreshes the throughput
+            observe(s, in_size, out_size, elapsed);
+            if (pays(ratio(in_size, out_size), s.throughput))
+                return true;
+            ++s.skipped;
+            return false;
+        }
+        std::lock_guard<std::mutex> lk(m_mutex);
+        auto& s = m_stats[static_cast<size_t>(msg_type)];
+        if (s.sampled && !pays(s.ratio, s.throughput) && ++s.since_attempt < m_options.retry_interval)
+        {
+            ++s.skipped;
+            return false;
+        }
+        s.since_attempt = 0;
+        return true;
+    }
+
+    /**
+     * @brief Record the outcome of compressing in_size bytes to out_size,
+     * which is in_size if compress gave up.
+     */
+    void record(MessageType msg_type, size_t in_size, size_t out_size, std::chrono::nanoseconds elapsed)
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        auto& s = m_stats[static_cast<size_t>(msg_type)];
+        ++s.attempted;
+        if (out_size < in_size)
+            ++s.compressed;
+        s.bytes_in += in_size;
+        s.bytes_out += out_size;
+        observe(s, in_size, out_size, elapsed);
+    }
+
+    CompressionStats stats(MessageType msg_type) const
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        return m_stats[static_cast<size_t>(msg_type)];
+    }
+
+    const CompressionPolicyOptions& options() const noexcept
+    {
+        return m_options;
+    }
+
+private:
+
+    struct Sample
+    {
+        size_t in_size;
+        size_t out_size;
+        std::chrono::nanoseconds elapsed;
+    };
+
+    static double ratio(size_t in_size, size_t out_size) noexcept
+    {
+        return out_size < in_size ? static_cast<double>(out_size) / static_cast<double>(in_size) : 1.0;
+    }
+
+    bool pays(double ratio, double throughput) const noexcept
+    {
+        if (0.5 <= ratio)
+            return false;
+        // compressing costs size / throughput seconds and saves
+        // size * (1 - ratio) / link seconds on the wire
+        return m_options.link_bytes_per_second == 0 || throughput == 0
+            || m_options.link_bytes_per_second < throughput * (1 - ratio);
+    }
+
+    void observe(CompressionStats& s, size_t in_size, size_t out_size, std::chrono::nanoseconds elapsed) const noexcept
+    {
+        const double seconds = std::chrono::duration<double>(elapsed).count();
+        const double throughput = 0 < seconds ? static_cast<double>(in_size) / seconds : s.throughput;
+        const double a = s.sampled ? m_options.ewma_alpha : 1.0;
+        s.ratio = a * ratio(in_size, out_size) + (1 - a) * s.ratio;
+        s.throughput = a * throughput + (1 - a) * s.throughput;
+        s.sampled = true;
+    }
+
+    // Compress slices spread over the payload.
+    Sample sample(const Buffer& payload) const
+    {
+        constexpr size_t slices = 4;
+        const size_t slice = m_options.sample_size / slices;
+        Buffer sample{static_cast<uint8_t *>(malloc(slice * slices)), slice * slices, payload.endianness()};
+        if (sample.get() == nullptr)
+            throw std::bad_alloc();
+        // each slice is centred in its quarter of the payload
+        const size_t stride = payload.size() / slices;
+        for (size_t i = 0; i < slices; ++i)
+            std::memcpy(sample.get() + i * slice, payload.get() + i * stride + (stride - slice) / 2, slice);
+
+        const size_t in_size = sample.size();
+        const auto start = std::chrono::steady_clock::now();
+        const size_t out_size = compress(std::move(sample)).size();
+        return {in_size, out_size, std::chrono::steady_clock::now() - start};
+    }
+
+    CompressionPolicyOptions m_options;
+    // indexed by MessageType
+    std::array<CompressionStats, 3> m_stats;
+    mutable std::mutex m_mutex;
+};
+
+/**
+ * @brief Build the header for a payload, compressing the payload first when
+ * the protocol level allows it and it pays.
+ *
+ * @param in_buff : Payload buffer, replaced by its compressed form if compressed.
+ * @param msg_type : Message type to send.
+ * @param level : Protocol level.
+ * @param policy : Decides whether compressing pays, null for local
+ * connections, which are never compressed.
+ * @return The header buffer and how many of its bytes to send. Compressed
+ * messages carry their uncompressed size after the fixed header.
+ */
+inline std::pair<Buffer, size_t> encode_header(Buffer& in_buff, MessageType msg_type, uint8_t level, CompressionPolicy *policy)
+{
+    // need to use a buffer as header endianness must match in_buff
+    Buffer header{static_cast<uint8_t *>(calloc(16, 1)), 16, in_buff.endianness()};
+    if (header.get() == nullptr)
+        throw std::bad_alloc(); // no need to throw as red destructor will do cleanup
+    size_t header_size = message_header_size; // default header size (can be 8, 12, or 16)
+    header.write_at(std::endian::little == in_buff.endianness(), 0);
+    header.write_at(static_cast<uint8_t>(msg_type), 1);
+    // start out as uncompressed. and no 4GB multiplier
+
+    // original in_buff size
+    const size_t orig_payload_size = in_buff.size();
+    const size_t uncompressed_msg_size = header_size + orig_payload_size;
+    if (uncompressed_msg_size >= 2_GB && level < 5)
+        throw std::runtime_error("Protocol level only supports messages up to 2GB");
+
+    // compression available if 0<level, not local, and total uncompressed message would be more than 2000 bytes.
+    // try to compress if the policy expects it to pay. Update header to reflect outcome.
+    if(0 < level && policy && 2000 < uncompressed_msg_size && policy->should_compress(in_buff, msg_type))
+    {
+        const auto start = std::chrono::steady_clock::now();
+        in_buff = compress(std::move(in_buff));
+        policy->record(msg_type, orig_payload_size, in_buff.size(), std::chrono::steady_clock::now() - start);
+        // if in_buff not smaller then compression skipped. Write uncompressed message size
+        if (in_buff.size() < orig_payload_size)
+        {
+            header.write_at<uint8_t>(uncompressed_msg_size < 4_GB ? 1 : 2, 2);
+            if (uncompressed_msg_size < 4_GB)
+                header.write<uint32_t>(uncompressed_msg_size, header_size);
+            else
+                header.write<uint64_t>(uncompressed_msg_size, header_size);
+        }
+    }
+
+    // write full message size
+    const size_t final_msg_size = header_size + in_buff.size();
+    header.write_at(static_cast<uint8_t>(final_msg_size / 4_GB), 3);
+    header.write_at(static_cast<uint32_t>(final_msg_size % 4_GB), 4);
+    return {std::move(header), header_size};
+}
+
+struct MessageHeader
+{
+    std::endian endianness;
+    MessageType type;
+    uint8_t compression_level;
+    // bytes following the fixed header
+    size_t payload_size;
+};
+
+inline MessageHeader parse_header(const Buffer& header)
+{
+    MessageHeader res;
+    res.endianness = header.get()[0] == 1 ? std::endian::little : std::endian::big;
+    res.type = MessageType{header.get()[1]};
+    res.compression_level = header.get()[2];
+    // the size is in the sender's endianness
+    const auto residual = to_native_endian(header.read_at<uint32_t>(4), res.endianness);
+    // 4GB times index 3 plus the residual uint32_t at index 4, minus 8 byte header gives payload size
+    res.payload_size = (4_GB * header.get()[3]) + residual - message_header_size;
+    return res;
+}
+
+/**
+ * @brief Set the endianness of a received payload and decompress it if
+ * required, regardless of level.
+ */
+inline Buffer decode_payload(Buffer payload, const MessageHeader& header)
+{
+    payload.set_endianness(header.endianness);
+    if (header.compression_level)
+        payload = decompress(std::move(payload), header.compression_level);
+    return payload;
+}
+
+/**
+ * @brief Implementation of the KX IPC protocol.
+ *
+ * KX IPC Protocol:
+ * 
+ * All messages start with a 4 byte header.
+ * Index: 0          1       2          3
+ * Desc:  endianness msgType compressed excessSize
+ * 
+ * endianness: 1 if little endian.
+ * msgType: 0 - async, 1 - sync, 2 - respose.
+ * compressed: (protocol 1+) 1 if compressed, 2 if compressed and original size 8 bytes
+ * excessSize: (protocol 5+) (4GB * this) + residual size is total message size
+ * 
+ * After that is the residual length of the message - including the header and the bytes used to store the size.
+ * This is a uint32_t. Anything 4GB + must increment excessSize in the header.
+ * 
+ * The rest of the message (the payload) is either compressed or uncompressed.
+ * 
+ * Uncompressed payload:
+ * The uncompressed payload can be unpacked recursively.
+ * The first byte is always the type.
+ * ATOMS: For atoms the next sizeof(type) bytes are the value.
+ * FUNCTIONS:
+ *      LAMBDA: There is a string (ending in a 0 byte). This is discarded. Then restart the process again.
+ *      t<104 (Unary primitive/operator/iterator/projection):
+ *          Theres a byte. If its 0 and t == 101 return null, else return "func".
+ *      t>105: Restart process again.
+ *      PROJECTION or COMPOSITION (t=104 or 105): There is a length TODO: may just be an integer, could be integer or long.
+ *          Then perform the serialization operation for the number of times indicated.
+ * DICTIONARY: (De)serialize keys then values.
+ * Attributes byte (s - 1, u - 2, p - 3, g - 4, largeArray - 128 (protocol 6 only, can be or-ed with attributes))
+ * TABLE: Serialise as dictionary (i.e. 99, cols, column values)
+ * ARRAY: Then the length of the array as unsigned int (8 bytes if largeArray, else 4 bytes). Then serialise all the entries.
+ *      Note: Symbols are null (0) terminated strings. (255 * 4GB) + 4GB (bar 1 byte) is essentially the 1TB limit.
+ * 
+ * TODO: Why is type 127 a sorted dictionary? https://code.kx.com/q/kb/serialization/#sorted-keyed-table
+ * A v3 explanation seems to be here http://jnordwick.github.io/k/kenc.html
+ * 
+ * Compressed payload:
+ * The compressed payload starts with the length the message if it wasn't compressed (including the header).
+ * The size is written as 4 bytes (compression level 1) if it will fit, else 8 bytes (compression level 2)
+ * 
+ * The algorithm doesn't have an identifiable name but it is made up of blocks.
+ * A block starts with a single byte header. The size of the block is 1 + 2*popcount(header) + (8-popcount(header)),
+ * i.e. there are two bytes in the block for each 1 bit in the header, and one byte for each 0 bit.
+ * 
+ * Definition: xor-offset: The XOR of two adjacent bytes.
+ * 
+ * The algorithm effectively tries to compress common sequences of bytes (up to a window size of 255).
+ * It starts by check the xor-offset of where you currently are in the buffer against the next byte.
+ *      - If that offset hasn't occurred before you cache the index of the offset, and write the
+ *        current byte value to the output buffer. (0 in header)
+ *      - If that offset has occurred but the first byte is different, update the cache to say the
+ *        offset last occurred here. Write the current byte value to the output buffer. (0 in header)
+ *      - If that offset has occurred before and the value of the byte where it occurred is the same
+ *        (this means you have two runs of two identical bytes) then:
+ *          1. Update the cache to say the offset last occurred here.
+ *          2. Determine how long the run goes on for (up to 255 or until you hit the end of the buffer)
+ *          3. Store the offset (1 byte), run length (1 byte)
+ *          4. Make sure there is a 1 in the buffer.
+ * Once the final header of the block is determined, go back to the START of the block and store it.
+ * 
+ * After compression the total length of the message (which is stored after the header) must be updated
+ * to reflect the compressed size. This means you cannot stream the serialization/compression, and hence
+ * there are protocol levels which limit messages to 2GB or less. 
+ *
+ * @tparam TSocket : Socket type. Must conform to an interface.
+ */
+template<class TSocket>
+class SocketConnection
+{
+    // endianness support required.
+    // ensure platform is big or little endian - not edge case platform as defined here:
+    // https://en.cppreference.com/w/cpp/types/endian
+    static_assert(
+        (std::endian::little == std::endian::native) != (std::endian::big == std::endian::native),
+        "Implementation requires machine is strictly big or little endian.");
+
+private:
+    TSocket m_conn;
+    uint8_t m_level;
+    // sends are const, but their outcomes feed the policy
+    mutable CompressionPolicy m_compression;
+
+    /**
+     * @brief 
+     * 
+     * @param in_buff : Payload buffer
+     * @param msg_type : Message type to send.
+     */
+    void send_impl(Buffer in_buff, MessageType msg_type) const
+    {
+        auto [header, header_size] = encode(in_buff, msg_type);
+        // more flag would be helpful here
+        m_conn.send(header.get(), header_size);
+        m_conn.send(in_buff.get(), in_buff.size());
+    }
+
+public:
+    /**
+     * @brief Construct a new Socket Connection object
+     * 
+     * @param conn : Connection to communicate protocol over.
+     * @param credentials :  String of the form "username:password"
+     * @param level : Protocol level.
+     * @param compression : Tuning of when sends are compressed.
+     * 
+     * Protocol level: https://code.kx.com/q/basics/ipc/#handshake.
+     *  0   : (V2.5) no compression, no timestamp, no timespan, no UUID
+     *  1..2: (V2.6-2.8) compression, timestamp, timespan
+     *  3   : (V3.0) compression, timestamp, timespan, UUID
+     *  4   : reserved
+     *  5   : support msgs >2GB; vectors must each have a count ≤ 2 billion
+     *  6   : support msgs >2GB and vectors may each have a count > 2 billion
+     * 
+     * Size restrictions are only enforced on serialization.
+     * Compression is applied on send according to the protocol level, and on receive according to the inbound message.
+     * Type restrictions should be enforced by a serializer.
+     */
+    SocketConnection(TSocket&& conn, const std::string& credentials = "", uint8_t level = 6, CompressionPolicyOptions compression = {})
+    :m_conn(std::move(conn))
+    ,m_level(level)
+    ,m_compression(compression)
+    {
+        if (level == 4 || 6 < level)
+            throw std::domain_error("Protocol level must be less than 7 and not 4.");
+
+        // perform handshake
+        // msgmore would be helpful here to do only one send, but not supported on macos.
+        m_conn.send(reinterpret_cast<const uint8_t *>(credentials.data()), credentials.size());
+        const uint8_t capability_msg[2] = {level, 0};
+        m_conn.send(capability_msg, sizeof(capability_msg));
+
+        const auto capability_response = m_conn.recv(1);
+        if (capability_response.size() == 0)
+            throw std::runtime_error("Access: authentication failed");
+        const uint8_t supported_level = *capability_response.get();
+        if (supported_level < level)
+            throw std::runtime_error("KDB instance supports insufficient protocol level: " + std::to_string(supported_level));
+    }
+
+    const TSocket& connection() const noexcept
+    {
+        return m_conn;
+    }
+
+    uint8_t protocol_level() const noexcept
+    {
+        return m_level;
+    }
+
+    const CompressionPolicy& compression() const noexcept
+    {
+        return m_compression;
+    }
+
+    /**
+     * @brief Build the header for a payload to send over this connection,
+     * compressing the payload if the connection's policy expects it to pay.
+     * See encode_header.
+     */
+    std::pair<Buffer, size_t> encode(Buffer& in_buff, MessageType msg_type) const
+    {
+        return encode_header(in_buff, msg_type, m_level, m_conn.is_unix_domain_socket() ? nullptr : &m_compression);
+    }
+
+    Buffer send(Buffer in_buff) const
+    {
+        send_impl(std::move(in_buff), MessageType::Sync);
+
+        auto [buff, msg_type] = recv();
+        if (msg_type != MessageType::Response)
+            throw std::runtime_error("Expected response message got " + (msg_type == MessageType::Sync ? "sync" : "async") + " message");
+        return buff;
+    }
+
+    void send_async(Buffer in_buff) const
+    {
+        send_impl(std::move(in_buff), MessageType::Async);
+    }
+
+    std::pair<Buffer, MessageType> recv() const
+    {
+        // a single recv can return part of a large message
+        Buffer header = m_conn.recv(message_header_size, MSG_WAITALL);
+        if (header.size() != message_header_size)
+            throw std::runtime_error("Could not get full header");
+
+        const auto info = parse_header(header);
+        auto payload = m_conn.recv(info.payload_size, MSG_WAITALL);
+        if (payload.size() != info.payload_size)
+            throw std::runtime_error("Could not get full payload");
+
+        return {decode_payload(std::move(payload), info), info.type};
+    }
+};
+
+class Serializer
+{
+private:
+    uint8_t m_level;
+
+    void supports_type(qbind::Type t)
+    {
+        const bool unsupported = (m_level < 3 && t == qbind::Type::GUID) ||
+            (m_level == 0 && (t == qbind::Type::Timestamp || t == qbind::Type::Timespan));
+        if (unsupported)
+        {
+            std::ostringstream ss;
+            ss << "Protocol level " << std::to_string(m_level) << " does not support " << t;
+            throw std::runtime_error(ss.str());
+        }
+    }
+
+    size_t get_buffer_length_size() const noexcept
+    {
+        return m_level == 6 ? 8 : 4;
+    }
+
+public:
+
+    /**
+     * @brief A helper class for (de)serializing to KX IPC format. 
+     * 
+     * @param level : Protocol level.
+     * @param compression : Tuning of when sends are compressed.
+     * 
+     * Protocol level: https://code.kx.com/q/basics/ipc/#handshake.
+     *  0   : (V2.5) no compression, no timestamp, no timespan, no UUID
+     *  1..2: (V2.6-2.8) compression, timestamp, timespan
+     *  3   : (V3.0) compression, timestamp, timespan, UUID
+     *  4   : reserved
+     *  5   : support msgs >2GB; vectors must each have a count ≤ 2 billion
+     *  6   : support msgs >2GB and vectors may each have a count > 2 billion
+     * 
+     * Array size and type constraints are applied on serialise
+     */
+    Serializer(uint8_t level)
+    :m_level(level)
+    {}
+
+    /**
+     * @brief Serialize numeric arrays (everything except symbol)
+     * 
+     * @tparam Iter 
+     * @param start 
+     * @param end 
+     * @return Buffer 
+     */
+    template <
+        qbind::Type Type,
+        typename Iter,
+        std::enable_if_t<std::is_arithmetic_v<typename std::iterator_traits<Iter>::value_type>, std::nullptr_t> = nullptr
+    >
+    Buffer serialize(Iter start, Iter end)
+    {
+        using v_type = typename qbind::internal::c_type<Type>::value;
+        using i_type = typename std::iterator_traits<Iter>::value_type;
+        static_assert(std::is_same_v<v_type, i_type>,
+                      "Iterator value type does not match underlying C type of KX Type");
+        supports_type(Type);
+
+        const size_t length = end - start;
+        if (m_level < 6 && length > 2000000000) // 2 billion
+            throw std::runtime_error("Only protocol level 6 supports arrays over 2 billion elements");
+        
+        const bool big_array = length >= 4_GB;
+        const size_t buf_length = 2 + (big_array ? 8 : 4) + (length * sizeof(v_type));
+
+        Buffer buf{static_cast<uint8_t *>(malloc(buf_length)), buf_length};
+        if (buf.get() == nullptr)
+            throw std::bad_alloc();
+        // write type and header
+        size_t idx = 0;
+        buf.write(static_cast<signed char>(Type), idx); // type
+        buf.write<uint8_t>(big_array ? 128 : 0, idx); // attributes TODO: implement s, u, p, g
+        if (big_array)
+            buf.write<int64_t>(length, idx);
+        else
+            buf.write<int32_t>(length, idx);
+
+        // find the initial point for data and copy across. Can use execution policy here if wanted.
+        auto data_base = reinterpret_cast<v_type *>(buf.get()+idx);
+        std::copy(start, end, data_base);
+
+        return buf;
+    }
+
+    // TODO symbol array
+
+    /**
+     * @brief Serialise an atom (everything except symbol)
+     * 
+     * @tparam Type 
+     * @tparam T 
+     * @param value 
+     * @return Buffer 
+     */
+    template <
+        qbind::Type Type,
+        typename T,
+        std::enable_if_t<std::is_arithmetic_v<T>, std::nullptr_t> = nullptr
+    >
+    Buffer serialize(T value)
+    {
+        using v_type = typename qbind::internal::c_type<Type>::value;
+        static_assert(std::is_same_v<T, v_type>,
+                      "Iterator value type does not match underlying C type of KX Type");
+        supports_type(Type);
+        const size_t buf_length = 1 + sizeof(T);
+
+        Buffer buf{static_cast<uint8_t *>(malloc(buf_length)), buf_length};
+        if (buf.get() == nullptr)
+            throw std::bad_alloc();
+
+        buf.write_at(-static_cast<signed char>(Type), 0);
+        buf.write_at<v_type>(value, 1);
+
+        return buf;
+    }
+};
+
@@ -0,0 +1,414 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "async_connection.h"
+
+struct Replica
+{
+    std::string hostname;
+    uint16_t port;
+};
+
+struct ConnectionPoolOptions
+{
+    std::string credentials;
+    uint8_t level = 6;
+    // Bounds connecting and the handshake, 0 for none.
+    std::chrono::microseconds connect_timeout{std::chrono::seconds(5)};
+    // Weight of the newest response time in each member's average.
+    double ewma_alpha = 0.2;
+    // Reconnect delay, doubling from min to max on each failed attempt.
+    std::chrono::milliseconds reconnect_min{100};
+    std::chrono::milliseconds reconnect_max{10000};
+    CompressionPolicyOptions compression;
+};
+
+/**
+ * @brief Load-balanced connections to a set of replica processes.
+ *
+ * Each query goes to the connected member with the lowest expected wait:
+ * its average response time (an exponentially weighted moving average)
+ * times one more than its queries in flight. A slow replica builds up
+ * queries in flight and a higher average, so new queries move to the
+ * others.
+ *
+ * Connecting is done on a background thread, so neither the loop nor
+ * callers block on it. Members that fail are reconnected there with an
+ * exponential backoff. Queries in flight on a member when it fails throw
+ * and aren't retried, as they may not be safe to run twice.
+ *
+ * Like AsyncConnection, the pool is used from the loop thread only and must
+ * be destroyed before the loop. Messages the replicas push that aren't
+ * responses are dropped.
+ */
+class ConnectionPool
+{
+public:
+
+    ConnectionPool(EventLoop& loop, std::vector<Replica> replicas, ConnectionPoolOptions options = {})
+    : m_state(std::make_shared<State>(loop, std::move(options)))
+    {
+        if (replicas.empty())
+            throw std::invalid_argument("ConnectionPool needs at least one replica");
+        m_state->members.resize(replicas.size());
+        for (size_t i = 0; i < replicas.size(); ++i)
+            m_state->members[i].replica = std::move(replicas[i]);
+        m_state->self = m_state;
+        m_state->connector = std::thread([state = m_state.get()] { state->connect_loop(); });
+        for (size_t i = 0; i < m_state->members.size(); ++i)
+            m_state->schedule_connect(i, std::chrono::steady_clock::now());
+    }
+
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    // Waits for a connect in progress, which connect_timeout bounds.
+    ~ConnectionPool()
+    {
+        m_state->close();
+    }
+
+    /**
+     * @brief Send payload as a sync message to the best member and await
+     * the response. Throws if no member is connected.
+     */
+    Task<Buffer> query(Buffer payload)
+    {
+        return query_impl(m_state, std::move(payload));
+    }
+
+    /**
+     * @brief Await count members being connected.
+     */
+    Task<void> wait_connected(size_t count = 1)
+    {
+        return wait_connected_impl(m_state, count);
+    }
+
+    size_t size() const noexcept
+    {
+        return m_state->members.size();
+    }
+
+    size_t connected() const noexcept
+    {
+        return m_state->connected();
+    }
+
+    // Average response time of member i, 0 until it has answered.
+    std::chrono::microseconds latency(size_t i) const
+    {
+        return std::chrono::microseconds(static_cast<int64_t>(m_state->members.at(i).ewma_us));
+    }
+
+    size_t in_flight(size_t i) const
+    {
+        return m_state->members.at(i).in_flight;
+    }
+
+private:
+
+    struct Member
+    {
+        Replica replica;
+        std::unique_ptr<AsyncConnection> conn;
+        // bumped on each connect and disconnect, so stale watchers and
+        // queries leave the new connection alone
+        uint64_t generation = 0;
+        size_t in_flight = 0;
+        double ewma_us = 0;
+        bool sampled = false;
+        // consecutive failed connects
+        size_t failures = 0;
+    };
+
+    struct ConnectJob
+    {
+        size_t member;
+        std::chrono::steady_clock::time_point due;
+    };
+
+    struct Waiter
+    {
+        size_t count;
+        std::coroutine_handle<> handle;
+    };
+
+    struct State
+    {
+        State(EventLoop& loop, ConnectionPoolOptions options)
+        : loop(loop)
+        , options(std::move(options))
+        {}
+
+        size_t connected() const noexcept
+        {
+            return static_cast<size_t>(std::count_if(members.begin(), members.end(), [](const Member& m) {
+                return m.conn && !m.conn->failed();
+            }));
+        }
+
+        // Index of the member with the lowest expected wait.
+        size_t pick()
+        {
+            // Members yet to answer are expected to be as fast as the fastest.
+            double fastest = 0;
+            for (const auto& m : members)
+            {
+                if (m.sampled && (fastest == 0 || m.ewma_us < fastest))
+                    fastest = m.ewma_us;
+            }
+
+            const size_t n = members.size();
+            size_t best = n;
+            double best_score = 0;
+            // Rotate the start so ties spread across members.
+            const size_t start = next_start++ % n;
+            for (size_t j = 0; j < n; ++j)
+            {
+                const size_t i = (start + j) % n;
+                auto& m = members[i];
+                if (!m.conn)
+                    continue;
+                if (m.conn->failed())
+                {
+                    disconnect(i);
+                    continue;
+                }
+                const double score = static_cast<double>(m.in_flight + 1) * ((m.sampled ? m.ewma_us : fastest) + 1);
+                if (best == n || score < best_score)
+                {
+                    best = i;
+                    best_score = score;
+                }
+            }
+            if (best == n)
+                throw std::runtime_error("No replicas connected");
+            return best;
+        }
+
+        void record(Member& m, std::chrono::steady_clock::duration elapsed)
+        {
+            const double us = std::chrono::duration<double, std::micro>(elapsed).count();
+            m.ewma_us = m.sampled ? options.ewma_alpha * us + (1 - options.ewma_alpha) * m.ewma_us : us;
+            m.sampled = true;
+        }
+
+        // Loop thread only.
+        void disconnect(size_t i)
+        {
+            auto& m = members[i];
+            if (!m.conn)
+                return;
+            m.conn.reset();
+            ++m.generation;
+            schedule_connect(i, std::chrono::steady_clock::now() + backoff(m.failures));
+        }
+
+        std::chrono::milliseconds backoff(size_t failures) const
+        {
+            auto res = options.reconnect_min;
+            for (size_t i = 0; i < failures && res < options.reconnect_max; ++i)
+                res *= 2;
+            return std::min(res, options.reconnect_max);
+        }
+
+        // Thread safe.
+        void schedule_connect(size_t i, std::chrono::steady_clock::time_point due)
+        {
+            {
+                std::lock_guard<std::mutex> lk(mutex);
+                jobs.push_back({i, due});
+            }
+            cv.notify_one();
+        }
+
+        // The connector thread: connect members as they fall due, and hand
+        // the results to the loop.
+        void connect_loop()
+        {
+            std::unique_lock<std::mutex> lk(mutex);
+            for (;;)
+            {
+                if (stop)
+                    return;
+                if (jobs.empty())
+                {
+                    cv.wait(lk);
+                    continue;
+                }
+                const auto job = std::min_element(jobs.begin(), jobs.end(), [](const auto& a, const auto& b) {
+                    return a.due < b.due;
+                });
+                if (std::chrono::steady_clock::now() < job->due)
+                {
+                    cv.wait_until(lk, job->due);
+                    continue;
+                }
+                const size_t i = job->member;
+                jobs.erase(job);
+                const Replica replica = members[i].replica;
+                lk.unlock();
+
+                std::unique_ptr<AsyncConnection> conn;
+                std::exception_ptr error;
+                try
+                {
+                    conn = std::make_unique<AsyncConnection>(
+                        loop, Socket(replica.hostname, replica.port, options.connect_timeout), options.credentials, options.level,
+                        options.compression);
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                }
+                // the pool outlives this thread, so its state is still there
+                loop.spawn(install(self.lock(), i, std::move(conn), error));
+                lk.lock();
+            }
+        }
+
+        void close()
+        {
+            {
+                std::lock_guard<std::mutex> lk(mutex);
+                stop = true;
+            }
+            cv.notify_one();
+            connector.join();
+            closed = true;
+            for (auto& m : members)
+                m.conn.reset();
+            for (auto& waiter : std::exchange(waiters, {}))
+                loop.post(waiter.handle);
+        }
+
+        void wake_waiters()
+        {
+            const size_t n = connected();
+            auto it = std::partition(waiters.begin(), waiters.end(), [&](const Waiter& w) { return n < w.count; });
+            for (auto done = it; done != waiters.end(); ++done)
+                loop.post(done->handle);
+            waiters.erase(it, waiters.end());
+        }
+
+        EventLoop& loop;
+        const ConnectionPoolOptions options;
+        // for the coroutines the connector spawns
+        std::weak_ptr<State> self;
+        // loop thread only
+        std::vector<Member> members;
+        std::vector<Waiter> waiters;
+        size_t next_start = 0;
+        bool closed = false;
+
+        std::thread connector;
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<ConnectJob> jobs;
+        bool stop = false;
+    };
+
+    // Runs on the loop with a connect attempt's outcome.
+    static Task<void> install(std::shared_ptr<State> state, size_t i, std::unique_ptr<AsyncConnection> conn, std::exception_ptr error)
+    {
+        if (state->closed)
+            co_return;
+        auto& m = state->members[i];
+        if (error)
+        {
+            state->schedule_connect(i, std::chrono::steady_clock::now() + state->backoff(++m.failures));
+            co_return;
+        }
+        m.conn = std::move(conn);
+        m.failures = 0;
+        const auto generation = ++m.generation;
+        state->wake_waiters();
+        state->loop.spawn(watch(state, i, generation));
+    }
+
+    // Drains pushed messages until the connection fails, so failures are
+    // noticed without waiting for a query.
+    static Task<void> watch(std::shared_ptr<State> state, size_t i, uint64_t generation)
+    {
+        try
+        {
+            for (;;)
+            {
+                auto& m = state->members[i];
+                if (state->closed || m.generation != generation)
+                    co_return;
+                co_await m.conn->recv();
+            }
+        }
+        catch (...)
+        {}
+        if (!state->closed && state->members[i].generation == generation)
+            state->disconnect(i);
+    }
+
+    static Task<Buffer> query_impl(std::shared_ptr<State> state, Buffer payload)
+    {
+        const size_t i = state->pick();
+        auto& m = state->members[i];
+        const auto generation = m.generation;
+        const auto start = std::chrono::steady_clock::now();
+        ++m.in_flight;
+        try
+        {
+            auto res = co_await m.conn->query(std::move(payload));
+            --m.in_flight;
+            state->record(m, std::chrono::steady_clock::now() - start);
+            co_return res;
+        }
+        catch (...)
+        {
+            --m.in_flight;
+            if (!state->closed && m.generation == generation && m.conn->failed())
+                state->disconnect(i);
+            throw;
+        }
+    }
+
+    static Task<void> wait_connected_impl(std::shared_ptr<State> state, size_t count)
+    {
+        struct Awaiter
+        {
+            State& state;
+            size_t count;
+
+            bool await_ready() const noexcept
+            {
+                return state.closed || count <= state.connected();
+            }
+
+            void await_suspend(std::coroutine_handle<> handle)
+            {
+                state.waiters.push_back({count, handle});
+            }
+
+            void await_resume() const
+            {
+                if (state.closed)
+                    throw std::runtime_error("Connection pool closed");
+            }
+        };
+        co_await Awaiter{*state, count};
+    }
+
+    std::shared_ptr<State> m_state;
+};
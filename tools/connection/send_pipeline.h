@@ -0,0 +1,178 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include <qbind/thread_pool.h>
+
+#include "connection.h"
+
+struct SendPipelineOptions
+{
+    // Messages compressing or waiting to be written before send_async blocks.
+    size_t max_queued = 64;
+};
+
+/**
+ * @brief Sends async messages over a connection, compressing them in
+ * parallel.
+ *
+ * A message's compression is sequential, but separate messages are
+ * independent. send_async queues a message and hands its compression to a
+ * ThreadPool, so a burst of messages, e.g. a snapshot, compresses on as many
+ * cores as the pool has. A writer thread sends them as they're ready, in
+ * the order they were queued. Whether each is compressed is decided by the
+ * connection's CompressionPolicy.
+ *
+ * The first failure, to compress or to write, stops the pipeline: queued
+ * messages are dropped and send_async and flush rethrow it. The connection
+ * mustn't be sent on by others while the pipeline lives, and must outlive
+ * it. send_async blocks while the queue is full, so must not be called from
+ * the pool's own workers.
+ */
+template<class TSocket>
+class SendPipeline
+{
+public:
+
+    explicit SendPipeline(const SocketConnection<TSocket>& conn, SendPipelineOptions options = {},
+                          qbind::ThreadPool& pool = qbind::ThreadPool::instance())
+    : m_conn(conn)
+    , m_pool(pool)
+    , m_max_queued(std::max<size_t>(options.max_queued, 1))
+    , m_writer([this] { write_loop(); })
+    {}
+
+    SendPipeline(const SendPipeline&) = delete;
+    SendPipeline& operator=(const SendPipeline&) = delete;
+
+    // Writes out what is queued, then stops. Failures are dropped, so flush
+    // first to see them.
+    ~SendPipeline()
+    {
+        {
+            std::lock_guard<std::mutex> lk(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+        m_writer.join();
+    }
+
+    /**
+     * @brief Queue payload to be sent as an async message after those
+     * already queued.
+     */
+    void send_async(Buffer payload)
+    {
+        Message *msg;
+        {
+            std::unique_lock<std::mutex> lk(m_mutex);
+            m_cv.wait(lk, [this] { return m_error || m_queue.size() < m_max_queued; });
+            if (m_error)
+                std::rethrow_exception(m_error);
+            m_queue.push_back(std::make_unique<Message>(std::move(payload)));
+            msg = m_queue.back().get();
+        }
+        m_pool.submit([this, msg] { encode(*msg); });
+    }
+
+    /**
+     * @brief Wait until every queued message is written.
+     */
+    void flush()
+    {
+        std::unique_lock<std::mutex> lk(m_mutex);
+        m_cv.wait(lk, [this] { return m_queue.empty(); });
+        if (m_error)
+            std::rethrow_exception(m_error);
+    }
+
+private:
+
+    struct Message
+    {
+        explicit Message(Buffer payload)
+        : payload(std::move(payload))
+        {}
+
+        Buffer payload;
+        Buffer header{nullptr, 0};
+        size_t header_size = 0;
+        std::exception_ptr error;
+        // set under the mutex once the fields above are final
+        bool ready = false;
+    };
+
+    // On the pool. Tasks must not throw.
+    void encode(Message& msg) noexcept
+    {
+        try
+        {
+            auto [header, header_size] = m_conn.encode(msg.payload, MessageType::Async);
+            msg.header = std::move(header);
+            msg.header_size = header_size;
+        }
+        catch (...)
+        {
+            msg.error = std::current_exception();
+        }
+        // notified under the lock, as once the message is written the
+        // pipeline may be destroyed
+        std::lock_guard<std::mutex> lk(m_mutex);
+        msg.ready = true;
+        m_cv.notify_all();
+    }
+
+    // Writes the head of the queue once it's ready. It stays queued while
+    // written, so flush waits for it.
+    void write_loop()
+    {
+        std::unique_lock<std::mutex> lk(m_mutex);
+        for (;;)
+        {
+            m_cv.wait(lk, [this] { return m_queue.empty() ? m_stop : m_queue.front()->ready; });
+            if (m_queue.empty())
+                return;
+            Message& msg = *m_queue.front();
+            std::exception_ptr error = msg.error;
+            if (!m_error && !error)
+            {
+                lk.unlock();
+                try
+                {
+                    m_conn.connection().send(msg.header.get(), msg.header_size);
+                    m_conn.connection().send(msg.payload.get(), msg.payload.size());
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                }
+                lk.lock();
+            }
+            if (error && !m_error)
+                m_error = error;
+            m_queue.pop_front();
+            m_cv.notify_all();
+        }
+    }
+
+    const SocketConnection<TSocket>& m_conn;
+    qbind::ThreadPool& m_pool;
+    const size_t m_max_queued;
+
+    std::mutex m_mutex;
+    // signalled when a message is ready or written, and on stop
+    std::condition_variable m_cv;
+    // in send order
+    std::deque<std::unique_ptr<Message>> m_queue;
+    std::exception_ptr m_error;
+    bool m_stop = false;
+    // last, so it starts once the rest is set up
+    std::thread m_writer;
+};
@@ -0,0 +1,615 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <errno.h>
+#include <poll.h>
+
+#include <qbind/ipc.h>
+#include <qbind/type.h>
+
+#include "connection.h"
+
+/**
+ * @brief An appendable column, stored in chunks of a fixed number of rows.
+ *
+ * Chunks are allocated whole as rows arrive and kept when the column is
+ * cleared, so a subscriber that consumes and clears in batches stops
+ * allocating once it has seen its largest batch.
+ *
+ * Fixed width types are stored as their underlying C type, symbols as
+ * pointers to interned strings and string columns (lists of char vectors)
+ * as the end offset of each row in to one run of characters.
+ */
+class ColumnBuffer
+{
+public:
+
+    ColumnBuffer(std::string name, signed char type, size_t chunk_rows)
+    : m_name(std::move(name))
+    , m_type(type)
+    , m_width(type == 0 ? sizeof(int64_t) : qbind::internal::k_width(type))
+    , m_chunk_rows(chunk_rows)
+    {
+        if (m_width == 0)
+            throw std::runtime_error("Can't buffer columns of type " + std::to_string(type));
+        if (chunk_rows == 0)
+            throw std::invalid_argument("chunk_rows must be positive");
+    }
+
+    const std::string& name() const noexcept
+    {
+        return m_name;
+    }
+
+    // q type of the column, 0 for string columns.
+    signed char type() const noexcept
+    {
+        return m_type;
+    }
+
+    size_t size() const noexcept
+    {
+        return m_size;
+    }
+
+    // Chunks in use.
+    size_t chunks() const noexcept
+    {
+        return m_size == 0 ? 0 : (m_size - 1) / m_chunk_rows + 1;
+    }
+
+    /**
+     * @brief Rows in chunk i, in place. Valid until the column is appended
+     * to or cleared.
+     */
+    template<qbind::Type Type>
+    std::span<const typename qbind::internal::c_type<Type>::underlier> chunk(size_t i) const
+    {
+        using T = typename qbind::internal::c_type<Type>::underlier;
+        if (static_cast<signed char>(Type) != m_type)
+            throw std::runtime_error("Column " + m_name + " has type " + std::to_string(m_type) + ", not " + std::to_string(static_cast<int>(Type)));
+        if (chunks() <= i)
+            throw std::out_of_range("Chunk " + std::to_string(i) + " of " + std::to_string(chunks()));
+        const size_t rows = std::min(m_chunk_rows, m_size - i * m_chunk_rows);
+        return {reinterpret_cast<const T *>(m_chunks[i].get()), rows};
+    }
+
+    std::string_view string(size_t row) const
+    {
+        if (m_type != 0)
+            throw std::runtime_error("Column " + m_name + " isn't a string column");
+        if (m_size <= row)
+            throw std::out_of_range("Row " + std::to_string(row) + " of " + std::to_string(m_size));
+        const size_t begin = row == 0 ? 0 : static_cast<size_t>(end(row - 1));
+        return {m_chars.data() + begin, static_cast<size_t>(end(row)) - begin};
+    }
+
+    // Keeps the chunks for reuse.
+    void clear() noexcept
+    {
+        m_size = 0;
+        m_chars.clear();
+    }
+
+    /**
+     * @brief Append count elements of the column's width from src.
+     *
+     * @param swap : src is in the other endianness.
+     */
+    void append(const uint8_t *src, size_t count, bool swap)
+    {
+        // GUIDs are byte arrays, never swapped
+        const bool swapped = swap && m_type != UU;
+        while (count != 0)
+        {
+            uint8_t *dst = reserve();
+            const size_t n = std::min(count, m_chunk_rows - m_size % m_chunk_rows);
+            if (swapped)
+                byteswap(dst, src, n, m_width);
+            else
+                std::memcpy(dst, src, n * m_width);
+            src += n * m_width;
+            count -= n;
+            m_size += n;
+        }
+    }
+
+    void append_symbol(const char *sym)
+    {
+        std::memcpy(reserve(), &sym, sizeof(sym));
+        ++m_size;
+    }
+
+    void append_string(const char *chars, size_t size)
+    {
+        m_chars.insert(m_chars.end(), chars, chars + size);
+        const auto end = static_cast<int64_t>(m_chars.size());
+        std::memcpy(reserve(), &end, sizeof(end));
+        ++m_size;
+    }
+
+private:
+
+    // Where the next row goes, allocating its chunk if needed.
+    uint8_t *reserve()
+    {
+        const size_t chunk = m_size / m_chunk_rows;
+        if (chunk == m_chunks.size())
+            m_chunks.emplace_back(new uint8_t[m_chunk_rows * m_width]);
+        return m_chunks[chunk].get() + (m_size % m_chunk_rows) * m_width;
+    }
+
+    int64_t end(size_t row) const noexcept
+    {
+        int64_t res;
+        std::memcpy(&res, m_chunks[row / m_chunk_rows].get() + (row % m_chunk_rows) * sizeof(res), sizeof(res));
+        return res;
+    }
+
+    std::string m_name;
+    signed char m_type;
+    size_t m_width;
+    size_t m_chunk_rows;
+    size_t m_size = 0;
+    std::vector<std::unique_ptr<uint8_t[]>> m_chunks;
+    // string columns only
+    std::vector<char> m_chars;
+};
+
+/**
+ * @brief Rows of one table accumulated from upd messages.
+ */
+class TableBuffer
+{
+public:
+
+    explicit TableBuffer(std::string name)
+    : m_name(std::move(name))
+    {}
+
+    const std::string& name() const noexcept
+    {
+        return m_name;
+    }
+
+    size_t rows() const noexcept
+    {
+        return m_columns.empty() ? 0 : m_columns.front().size();
+    }
+
+    const std::vector<ColumnBuffer>& columns() const noexcept
+    {
+        return m_columns;
+    }
+
+    const ColumnBuffer& column(std::string_view name) const
+    {
+        for (const auto& column : m_columns)
+        {
+            if (column.name() == name)
+                return column;
+        }
+        throw std::out_of_range("No column " + std::string(name) + " in " + m_name);
+    }
+
+private:
+
+    friend class Subscriber;
+
+    std::string m_name;
+    std::vector<ColumnBuffer> m_columns;
+    std::chrono::steady_clock::time_point m_last_batch = std::chrono::steady_clock::now();
+};
+
+struct SubscriberOptions
+{
+    // Rows per column chunk.
+    size_t chunk_rows = 1 << 16;
+    // Hand a table to the consumer once it has this many rows, 0 for no limit...
+    size_t batch_rows = 1 << 16;
+    // ...or once this long has passed since its last batch, 0 for never.
+    std::chrono::milliseconds batch_interval{0};
+};
+
+/**
+ * @brief Decodes the upd messages a tickerplant publishes straight in to
+ * columnar table buffers, and hands them to a consumer in batches.
+ *
+ * Each (`upd;`table;data) message is parsed from its IPC bytes, without
+ * building K objects, and its columns appended to the table's buffers: fixed
+ * width vectors with one copy, or one bulk byte swap from a sender of the
+ * other endianness. data may be a table, a list of columns or, for a single
+ * row, a list of atoms (with strings as char vectors). Columns of data sent
+ * as a list are named as q names them, x, x1, x2..., unless set_columns has
+ * named them.
+ *
+ * The consumer gets a table's buffers, read only, once it has batch_rows
+ * rows or batch_interval has passed, after which they are cleared. Views of
+ * the columns are only valid during the call. Symbols point in to an intern
+ * table that lives as long as the subscriber.
+ */
+class Subscriber
+{
+public:
+
+    using Consumer = std::function<void(const TableBuffer&)>;
+
+    explicit Subscriber(Consumer consumer, SubscriberOptions options = {})
+    : m_consumer(std::move(consumer))
+    , m_options(options)
+    {}
+
+    /**
+     * @brief Name the columns of a table whose updates are sent as lists.
+     */
+    void set_columns(const std::string& table, std::vector<std::string> names)
+    {
+        m_names[table] = std::move(names);
+    }
+
+    /**
+     * @brief Decode one message payload.
+     *
+     * @return False if it isn't an upd message, which is ignored.
+     */
+    bool process(const Buffer& payload)
+    {
+        Reader in{payload, 0};
+        if (in.byte() != 0)
+            return false;
+        in.byte(); // attribute
+        if (in.read<int32_t>() != 3 || static_cast<signed char>(in.byte()) != -KS || in.symbol() != "upd")
+            return false;
+        if (static_cast<signed char>(in.byte()) != -KS)
+            return false;
+        const std::string_view name = in.symbol();
+
+        auto it = m_tables.find(name);
+        if (it == m_tables.end())
+            it = m_tables.emplace(std::string(name), TableBuffer(std::string(name))).first;
+        TableBuffer& table = it->second;
+        decode(table, in);
+        ++m_messages;
+
+        if (0 < m_options.batch_rows && m_options.batch_rows <= table.rows())
+            consume(table);
+        return true;
+    }
+
+    /**
+     * @brief Hand tables to the consumer whose batch_interval has passed.
+     */
+    void flush_due()
+    {
+        if (m_options.batch_interval.count() == 0)
+            return;
+        const auto now = std::chrono::steady_clock::now();
+        for (auto& [name, table] : m_tables)
+        {
+            if (table.rows() && m_options.batch_interval <= now - table.m_last_batch)
+                consume(table);
+        }
+    }
+
+    /**
+     * @brief Hand every table with rows to the consumer.
+     */
+    void flush()
+    {
+        for (auto& [name, table] : m_tables)
+        {
+            if (table.rows())
+                consume(table);
+        }
+    }
+
+    /**
+     * @brief Receive and process messages until stop is set, waking at least
+     * every poll_interval to check it and flush tables that are due.
+     */
+    template<class TSocket>
+    void run(const SocketConnection<TSocket>& conn, const std::atomic<bool>& stop, std::chrono::milliseconds poll_interval = std::chrono::milliseconds(100))
+    {
+        pollfd fd{conn.connection().fd(), POLLIN, 0};
+        while (!stop.load(std::memory_order_relaxed))
+        {
+            auto timeout = poll_interval;
+            if (0 < m_options.batch_interval.count())
+                timeout = std::min(timeout, m_options.batch_interval);
+            const int rc = ::poll(&fd, 1, static_cast<int>(timeout.count()));
+            THROW_ERRNO_IF(rc == -1 && errno != EINTR);
+            if (0 < rc)
+            {
+                const auto [payload, type] = conn.recv();
+                process(payload);
+            }
+            flush_due();
+        }
+    }
+
+    const TableBuffer *table(std::string_view name) const
+    {
+        const auto it = m_tables.find(name);
+        return it == m_tables.end() ? nullptr : &it->second;
+    }
+
+    // upd messages processed.
+    uint64_t messages() const noexcept
+    {
+        return m_messages;
+    }
+
+private:
+
+    struct Hash
+    {
+        using is_transparent = void;
+
+        size_t operator()(std::string_view s) const noexcept
+        {
+            return std::hash<std::string_view>()(s);
+        }
+    };
+
+    // Bounds checked reads from a payload.
+    struct Reader
+    {
+        const Buffer& buf;
+        size_t idx;
+
+        void need(size_t n) const
+        {
+            if (buf.size() < idx || buf.size() - idx < n)
+                throw std::runtime_error("Truncated upd message");
+        }
+
+        uint8_t byte()
+        {
+            need(1);
+            return buf.get()[idx++];
+        }
+
+        template<class T>
+        T read()
+        {
+            need(sizeof(T));
+            return buf.read<T>(idx);
+        }
+
+        const uint8_t *skip(size_t n)
+        {
+            need(n);
+            const uint8_t *res = buf.get() + idx;
+            idx += n;
+            return res;
+        }
+
+        std::string_view symbol()
+        {
+            const char *begin = reinterpret_cast<const char *>(buf.get() + idx);
+            const void *end = memchr(begin, 0, buf.size() - std::min(idx, buf.size()));
+            if (end == nullptr)
+                throw std::runtime_error("Truncated upd message");
+            const std::string_view res(begin, static_cast<const char *>(end) - begin);
+            idx += res.size() + 1;
+            return res;
+        }
+
+        // Vector header after the type: attribute and count, of elements at
+        // least width bytes each which must fit in what's left.
+        size_t count(size_t width = 1)
+        {
+            const uint8_t attr = byte();
+            // large vectors flag an 8 byte count, as Serializer writes them
+            const int64_t n = attr & 128 ? read<int64_t>() : read<int32_t>();
+            if (n < 0)
+                throw std::runtime_error("Corrupt count in upd message");
+            need(0);
+            if (static_cast<uint64_t>(n) > (buf.size() - idx) / width)
+                throw std::runtime_error("Truncated upd message");
+            return static_cast<size_t>(n);
+        }
+    };
+
+    char *intern(std::string_view sym)
+    {
+        auto it = m_symbols.find(sym);
+        if (it == m_symbols.end())
+            it = m_symbols.emplace(sym).first;
+        return const_cast<char *>(it->c_str());
+    }
+
+    // One item of data: a column, or an atom or string of a single row.
+    struct Item
+    {
+        signed char type;
+        // where the elements start
+        size_t offset;
+        // elements, or characters of a single row's string
+        size_t count;
+        bool row;
+
+        size_t rows() const noexcept
+        {
+            return row ? 1 : count;
+        }
+    };
+
+    // Read the type and count of an item and skip past it.
+    Item scan(Reader& in)
+    {
+        const auto type = static_cast<signed char>(in.byte());
+        if (type == -KS)
+        {
+            const size_t offset = in.idx;
+            in.symbol();
+            return {KS, offset, 1, true};
+        }
+        if (type < 0)
+        {
+            const size_t width = qbind::internal::k_width(type);
+            if (width == 0)
+                throw std::runtime_error("Can't decode upd atoms of type " + std::to_string(type));
+            const size_t offset = in.idx;
+            in.skip(width);
+            return {static_cast<signed char>(-type), offset, 1, true};
+        }
+        if (type == KS)
+        {
+            // each symbol is at least its null
+            const size_t n = in.count();
+            const size_t offset = in.idx;
+            for (size_t i = 0; i < n; ++i)
+                in.symbol();
+            return {KS, offset, n, false};
+        }
+        if (type == 0)
+        {
+            // strings, each at least a type, attribute and count
+            const size_t n = in.count(6);
+            const size_t offset = in.idx;
+            for (size_t i = 0; i < n; ++i)
+            {
+                if (in.byte() != KC)
+                    throw std::runtime_error("Can't decode upd general lists other than strings");
+                in.skip(in.count());
+            }
+            return {0, offset, n, false};
+        }
+        const size_t width = qbind::internal::k_width(type);
+        if (width == 0)
+            throw std::runtime_error("Can't decode upd columns of type " + std::to_string(type));
+        const size_t n = in.count(width);
+        const size_t offset = in.idx;
+        in.skip(n * width);
+        return {type, offset, n, false};
+    }
+
+    void decode(TableBuffer& table, Reader& in)
+    {
+        std::vector<std::string> names;
+        const auto type = static_cast<signed char>(in.byte());
+        if (type == XT)
+        {
+            // attribute, then the dictionary of column names to columns
+            in.byte();
+            if (static_cast<signed char>(in.byte()) != XD || static_cast<signed char>(in.byte()) != KS)
+                throw std::runtime_error("Malformed table in upd message");
+            const size_t n = in.count();
+            for (size_t i = 0; i < n; ++i)
+                names.emplace_back(in.symbol());
+            if (in.byte() != 0)
+                throw std::runtime_error("Malformed table in upd message");
+        }
+        else if (type != 0)
+            throw std::runtime_error("Can't decode upd data of type " + std::to_string(type));
+
+        const size_t n = in.count();
+        if (type == XT && n != names.size())
+            throw std::runtime_error("Malformed table in upd message");
+        std::vector<Item> items;
+        items.reserve(n);
+        for (size_t i = 0; i < n; ++i)
+            items.push_back(scan(in));
+
+        // A row has atoms, and char vectors for its strings. Without atoms
+        // char vectors are columns, unless the table has string columns.
+        bool row = !items.empty() && std::all_of(items.begin(), items.end(), [](const Item& item) { return item.row || item.type == KC; });
+        if (row && std::none_of(items.begin(), items.end(), [](const Item& item) { return item.row; }))
+        {
+            row = table.m_columns.size() == items.size();
+            for (size_t i = 0; row && i < items.size(); ++i)
+                row = table.m_columns[i].type() == 0;
+        }
+        for (auto& item : items)
+        {
+            // char vectors of a row are its strings, char atoms stay chars
+            if (row && !item.row && item.type == KC)
+                item = {0, item.offset, item.count, true};
+            if (item.rows() != items.front().rows())
+                throw std::runtime_error("Columns of an upd message for " + table.name() + " differ in length");
+        }
+
+        prepare(table, items, names);
+        const bool swap = in.buf.endianness() != std::endian::native;
+        for (size_t i = 0; i < items.size(); ++i)
+            append(table.m_columns[i], items[i], in.buf, swap);
+    }
+
+    // Create the table's columns on its first message, check them after.
+    void prepare(TableBuffer& table, const std::vector<Item>& items, const std::vector<std::string>& names)
+    {
+        if (table.m_columns.empty())
+        {
+            const auto it = m_names.find(table.name());
+            for (size_t i = 0; i < items.size(); ++i)
+            {
+                std::string name = !names.empty() ? names[i] :
+                                   it != m_names.end() && i < it->second.size() ? it->second[i] :
+                                   i == 0 ? "x" : "x" + std::to_string(i);
+                table.m_columns.emplace_back(std::move(name), items[i].type, m_options.chunk_rows);
+            }
+            return;
+        }
+        if (items.size() != table.m_columns.size())
+            throw std::runtime_error("upd message for " + table.name() + " has " + std::to_string(items.size()) + " columns, expected " + std::to_string(table.m_columns.size()));
+        for (size_t i = 0; i < items.size(); ++i)
+        {
+            if (items[i].type != table.m_columns[i].type())
+                throw std::runtime_error("Column " + table.m_columns[i].name() + " of " + table.name() + " changed type from " + std::to_string(table.m_columns[i].type()) + " to " + std::to_string(items[i].type));
+        }
+    }
+
+    void append(ColumnBuffer& column, const Item& item, const Buffer& buf, bool swap)
+    {
+        Reader in{buf, item.offset};
+        if (item.type == KS)
+        {
+            for (size_t i = 0; i < item.count; ++i)
+                column.append_symbol(intern(in.symbol()));
+        }
+        else if (item.type == 0 && item.row)
+            column.append_string(reinterpret_cast<const char *>(buf.get() + item.offset), item.count);
+        else if (item.type == 0)
+        {
+            for (size_t i = 0; i < item.count; ++i)
+            {
+                in.byte();
+                const size_t n = in.count();
+                column.append_string(reinterpret_cast<const char *>(in.skip(n)), n);
+            }
+        }
+        else
+            column.append(buf.get() + item.offset, item.count, swap);
+    }
+
+    void consume(TableBuffer& table)
+    {
+        m_consumer(table);
+        for (auto& column : table.m_columns)
+            column.clear();
+        table.m_last_batch = std::chrono::steady_clock::now();
+    }
+
+    Consumer m_consumer;
+    SubscriberOptions m_options;
+    std::unordered_map<std::string, TableBuffer, Hash, std::equal_to<>> m_tables;
+    std::unordered_map<std::string, std::vector<std::string>> m_names;
+    std::unordered_set<std::string, Hash, std::equal_to<>> m_symbols;
+    uint64_t m_messages = 0;
+};